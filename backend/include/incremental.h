@@ -0,0 +1,16 @@
+#pragma once
+
+#include "BinTree_struct.h"
+#include "compile_cache.h"
+
+/*
+ * Prints the code of the tree as BuildIrModule and PrintIrToAsm do,
+ * but copies the code of a function from the cache if neither its
+ * subtree nor what its callees assign changed since it was printed.
+ * Returns false if code can't be generated.
+ */
+bool
+PrintTreeToAsmIncremental (const BinTree*      const tree,
+                           const cache_config* const cache_config,
+                                 FILE*         const stream,
+                           const size_t              n_jobs);
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "ir.h"
+
+/*
+ * Instruction selection by tree pattern matching. The values of a
+ * block form trees, as each is taken once by the instruction after
+ * its operands, and every statement is the root of one. Rules tile
+ * the trees with patterns, a labeller finds the cheapest tiling
+ * bottom up and the code of each tile is printed at its root.
+ */
+
+/* what a pattern leaf stands for */
+enum asm_nonterm
+{
+    NT_NONE  = 0,
+    NT_VALUE = 1,   // a subtree that leaves its value on the stack
+    NT_STMT  = 2,   // a root, leaves nothing
+};
+
+/* blocks are numbered in their function, its code doesn't depend on others */
+#define BLOCK_NAME ":func%zu_block%zu"
+#define FUNC_NAME  ":func%zu"
+
+const int8_t ANY_OP_CODE = -1;
+const int8_t ALL_VALUES  = -1;  // every value operand is a NT_VALUE leaf
+
+const size_t MAX_PATTERN_LEN = 4;
+
+const size_t NO_COST = SIZE_MAX;
+
+/*
+ * A node of a pattern in prefix order. An inner node matches the
+ * opcode, the op_code unless it is ANY_OP_CODE, and n_kids value
+ * operands with the nodes that follow; a leaf matches a subtree.
+ */
+struct asm_pattern_node
+{
+    uint8_t     opcode;
+    int8_t      op_code;
+    int8_t      n_kids;
+    asm_nonterm leaf;
+};
+
+/*
+ * The code is a line per instruction, with $n the number, $s the slot,
+ * $f the callee label, $o the operation of the root, $t and $e the
+ * labels of its then and else blocks, $x the end of the function.
+ * A line that starts with '?' is a jump left out when it goes to the
+ * next block. The cost is the number of instructions.
+ */
+struct asm_rule
+{
+    asm_nonterm      result;
+    asm_pattern_node pattern [MAX_PATTERN_LEN];
+    size_t           cost;
+    const char*      code;
+};
+
+/* by instruction - first_instr of the function */
+struct asm_selection
+{
+    ir_id             first_instr;
+    ir_id             n_instrs;
+
+    const asm_rule**  rules;
+    size_t*           costs;
+    bool*             is_covered;   // inside a tile, has no code of its own
+};
+
+/*
+ * All that generating the code of a function touches, so that
+ * functions can be generated on different threads at once.
+ */
+struct asm_context
+{
+    const ir_module*   module;
+    const ir_function* func;
+          FILE*        stream;
+
+    asm_selection      selection;
+};
+
+bool
+AsmSelectionCtor    (      asm_selection* const selection,
+                     const ir_function*   const func);
+
+void
+AsmSelectionDtor    (      asm_selection* const selection);
+
+/* returns false if an instruction matches no rule */
+bool
+SelectInstructions  (const ir_module*     const module,
+                     const ir_function*   const func,
+                           asm_selection* const selection);
+
+/* prints the code of the tile rooted at the instruction, if it is one */
+void
+EmitInstr           (const asm_context* const context,
+                     const ir_id              instr,
+                     const ir_id              next_block);
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <stdint.h>
+#include "BinTree_struct.h"
+
+/*
+ * Control-flow graph of basic blocks in SSA form, the tree lowered
+ * for code generation.
+ *
+ * Instructions, blocks and operand lists are allocated from growing
+ * arrays of the module and freed with it at once, ids are indices in
+ * these arrays. An instruction is the value it defines, so value ids
+ * are dense and every value is defined once.
+ *
+ * Variable slots stay in memory, as the processor keeps them there,
+ * and the definitions of a slot are its versions: a store, a formal
+ * popped at the entry, a restore after a call, a phi at a join, the
+ * call itself for the slots the callee assigns, and the entry of the
+ * function for all slots. Loads and saves name the version they read.
+ * All versions of a slot live in the slot, so phis cost no code.
+ *
+ * Temporaries are passed on the stack: an instruction takes its
+ * operands from the top of it, the last operand on top, and pushes
+ * its value if it has one.
+ */
+
+typedef uint32_t ir_id;
+
+const ir_id  IR_NONE          = UINT32_MAX;
+
+const size_t IR_INIT_CAPACITY = 64;
+
+/* structured code has no more edges per block */
+const size_t IR_MAX_PREDS     = 2;
+const size_t IR_MAX_SUCCS     = 2;
+
+enum ir_opcode
+{
+    IR_ENTRY   = 0,     // version of every slot at the entry
+    IR_PARAM   = 1,     // pops an arg the caller pushed into the slot
+    IR_CONST   = 2,
+    IR_LOAD    = 3,     // (version)
+    IR_STORE   = 4,     // (value)
+    IR_UNARY   = 5,     // (value)
+    IR_BINARY  = 6,     // (left, right)
+    IR_INPUT   = 7,
+    IR_OUTPUT  = 8,     // (value)
+    IR_SAVE    = 9,     // (version), keeps the slot on the stack
+    IR_CALL    = 10,    // (args...)
+    IR_RESTORE = 11,    // (save)
+    IR_RESULT  = 12,    // (call), pushes what the call returned
+    IR_PHI     = 13,    // (version per pred)
+
+    IR_JUMP    = 14,
+    IR_BRANCH  = 15,    // (condition), to succs [0] unless it is 0
+    IR_RETURN  = 16,    // (value)
+    IR_EXIT    = 17,    // end of the function body
+};
+
+struct ir_instr
+{
+    uint8_t  opcode;            // ir_opcode
+    int8_t   op_code;           // of unary, binary and output
+    uint16_t n_operands;
+
+    ir_id    block;
+    ir_id    next;              // in the block
+    ir_id    operands;          // first of them in module operands
+
+    union
+    {
+        double   number;
+        uint32_t slot;
+        uint32_t func;          // func_index of the callee
+    };
+};
+
+struct ir_block
+{
+    ir_id   first;
+    ir_id   last;
+
+    ir_id   preds [IR_MAX_PREDS];   // phi operands go in this order
+    ir_id   succs [IR_MAX_SUCCS];
+    uint8_t n_preds;
+    uint8_t n_succs;
+};
+
+/* blocks and instructions of a function are consecutive */
+struct ir_function
+{
+    var_index_type func_index;
+
+    ir_id first_block;          // the entry
+    ir_id n_blocks;
+
+    ir_id first_instr;
+    ir_id n_instrs;
+};
+
+/* main goes first, then the functions in the order of the tree */
+struct ir_module
+{
+    ir_instr*    instrs;
+    ir_id        n_instrs;
+    size_t       instrs_capacity;
+
+    ir_id*       operands;
+    ir_id        n_operands;
+    size_t       operands_capacity;
+
+    ir_block*    blocks;
+    ir_id        n_blocks;
+    size_t       blocks_capacity;
+
+    ir_function* funcs;
+    ir_id        n_funcs;
+    size_t       funcs_capacity;
+
+    uint32_t     n_slots;
+};
+
+bool
+IrModuleCtor    (ir_module* const module);
+
+void
+IrModuleDtor    (ir_module* const module);
+
+/*
+ * Lowers the tree into an empty module. Returns false if the tree
+ * has a node code can't be generated for or memory runs out.
+ * Functions are left out where is_skipped, by their place in the
+ * chain, is true: a call is lowered without its callee.
+ */
+bool
+BuildIrModule   (      ir_module* const module,
+                 const BinTree*   const tree,
+                 const bool*      const is_skipped = nullptr);
+
+/* prints what is wrong to the stream, returns false if anything is */
+bool
+VerifyIrModule  (const ir_module* const module,
+                       FILE*      const stream);
+
+void
+DumpIrModule    (const ir_module* const module,
+                       FILE*      const stream);
+
+/*
+ * Appends an instruction with n_operands operands set to IR_NONE
+ * to the block. Returns IR_NONE if memory runs out.
+ */
+ir_id
+IrAddInstr      (      ir_module* const module,
+                 const ir_opcode        opcode,
+                 const ir_id            block,
+                 const size_t           n_operands);
+
+/* the same, but puts the instruction first in the block */
+ir_id
+IrAddPhi        (      ir_module* const module,
+                 const ir_id            block,
+                 const size_t           n_operands);
+
+ir_id
+IrAddBlock      (ir_module* const module);
+
+/* the function takes the blocks and instructions added after it */
+ir_id
+IrAddFunction   (      ir_module*     const module,
+                 const var_index_type       func_index);
+
+void
+IrAddEdge       (      ir_module* const module,
+                 const ir_id            from,
+                 const ir_id            to);
+
+bool
+IrIsTerminator  (const uint8_t opcode);
+
+/* pushes a value on the stack, that other instructions take */
+bool
+IrHasValue      (const uint8_t opcode);
+
+/* defines a version of its slot, or of many for entry and call */
+bool
+IrHasVersion    (const uint8_t opcode);
+
+ir_id
+IrGetOperand    (const ir_module* const module,
+                 const ir_id            instr,
+                 const size_t           index);
+
+void
+IrSetOperand    (      ir_module* const module,
+                 const ir_id            instr,
+                 const size_t           index,
+                 const ir_id            value);
@@ -0,0 +1,369 @@
+#pragma once
+
+#include <math.h>
+#include "BinTree_struct.h"
+
+const size_t DEFAULT_INLINE_BUDGET = 40;
+const size_t MAX_INLINE_ROUNDS     = 8;
+
+const size_t MAX_POW_EXPONENT      = 64;
+
+const size_t DEFAULT_MEMO_SIZE     = 16;
+const size_t MAX_MEMO_NODES        = 512;   // of the code a memoized function gets
+
+const size_t DEFAULT_EVAL_BUDGET   = 1 << 22;
+
+const size_t DEFAULT_UNROLL_FACTOR = 4;
+const size_t DEFAULT_UNROLL_LIMIT  = 256;
+
+const size_t DEFAULT_SELECT_BUDGET = 12;
+
+const size_t DEFAULT_CLONE_BUDGET  = 16;
+const size_t MAX_CLONED_NODES      = 400;
+
+const size_t PASS_REPORT_INIT_CAPACITY = 16;
+
+enum pass_stats_format
+{
+    PASS_STATS_NONE  = 0,
+    PASS_STATS_TABLE = 1,
+    PASS_STATS_JSON  = 2,
+};
+
+struct optimize_config
+{
+    bool   fold_constants;
+    bool   inline_functions;
+    bool   hoist_invariants;
+    bool   fast_math;       // rewrites that may change the last bits
+    bool   eliminate_dead_code;
+    bool   eliminate_common_subexprs;
+    bool   memoize_recursive;   // all pure recursive functions
+    bool   report_purity;
+    bool   partial_eval;    // runs what doesn't depend on input
+    bool   specialize_functions;
+    bool   unroll_loops;
+    bool   convert_ifs;     // assumes the values picked are finite
+
+    size_t inline_budget;   // max number of nodes in an inlined body
+    size_t memo_size;       // max buckets per memoized function
+    size_t eval_budget;     // max nodes run by the partial evaluator
+    size_t clone_budget;    // max number of specialized clones
+    size_t unroll_factor;   // bodies per check in an unrolled loop
+    size_t unroll_limit;    // max nodes in the unrolled bodies
+    size_t select_budget;   // max nodes in both values of a select
+
+    const char* memoize_list;   // "1,4,5" memoizes these functions only
+    const char* pass_list;      // "fold,inline" runs these in this order
+
+    pass_stats_format stats_format;
+    bool              verify_passes;   // lowers and checks the IR after each
+};
+
+enum purity_verdict
+{
+    PURE             = 0,
+    IMPURE_ENTRY     = 1,   // main or an index with no function
+    IMPURE_IO        = 2,
+    IMPURE_CALLEE    = 3,
+    IMPURE_READ      = 4,   // reads a slot it wasn't given
+    IMPURE_WRITE     = 5,   // writes a slot read after it returns
+    IMPURE_NO_RETURN = 6,
+};
+
+/*
+ * State shared by the passes. Variable slots are global in the
+ * generated code, so fresh slots are taken past the largest index
+ * met in the tree.
+ */
+struct optimize_context
+{
+          BinTree*         tree;
+    const optimize_config* config;
+
+    var_index_type n_vars;
+    var_index_type n_funcs;
+
+    bool is_failed;     // a pass that has to finish couldn't, the tree is not to be emitted
+};
+
+/* what one pass did, n_instrs is 0 unless the tree was lowered after it */
+struct pass_stat
+{
+    const char* name;
+    double      seconds;
+    size_t      nodes_before;
+    size_t      nodes_after;
+    size_t      n_instrs;
+    bool        is_changed;
+};
+
+struct pass_report
+{
+    pass_stat* stats;
+    size_t     n_stats;
+    size_t     capacity;
+};
+
+/* DRIVER BEGIN */
+
+void
+InitOptimizeConfig  (optimize_config* const config);
+
+bool
+ParseOptimizeOption (const char*      const option,
+                     optimize_config* const config);
+
+/* -O0, -O1, -O2, --passes=, --pass-stats[=json] and --verify-passes */
+bool
+ParsePassOption     (const char*      const option,
+                     optimize_config* const config);
+
+/*
+ * Returns false if the tree can't be compiled, e.g. a Narsil can't
+ * be expanded or a pass broke it. Fills the report if it is given.
+ */
+bool
+OptimizeTree        (      BinTree*         const tree,
+                     const optimize_config* const config,
+                           pass_report*     const report);
+
+/*
+ * Runs the passes of -O levels and -f options in their fixed order,
+ * or the ones of --passes= in the order given.
+ */
+bool
+RunPassPipeline     (optimize_context* const context,
+                     pass_report*      const report);
+
+bool
+PassReportCtor      (pass_report* const report);
+
+void
+PassReportDtor      (pass_report* const report);
+
+bool
+PassReportAdd       (      pass_report* const report,
+                     const pass_stat*   const stat);
+
+void
+PrintPassReport     (      FILE*              const stream,
+                     const pass_report*       const report,
+                     const pass_stats_format        format);
+
+/* monotonic, in seconds */
+double
+GetWallTime         ();
+
+/* DRIVER END */
+
+
+
+/* PASSES BEGIN */
+
+/*
+ * Replaces every Narsil with the derivative it stands for. Runs
+ * always, the processor has no instruction for it. Returns whether
+ * there was a Narsil, sets is_failed if one can't be expanded.
+ */
+bool
+ExpandDerivatives (optimize_context* const context);
+
+bool
+FoldConstants   (optimize_context* const context);
+
+/*
+ * Computes an operation the way the processor does. Returns false
+ * if it can't be done at compile time or the result is not finite.
+ */
+bool
+EvaluateOperation (const op_code_type       op_code,
+                   const double             left,
+                   const double             right,
+                         double*      const result);
+
+/*
+ * Runs main up to the first input and replaces what was run with its
+ * outputs, replaces calls of pure functions with literal args by their
+ * values. Everything is run the way the processor would.
+ */
+bool
+PartialEvaluate (optimize_context* const context);
+
+/*
+ * Clones a function for every set of literal args it is called with,
+ * up to clone_budget clones, and points the calls at the clones.
+ */
+bool
+SpecializeFunctions (optimize_context* const context);
+
+bool
+InlineFunctions (optimize_context* const context);
+
+/*
+ * Replaces ifs that assign one variable in both branches, or in the
+ * only one, by an arithmetic select of the two values.
+ */
+bool
+ConvertIfsToSelects (optimize_context* const context);
+
+bool
+HoistLoopInvariants (optimize_context* const context);
+
+bool
+UnrollLoops     (optimize_context* const context);
+
+bool
+ReduceStrength  (optimize_context* const context);
+
+bool
+EliminateDeadCode (optimize_context* const context);
+
+bool
+EliminateCommonSubexpressions (optimize_context* const context);
+
+/*
+ * Classifies the functions, prints the purity report if asked
+ * and memoizes the requested pure ones.
+ */
+bool
+MemoizePureFunctions (optimize_context* const context);
+
+/* PASSES END */
+
+
+
+/* ANALYSES BEGIN */
+
+/*
+ * Sets verdicts [func] and is_recursive [func] for every function
+ * index below context -> n_funcs. Returns false if out of memory.
+ */
+bool
+ClassifyFunctions   (optimize_context* const context,
+                     purity_verdict*   const verdicts,
+                     bool*             const is_recursive);
+
+void
+PrintPurityReport   (      FILE*           const stream,
+                     const purity_verdict* const verdicts,
+                     const var_index_type        n_funcs);
+
+/* ANALYSES END */
+
+
+
+/* TREE HELPERS BEGIN */
+
+BinTree_node*
+GetFunctionByIndex  (      BinTree_node* const root,
+                     const var_index_type      func_index);
+
+/* sets n_vars and n_funcs of the context past the indices in its tree */
+void
+CountContextIndices (optimize_context* const context);
+
+/*
+ * Returns the address of the pointer to the first statement
+ * of the function, so that statements can be spliced in front.
+ */
+BinTree_node**
+GetFunctionBodyLink (BinTree_node* const func);
+
+BinTree_node*
+GetFunctionFormals  (BinTree_node* const func);
+
+size_t
+CountNodes          (const BinTree_node* const node);
+
+size_t
+CountListElems      (const BinTree_node* const list);
+
+bool
+ContainsCall        (const BinTree_node* const node);
+
+/* true if every path through the chain ends in a return */
+bool
+ChainReturns        (const BinTree_node* const chain);
+
+bool
+IsStatementOperation (const BinTree_node* const node,
+                      const op_code_type        un_op_code);
+
+/*
+ * True for operations that compute a value from their operands
+ * only: arithmetics, comparisons and SIN, COS, SQRT, LN, !.
+ */
+bool
+IsValueOperation    (const BinTree_node* const node);
+
+/*
+ * Asm and tree files keep numbers as FormatDouble text, which
+ * round-trips all but NaN payloads; a computed literal must
+ * survive it or the program changes.
+ */
+bool
+IsPrintedExactly    (const double value);
+
+bool
+IsNumberNode        (const BinTree_node* const node,
+                     const double              value);
+
+bool
+SubtreesEqual       (const BinTree_node* const left,
+                     const BinTree_node* const right);
+
+/*
+ * Sets assigned [var_index] for every variable the subtree may write,
+ * including formals and assignments of all functions it may call.
+ * assigned must have context -> n_vars elements.
+ */
+void
+MarkAssignedVariables (const BinTree_node*     const node,
+                             bool*             const assigned,
+                             optimize_context* const context);
+
+/*
+ * Sets assigned [var_index] for every variable a call of the function
+ * may write: its formals and what its body and its callees assign.
+ */
+void
+MarkCallClobbers    (const var_index_type       func_index,
+                           bool*             const assigned,
+                           optimize_context* const context);
+
+/*
+ * Sets is_mentioned [var_index] for every variable met in the subtree
+ * with var_index < n_vars.
+ */
+void
+MarkMentionedVariables (const BinTree_node*    const node,
+                              bool*            const is_mentioned,
+                        const var_index_type         n_vars);
+
+var_index_type
+AllocateVariable    (optimize_context* const context);
+
+BinTree_node*
+MakeAssume          (const var_index_type      var_index,
+                           BinTree_node* const expression,
+                           BinTree*      const tree);
+
+/*
+ * Hangs the statement on *tail_link as a new chain element,
+ * returns the link to append the next one to.
+ */
+BinTree_node**
+AppendStatement     (BinTree_node** const tail_link,
+                     BinTree_node*  const statement,
+                     BinTree*       const tree);
+
+BinTree_node*
+MakeNumber          (const double        value,
+                           BinTree* const tree);
+
+BinTree_node*
+MakeVariable        (const var_index_type      var_index,
+                           BinTree*      const tree);
+
+/* TREE HELPERS END */
@@ -1,14 +1,33 @@
 #pragma once
 
 #include "BinTree_struct.h"
+#include "ir.h"
 
-const size_t FIRST_FUNC_NUMBER = 1;
+/* lowers the tree and prints the code for it to the stream, on one thread */
+bool
+PrintTreeToAsm  (const BinTree* const tree,
+                       FILE*    const stream);
 
-enum op_status
-{
-    NOT_IN_OPERATION = 0,
-    IN_OPERATION     = 1
-};
+/*
+ * Generates functions on up to n_jobs threads, the output is the
+ * same for any n_jobs. Returns false if code can't be generated.
+ */
+bool
+PrintIrToAsm    (const ir_module* const module,
+                       FILE*      const stream,
+                 const size_t           n_jobs);
 
-void
-PrintTreeToAsm (const BinTree* const tree);
+/*
+ * Prints every function of the module, in the order of the module,
+ * to a buffer of its own. The buffers are to be freed even if it
+ * returns false.
+ */
+bool
+PrintIrFunctions (const ir_module* const module,
+                        char**     const texts,
+                        size_t*    const text_sizes,
+                  const size_t           n_jobs);
+
+/* the mnemonic of an operation in the processor's assembly */
+const char*
+GetAsmOperation (const op_code_type op_code);
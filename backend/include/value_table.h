@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+#include "BinTree_struct.h"
+
+/*
+ * Hash-consing table: every distinct (type, operation, left id,
+ * right id) key gets a dense id, equal keys get equal ids. Leaves
+ * use NO_VALUE_ID children and keep their payload in op.
+ *
+ * Clearing takes O(1): slots of older generations count as empty.
+ */
+
+typedef size_t value_id_type;
+
+const value_id_type NO_VALUE_ID = SIZE_MAX;
+
+const size_t VALUE_TABLE_INIT_CAPACITY = 64;
+
+struct value_key
+{
+    data_type     type;
+    uint64_t      op;       // op code or the bits of a number
+    value_id_type left;
+    value_id_type right;
+};
+
+struct value_table
+{
+    value_key*     keys;
+    value_id_type* ids;
+    size_t*        generations;
+
+    size_t         capacity;    // power of two
+    size_t         n_keys;
+    size_t         generation;
+
+    value_id_type  n_ids;
+};
+
+bool
+ValueTableCtor  (value_table* const table);
+
+void
+ValueTableDtor  (value_table* const table);
+
+/* forgets all keys, ids start from zero again */
+void
+ValueTableClear (value_table* const table);
+
+/*
+ * Returns the id of the key, a new one if the key is met first.
+ * Returns NO_VALUE_ID if the table can't grow.
+ */
+value_id_type
+GetValueId      (      value_table* const table,
+                 const value_key*   const key);
+
+/* an id equal to no key, e.g. for a variable after an assignment */
+value_id_type
+NewValueId      (value_table* const table);
+
+value_key
+MakeNumberKey   (const double value);
+
+value_key
+MakeOperationKey (const data_type           type,
+                  const op_code_type        op_code,
+                  const value_id_type       left,
+                  const value_id_type       right);
@@ -0,0 +1,492 @@
+#include "optimize.h"
+#include "value_table.h"
+
+/*
+ * Value numbering inside basic blocks. A block is a run of statements
+ * without calls, it may end with an if whose condition is a part of
+ * it. Every value operation gets the id of (op code, left id, right
+ * id), a variable gets a fresh id on each assignment, so equal ids
+ * mean equal values.
+ *
+ * An id met at least twice is computed once into a fresh slot in
+ * front of the statement with its first occurrence. Inner ids that
+ * only repeat as parts of a repeated expression are left inside it.
+ */
+
+const size_t MAX_BLOCK_LEN = 256;
+
+struct value_use
+{
+    BinTree_node** link;
+    value_id_type  id;
+    value_id_type  parent_id;
+    size_t         statement;
+};
+
+struct value_info
+{
+    size_t         n_uses;
+    size_t         max_parent_uses;
+    var_index_type temp_index;
+};
+
+struct block_state
+{
+    value_table     table;
+
+    value_id_type*  var_ids;            // current id of each variable
+    size_t*         var_generations;
+    var_index_type  n_vars;
+
+    value_use*      uses;
+    size_t          n_uses;
+    size_t          uses_capacity;
+
+    BinTree_node**  statement_links [MAX_BLOCK_LEN];
+    size_t          n_statements;
+
+    optimize_context* context;
+};
+
+static bool
+NumberChain         (BinTree_node**    const chain_link,
+                     block_state*      const state);
+
+static BinTree_node**
+NumberBlock         (BinTree_node**    const block_link,
+                     block_state*      const state);
+
+static void
+NumberStatement     (BinTree_node**    const statement_ptr,
+                     block_state*      const state);
+
+static value_id_type
+NumberExpression    (BinTree_node**    const node_ptr,
+                     size_t*           const use_index,
+                     block_state*      const state);
+
+static value_id_type
+GetVariableId       (const var_index_type    var_index,
+                           block_state*      const state);
+
+static void
+AssignVariable      (const var_index_type    var_index,
+                           block_state*      const state);
+
+static size_t
+AddUse              (BinTree_node**    const link,
+                     const value_id_type     id,
+                     block_state*      const state);
+
+static bool
+ReplaceCommon       (block_state*      const state);
+
+static inline bool
+IsCommutative       (const op_code_type op_code);
+
+bool
+EliminateCommonSubexpressions (optimize_context* const context)
+{
+    assert (context);
+
+    block_state state = {};
+
+    state .context = context;
+    state .n_vars  = context -> n_vars;
+
+    state .var_ids         = (value_id_type*) calloc (state .n_vars + 1,
+                                                      sizeof (value_id_type));
+    state .var_generations = (size_t*)        calloc (state .n_vars + 1,
+                                                      sizeof (size_t));
+
+    if (!state .var_ids || !state .var_generations ||
+        !ValueTableCtor (&state .table))
+    {
+        perror ("value numbering allocation error");
+
+        free (state .var_ids);
+        free (state .var_generations);
+
+        return false;
+    }
+
+    bool is_eliminated = false;
+
+    for (BinTree_node* func = context -> tree -> root;
+                       func; func = func -> right)
+    {
+        is_eliminated |= NumberChain (GetFunctionBodyLink (func), &state);
+    }
+
+    ValueTableDtor (&state .table);
+
+    free (state .var_ids);
+    free (state .var_generations);
+    free (state .uses);
+
+    return is_eliminated;
+}
+
+static bool
+NumberChain (BinTree_node**    const chain_link,
+             block_state*      const state)
+{
+    assert (chain_link);
+    assert (state);
+
+    bool is_eliminated = false;
+
+    BinTree_node** link = chain_link;
+
+    while (*link)
+    {
+        ValueTableClear (&state -> table);
+
+        state -> n_uses       = 0;
+        state -> n_statements = 0;
+
+        link = NumberBlock (link, state);
+
+        BinTree_node* const end_node = *link;
+
+        is_eliminated |= ReplaceCommon (state);
+
+        /* temps spliced in front of an ending if take its link */
+        while (*link != end_node) link = &(*link) -> right;
+
+        if (!end_node) break;
+
+        BinTree_node* const statement = end_node -> left;
+
+        if (statement && statement -> data .data_type == KEY_OP)
+        {
+            is_eliminated |= NumberChain (&statement -> right -> left,  state);
+            is_eliminated |= NumberChain (&statement -> right -> right, state);
+        }
+
+        /* a block cut by MAX_BLOCK_LEN goes on from its last statement */
+        else if (!ContainsCall (statement))
+        {
+            continue;
+        }
+
+        link = &end_node -> right;
+    }
+
+    return is_eliminated;
+}
+
+/*
+ * Numbers the statements of one block, returns the link to the
+ * statement that ends it: an if, a while or a statement with calls.
+ * The condition of an ending if is numbered with the block.
+ */
+static BinTree_node**
+NumberBlock (BinTree_node**    const block_link,
+             block_state*      const state)
+{
+    assert (block_link);
+    assert (state);
+
+    BinTree_node** link = block_link;
+
+    for (; *link && state -> n_statements < MAX_BLOCK_LEN;
+           link = &(*link) -> right)
+    {
+        BinTree_node* const statement = (*link) -> left;
+
+        if (!statement) continue;
+
+        if (statement -> data .data_type == KEY_OP)
+        {
+            if (statement -> data .key_op_code == IF &&
+                !ContainsCall (statement -> left))
+            {
+                state -> statement_links [state -> n_statements++] = link;
+
+                NumberExpression (&statement -> left, nullptr, state);
+            }
+
+            break;
+        }
+
+        if (ContainsCall (statement)) break;
+
+        state -> statement_links [state -> n_statements++] = link;
+
+        NumberStatement (&(*link) -> left, state);
+    }
+
+    return link;
+}
+
+static void
+NumberStatement (BinTree_node**    const statement_ptr,
+                 block_state*      const state)
+{
+    assert (statement_ptr);
+    assert (state);
+
+    BinTree_node* const statement = *statement_ptr;
+
+    if (statement -> data .data_type == BIN_OP &&
+        statement -> data .bin_op_code == ASSUME_BEGIN)
+    {
+        NumberExpression (&statement -> right, nullptr, state);
+        AssignVariable   (statement -> left -> data .var_index, state);
+
+        return;
+    }
+
+    if (IsStatementOperation (statement, IN))
+    {
+        AssignVariable (statement -> right -> data .var_index, state);
+        return;
+    }
+
+    if (statement -> data .data_type == UN_OP &&
+        !IsValueOperation (statement))
+    {
+        NumberExpression (&statement -> right, nullptr, state);
+        return;
+    }
+
+    NumberExpression (statement_ptr, nullptr, state);
+}
+
+/*
+ * Returns the id of the subtree. Value operations are recorded as
+ * uses, *use_index gets the index of the use of the node itself.
+ */
+static value_id_type
+NumberExpression (BinTree_node**    const node_ptr,
+                  size_t*           const use_index,
+                  block_state*      const state)
+{
+    assert (node_ptr);
+    assert (state);
+
+    BinTree_node* const node = *node_ptr;
+
+    if (use_index) *use_index = SIZE_MAX;
+
+    if (!node) return NO_VALUE_ID;
+
+    if (node -> data .data_type == NUMBER)
+    {
+        const value_key key = MakeNumberKey (node -> data .num_value);
+        return GetValueId (&state -> table, &key);
+    }
+
+    if (node -> data .data_type == VARIABLE)
+        return GetVariableId (node -> data .var_index, state);
+
+    /* anything else is opaque and equal to nothing */
+    if (!IsValueOperation (node))
+        return NewValueId (&state -> table);
+
+    size_t left_use  = SIZE_MAX;
+    size_t right_use = SIZE_MAX;
+
+    value_id_type left_id  = NumberExpression (&node -> left,  &left_use,
+                                               state);
+    value_id_type right_id = NumberExpression (&node -> right, &right_use,
+                                               state);
+
+    const op_code_type op_code = node -> data .punct_op_code;
+
+    if (IsCommutative (op_code) && left_id > right_id)
+    {
+        const value_id_type swap_id = left_id;
+
+        left_id  = right_id;
+        right_id = swap_id;
+    }
+
+    const value_key key = MakeOperationKey (node -> data .data_type, op_code,
+                                            left_id, right_id);
+    const value_id_type id = GetValueId (&state -> table, &key);
+
+    if (id == NO_VALUE_ID) return NewValueId (&state -> table);
+
+    if (left_use  != SIZE_MAX) state -> uses [left_use]  .parent_id = id;
+    if (right_use != SIZE_MAX) state -> uses [right_use] .parent_id = id;
+
+    const size_t new_use = AddUse (node_ptr, id, state);
+
+    if (use_index) *use_index = new_use;
+
+    return id;
+}
+
+static value_id_type
+GetVariableId (const var_index_type    var_index,
+                     block_state*      const state)
+{
+    assert (state);
+
+    /* slots allocated by this pass are never read twice */
+    if (var_index >= state -> n_vars)
+        return NewValueId (&state -> table);
+
+    if (state -> var_generations [var_index] != state -> table .generation)
+        AssignVariable (var_index, state);
+
+    return state -> var_ids [var_index];
+}
+
+static void
+AssignVariable (const var_index_type    var_index,
+                      block_state*      const state)
+{
+    assert (state);
+
+    if (var_index >= state -> n_vars) return;
+
+    state -> var_ids         [var_index] = NewValueId (&state -> table);
+    state -> var_generations [var_index] = state -> table .generation;
+}
+
+static size_t
+AddUse (BinTree_node**    const link,
+        const value_id_type     id,
+        block_state*      const state)
+{
+    assert (link);
+    assert (state);
+
+    if (state -> n_uses == state -> uses_capacity)
+    {
+        const size_t new_capacity = state -> uses_capacity ?
+                                    2 * state -> uses_capacity :
+                                    VALUE_TABLE_INIT_CAPACITY;
+
+        value_use* const new_uses = (value_use*)
+            realloc (state -> uses, new_capacity * sizeof (value_use));
+        if (!new_uses)
+        {
+            perror ("uses reallocation error");
+            return SIZE_MAX;
+        }
+
+        state -> uses          = new_uses;
+        state -> uses_capacity = new_capacity;
+    }
+
+    state -> uses [state -> n_uses] = {.link      = link,
+                                       .id        = id,
+                                       .parent_id = NO_VALUE_ID,
+                                       .statement = state -> n_statements - 1};
+
+    return state -> n_uses++;
+}
+
+/*
+ * Uses go in post-order, so inner expressions are replaced before
+ * the ones containing them and a moved subtree is already final.
+ */
+static bool
+ReplaceCommon (block_state* const state)
+{
+    assert (state);
+
+    if (state -> n_uses < 2) return false;
+
+    BinTree* const tree = state -> context -> tree;
+
+    const value_id_type n_ids = state -> table .n_ids;
+
+    value_info* const values = (value_info*) calloc (n_ids + 1,
+                                                     sizeof (value_info));
+    BinTree_node** const spliced = (BinTree_node**)
+        calloc (state -> n_statements + 1, sizeof (BinTree_node*));
+    BinTree_node*** const spliced_tails = (BinTree_node***)
+        calloc (state -> n_statements + 1, sizeof (BinTree_node**));
+
+    if (!values || !spliced || !spliced_tails)
+    {
+        perror ("value info allocation error");
+        free (values);
+        free (spliced);
+        free (spliced_tails);
+
+        return false;
+    }
+
+    for (size_t i = 0; i < state -> n_uses; i++)
+    {
+        values [state -> uses [i] .id] .n_uses++;
+        values [state -> uses [i] .id] .temp_index = VAR_INDEX_POISON;
+    }
+
+    for (size_t i = 0; i < state -> n_uses; i++)
+    {
+        const value_use* const use = &state -> uses [i];
+        if (use -> parent_id == NO_VALUE_ID) continue;
+
+        value_info* const value = &values [use -> id];
+        const size_t parent_uses = values [use -> parent_id] .n_uses;
+
+        if (parent_uses > value -> max_parent_uses)
+            value -> max_parent_uses = parent_uses;
+    }
+
+    bool is_replaced = false;
+
+    for (size_t i = 0; i < state -> n_uses; i++)
+    {
+        const value_use* const use   = &state -> uses [i];
+        value_info*      const value = &values [use -> id];
+
+        if (value -> n_uses < 2 || value -> n_uses <= value -> max_parent_uses)
+            continue;
+
+        BinTree_node* const expression = *use -> link;
+
+        if (value -> temp_index == VAR_INDEX_POISON)
+        {
+            value -> temp_index = AllocateVariable (state -> context);
+
+            if (!spliced_tails [use -> statement])
+                spliced_tails [use -> statement] = &spliced [use -> statement];
+
+            spliced_tails [use -> statement] =
+                AppendStatement (spliced_tails [use -> statement],
+                                 MakeAssume (value -> temp_index,
+                                             expression, tree),
+                                 tree);
+        }
+
+        else
+        {
+            BinTree_DestroySubtree (expression, tree);
+        }
+
+        *use -> link = MakeVariable (value -> temp_index, tree);
+        is_replaced = true;
+    }
+
+    /* backwards, so that links of earlier statements stay valid */
+    for (size_t i = state -> n_statements; i > 0; i--)
+    {
+        if (!spliced [i - 1]) continue;
+
+        BinTree_node** const link = state -> statement_links [i - 1];
+
+        *spliced_tails [i - 1] = *link;
+        *link                  = spliced [i - 1];
+    }
+
+    free (values);
+    free (spliced);
+    free (spliced_tails);
+
+    return is_replaced;
+}
+
+static inline bool
+IsCommutative (const op_code_type op_code)
+{
+    return op_code == ADD      || op_code == MUL ||
+           op_code == IS_EQUAL || op_code == NOT_EQUAL;
+}
@@ -0,0 +1,753 @@
+#include "optimize.h"
+
+/*
+ * Three cleanups, repeated while something changes:
+ *   - pruning: ifs and whiles with literal conditions are resolved,
+ *     statements after a return or an endless loop are dropped;
+ *   - functions unreachable from main are dropped;
+ *   - dead stores: assignments without calls whose variable is not
+ *     live afterwards are dropped.
+ *
+ * Liveness is computed backwards over the statement chains. Variables
+ * are global slots, so after a return every variable another function
+ * mentions is live, and a call reads every variable mentioned in the
+ * functions it may reach.
+ */
+
+const size_t MAX_DCE_ROUNDS = 8;
+
+/* variables mentioned by a function and everything it may call */
+struct var_list
+{
+    var_index_type* vars;
+    size_t          n_vars;
+
+    bool            is_recursive;
+    bool            is_root_reached;
+    bool            is_ready;
+};
+
+struct liveness_info
+{
+    optimize_context* context;
+    var_index_type    n_vars;
+
+    bool*             exit_live;      // live after return from the function
+    var_list*         callee_reads;   // per function, with its callees
+
+    bool              is_removing;
+    bool              is_changed;
+};
+
+static bool
+PruneChain          (BinTree_node**    const chain_link,
+                     optimize_context* const context,
+                     bool*             const is_changed);
+
+static void
+DestroyChain        (BinTree_node* const chain,
+                     BinTree*      const tree);
+
+static bool
+RemoveUnusedFunctions (optimize_context* const context);
+
+static void
+MarkReachableFunctions (const BinTree_node*     const node,
+                              bool*             const is_reachable,
+                              optimize_context* const context);
+
+static bool
+RemoveDeadStores    (optimize_context* const context);
+
+static void
+LiveChain           (BinTree_node** const chain_link,
+                     bool*          const live,
+                     liveness_info* const info);
+
+static void
+LiveStatement       (BinTree_node** const link,
+                     bool*          const live,
+                     liveness_info* const info);
+
+static void
+LiveWhile           (BinTree_node*  const statement,
+                     bool*          const live,
+                     liveness_info* const info);
+
+static void
+GenerateUses        (const BinTree_node* const node,
+                           bool*         const live,
+                           liveness_info* const info);
+
+static const var_list*
+GetCalleeReads      (const var_index_type       func_index,
+                           liveness_info* const info);
+
+static void
+CollectCalleeReads  (const BinTree_node*   const node,
+                     const var_index_type        func_index,
+                           bool*           const is_read,
+                           bool*           const visited_funcs,
+                           var_list*       const reads,
+                           liveness_info*  const info);
+
+bool
+EliminateDeadCode (optimize_context* const context)
+{
+    assert (context);
+
+    bool is_eliminated = false;
+
+    for (size_t round = 0; round < MAX_DCE_ROUNDS; round++)
+    {
+        bool is_changed = false;
+
+        for (BinTree_node* func = context -> tree -> root;
+                           func; func = func -> right)
+        {
+            PruneChain (GetFunctionBodyLink (func), context, &is_changed);
+        }
+
+        is_changed |= RemoveUnusedFunctions (context);
+        is_changed |= RemoveDeadStores      (context);
+
+        if (!is_changed) break;
+
+        is_eliminated = true;
+    }
+
+    return is_eliminated;
+}
+
+/*
+ * Returns true if the chain never falls through to its end.
+ */
+static bool
+PruneChain (BinTree_node**    const chain_link,
+            optimize_context* const context,
+            bool*             const is_changed)
+{
+    assert (chain_link);
+    assert (context);
+    assert (is_changed);
+
+    BinTree* const tree = context -> tree;
+
+    BinTree_node** link = chain_link;
+
+    while (*link)
+    {
+        BinTree_node* const node      = *link;
+        BinTree_node* const statement = node -> left;
+
+        bool is_terminator = IsStatementOperation (statement, RET);
+
+        if (statement && statement -> data .data_type == KEY_OP)
+        {
+            BinTree_node* const condition = statement -> left;
+            BinTree_node* const branches  = statement -> right;
+
+            const bool is_if = statement -> data .key_op_code == IF;
+
+            if (condition -> data .data_type == NUMBER && (is_if ||
+                IsNumberNode (condition, 0)))
+            {
+                BinTree_node** const taken_link =
+                    IsNumberNode (condition, 0) ? &branches -> right
+                                                : &branches -> left;
+
+                BinTree_node* const taken = is_if ? *taken_link : nullptr;
+                if (is_if) *taken_link = nullptr;
+
+                BinTree_node** tail_link = link;
+                *link = taken;
+
+                while (*tail_link) tail_link = &(*tail_link) -> right;
+
+                *tail_link    = node -> right;
+                node -> right = nullptr;
+                BinTree_DestroySubtree (node, tree);
+
+                *is_changed = true;
+                continue;
+            }
+
+            const bool is_true_terminated =
+                PruneChain (&branches -> left,  context, is_changed);
+            const bool is_false_terminated =
+                PruneChain (&branches -> right, context, is_changed);
+
+            /* a while without break only leaves by its condition */
+            is_terminator = is_if ? is_true_terminated &&
+                                    is_false_terminated
+                                  : condition -> data .data_type == NUMBER;
+        }
+
+        if (is_terminator && node -> right)
+        {
+            DestroyChain (node -> right, tree);
+            node -> right = nullptr;
+
+            *is_changed = true;
+        }
+
+        if (is_terminator) return true;
+
+        link = &node -> right;
+    }
+
+    return false;
+}
+
+static void
+DestroyChain (BinTree_node* const chain,
+              BinTree*      const tree)
+{
+    BinTree_node* node = chain;
+
+    /* iterative, chains may be long */
+    while (node)
+    {
+        BinTree_node* const next = node -> right;
+
+        node -> right = nullptr;
+        BinTree_DestroySubtree (node, tree);
+
+        node = next;
+    }
+}
+
+static bool
+RemoveUnusedFunctions (optimize_context* const context)
+{
+    assert (context);
+
+    bool* const is_reachable =
+        (bool*) calloc (context -> n_funcs + 1, sizeof (bool));
+    if (!is_reachable)
+    {
+        perror ("is_reachable allocation error");
+        return false;
+    }
+
+    BinTree_node* const root = context -> tree -> root;
+
+    is_reachable [root -> data .func_index] = true;
+    MarkReachableFunctions (*GetFunctionBodyLink (root),
+                            is_reachable, context);
+
+    bool is_removed = false;
+
+    for (BinTree_node* func = root; func -> right; )
+    {
+        BinTree_node* const next = func -> right;
+
+        if (next -> data .func_index < context -> n_funcs &&
+            is_reachable [next -> data .func_index])
+        {
+            func = next;
+            continue;
+        }
+
+        func -> right = next -> right;
+        next -> right = nullptr;
+        BinTree_DestroySubtree (next, context -> tree);
+
+        is_removed = true;
+    }
+
+    free (is_reachable);
+
+    return is_removed;
+}
+
+static void
+MarkReachableFunctions (const BinTree_node*     const node,
+                              bool*             const is_reachable,
+                              optimize_context* const context)
+{
+    assert (is_reachable);
+
+    if (!node) return;
+
+    if (node -> data .data_type == FUNCTION &&
+        node -> data .func_index < context -> n_funcs &&
+        !is_reachable [node -> data .func_index])
+    {
+        is_reachable [node -> data .func_index] = true;
+
+        BinTree_node* const callee =
+            GetFunctionByIndex (context -> tree -> root,
+                                node -> data .func_index);
+        if (callee)
+        {
+            MarkReachableFunctions (*GetFunctionBodyLink (callee),
+                                    is_reachable, context);
+        }
+    }
+
+    MarkReachableFunctions (node -> left,  is_reachable, context);
+    MarkReachableFunctions (node -> right, is_reachable, context);
+}
+
+static bool
+RemoveDeadStores (optimize_context* const context)
+{
+    assert (context);
+
+    const var_index_type n_vars = context -> n_vars;
+
+    liveness_info info = {.context      = context,
+                          .n_vars       = n_vars,
+                          .exit_live    = nullptr,
+                          .callee_reads = nullptr,
+                          .is_removing  = true,
+                          .is_changed   = false};
+
+    info .callee_reads = (var_list*) calloc (context -> n_funcs + 1,
+                                             sizeof (var_list));
+
+    /* how many functions mention each variable */
+    size_t* const n_users   = (size_t*) calloc (n_vars + 1, sizeof (size_t));
+    bool*   const func_vars = (bool*)   calloc (n_vars + 1, sizeof (bool));
+    bool*   const live      = (bool*)   calloc (n_vars + 1, sizeof (bool));
+
+    info .exit_live = (bool*) calloc (n_vars + 1, sizeof (bool));
+
+    if (!info .callee_reads || !n_users || !func_vars ||
+        !live || !info .exit_live)
+    {
+        perror ("liveness allocation error");
+    }
+
+    else
+    {
+        BinTree_node* const root = context -> tree -> root;
+
+        bool is_main_called = false;
+
+        for (BinTree_node* func = root; func; func = func -> right)
+        {
+            memset (func_vars, 0, n_vars * sizeof (bool));
+            MarkMentionedVariables (func -> left, func_vars, n_vars);
+
+            for (var_index_type i = 0; i < n_vars; i++)
+                n_users [i] += func_vars [i];
+
+            is_main_called |= GetCalleeReads (func -> data .func_index,
+                                              &info) -> is_root_reached;
+        }
+
+        for (BinTree_node* func = root; func; func = func -> right)
+        {
+            memset (func_vars, 0, n_vars * sizeof (bool));
+            MarkMentionedVariables (func -> left, func_vars, n_vars);
+
+            const var_list* const reads =
+                GetCalleeReads (func -> data .func_index, &info);
+
+            /*
+             * Nothing runs after main unless somebody calls it, and
+             * a function that may reenter itself reads its own slots.
+             */
+            const bool is_called = func != root || is_main_called;
+
+            for (var_index_type i = 0; i < n_vars; i++)
+            {
+                info .exit_live [i] = is_called &&
+                    (n_users [i] > (size_t) func_vars [i] ||
+                     (reads -> is_recursive && func_vars [i]));
+            }
+
+            /* the next call reads what this one leaves in its slots */
+            info .is_removing = false;
+
+            for (bool is_stable = !is_called; !is_stable; )
+            {
+                memcpy (live, info .exit_live, n_vars * sizeof (bool));
+                LiveChain (GetFunctionBodyLink (func), live, &info);
+
+                is_stable = true;
+
+                for (var_index_type i = 0; i < n_vars; i++)
+                {
+                    if (live [i] && func_vars [i] && !info .exit_live [i])
+                    {
+                        info .exit_live [i] = true;
+                        is_stable           = false;
+                    }
+                }
+            }
+
+            info .is_removing = true;
+
+            memcpy (live, info .exit_live, n_vars * sizeof (bool));
+
+            LiveChain (GetFunctionBodyLink (func), live, &info);
+        }
+    }
+
+    if (info .callee_reads)
+    {
+        for (var_index_type i = 0; i <= context -> n_funcs; i++)
+            free (info .callee_reads [i] .vars);
+    }
+
+    free (info .callee_reads);
+    free (info .exit_live);
+    free (n_users);
+    free (func_vars);
+    free (live);
+
+    return info .is_changed;
+}
+
+/*
+ * On entry live holds what is live after the chain,
+ * on exit what is live before it.
+ */
+static void
+LiveChain (BinTree_node** const chain_link,
+           bool*          const live,
+           liveness_info* const info)
+{
+    assert (chain_link);
+    assert (live);
+    assert (info);
+
+    size_t n_links = 0;
+    for (BinTree_node* node = *chain_link; node; node = node -> right)
+        n_links++;
+
+    if (n_links == 0) return;
+
+    BinTree_node*** const links =
+        (BinTree_node***) calloc (n_links, sizeof (BinTree_node**));
+    if (!links)
+    {
+        perror ("links allocation error");
+        return;
+    }
+
+    size_t link_index = 0;
+    for (BinTree_node** link = chain_link; *link; link = &(*link) -> right)
+        links [link_index++] = link;
+
+    /* a removed statement only changes the link of the one after it */
+    for (size_t i = n_links; i > 0; i--)
+    {
+        LiveStatement (links [i - 1], live, info);
+    }
+
+    free (links);
+}
+
+static void
+LiveStatement (BinTree_node** const link,
+               bool*          const live,
+               liveness_info* const info)
+{
+    assert (link);
+    assert (live);
+    assert (info);
+
+    BinTree_node* const node      = *link;
+    BinTree_node* const statement = node -> left;
+
+    if (!statement) return;
+
+    switch (statement -> data .data_type)
+    {
+        case BIN_OP:
+        {
+            if (statement -> data .bin_op_code != ASSUME_BEGIN)
+            {
+                GenerateUses (statement, live, info);
+                break;
+            }
+
+            const var_index_type target = statement -> left -> data .var_index;
+
+            if (info -> is_removing && target < info -> n_vars &&
+                !live [target] && !ContainsCall (statement -> right))
+            {
+                *link         = node -> right;
+                node -> right = nullptr;
+                BinTree_DestroySubtree (node, info -> context -> tree);
+
+                info -> is_changed = true;
+                break;
+            }
+
+            if (target < info -> n_vars) live [target] = false;
+
+            GenerateUses (statement -> right, live, info);
+            break;
+        }
+
+        case UN_OP:
+        {
+            if (statement -> data .un_op_code == IN)
+            {
+                const var_index_type target =
+                    statement -> right -> data .var_index;
+
+                if (target < info -> n_vars) live [target] = false;
+                break;
+            }
+
+            if (statement -> data .un_op_code == RET)
+            {
+                memcpy (live, info -> exit_live,
+                        info -> n_vars * sizeof (bool));
+            }
+
+            GenerateUses (statement -> right, live, info);
+            break;
+        }
+
+        case KEY_OP:
+        {
+            if (statement -> data .key_op_code == WHILE)
+            {
+                LiveWhile (statement, live, info);
+                break;
+            }
+
+            bool* const false_live = (bool*) calloc (info -> n_vars + 1,
+                                                     sizeof (bool));
+            if (!false_live)
+            {
+                perror ("false_live allocation error");
+                break;
+            }
+
+            memcpy (false_live, live, info -> n_vars * sizeof (bool));
+
+            LiveChain (&statement -> right -> left,  live,       info);
+            LiveChain (&statement -> right -> right, false_live, info);
+
+            for (var_index_type i = 0; i < info -> n_vars; i++)
+                live [i] |= false_live [i];
+
+            free (false_live);
+
+            GenerateUses (statement -> left, live, info);
+            break;
+        }
+
+        case FUNCTION:    [[fallthrough]];
+        case PUNCTUATION: [[fallthrough]];
+        case NUMBER:      [[fallthrough]];
+        case VARIABLE:    [[fallthrough]];
+        case NO_TYPE:     [[fallthrough]];
+
+        default:
+            GenerateUses (statement, live, info);
+            break;
+    }
+}
+
+/*
+ * live at the head = condition uses + live after the loop +
+ * live before the body (with the head as its successor).
+ */
+static void
+LiveWhile (BinTree_node*  const statement,
+           bool*          const live,
+           liveness_info* const info)
+{
+    assert (statement);
+    assert (live);
+    assert (info);
+
+    const var_index_type n_vars = info -> n_vars;
+
+    bool* const head_live = (bool*) calloc (n_vars + 1, sizeof (bool));
+    bool* const body_live = (bool*) calloc (n_vars + 1, sizeof (bool));
+    if (!head_live || !body_live)
+    {
+        perror ("loop liveness allocation error");
+        free (head_live);
+        free (body_live);
+
+        return;
+    }
+
+    memcpy (head_live, live, n_vars * sizeof (bool));
+    GenerateUses (statement -> left, head_live, info);
+
+    const bool is_removing = info -> is_removing;
+    info -> is_removing = false;
+
+    bool is_stable = false;
+
+    while (!is_stable)
+    {
+        memcpy (body_live, head_live, n_vars * sizeof (bool));
+        LiveChain (&statement -> right -> left, body_live, info);
+
+        is_stable = true;
+
+        for (var_index_type i = 0; i < n_vars; i++)
+        {
+            if (body_live [i] && !head_live [i])
+            {
+                head_live [i] = true;
+                is_stable     = false;
+            }
+        }
+    }
+
+    info -> is_removing = is_removing;
+
+    if (is_removing)
+    {
+        memcpy (body_live, head_live, n_vars * sizeof (bool));
+        LiveChain (&statement -> right -> left, body_live, info);
+    }
+
+    memcpy (live, head_live, n_vars * sizeof (bool));
+
+    free (head_live);
+    free (body_live);
+}
+
+static void
+GenerateUses (const BinTree_node*  const node,
+                    bool*          const live,
+                    liveness_info* const info)
+{
+    assert (live);
+    assert (info);
+
+    if (!node) return;
+
+    if (node -> data .data_type == VARIABLE &&
+        node -> data .var_index < info -> n_vars)
+    {
+        live [node -> data .var_index] = true;
+    }
+
+    else if (node -> data .data_type == FUNCTION)
+    {
+        const var_list* const reads =
+            GetCalleeReads (node -> data .func_index, info);
+
+        for (size_t i = 0; i < reads -> n_vars; i++)
+            live [reads -> vars [i]] = true;
+    }
+
+    GenerateUses (node -> left,  live, info);
+    GenerateUses (node -> right, live, info);
+}
+
+static const var_list*
+GetCalleeReads (const var_index_type       func_index,
+                      liveness_info* const info)
+{
+    assert (info);
+
+    static const var_list empty_list = {};
+
+    optimize_context* const context = info -> context;
+
+    if (func_index >= context -> n_funcs) return &empty_list;
+
+    var_list* const reads = &info -> callee_reads [func_index];
+    if (reads -> is_ready) return reads;
+
+    reads -> is_ready = true;
+
+    BinTree_node* const func =
+        GetFunctionByIndex (context -> tree -> root, func_index);
+    if (!func) return reads;
+
+    bool* const is_read       = (bool*) calloc (info -> n_vars + 1,
+                                                sizeof (bool));
+    bool* const visited_funcs = (bool*) calloc (context -> n_funcs + 1,
+                                                sizeof (bool));
+    if (!is_read || !visited_funcs)
+    {
+        perror ("callee reads allocation error");
+        free (is_read);
+        free (visited_funcs);
+
+        return reads;
+    }
+
+    CollectCalleeReads (func -> left, func_index, is_read,
+                        visited_funcs, reads, info);
+
+    for (var_index_type i = 0; i < info -> n_vars; i++)
+        reads -> n_vars += is_read [i];
+
+    reads -> vars = (var_index_type*) calloc (reads -> n_vars + 1,
+                                              sizeof (var_index_type));
+    if (reads -> vars)
+    {
+        size_t n_collected = 0;
+
+        for (var_index_type i = 0; i < info -> n_vars; i++)
+        {
+            if (is_read [i]) reads -> vars [n_collected++] = i;
+        }
+    }
+
+    else
+    {
+        perror ("reads allocation error");
+        reads -> n_vars = 0;
+    }
+
+    free (is_read);
+    free (visited_funcs);
+
+    return reads;
+}
+
+static void
+CollectCalleeReads (const BinTree_node*   const node,
+                    const var_index_type        func_index,
+                          bool*           const is_read,
+                          bool*           const visited_funcs,
+                          var_list*       const reads,
+                          liveness_info*  const info)
+{
+    if (!node) return;
+
+    if (node -> data .data_type == VARIABLE &&
+        node -> data .var_index < info -> n_vars)
+    {
+        is_read [node -> data .var_index] = true;
+    }
+
+    else if (node -> data .data_type == FUNCTION &&
+             node -> data .func_index < info -> context -> n_funcs)
+    {
+        const var_index_type callee_index = node -> data .func_index;
+
+        reads -> is_recursive    |= callee_index == func_index;
+        reads -> is_root_reached |=
+            callee_index == info -> context -> tree -> root -> data .func_index;
+
+        if (!visited_funcs [callee_index])
+        {
+            visited_funcs [callee_index] = true;
+
+            BinTree_node* const callee =
+                GetFunctionByIndex (info -> context -> tree -> root,
+                                    callee_index);
+            if (callee)
+            {
+                CollectCalleeReads (callee -> left, func_index, is_read,
+                                    visited_funcs, reads, info);
+            }
+        }
+    }
+
+    CollectCalleeReads (node -> left,  func_index, is_read,
+                        visited_funcs, reads, info);
+    CollectCalleeReads (node -> right, func_index, is_read,
+                        visited_funcs, reads, info);
+}
@@ -0,0 +1,796 @@
+#include "optimize.h"
+#include "value_table.h"
+
+/*
+ * Narsil f Gollum x is replaced by df/dx at compile time. Without
+ * Gollum x the only variable of f is taken.
+ *
+ * Expressions go through a hash-consed DAG: equal subterms are one
+ * node, derivatives are memoized per node, and node constructors
+ * simplify (0 * a, a + 0, literal folding), so the derivative of a
+ * large expression stays linear in its size. Nodes the result uses
+ * more than once are computed into fresh slots in front of the
+ * statement instead of being copied, where splicing is possible.
+ *
+ * Simplifications follow real arithmetic: 0 * a is 0 for any a.
+ */
+
+struct dag_node
+{
+    data_type      type;
+    op_code_type   op_code;
+    double         num_value;
+    var_index_type var_index;
+
+    value_id_type  left;
+    value_id_type  right;
+};
+
+struct expression_dag
+{
+    value_table    table;
+
+    dag_node*      nodes;           // indexed by id
+    size_t         capacity;
+
+    value_id_type* derivatives;     // by the current variable
+    size_t         n_derivatives;
+    var_index_type diff_var;
+
+    value_id_type  zero;
+    value_id_type  one;
+
+    bool           is_expanded;     // a Narsil was replaced
+    bool           is_failed;
+};
+
+struct export_state
+{
+    size_t*           n_refs;
+    var_index_type*   temps;
+
+    bool              can_splice;
+    BinTree_node*     spliced;
+    BinTree_node**    spliced_tail;
+
+    optimize_context* context;
+};
+
+static bool
+ExpandInChain       (BinTree_node**    const chain_link,
+                     expression_dag*   const dag,
+                     optimize_context* const context);
+
+static void
+ExpandInNode        (BinTree_node**    const node_ptr,
+                     expression_dag*   const dag,
+                     export_state*     const state);
+
+static value_id_type
+ImportExpression    (const BinTree_node*   const node,
+                           expression_dag* const dag);
+
+static value_id_type
+ImportDerivative    (const BinTree_node*   const node,
+                           expression_dag* const dag);
+
+static var_index_type
+FindOnlyVariable    (const BinTree_node*   const node,
+                           bool*           const is_unique);
+
+static value_id_type
+Differentiate       (const value_id_type         id,
+                           expression_dag* const dag);
+
+static value_id_type
+DifferentiateOperation (const value_id_type         id,
+                              expression_dag* const dag);
+
+static BinTree_node*
+ExportExpression    (const value_id_type         id,
+                     const expression_dag* const dag,
+                           export_state*   const state);
+
+static void
+CountReferences     (const value_id_type         id,
+                     const expression_dag* const dag,
+                           size_t*         const n_refs);
+
+static value_id_type
+AddNode             (      expression_dag* const dag,
+                     const value_key*      const key,
+                     const dag_node*       const node);
+
+static value_id_type
+MakeDagNumber       (const double                value,
+                           expression_dag* const dag);
+
+static value_id_type
+MakeDagVariable     (const var_index_type        var_index,
+                           expression_dag* const dag);
+
+static value_id_type
+MakeDagOperation    (const data_type             type,
+                     const op_code_type          op_code,
+                     const value_id_type         left,
+                     const value_id_type         right,
+                           expression_dag* const dag);
+
+static value_id_type
+MakeDagUnary        (const op_code_type          op_code,
+                     const value_id_type         right,
+                           expression_dag* const dag);
+
+static value_id_type
+MakeDagBinary       (const op_code_type          op_code,
+                     const value_id_type         left,
+                     const value_id_type         right,
+                           expression_dag* const dag);
+
+static inline bool
+IsDagNumber         (const value_id_type         id,
+                     const expression_dag* const dag);
+
+bool
+ExpandDerivatives (optimize_context* const context)
+{
+    assert (context);
+
+    expression_dag dag = {};
+
+    if (!ValueTableCtor (&dag .table))
+    {
+        context -> is_failed = true;
+        return false;
+    }
+
+    bool is_done = true;
+
+    for (BinTree_node* func = context -> tree -> root;
+                       func && is_done; func = func -> right)
+    {
+        is_done = ExpandInChain (GetFunctionBodyLink (func),
+                                 &dag, context);
+    }
+
+    ValueTableDtor (&dag .table);
+
+    free (dag .nodes);
+    free (dag .derivatives);
+
+    if (!is_done) context -> is_failed = true;
+
+    return dag .is_expanded;
+}
+
+/*
+ * Returns false if some Narsil can't be expanded.
+ */
+static bool
+ExpandInChain (BinTree_node**    const chain_link,
+               expression_dag*   const dag,
+               optimize_context* const context)
+{
+    assert (chain_link);
+    assert (dag);
+    assert (context);
+
+    for (BinTree_node** link = chain_link; *link; link = &(*link) -> right)
+    {
+        BinTree_node* const node      = *link;
+        BinTree_node* const statement = node -> left;
+
+        if (!statement) continue;
+
+        export_state state = {.n_refs       = nullptr,
+                              .temps        = nullptr,
+                              .can_splice   = !ContainsCall (statement),
+                              .spliced      = nullptr,
+                              .spliced_tail = nullptr,
+                              .context      = context};
+
+        state .spliced_tail = &state .spliced;
+
+        if (statement -> data .data_type == KEY_OP)
+        {
+            /* a while condition is reevaluated, nowhere to splice it */
+            state .can_splice = statement -> data .key_op_code == IF &&
+                                !ContainsCall (statement -> left);
+
+            ExpandInNode (&statement -> left, dag, &state);
+
+            if (!ExpandInChain (&statement -> right -> left,  dag, context) ||
+                !ExpandInChain (&statement -> right -> right, dag, context))
+            {
+                return false;
+            }
+        }
+
+        else
+        {
+            ExpandInNode (&node -> left, dag, &state);
+        }
+
+        if (dag -> is_failed) return false;
+
+        if (state .spliced)
+        {
+            *state .spliced_tail = node;
+            *link                = state .spliced;
+            link                 = state .spliced_tail;
+        }
+    }
+
+    return true;
+}
+
+static void
+ExpandInNode (BinTree_node**    const node_ptr,
+              expression_dag*   const dag,
+              export_state*     const state)
+{
+    assert (node_ptr);
+    assert (dag);
+    assert (state);
+
+    BinTree_node* const node = *node_ptr;
+    if (!node || dag -> is_failed) return;
+
+    if (!IsStatementOperation (node, DIFF))
+    {
+        ExpandInNode (&node -> left,  dag, state);
+        ExpandInNode (&node -> right, dag, state);
+
+        return;
+    }
+
+    ValueTableClear (&dag -> table);
+
+    dag -> zero = MakeDagNumber (0, dag);
+    dag -> one  = MakeDagNumber (1, dag);
+
+    const value_id_type result = ImportDerivative (node, dag);
+    if (dag -> is_failed) return;
+
+    BinTree* const tree = state -> context -> tree;
+
+    state -> n_refs = (size_t*)         calloc (dag -> table .n_ids + 1,
+                                                sizeof (size_t));
+    state -> temps  = (var_index_type*) calloc (dag -> table .n_ids + 1,
+                                                sizeof (var_index_type));
+    if (!state -> n_refs || !state -> temps)
+    {
+        perror ("export state allocation error");
+        dag -> is_failed = true;
+    }
+
+    else
+    {
+        for (value_id_type i = 0; i < dag -> table .n_ids; i++)
+            state -> temps [i] = VAR_INDEX_POISON;
+
+        CountReferences (result, dag, state -> n_refs);
+
+        *node_ptr = ExportExpression (result, dag, state);
+        BinTree_DestroySubtree (node, tree);
+
+        dag -> is_expanded = true;
+    }
+
+    free (state -> n_refs);
+    free (state -> temps);
+
+    state -> n_refs = nullptr;
+    state -> temps  = nullptr;
+}
+
+static value_id_type
+ImportExpression (const BinTree_node*   const node,
+                        expression_dag* const dag)
+{
+    assert (dag);
+
+    if (!node || dag -> is_failed) return NO_VALUE_ID;
+
+    switch (node -> data .data_type)
+    {
+        case NUMBER:
+            return MakeDagNumber (node -> data .num_value, dag);
+
+        case VARIABLE:
+            return MakeDagVariable (node -> data .var_index, dag);
+
+        case UN_OP:
+            if (node -> data .un_op_code == DIFF)
+                return ImportDerivative (node, dag);
+
+            [[fallthrough]];
+
+        case BIN_OP:
+            if (IsValueOperation (node))
+            {
+                const value_id_type left  =
+                    ImportExpression (node -> left,  dag);
+                const value_id_type right =
+                    ImportExpression (node -> right, dag);
+
+                return MakeDagOperation (node -> data .data_type,
+                                         node -> data .punct_op_code,
+                                         left, right, dag);
+            }
+
+            [[fallthrough]];
+
+        case FUNCTION:    [[fallthrough]];
+        case PUNCTUATION: [[fallthrough]];
+        case KEY_OP:      [[fallthrough]];
+        case NO_TYPE:     [[fallthrough]];
+
+        default:
+            fprintf (stderr, "Narsil can only differentiate arithmetics, "
+                             "without calls and assignments.\n");
+
+            dag -> is_failed = true;
+            return NO_VALUE_ID;
+    }
+}
+
+/*
+ * Imports the derivative of a Narsil node. Inner Narsils are
+ * expanded first, they may be by other variables.
+ */
+static value_id_type
+ImportDerivative (const BinTree_node*   const node,
+                        expression_dag* const dag)
+{
+    assert (node);
+    assert (dag);
+
+    const value_id_type function = ImportExpression (node -> right, dag);
+    if (dag -> is_failed) return NO_VALUE_ID;
+
+    var_index_type diff_var = VAR_INDEX_POISON;
+
+    if (node -> left)
+    {
+        diff_var = node -> left -> data .var_index;
+    }
+
+    else
+    {
+        bool is_unique = true;
+        diff_var = FindOnlyVariable (node -> right, &is_unique);
+
+        if (!is_unique)
+        {
+            fprintf (stderr, "Narsil of an expression with several "
+                             "variables needs one: Narsil f Gollum x\n");
+
+            dag -> is_failed = true;
+            return NO_VALUE_ID;
+        }
+
+        /* a constant has zero derivative by anything */
+        if (diff_var == VAR_INDEX_POISON) return dag -> zero;
+    }
+
+    /* the memo holds derivatives by one variable only */
+    free (dag -> derivatives);
+
+    dag -> diff_var      = diff_var;
+    dag -> n_derivatives = dag -> table .n_ids;
+    dag -> derivatives   = (value_id_type*)
+        calloc (dag -> n_derivatives + 1, sizeof (value_id_type));
+    if (!dag -> derivatives)
+    {
+        perror ("derivatives allocation error");
+
+        dag -> is_failed = true;
+        return NO_VALUE_ID;
+    }
+
+    for (size_t i = 0; i < dag -> n_derivatives; i++)
+        dag -> derivatives [i] = NO_VALUE_ID;
+
+    return Differentiate (function, dag);
+}
+
+static var_index_type
+FindOnlyVariable (const BinTree_node* const node,
+                        bool*         const is_unique)
+{
+    assert (is_unique);
+
+    if (!node) return VAR_INDEX_POISON;
+
+    if (node -> data .data_type == VARIABLE)
+        return node -> data .var_index;
+
+    const var_index_type left  = FindOnlyVariable (node -> left,  is_unique);
+    const var_index_type right = FindOnlyVariable (node -> right, is_unique);
+
+    if (left != VAR_INDEX_POISON && right != VAR_INDEX_POISON &&
+        left != right)
+    {
+        *is_unique = false;
+    }
+
+    return left != VAR_INDEX_POISON ? left : right;
+}
+
+static value_id_type
+Differentiate (const value_id_type         id,
+                     expression_dag* const dag)
+{
+    assert (dag);
+
+    if (id == NO_VALUE_ID || dag -> is_failed) return NO_VALUE_ID;
+
+    /* nodes made while differentiating are past the memo */
+    if (id < dag -> n_derivatives && dag -> derivatives [id] != NO_VALUE_ID)
+        return dag -> derivatives [id];
+
+    value_id_type derivative = dag -> zero;
+
+    const dag_node* const node = &dag -> nodes [id];
+
+    if (node -> type == VARIABLE && node -> var_index == dag -> diff_var)
+        derivative = dag -> one;
+
+    else if (node -> type == BIN_OP || node -> type == UN_OP)
+        derivative = DifferentiateOperation (id, dag);
+
+    if (id < dag -> n_derivatives)
+        dag -> derivatives [id] = derivative;
+
+    return derivative;
+}
+
+static value_id_type
+DifferentiateOperation (const value_id_type         id,
+                              expression_dag* const dag)
+{
+    assert (dag);
+
+    /* nodes may move when the array grows, copy the fields */
+    const op_code_type  op_code = dag -> nodes [id] .op_code;
+    const value_id_type u       = dag -> nodes [id] .left;
+    const value_id_type v       = dag -> nodes [id] .right;
+
+    const value_id_type du = (dag -> nodes [id] .type == BIN_OP) ?
+                             Differentiate (u, dag) : dag -> zero;
+    const value_id_type dv = Differentiate (v, dag);
+
+    #define ADD_(a, b) MakeDagBinary (ADD, a, b, dag)
+    #define SUB_(a, b) MakeDagBinary (SUB, a, b, dag)
+    #define MUL_(a, b) MakeDagBinary (MUL, a, b, dag)
+    #define DIV_(a, b) MakeDagBinary (DIV, a, b, dag)
+    #define POW_(a, b) MakeDagBinary (POW, a, b, dag)
+    #define NUM_(a)    MakeDagNumber (a, dag)
+
+    switch (op_code)
+    {
+        case SIN:  return MUL_ (MakeDagUnary (COS, v, dag), dv);
+        case COS:  return MUL_ (MUL_ (NUM_ (-1), MakeDagUnary (SIN, v, dag)),
+                                dv);
+        case SQRT: return DIV_ (dv, MUL_ (NUM_ (2), MakeDagUnary (SQRT, v,
+                                                                  dag)));
+        case LN:   return DIV_ (dv, v);
+
+        case ADD:  return ADD_ (du, dv);
+        case SUB:  return SUB_ (du, dv);
+        case MUL:  return ADD_ (MUL_ (du, v), MUL_ (u, dv));
+        case DIV:  return DIV_ (SUB_ (MUL_ (du, v), MUL_ (u, dv)),
+                                MUL_ (v, v));
+
+        case POW:
+        {
+            /* u^c -> c * u^(c - 1) * du */
+            if (dv == dag -> zero)
+                return MUL_ (MUL_ (v, POW_ (u, SUB_ (v, dag -> one))), du);
+
+            /* c^v -> c^v * ln c * dv */
+            if (du == dag -> zero)
+                return MUL_ (MUL_ (id, MakeDagUnary (LN, u, dag)), dv);
+
+            /* u^v * (dv * ln u + v * du / u) */
+            return MUL_ (id, ADD_ (MUL_ (dv, MakeDagUnary (LN, u, dag)),
+                                   DIV_ (MUL_ (v, du), u)));
+        }
+
+        /* comparisons and ! are piecewise constant */
+        case NOT:              [[fallthrough]];
+        case IS_EQUAL:         [[fallthrough]];
+        case GREATER:          [[fallthrough]];
+        case LESS:             [[fallthrough]];
+        case GREATER_OR_EQUAL: [[fallthrough]];
+        case LESS_OR_EQUAL:    [[fallthrough]];
+        case NOT_EQUAL:        [[fallthrough]];
+
+        default:
+            return dag -> zero;
+    }
+
+    #undef ADD_
+    #undef SUB_
+    #undef MUL_
+    #undef DIV_
+    #undef POW_
+    #undef NUM_
+}
+
+/*
+ * Nodes used more than once go to fresh slots if splicing is
+ * possible, so the exported tree is as big as the DAG.
+ */
+static BinTree_node*
+ExportExpression (const value_id_type         id,
+                  const expression_dag* const dag,
+                        export_state*   const state)
+{
+    assert (dag);
+    assert (state);
+
+    if (id == NO_VALUE_ID) return nullptr;
+
+    BinTree* const tree = state -> context -> tree;
+
+    if (state -> temps [id] != VAR_INDEX_POISON)
+        return MakeVariable (state -> temps [id], tree);
+
+    const dag_node* const node = &dag -> nodes [id];
+
+    switch (node -> type)
+    {
+        case NUMBER:   return MakeNumber   (node -> num_value, tree);
+        case VARIABLE: return MakeVariable (node -> var_index, tree);
+
+        case BIN_OP: [[fallthrough]];
+        case UN_OP:
+            break;
+
+        case FUNCTION:    [[fallthrough]];
+        case PUNCTUATION: [[fallthrough]];
+        case KEY_OP:      [[fallthrough]];
+        case NO_TYPE:     [[fallthrough]];
+
+        default:
+            return nullptr;
+    }
+
+    BinTree_node* const expression =
+        BinTree_CtorNode (node -> type, node -> op_code,
+                          ExportExpression (node -> left,  dag, state),
+                          ExportExpression (node -> right, dag, state),
+                          nullptr, tree);
+
+    if (state -> n_refs [id] < 2 || !state -> can_splice)
+        return expression;
+
+    state -> temps [id] = AllocateVariable (state -> context);
+
+    state -> spliced_tail =
+        AppendStatement (state -> spliced_tail,
+                         MakeAssume (state -> temps [id], expression, tree),
+                         tree);
+
+    return MakeVariable (state -> temps [id], tree);
+}
+
+static void
+CountReferences (const value_id_type         id,
+                 const expression_dag* const dag,
+                       size_t*         const n_refs)
+{
+    assert (dag);
+    assert (n_refs);
+
+    if (id == NO_VALUE_ID) return;
+
+    /* children of a shared node are counted once */
+    if (n_refs [id]++ > 0) return;
+
+    CountReferences (dag -> nodes [id] .left,  dag, n_refs);
+    CountReferences (dag -> nodes [id] .right, dag, n_refs);
+}
+
+static value_id_type
+AddNode (      expression_dag* const dag,
+         const value_key*      const key,
+         const dag_node*       const node)
+{
+    assert (dag);
+    assert (key);
+    assert (node);
+
+    if (dag -> is_failed) return NO_VALUE_ID;
+
+    const value_id_type id = GetValueId (&dag -> table, key);
+
+    if (id == NO_VALUE_ID)
+    {
+        dag -> is_failed = true;
+        return NO_VALUE_ID;
+    }
+
+    if (id < dag -> table .n_ids - 1) return id;
+
+    if (id >= dag -> capacity)
+    {
+        const size_t new_capacity = dag -> capacity ? 2 * dag -> capacity
+                                                    : VALUE_TABLE_INIT_CAPACITY;
+
+        dag_node* const new_nodes = (dag_node*)
+            realloc (dag -> nodes, new_capacity * sizeof (dag_node));
+        if (!new_nodes)
+        {
+            perror ("dag nodes reallocation error");
+
+            dag -> is_failed = true;
+            return NO_VALUE_ID;
+        }
+
+        dag -> nodes    = new_nodes;
+        dag -> capacity = new_capacity;
+    }
+
+    dag -> nodes [id] = *node;
+
+    return id;
+}
+
+static value_id_type
+MakeDagNumber (const double                value,
+                     expression_dag* const dag)
+{
+    assert (dag);
+
+    const value_key key  = MakeNumberKey (value);
+    const dag_node  node = {.type      = NUMBER,
+                            .op_code   = OP_CODE_POISON,
+                            .num_value = value,
+                            .var_index = VAR_INDEX_POISON,
+                            .left      = NO_VALUE_ID,
+                            .right     = NO_VALUE_ID};
+
+    return AddNode (dag, &key, &node);
+}
+
+static value_id_type
+MakeDagVariable (const var_index_type        var_index,
+                       expression_dag* const dag)
+{
+    assert (dag);
+
+    const value_key key  = {.type  = VARIABLE,
+                            .op    = var_index,
+                            .left  = NO_VALUE_ID,
+                            .right = NO_VALUE_ID};
+    const dag_node  node = {.type      = VARIABLE,
+                            .op_code   = OP_CODE_POISON,
+                            .num_value = 0,
+                            .var_index = var_index,
+                            .left      = NO_VALUE_ID,
+                            .right     = NO_VALUE_ID};
+
+    return AddNode (dag, &key, &node);
+}
+
+static value_id_type
+MakeDagOperation (const data_type             type,
+                  const op_code_type          op_code,
+                  const value_id_type         left,
+                  const value_id_type         right,
+                        expression_dag* const dag)
+{
+    assert (dag);
+
+    if (type == UN_OP) return MakeDagUnary  (op_code, right, dag);
+
+    return MakeDagBinary (op_code, left, right, dag);
+}
+
+static value_id_type
+MakeDagUnary (const op_code_type          op_code,
+              const value_id_type         right,
+                    expression_dag* const dag)
+{
+    assert (dag);
+
+    if (dag -> is_failed) return NO_VALUE_ID;
+
+    double result = 0;
+
+    if (IsDagNumber (right, dag) &&
+        EvaluateOperation (op_code, 0, dag -> nodes [right] .num_value,
+                           &result) &&
+        IsPrintedExactly (result))
+    {
+        return MakeDagNumber (result, dag);
+    }
+
+    const value_key key  = MakeOperationKey (UN_OP, op_code,
+                                             NO_VALUE_ID, right);
+    const dag_node  node = {.type      = UN_OP,
+                            .op_code   = op_code,
+                            .num_value = 0,
+                            .var_index = VAR_INDEX_POISON,
+                            .left      = NO_VALUE_ID,
+                            .right     = right};
+
+    return AddNode (dag, &key, &node);
+}
+
+static value_id_type
+MakeDagBinary (const op_code_type          op_code,
+               const value_id_type         left,
+               const value_id_type         right,
+                     expression_dag* const dag)
+{
+    assert (dag);
+
+    if (dag -> is_failed) return NO_VALUE_ID;
+
+    double result = 0;
+
+    if (IsDagNumber (left, dag) && IsDagNumber (right, dag) &&
+        EvaluateOperation (op_code, dag -> nodes [left]  .num_value,
+                                    dag -> nodes [right] .num_value,
+                           &result) &&
+        IsPrintedExactly (result))
+    {
+        return MakeDagNumber (result, dag);
+    }
+
+    const value_id_type zero = dag -> zero;
+    const value_id_type one  = dag -> one;
+
+    switch (op_code)
+    {
+        case ADD:
+            if (left  == zero) return right;
+            if (right == zero) return left;
+            break;
+
+        case SUB:
+            if (right == zero) return left;
+            if (left  == right) return zero;
+            break;
+
+        case MUL:
+            if (left  == zero || right == zero) return zero;
+            if (left  == one)  return right;
+            if (right == one)  return left;
+            break;
+
+        case DIV:
+            if (left  == zero) return zero;
+            if (right == one)  return left;
+            break;
+
+        case POW:
+            if (right == zero) return one;
+            if (right == one)  return left;
+            break;
+
+        default:
+            break;
+    }
+
+    const value_key key  = MakeOperationKey (BIN_OP, op_code, left, right);
+    const dag_node  node = {.type      = BIN_OP,
+                            .op_code   = op_code,
+                            .num_value = 0,
+                            .var_index = VAR_INDEX_POISON,
+                            .left      = left,
+                            .right     = right};
+
+    return AddNode (dag, &key, &node);
+}
+
+static inline bool
+IsDagNumber (const value_id_type         id,
+             const expression_dag* const dag)
+{
+    return id != NO_VALUE_ID && dag -> nodes [id] .type == NUMBER;
+}
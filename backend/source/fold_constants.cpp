@@ -0,0 +1,172 @@
+#include "optimize.h"
+
+static bool
+FoldNode (BinTree_node** const node_ptr,
+          BinTree*       const tree);
+
+static bool
+FoldIdentity (BinTree_node** const node_ptr,
+              BinTree*       const tree);
+
+static inline bool
+IsEqual (const double left,
+         const double right);
+
+bool
+FoldConstants (optimize_context* const context)
+{
+    assert (context);
+
+    return FoldNode (&context -> tree -> root, context -> tree);
+}
+
+bool
+EvaluateOperation (const op_code_type       op_code,
+                   const double             left,
+                   const double             right,
+                         double*      const result)
+{
+    assert (result);
+
+    switch (op_code)
+    {
+        case SIN:  *result = sin  (right);   break;
+        case COS:  *result = cos  (right);   break;
+        case SQRT: *result = sqrt (right);   break;
+        case LN:   *result = log  (right);   break;
+        case NOT:  *result = IsEqual (right, 0);    break;
+
+        case ADD:  *result = left + right;   break;
+        case SUB:  *result = left - right;   break;
+        case MUL:  *result = left * right;   break;
+        case DIV:  *result = left / right;   break;
+        case POW:  *result = pow (left, right);     break;
+
+        case IS_EQUAL:         *result =  IsEqual (left, right);   break;
+        case NOT_EQUAL:        *result = !IsEqual (left, right);   break;
+        case GREATER:          *result = left >  right;            break;
+        case LESS:             *result = left <  right;            break;
+        case GREATER_OR_EQUAL: *result = left >= right;            break;
+        case LESS_OR_EQUAL:    *result = left <= right;            break;
+
+        default:
+            return false;
+    }
+
+    /* nan and inf can't be pushed back as a literal */
+    return isfinite (*result);
+}
+
+static bool
+FoldNode (BinTree_node** const node_ptr,
+          BinTree*       const tree)
+{
+    assert (node_ptr);
+    assert (tree);
+
+    BinTree_node* const node = *node_ptr;
+    if (!node) return false;
+
+    bool is_folded = FoldNode (&node -> left,  tree);
+    is_folded     |= FoldNode (&node -> right, tree);
+
+    if (node -> data .data_type != BIN_OP &&
+        node -> data .data_type != UN_OP)
+    {
+        return is_folded;
+    }
+
+    /* statements are not values */
+    if ((node -> data .data_type == BIN_OP &&
+         node -> data .bin_op_code == ASSUME_BEGIN) ||
+        (node -> data .data_type == UN_OP &&
+         node -> data .un_op_code >= OUT && node -> data .un_op_code <= RET))
+    {
+        return is_folded;
+    }
+
+    const bool is_bin_op = node -> data .data_type == BIN_OP;
+
+    if ((is_bin_op && !(node -> left && node -> left -> data
+                        .data_type == NUMBER))       ||
+        !node -> right || node -> right -> data .data_type != NUMBER)
+    {
+        return FoldIdentity (node_ptr, tree) || is_folded;
+    }
+
+    double result = 0;
+    const double left_value = is_bin_op ? node -> left -> data .num_value : 0;
+
+    if (!EvaluateOperation (is_bin_op ? node -> data .bin_op_code
+                                      : node -> data .un_op_code,
+                            left_value, node -> right -> data .num_value,
+                            &result) ||
+        !IsPrintedExactly (result))
+    {
+        return is_folded;
+    }
+
+    *node_ptr = MakeNumber (result, tree);
+    BinTree_DestroySubtree (node, tree);
+
+    return true;
+}
+
+/*
+ * Rewrites x mul 1, 1 mul x, x div 1, x sub 0 and x pow 1 into x.
+ * x add 0 is left alone as -0 add 0 is +0.
+ */
+static bool
+FoldIdentity (BinTree_node** const node_ptr,
+              BinTree*       const tree)
+{
+    assert (node_ptr);
+    assert (tree);
+
+    BinTree_node* const node = *node_ptr;
+
+    if (node -> data .data_type != BIN_OP) return false;
+
+    BinTree_node* kept = nullptr;
+
+    switch (node -> data .bin_op_code)
+    {
+        case MUL:
+            if      (IsNumberNode (node -> right, 1)) kept = node -> left;
+            else if (IsNumberNode (node -> left,  1)) kept = node -> right;
+            break;
+
+        case DIV:
+            if (IsNumberNode (node -> right, 1)) kept = node -> left;
+            break;
+
+        case SUB:
+            if (IsNumberNode (node -> right, 0)) kept = node -> left;
+            break;
+
+        case POW:
+            if (IsNumberNode (node -> right, 1)) kept = node -> left;
+            break;
+
+        default:
+            break;
+    }
+
+    if (!kept) return false;
+
+    if (kept == node -> left) node -> left  = nullptr;
+    else                      node -> right = nullptr;
+
+    *node_ptr = kept;
+    BinTree_DestroySubtree (node, tree);
+
+    return true;
+}
+
+/* operands are finite, so this is plain == without -Wfloat-equal */
+static inline bool
+IsEqual (const double left,
+         const double right)
+{
+    return !(left < right) && !(left > right);
+}
@@ -0,0 +1,231 @@
+#include "optimize.h"
+
+/*
+ * If-conversion of small ifs that only pick a value for a variable:
+ *
+ *     if (c) { x = a } else { x = b }
+ *
+ * becomes a select the processor runs without a jump:
+ *
+ *     t = c != 0
+ *     x = t * a + (1 - t) * b
+ *
+ * An if without else picks between a and x itself. The processor
+ * has no select instruction, so the select is arithmetic. It is
+ * exact as long as a and b are finite, but for the sign of a zero:
+ * one of the products is a value times one, the other is a zero
+ * added to it.
+ *
+ * Both values are computed whatever c is, so they may only use
+ * operations that can't fail or do anything else: no calls, no
+ * division, root, logarithm or power a guard might be protecting.
+ * select_budget bounds the nodes of a and b together, past it the
+ * work done on the wrong side costs more than the jump saves.
+ */
+
+static bool
+ConvertChain    (BinTree_node**    const chain_link,
+                 optimize_context* const context);
+
+static bool
+ConvertIf       (BinTree_node*     const elem,
+                 optimize_context* const context);
+
+static BinTree_node*
+GetSingleAssume (BinTree_node* const chain);
+
+static bool
+IsSelectable    (const BinTree_node* const node);
+
+static bool
+IsTruthValue    (const BinTree_node* const node);
+
+bool
+ConvertIfsToSelects (optimize_context* const context)
+{
+    assert (context);
+
+    bool is_converted = false;
+
+    for (BinTree_node* func = context -> tree -> root;
+                       func; func = func -> right)
+    {
+        is_converted |= ConvertChain (GetFunctionBodyLink (func), context);
+    }
+
+    return is_converted;
+}
+
+/* nested ifs go first, an outer one may become small enough then */
+static bool
+ConvertChain (BinTree_node**    const chain_link,
+              optimize_context* const context)
+{
+    assert (chain_link);
+    assert (context);
+
+    bool is_converted = false;
+
+    for (BinTree_node* elem = *chain_link; elem; elem = elem -> right)
+    {
+        BinTree_node* const statement = elem -> left;
+
+        if (!statement || statement -> data .data_type != KEY_OP)
+            continue;
+
+        is_converted |= ConvertChain (&statement -> right -> left,  context);
+        is_converted |= ConvertChain (&statement -> right -> right, context);
+
+        if (statement -> data .key_op_code == IF && ConvertIf (elem, context))
+        {
+            is_converted = true;
+
+            /* skip the select, it is the element after the mask */
+            elem = elem -> right;
+        }
+    }
+
+    return is_converted;
+}
+
+static bool
+ConvertIf (BinTree_node*     const elem,
+           optimize_context* const context)
+{
+    assert (elem);
+    assert (context);
+
+    BinTree* const tree = context -> tree;
+
+    BinTree_node* const statement = elem -> left;
+
+    BinTree_node* const if_true  = GetSingleAssume (statement -> right -> left);
+    BinTree_node* const if_false = GetSingleAssume (statement -> right -> right);
+
+    if (!if_true) return false;
+
+    /* an if without else keeps the old value */
+    if (!if_false && statement -> right -> right)
+        return false;
+
+    const var_index_type target = if_true -> left -> data .var_index;
+
+    if (if_false && if_false -> left -> data .var_index != target)
+        return false;
+
+    BinTree_node* const true_value  = if_true -> right;
+    BinTree_node* const false_value = if_false ? if_false -> right
+                                               : MakeVariable (target, tree);
+
+    if (!IsSelectable (true_value) || !IsSelectable (false_value) ||
+        CountNodes (true_value) + CountNodes (false_value) >
+        context -> config -> select_budget)
+    {
+        return false;
+    }
+
+    /* je compares the condition with 0, so does the mask */
+    BinTree_node* mask = statement -> left;
+
+    if (!IsTruthValue (mask))
+        mask = BinTree_CtorNode (BIN_OP, NOT_EQUAL, mask,
+                                 MakeNumber (0, tree), nullptr, tree);
+
+    const var_index_type mask_slot = AllocateVariable (context);
+
+    BinTree_node* const picked_true =
+        BinTree_CtorNode (BIN_OP, MUL, MakeVariable (mask_slot, tree),
+                          true_value, nullptr, tree);
+
+    BinTree_node* const not_mask =
+        BinTree_CtorNode (BIN_OP, SUB, MakeNumber (1, tree),
+                          MakeVariable (mask_slot, tree), nullptr, tree);
+
+    BinTree_node* const picked_false =
+        BinTree_CtorNode (BIN_OP, MUL, not_mask, false_value, nullptr, tree);
+
+    BinTree_node* const select =
+        BinTree_CtorNode (BIN_OP, ADD, picked_true, picked_false,
+                          nullptr, tree);
+
+    BinTree_node* const next = elem -> right;
+
+    elem -> left = MakeAssume (mask_slot, mask, tree);
+
+    *AppendStatement (&elem -> right, MakeAssume (target, select, tree),
+                      tree) = next;
+
+    return true;
+}
+
+/* returns the assignment if it is the only statement of the chain */
+static BinTree_node*
+GetSingleAssume (BinTree_node* const chain)
+{
+    if (!chain || chain -> right) return nullptr;
+
+    BinTree_node* const statement = chain -> left;
+
+    if (!statement || statement -> data .data_type   != BIN_OP ||
+                      statement -> data .bin_op_code != ASSUME_BEGIN)
+    {
+        return nullptr;
+    }
+
+    return statement;
+}
+
+static bool
+IsSelectable (const BinTree_node* const node)
+{
+    if (!node) return true;
+
+    switch (node -> data .data_type)
+    {
+        case NUMBER:   [[fallthrough]];
+        case VARIABLE:
+            return true;
+
+        case BIN_OP:
+            if (node -> data .bin_op_code == DIV ||
+                node -> data .bin_op_code == POW ||
+                node -> data .bin_op_code == ASSUME_BEGIN)
+            {
+                return false;
+            }
+            break;
+
+        case UN_OP:
+            if (node -> data .un_op_code != SIN &&
+                node -> data .un_op_code != COS &&
+                node -> data .un_op_code != NOT)
+            {
+                return false;
+            }
+            break;
+
+        case FUNCTION:    [[fallthrough]];
+        case KEY_OP:      [[fallthrough]];
+        case PUNCTUATION: [[fallthrough]];
+        case NO_TYPE:     [[fallthrough]];
+
+        default:
+            return false;
+    }
+
+    return IsSelectable (node -> left) && IsSelectable (node -> right);
+}
+
+/* comparisons and negation give 0 or 1 already */
+static bool
+IsTruthValue (const BinTree_node* const node)
+{
+    assert (node);
+
+    if (node -> data .data_type == UN_OP)
+        return node -> data .un_op_code == NOT;
+
+    return node -> data .data_type   == BIN_OP   &&
+           node -> data .bin_op_code >= IS_EQUAL &&
+           node -> data .bin_op_code <= NOT_EQUAL;
+}
@@ -0,0 +1,334 @@
+#include "incremental.h"
+#include "ir.h"
+#include "optimize.h"
+#include "print_asm.h"
+
+/*
+ * The code of a function is made of its subtree alone, but for the
+ * calls, which depend on a callee by the slots it may assign. So the
+ * key of a function is the hash of its subtree and of these slots of
+ * every callee. The functions whose keys are not in the cache are
+ * lowered and printed, the code of the rest is copied from it.
+ */
+
+/* the code of every function, by its place in the chain */
+struct function_asm
+{
+    compile_cache* caches;
+    char**         texts;
+    size_t*        sizes;
+    bool*          is_cached;
+};
+
+/* hashes of what the calls of a callee assign, found once per callee */
+struct callee_hashes
+{
+    optimize_context context;
+
+    cache_hash  start;          // of the tool and the executable
+    cache_hash* hashes;         // by callee
+    bool*       is_hashed;      // by callee
+    bool*       assigned;       // by slot, for the one being hashed
+};
+
+static bool
+LoadFunctionAsm      (const BinTree*      const tree,
+                      const cache_config* const cache_config,
+                            function_asm* const funcs);
+
+static bool
+PrintMissedFunctions (const BinTree*      const tree,
+                            function_asm* const funcs,
+                      const size_t              n_funcs,
+                      const size_t              n_jobs);
+
+static void
+HashSubtree          (const BinTree_node*  const node,
+                            cache_hash*    const hash,
+                            callee_hashes* const callees);
+
+static void
+HashNodeData         (const BinTree_node* const node,
+                            cache_hash*   const hash);
+
+static void
+HashCallee           (      callee_hashes* const callees,
+                      const var_index_type       func_index,
+                            cache_hash*    const hash);
+
+bool
+PrintTreeToAsmIncremental (const BinTree*      const tree,
+                           const cache_config* const cache_config,
+                                 FILE*         const stream,
+                           const size_t              n_jobs)
+{
+    assert (tree);
+    assert (cache_config);
+    assert (stream);
+
+    size_t n_funcs = 0;
+
+    for (const BinTree_node* func = tree -> root; func; func = func -> right)
+        n_funcs++;
+
+    if (!n_funcs) return true;
+
+    function_asm funcs = {.caches    = (compile_cache*) calloc (n_funcs, sizeof (compile_cache)),
+                          .texts     = (char**)         calloc (n_funcs, sizeof (char*)),
+                          .sizes     = (size_t*)        calloc (n_funcs, sizeof (size_t)),
+                          .is_cached = (bool*)          calloc (n_funcs, sizeof (bool))};
+
+    bool is_printed = funcs .caches && funcs .texts && funcs .sizes && funcs .is_cached;
+
+    if (!is_printed)
+        perror ("function asm allocation error");
+
+    is_printed = is_printed && LoadFunctionAsm (tree, cache_config, &funcs) &&
+                               PrintMissedFunctions (tree, &funcs, n_funcs, n_jobs);
+
+    /* main goes last, after the functions it calls */
+    if (is_printed)
+    {
+        fprintf (stream, "\t\tjmp :main\n\n");
+
+        for (size_t i = 1; i <= n_funcs; i++)
+            fwrite (funcs .texts [i % n_funcs], sizeof (char), funcs .sizes [i % n_funcs], stream);
+    }
+
+    for (size_t i = 0; i < n_funcs && funcs .texts; i++)
+        free (funcs .texts [i]);
+
+    free (funcs .caches);
+    free (funcs .texts);
+    free (funcs .sizes);
+    free (funcs .is_cached);
+
+    return is_printed;
+}
+
+static bool
+LoadFunctionAsm (const BinTree*      const tree,
+                 const cache_config* const cache_config,
+                       function_asm* const funcs)
+{
+    assert (tree);
+    assert (cache_config);
+    assert (funcs);
+
+    /* the analyses the context is for only read the tree */
+    callee_hashes callees = {.context   = {.tree      = const_cast <BinTree*> (tree),
+                                           .config    = nullptr,
+                                           .n_vars    = 0,
+                                           .n_funcs   = 0,
+                                           .is_failed = false},
+                             .start     = 0,
+                             .hashes    = nullptr,
+                             .is_hashed = nullptr,
+                             .assigned  = nullptr};
+
+    CountContextIndices (&callees .context);
+
+    if (!StartCacheHash (cache_config, "backend-function", &callees .start))
+        return false;
+
+    callees .hashes    = (cache_hash*) calloc (callees .context .n_funcs + 1, sizeof (cache_hash));
+    callees .is_hashed = (bool*)       calloc (callees .context .n_funcs + 1, sizeof (bool));
+    callees .assigned  = (bool*)       calloc (callees .context .n_vars  + 1, sizeof (bool));
+
+    bool is_loaded = callees .hashes && callees .is_hashed && callees .assigned;
+
+    if (!is_loaded)
+        perror ("callee hashes allocation error");
+
+    size_t position = 0;
+
+    for (const BinTree_node* func = tree -> root; func && is_loaded;
+                             func = func -> right, position++)
+    {
+        /* the right child is the next function */
+        cache_hash hash = callees .start;
+
+        HashNodeData (func, &hash);
+        HashSubtree  (func -> left, &hash, &callees);
+
+        SetFragmentCache (&funcs -> caches [position], cache_config, hash);
+
+        FILE* const buffer = open_memstream (&funcs -> texts [position],
+                                             &funcs -> sizes [position]);
+        if (!buffer)
+        {
+            perror ("function asm open error");
+            is_loaded = false;
+            break;
+        }
+
+        funcs -> is_cached [position] = CacheLoad (&funcs -> caches [position], buffer);
+
+        is_loaded = fclose (buffer) == 0;
+
+        /* lowered and printed again */
+        if (!funcs -> is_cached [position])
+        {
+            free (funcs -> texts [position]);
+            funcs -> texts [position] = nullptr;
+        }
+    }
+
+    free (callees .hashes);
+    free (callees .is_hashed);
+    free (callees .assigned);
+
+    return is_loaded;
+}
+
+/* the module has the functions that are not cached, in the order of the chain */
+static bool
+PrintMissedFunctions (const BinTree*      const tree,
+                            function_asm* const funcs,
+                      const size_t              n_funcs,
+                      const size_t              n_jobs)
+{
+    assert (tree);
+    assert (funcs);
+
+    ir_module module = {};
+
+    char**  const texts = (char**)  calloc (n_funcs, sizeof (char*));
+    size_t* const sizes = (size_t*) calloc (n_funcs, sizeof (size_t));
+
+    if (!texts || !sizes)
+    {
+        perror ("asm buffers allocation error");
+        free (texts);
+        free (sizes);
+        return false;
+    }
+
+    const bool is_printed = IrModuleCtor (&module)                              &&
+                            BuildIrModule (&module, tree, funcs -> is_cached)  &&
+                            PrintIrFunctions (&module, texts, sizes, n_jobs);
+
+    size_t func = 0;
+
+    for (size_t position = 0; position < n_funcs; position++)
+    {
+        if (funcs -> is_cached [position]) continue;
+
+        if (!is_printed)
+        {
+            free (texts [func++]);
+            continue;
+        }
+
+        assert (func < module .n_funcs);
+
+        funcs -> texts [position] = texts [func];
+        funcs -> sizes [position] = sizes [func];
+        func++;
+
+        CacheStore (&funcs -> caches [position], funcs -> texts [position],
+                    funcs -> sizes [position]);
+    }
+
+    free (texts);
+    free (sizes);
+
+    IrModuleDtor (&module);
+
+    return is_printed;
+}
+
+static void
+HashSubtree (const BinTree_node*  const node,
+                   cache_hash*    const hash,
+                   callee_hashes* const callees)
+{
+    assert (hash);
+    assert (callees);
+
+    /* a missing child is a part of the shape */
+    const bool is_node = node != nullptr;
+
+    HashBytes (hash, &is_node, sizeof (is_node));
+
+    if (!node) return;
+
+    HashNodeData (node, hash);
+
+    if (node -> data .data_type == FUNCTION)
+        HashCallee (callees, node -> data .func_index, hash);
+
+    HashSubtree (node -> left,  hash, callees);
+    HashSubtree (node -> right, hash, callees);
+}
+
+static void
+HashNodeData (const BinTree_node* const node,
+                    cache_hash*   const hash)
+{
+    assert (node);
+    assert (hash);
+
+    const data* const node_data = &node -> data;
+
+    HashBytes (hash, &node_data -> data_type, sizeof (node_data -> data_type));
+
+    switch (node_data -> data_type)
+    {
+        case PUNCTUATION:
+        case BIN_OP:
+        case UN_OP:
+        case KEY_OP:
+            HashBytes (hash, &node_data -> key_op_code, sizeof (node_data -> key_op_code));
+            break;
+
+        case NUMBER:
+            HashBytes (hash, &node_data -> num_value, sizeof (node_data -> num_value));
+            break;
+
+        case VARIABLE:
+            HashBytes (hash, &node_data -> var_index, sizeof (node_data -> var_index));
+            break;
+
+        case FUNCTION:
+            HashBytes (hash, &node_data -> func_index, sizeof (node_data -> func_index));
+            break;
+
+        case NO_TYPE:
+        default:
+            break;
+    }
+}
+
+static void
+HashCallee (      callee_hashes* const callees,
+            const var_index_type       func_index,
+                  cache_hash*    const hash)
+{
+    assert (callees);
+    assert (hash);
+    assert (func_index < callees -> context .n_funcs);
+
+    if (!callees -> is_hashed [func_index])
+    {
+        const var_index_type n_vars = callees -> context .n_vars;
+
+        for (var_index_type slot = 0; slot < n_vars; slot++)
+            callees -> assigned [slot] = false;
+
+        MarkCallClobbers (func_index, callees -> assigned, &callees -> context);
+
+        cache_hash callee_hash = callees -> start;
+
+        for (var_index_type slot = 0; slot < n_vars; slot++)
+        {
+            if (callees -> assigned [slot])
+                HashBytes (&callee_hash, &slot, sizeof (slot));
+        }
+
+        callees -> hashes    [func_index] = callee_hash;
+        callees -> is_hashed [func_index] = true;
+    }
+
+    HashBytes (hash, &callees -> hashes [func_index], sizeof (cache_hash));
+}
@@ -0,0 +1,596 @@
+#include "optimize.h"
+
+/*
+ * Inlining works on statements: arguments are assigned to the formals
+ * and the callee body is spliced in front of the statement with the
+ * call, the call itself is replaced by the returned expression.
+ *
+ * Slots are global, so the body keeps writing the caller-visible
+ * variables it writes after a real call. The exception are the
+ * variables met in the arguments: a call saves and restores them,
+ * so the body gets fresh copies of those it writes.
+ *
+ * Only leaf functions (without calls) are inlined, so they never
+ * recurse. Callers become leaves once their own calls are inlined,
+ * that is what the rounds are for. A call is taken only if nothing
+ * evaluated before it in the same statement is a call or reads a
+ * variable the body writes, because splicing moves the body in front
+ * of the whole statement. A call in the arguments of another one is
+ * taken only if the outer call writes none of the variables met in
+ * its arguments: the outer call saves them, and the expression left
+ * in place of the inner call may not name them any more.
+ */
+
+struct call_search
+{
+    const BinTree_node*     statement;
+          bool              is_call_seen;
+          bool*             is_read;        // variables read before the call
+          bool*             is_clobbered;   // by calls whose arguments the walk is in
+          optimize_context* context;
+};
+
+static bool
+InlineInChain    (BinTree_node**    const chain_link,
+                  optimize_context* const context);
+
+static BinTree_node**
+FindInlineCall   (BinTree_node** const node_ptr,
+                  call_search*   const search);
+
+static bool
+IsInlinable      (const BinTree_node*     const call,
+                  const bool                    is_value_used,
+                  const bool*             const is_read,
+                        optimize_context* const context);
+
+static bool
+HasReadClobbered (const BinTree_node*     const call,
+                  const bool*             const is_read,
+                        optimize_context* const context);
+
+static bool
+HasSavedClobbered (const BinTree_node*     const call,
+                   const bool*             const is_clobbered,
+                         optimize_context* const context);
+
+static BinTree_node**
+ExpandCall       (BinTree_node**    const link,
+                  BinTree_node**    const call_ptr,
+                  optimize_context* const context);
+
+static bool
+IsFormal         (      BinTree_node*   const callee,
+                  const var_index_type        var_index);
+
+static BinTree_node*
+CopyRenamed      (      BinTree_node*   const node,
+                  const var_index_type* const rename_table,
+                  const var_index_type        rename_table_size,
+                        BinTree*        const tree);
+
+static void
+RenameVariables  (      BinTree_node*   const node,
+                  const var_index_type* const rename_table,
+                  const var_index_type        rename_table_size);
+
+bool
+InlineFunctions (optimize_context* const context)
+{
+    assert (context);
+
+    bool is_inlined = false;
+
+    for (size_t round = 0; round < MAX_INLINE_ROUNDS; round++)
+    {
+        bool is_round_inlined = false;
+
+        for (BinTree_node* func = context -> tree -> root;
+                           func; func = func -> right)
+        {
+            is_round_inlined |=
+                InlineInChain (GetFunctionBodyLink (func), context);
+        }
+
+        if (!is_round_inlined) break;
+
+        is_inlined = true;
+    }
+
+    return is_inlined;
+}
+
+static bool
+InlineInChain (BinTree_node**    const chain_link,
+               optimize_context* const context)
+{
+    assert (chain_link);
+    assert (context);
+
+    bool is_inlined = false;
+
+    bool* is_read = nullptr;
+
+    BinTree_node** link = chain_link;
+
+    while (*link)
+    {
+        BinTree_node* const node      = *link;
+        BinTree_node* const statement = node -> left;
+
+        /* expansions allocate slots, so the set is sized per statement */
+        free (is_read);
+        is_read = (bool*) calloc (context -> n_vars + 1, sizeof (bool));
+        if (!is_read)
+        {
+            perror ("is_read allocation error");
+            break;
+        }
+
+        call_search search = {.statement    = statement,
+                              .is_call_seen = false,
+                              .is_read      = is_read,
+                              .is_clobbered = nullptr,
+                              .context      = context};
+
+        BinTree_node** call_ptr = nullptr;
+
+        if (statement && statement -> data .data_type == KEY_OP)
+        {
+            /* a while condition is reevaluated, nowhere to splice it */
+            if (statement -> data .key_op_code == IF)
+            {
+                search .statement = nullptr;
+                call_ptr = FindInlineCall (&statement -> left, &search);
+            }
+
+            if (!call_ptr)
+            {
+                is_inlined |=
+                    InlineInChain (&statement -> right -> left,  context);
+                is_inlined |=
+                    InlineInChain (&statement -> right -> right, context);
+
+                link = &node -> right;
+                continue;
+            }
+        }
+
+        else
+        {
+            call_ptr = FindInlineCall (&node -> left, &search);
+        }
+
+        if (!call_ptr)
+        {
+            link = &node -> right;
+            continue;
+        }
+
+        link = ExpandCall (link, call_ptr, context);
+        is_inlined = true;
+    }
+
+    free (is_read);
+
+    return is_inlined;
+}
+
+/*
+ * Walks the statement in the order the code is evaluated in.
+ */
+static BinTree_node**
+FindInlineCall (BinTree_node** const node_ptr,
+                call_search*   const search)
+{
+    assert (node_ptr);
+    assert (search);
+
+    BinTree_node* const node = *node_ptr;
+    if (!node) return nullptr;
+
+    BinTree_node** call_ptr = nullptr;
+
+    switch (node -> data .data_type)
+    {
+        case BIN_OP:
+        {
+            if (node -> data .bin_op_code != ASSUME_BEGIN)
+            {
+                call_ptr = FindInlineCall (&node -> left, search);
+                if (call_ptr) return call_ptr;
+            }
+
+            return FindInlineCall (&node -> right, search);
+        }
+
+        case UN_OP:
+        {
+            if (node -> data .un_op_code == IN) return nullptr;
+
+            return FindInlineCall (&node -> right, search);
+        }
+
+        case PUNCTUATION:
+        {
+            call_ptr = FindInlineCall (&node -> left, search);
+            if (call_ptr) return call_ptr;
+
+            return FindInlineCall (&node -> right, search);
+        }
+
+        case FUNCTION:
+        {
+            const bool is_call_seen = search -> is_call_seen;
+
+            const var_index_type n_vars = search -> context -> n_vars;
+
+            /* the arguments are searched with what this call writes added */
+            bool* const enclosing_clobbered = search -> is_clobbered;
+
+            search -> is_clobbered = (bool*) calloc (n_vars + 1, sizeof (bool));
+            if (!search -> is_clobbered)
+            {
+                perror ("is_clobbered allocation error");
+                search -> is_clobbered = enclosing_clobbered;
+                search -> is_call_seen = true;
+
+                return nullptr;
+            }
+
+            if (enclosing_clobbered)
+                memcpy (search -> is_clobbered, enclosing_clobbered,
+                        (n_vars + 1) * sizeof (bool));
+
+            MarkCallClobbers (node -> data .func_index,
+                              search -> is_clobbered, search -> context);
+
+            call_ptr = FindInlineCall (&node -> right, search);
+
+            free (search -> is_clobbered);
+            search -> is_clobbered = enclosing_clobbered;
+
+            if (call_ptr) return call_ptr;
+
+            if (!is_call_seen && !ContainsCall (node -> right) &&
+                IsInlinable (node, node != search -> statement,
+                             search -> is_read, search -> context) &&
+                !HasSavedClobbered (node, search -> is_clobbered,
+                                    search -> context))
+            {
+                return node_ptr;
+            }
+
+            search -> is_call_seen = true;
+            return nullptr;
+        }
+
+        case VARIABLE:
+        {
+            if (node -> data .var_index < search -> context -> n_vars)
+                search -> is_read [node -> data .var_index] = true;
+
+            return nullptr;
+        }
+
+        case KEY_OP:   [[fallthrough]];
+        case NUMBER:   [[fallthrough]];
+        case NO_TYPE:  [[fallthrough]];
+
+        default:
+            return nullptr;
+    }
+}
+
+static bool
+IsInlinable (const BinTree_node*     const call,
+             const bool                    is_value_used,
+             const bool*             const is_read,
+                   optimize_context* const context)
+{
+    assert (call);
+    assert (is_read);
+    assert (context);
+
+    BinTree_node* const callee =
+        GetFunctionByIndex (context -> tree -> root,
+                            call -> data .func_index);
+
+    if (!callee || callee -> data .func_index == 0) return false;
+
+    if (CountListElems (GetFunctionFormals (callee)) !=
+        CountListElems (call -> right))
+    {
+        return false;
+    }
+
+    const BinTree_node* const body = *GetFunctionBodyLink (callee);
+
+    if (CountNodes (body) > context -> config -> inline_budget ||
+        ContainsCall (body))
+    {
+        return false;
+    }
+
+    bool has_ret = false;
+
+    for (const BinTree_node* node = body; node; node = node -> right)
+    {
+        const BinTree_node* const statement = node -> left;
+        if (!statement) continue;
+
+        if (statement -> data .data_type == KEY_OP) return false;
+
+        if (IsStatementOperation (statement, RET))
+        {
+            /* early returns would need jumps */
+            if (node -> right) return false;
+
+            has_ret = true;
+        }
+    }
+
+    return (has_ret || !is_value_used) &&
+           !HasReadClobbered (call, is_read, context);
+}
+
+/*
+ * True if the statement reads a variable before the call that the
+ * inlined body would already have overwritten. The arguments don't
+ * count, their variables are kept by the call.
+ */
+static bool
+HasReadClobbered (const BinTree_node*     const call,
+                  const bool*             const is_read,
+                        optimize_context* const context)
+{
+    assert (call);
+    assert (is_read);
+    assert (context);
+
+    const var_index_type n_vars = context -> n_vars;
+
+    bool* const is_assigned = (bool*) calloc (n_vars + 1, sizeof (bool));
+    bool* const is_saved    = (bool*) calloc (n_vars + 1, sizeof (bool));
+    if (!is_assigned || !is_saved)
+    {
+        perror ("clobber sets allocation error");
+        free (is_assigned);
+        free (is_saved);
+
+        return true;
+    }
+
+    MarkAssignedVariables  (call,          is_assigned, context);
+    MarkMentionedVariables (call -> right, is_saved,    n_vars);
+
+    bool is_clobbered = false;
+
+    for (var_index_type i = 0; i < n_vars && !is_clobbered; i++)
+    {
+        is_clobbered = is_read [i] && is_assigned [i] && !is_saved [i];
+    }
+
+    free (is_assigned);
+    free (is_saved);
+
+    return is_clobbered;
+}
+
+/*
+ * True if a call the arguments belong to writes a variable met in
+ * them. That call saves the variable and the expansion may drop it
+ * from the arguments, so the write would stay after the call.
+ */
+static bool
+HasSavedClobbered (const BinTree_node*     const call,
+                   const bool*             const is_clobbered,
+                         optimize_context* const context)
+{
+    assert (call);
+    assert (context);
+
+    if (!is_clobbered) return false;
+
+    const var_index_type n_vars = context -> n_vars;
+
+    bool* const is_saved = (bool*) calloc (n_vars + 1, sizeof (bool));
+    if (!is_saved)
+    {
+        perror ("is_saved allocation error");
+        return true;
+    }
+
+    MarkMentionedVariables (call -> right, is_saved, n_vars);
+
+    bool is_dropped = false;
+
+    for (var_index_type i = 0; i < n_vars && !is_dropped; i++)
+    {
+        is_dropped = is_saved [i] && is_clobbered [i];
+    }
+
+    free (is_saved);
+
+    return is_dropped;
+}
+
+/*
+ * Returns the link to continue the chain walk from: the statement
+ * with the call if it is still there, the next one otherwise.
+ */
+static BinTree_node**
+ExpandCall (BinTree_node**    const link,
+            BinTree_node**    const call_ptr,
+            optimize_context* const context)
+{
+    assert (link);
+    assert (call_ptr);
+    assert (context);
+
+    BinTree*      const tree   = context -> tree;
+    BinTree_node* const node   = *link;
+    BinTree_node* const call   = *call_ptr;
+    BinTree_node* const callee = GetFunctionByIndex (tree -> root,
+                                                     call -> data .func_index);
+
+    const bool is_statement = call == node -> left;
+
+    const var_index_type rename_table_size = context -> n_vars;
+
+    var_index_type* const rename_table = (var_index_type*)
+        calloc (rename_table_size + 1, sizeof (var_index_type));
+    bool* const is_assigned = (bool*) calloc (rename_table_size + 1,
+                                              sizeof (bool));
+    bool* const is_saved    = (bool*) calloc (rename_table_size + 1,
+                                              sizeof (bool));
+    if (!rename_table || !is_assigned || !is_saved)
+    {
+        perror ("rename_table allocation error");
+        free (rename_table);
+        free (is_assigned);
+        free (is_saved);
+
+        return &node -> right;
+    }
+
+    MarkAssignedVariables  (call,          is_assigned, context);
+    MarkMentionedVariables (call -> right, is_saved,    rename_table_size);
+
+    BinTree_node*  new_chain = nullptr;
+    BinTree_node** tail_link = &new_chain;
+
+    /* saved variables the body writes live in copies during the body */
+    for (var_index_type i = 0; i < rename_table_size; i++)
+    {
+        rename_table [i] = i;
+
+        if (!is_saved [i] || !is_assigned [i]) continue;
+
+        rename_table [i] = AllocateVariable (context);
+
+        if (IsFormal (callee, i)) continue;
+
+        tail_link = AppendStatement (tail_link,
+                                     MakeAssume (rename_table [i],
+                                                 MakeVariable (i, tree),
+                                                 tree),
+                                     tree);
+    }
+
+    free (is_assigned);
+    free (is_saved);
+
+    /* formals are renamed copies or slots the arguments don't read */
+    BinTree_node* arg = call -> right;
+
+    for (BinTree_node* formal = GetFunctionFormals (callee);
+                       formal; formal = formal -> right, arg = arg -> right)
+    {
+        BinTree_node* const formal_var =
+            CopyRenamed (formal -> left, rename_table,
+                         rename_table_size, tree);
+
+        BinTree_node* const statement =
+            BinTree_CtorNode (BIN_OP, ASSUME_BEGIN, formal_var,
+                              arg -> left, nullptr, tree);
+        arg -> left = nullptr;
+
+        tail_link = AppendStatement (tail_link, statement, tree);
+    }
+
+    BinTree_node* ret_value = nullptr;
+
+    for (BinTree_node* body_node = *GetFunctionBodyLink (callee);
+                       body_node; body_node = body_node -> right)
+    {
+        if (!body_node -> left) continue;
+
+        if (IsStatementOperation (body_node -> left, RET))
+        {
+            ret_value = body_node -> left -> right;
+            break;
+        }
+
+        tail_link =
+            AppendStatement (tail_link,
+                             CopyRenamed (body_node -> left, rename_table,
+                                          rename_table_size, tree),
+                             tree);
+    }
+
+    BinTree_node** next_link = (tail_link == &new_chain) ? link : tail_link;
+
+    if (is_statement)
+    {
+        *tail_link = node -> right;
+        *link      = new_chain;
+
+        node -> right = nullptr;
+        BinTree_DestroySubtree (node, tree);
+    }
+
+    else
+    {
+        *call_ptr = CopyRenamed (ret_value, rename_table,
+                                 rename_table_size, tree);
+        BinTree_DestroySubtree (call, tree);
+
+        *tail_link = node;
+        *link      = new_chain;
+    }
+
+    free (rename_table);
+
+    return next_link;
+}
+
+static bool
+IsFormal (      BinTree_node*   const callee,
+          const var_index_type        var_index)
+{
+    for (const BinTree_node* formal = GetFunctionFormals (callee);
+                             formal; formal = formal -> right)
+    {
+        if (formal -> left -> data .var_index == var_index)
+            return true;
+    }
+
+    return false;
+}
+
+static BinTree_node*
+CopyRenamed (      BinTree_node*   const node,
+             const var_index_type* const rename_table,
+             const var_index_type        rename_table_size,
+                   BinTree*        const tree)
+{
+    assert (tree);
+
+    BinTree_node* const copy = CopyNode (node, nullptr, tree);
+
+    RenameVariables (copy, rename_table, rename_table_size);
+
+    return copy;
+}
+
+static void
+RenameVariables (      BinTree_node*   const node,
+                 const var_index_type* const rename_table,
+                 const var_index_type        rename_table_size)
+{
+    assert (rename_table);
+
+    if (!node) return;
+
+    if (node -> data .data_type == VARIABLE)
+    {
+        const var_index_type var_index = node -> data .var_index;
+        assert (var_index < rename_table_size);
+
+        node -> data .var_index = rename_table [var_index];
+    }
+
+    RenameVariables (node -> left,  rename_table, rename_table_size);
+    RenameVariables (node -> right, rename_table, rename_table_size);
+}
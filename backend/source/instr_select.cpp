@@ -0,0 +1,389 @@
+#include "instr_select.h"
+#include "print_asm.h"
+#include "num_io.h"
+
+#define NODE(opcode, n_kids)            {opcode, ANY_OP_CODE, n_kids, NT_NONE}
+#define NODE_OP(opcode, op_code, n_kids) {opcode, op_code, n_kids, NT_NONE}
+#define VALUE                           {0, ANY_OP_CODE, 0, NT_VALUE}
+
+/*
+ * The rules of the stack processor. A rule of one node is the plain
+ * code of the instruction, so that every tree has a tiling, the
+ * larger ones are what the processor does cheaper at once.
+ *
+ * Conditional jumps compare the two values on top the way the
+ * operations do, below the top against the top, and take them off.
+ * An equality branch jumps to the else block itself; an ordered one
+ * jumps to the then block and falls to the else one, so that it goes
+ * to the else block for a NaN just as the comparison would.
+ */
+static const asm_rule STACK_RULES [] =
+    {
+     /* values */
+     {NT_VALUE, {NODE (IR_CONST,  0)},                1, "PUSH $n"},
+     {NT_VALUE, {NODE (IR_LOAD,   0)},                1, "PUSH [$s]"},
+     {NT_VALUE, {NODE (IR_UNARY,  1), VALUE},         1, "$o"},
+     {NT_VALUE, {NODE (IR_BINARY, 2), VALUE, VALUE},  1, "$o"},
+     {NT_VALUE, {NODE (IR_INPUT,  0)},                1, "IN"},
+     {NT_VALUE, {NODE (IR_RESULT, 0)},                1, "PUSH rax"},
+
+     /* statements, versions of slots live in the slots and cost nothing */
+     {NT_STMT,  {NODE (IR_ENTRY,   0)},               0, ""},
+     {NT_STMT,  {NODE (IR_PHI,     0)},               0, ""},
+     {NT_STMT,  {NODE (IR_PARAM,   0)},               1, "POP [$s]"},
+     {NT_STMT,  {NODE (IR_STORE,   1), VALUE},        1, "POP [$s]"},
+     {NT_STMT,  {NODE (IR_OUTPUT,  1), VALUE},        1, "$o"},
+     {NT_STMT,  {NODE (IR_SAVE,    0)},               1, "PUSH [$s]"},
+     {NT_STMT,  {NODE (IR_CALL,    ALL_VALUES)},      1, "call $f"},
+     {NT_STMT,  {NODE (IR_RESTORE, 0)},               1, "POP [$s]"},
+     {NT_STMT,  {NODE (IR_JUMP,    0)},               1, "?jmp $t"},
+     {NT_STMT,  {NODE (IR_BRANCH,  1), VALUE},        3, "PUSH 0\nje $e\n?jmp $t"},
+     {NT_STMT,  {NODE (IR_RETURN,  1), VALUE},        2, "POP rax\nret"},
+     {NT_STMT,  {NODE (IR_EXIT,    0)},               1, "$x"},
+
+     /* a comparison that only decides a branch is the jump */
+     {NT_STMT,  {NODE (IR_BRANCH, 1), NODE_OP (IR_BINARY, IS_EQUAL,         2), VALUE, VALUE},
+                2, "jne $e\n?jmp $t"},
+     {NT_STMT,  {NODE (IR_BRANCH, 1), NODE_OP (IR_BINARY, NOT_EQUAL,        2), VALUE, VALUE},
+                2, "je $e\n?jmp $t"},
+     {NT_STMT,  {NODE (IR_BRANCH, 1), NODE_OP (IR_BINARY, GREATER,          2), VALUE, VALUE},
+                2, "ja $t\n?jmp $e"},
+     {NT_STMT,  {NODE (IR_BRANCH, 1), NODE_OP (IR_BINARY, LESS,             2), VALUE, VALUE},
+                2, "jb $t\n?jmp $e"},
+     {NT_STMT,  {NODE (IR_BRANCH, 1), NODE_OP (IR_BINARY, GREATER_OR_EQUAL, 2), VALUE, VALUE},
+                2, "jae $t\n?jmp $e"},
+     {NT_STMT,  {NODE (IR_BRANCH, 1), NODE_OP (IR_BINARY, LESS_OR_EQUAL,    2), VALUE, VALUE},
+                2, "jbe $t\n?jmp $e"},
+     {NT_STMT,  {NODE (IR_BRANCH, 1), NODE_OP (IR_UNARY,  NOT,              1), VALUE},
+                3, "PUSH 0\njne $e\n?jmp $t"},
+
+     /* the callee left the value in rax already */
+     {NT_STMT,  {NODE (IR_RETURN, 1), NODE (IR_RESULT, 0)},
+                1, "ret"},
+    };
+
+#undef NODE
+#undef NODE_OP
+#undef VALUE
+
+static const size_t N_STACK_RULES = sizeof (STACK_RULES) / sizeof (STACK_RULES [0]);
+
+static bool
+MatchNode       (const ir_module*        const module,
+                       asm_selection*    const selection,
+                 const asm_pattern_node* const pattern,
+                       size_t*           const position,
+                 const ir_id                   instr,
+                       size_t*           const cost,
+                 const bool                    is_covering,
+                 const bool                    is_inner);
+
+static void
+EmitLine        (const asm_context* const context,
+                 const ir_id              instr,
+                 const char*        const line,
+                 const size_t             line_len,
+                 const ir_id              next_block);
+
+static asm_nonterm
+GetNonterm      (const uint8_t opcode);
+
+bool
+AsmSelectionCtor (      asm_selection* const selection,
+                  const ir_function*   const func)
+{
+    assert (selection);
+    assert (func);
+
+    selection -> first_instr = func -> first_instr;
+    selection -> n_instrs    = func -> n_instrs;
+
+    selection -> rules      = (const asm_rule**) calloc (func -> n_instrs + 1, sizeof (asm_rule*));
+    selection -> costs      = (size_t*)          calloc (func -> n_instrs + 1, sizeof (size_t));
+    selection -> is_covered = (bool*)            calloc (func -> n_instrs + 1, sizeof (bool));
+
+    if (!selection -> rules || !selection -> costs || !selection -> is_covered)
+    {
+        perror ("instruction selection allocation error");
+        AsmSelectionDtor (selection);
+        return false;
+    }
+
+    return true;
+}
+
+void
+AsmSelectionDtor (asm_selection* const selection)
+{
+    assert (selection);
+
+    free (selection -> rules);
+    free (selection -> costs);
+    free (selection -> is_covered);
+
+    selection -> rules      = nullptr;
+    selection -> costs      = nullptr;
+    selection -> is_covered = nullptr;
+}
+
+/*
+ * Operands go before their users, so one pass up the instructions
+ * labels each with its cheapest rule given the costs of the subtrees
+ * under the rule's leaves, and one pass down marks the instructions
+ * inside the tiles the roots picked.
+ */
+bool
+SelectInstructions (const ir_module*     const module,
+                    const ir_function*   const func,
+                          asm_selection* const selection)
+{
+    assert (module);
+    assert (func);
+    assert (selection);
+
+    const ir_id first_instr = func -> first_instr;
+    const ir_id end_instr   = first_instr + func -> n_instrs;
+
+    for (ir_id instr = first_instr; instr < end_instr; instr++)
+    {
+        const ir_id index = instr - first_instr;
+
+        selection -> costs      [index] = NO_COST;
+        selection -> rules      [index] = nullptr;
+        selection -> is_covered [index] = false;
+
+        for (size_t i = 0; i < N_STACK_RULES; i++)
+        {
+            const asm_rule* const rule = &STACK_RULES [i];
+
+            if (rule -> result != GetNonterm (module -> instrs [instr] .opcode))
+                continue;
+
+            size_t position = 0;
+            size_t cost     = rule -> cost;
+
+            if (MatchNode (module, selection, rule -> pattern, &position, instr,
+                           &cost, false, false) &&
+                cost < selection -> costs [index])
+            {
+                selection -> costs [index] = cost;
+                selection -> rules [index] = rule;
+            }
+        }
+
+        if (!selection -> rules [index])
+        {
+            fprintf (stderr, "func%zu: v%u: no rule matches\n",
+                     (size_t) func -> func_index, instr);
+            return false;
+        }
+    }
+
+    for (ir_id instr = end_instr; instr-- > first_instr; )
+    {
+        const ir_id index = instr - first_instr;
+
+        if (selection -> is_covered [index]) continue;
+
+        size_t position = 0;
+        size_t cost     = 0;
+
+        MatchNode (module, selection, selection -> rules [index] -> pattern,
+                   &position, instr, &cost, true, false);
+    }
+
+    return true;
+}
+
+void
+EmitInstr (const asm_context* const context,
+           const ir_id              instr,
+           const ir_id              next_block)
+{
+    assert (context);
+
+    const asm_selection* const selection = &context -> selection;
+
+    const ir_id index = instr - selection -> first_instr;
+    assert (index < selection -> n_instrs);
+
+    if (selection -> is_covered [index]) return;
+
+    for (const char* line = selection -> rules [index] -> code; *line; )
+    {
+        const size_t line_len = strcspn (line, "\n");
+
+        EmitLine (context, instr, line, line_len, next_block);
+
+        line += line_len;
+        if (*line == '\n') line++;
+    }
+}
+
+/*
+ * Matches the pattern from position on against the subtree of the
+ * instruction and adds the costs of the leaves. Covering marks the
+ * inner nodes under the root of a match known to succeed.
+ */
+static bool
+MatchNode (const ir_module*        const module,
+                 asm_selection*    const selection,
+           const asm_pattern_node* const pattern,
+                 size_t*           const position,
+           const ir_id                   instr,
+                 size_t*           const cost,
+           const bool                    is_covering,
+           const bool                    is_inner)
+{
+    assert (module);
+    assert (selection);
+    assert (pattern);
+    assert (position);
+    assert (cost);
+    assert (*position < MAX_PATTERN_LEN);
+
+    const asm_pattern_node* const node      = &pattern [(*position)++];
+    const ir_instr*         const instr_ptr = &module -> instrs [instr];
+    const ir_id                   index     = instr - selection -> first_instr;
+
+    if (node -> leaf != NT_NONE)
+    {
+        if (node -> leaf != GetNonterm (instr_ptr -> opcode) ||
+            selection -> costs [index] == NO_COST)
+        {
+            return false;
+        }
+
+        *cost += selection -> costs [index];
+        return true;
+    }
+
+    if (node -> opcode != instr_ptr -> opcode ||
+       (node -> op_code != ANY_OP_CODE && node -> op_code != instr_ptr -> op_code))
+    {
+        return false;
+    }
+
+    if (is_covering && is_inner)
+        selection -> is_covered [index] = true;
+
+    /* versions, saves and calls are operands, but not on the stack */
+    size_t n_kids = 0;
+
+    for (size_t i = 0; i < instr_ptr -> n_operands; i++)
+    {
+        const ir_id operand = IrGetOperand (module, instr, i);
+
+        if (!IrHasValue (module -> instrs [operand] .opcode)) continue;
+
+        assert (operand < instr);
+        n_kids++;
+
+        if (node -> n_kids == ALL_VALUES)
+        {
+            *cost += selection -> costs [operand - selection -> first_instr];
+            continue;
+        }
+
+        if ((int) n_kids > node -> n_kids ||
+            !MatchNode (module, selection, pattern, position, operand,
+                        cost, is_covering, true))
+        {
+            return false;
+        }
+    }
+
+    return node -> n_kids == ALL_VALUES || (int) n_kids == node -> n_kids;
+}
+
+static void
+EmitLine (const asm_context* const context,
+          const ir_id              instr,
+          const char*        const line,
+          const size_t             line_len,
+          const ir_id              next_block)
+{
+    assert (context);
+    assert (line);
+
+    const ir_module*   const module    = context -> module;
+    const ir_function* const func      = context -> func;
+          FILE*        const stream    = context -> stream;
+    const ir_instr*    const instr_ptr = &module -> instrs [instr];
+    const ir_block*    const block_ptr = &module -> blocks [instr_ptr -> block];
+
+    size_t start = 0;
+
+    if (line [0] == '?')
+    {
+        const char* const label = (const char*) memchr (line, '$', line_len);
+        assert (label && (label [1] == 't' || label [1] == 'e'));
+
+        const ir_id target = block_ptr -> succs [label [1] == 't' ? 0 : 1];
+
+        if (target == next_block) return;
+
+        start = 1;
+    }
+
+    fprintf (stream, "\t\t");
+
+    for (size_t i = start; i < line_len; i++)
+    {
+        if (line [i] != '$')
+        {
+            fputc (line [i], stream);
+            continue;
+        }
+
+        switch (line [++i])
+        {
+            case 'n':
+            {
+                char number_str [DOUBLE_OUTPUT_MAX_LEN] = "";
+
+                FormatDouble (instr_ptr -> number, number_str);
+                fputs (number_str, stream);
+                break;
+            }
+
+            case 's':
+                fprintf (stream, "%u", instr_ptr -> slot);
+                break;
+
+            case 'f':
+                fprintf (stream, FUNC_NAME, (size_t) instr_ptr -> func);
+                break;
+
+            case 'o':
+                fprintf (stream, "%s", GetAsmOperation (instr_ptr -> op_code));
+                break;
+
+            case 't':
+                fprintf (stream, BLOCK_NAME, (size_t) func -> func_index,
+                         (size_t) (block_ptr -> succs [0] - func -> first_block));
+                break;
+
+            case 'e':
+                fprintf (stream, BLOCK_NAME, (size_t) func -> func_index,
+                         (size_t) (block_ptr -> succs [1] - func -> first_block));
+                break;
+
+            case 'x':
+                fputs ((func -> func_index == 0) ? "hlt" : "ret", stream);
+                break;
+
+            default:
+                assert (0 && "unknown field in the code of a rule");
+                break;
+        }
+    }
+
+    fputc ('\n', stream);
+}
+
+static asm_nonterm
+GetNonterm (const uint8_t opcode)
+{
+    return IrHasValue (opcode) ? NT_VALUE : NT_STMT;
+}
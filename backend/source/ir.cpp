@@ -0,0 +1,457 @@
+#include "ir.h"
+#include "print_asm.h"
+#include "num_io.h"
+
+static bool
+ReserveArray    (      void**   const array,
+                       size_t*  const capacity,
+                 const size_t         n_elems,
+                 const size_t         elem_size);
+
+static void
+DumpFunction    (const ir_module*   const module,
+                 const ir_function* const func,
+                       FILE*        const stream);
+
+static void
+DumpInstr       (const ir_module* const module,
+                 const ir_id            instr,
+                       FILE*      const stream);
+
+static const char* const ir_opcode_names [] =
+    {
+     "entry", "param", "const", "load", "store", "unary", "binary",
+     "in", "out", "save", "call", "restore", "result", "phi",
+
+     "jump", "branch", "return", "exit"
+    };
+
+bool
+IrModuleCtor (ir_module* const module)
+{
+    assert (module);
+
+    *module = {};
+
+    return ReserveArray ((void**) &module -> instrs,
+                         &module -> instrs_capacity,
+                         IR_INIT_CAPACITY, sizeof (ir_instr))    &&
+           ReserveArray ((void**) &module -> operands,
+                         &module -> operands_capacity,
+                         IR_INIT_CAPACITY, sizeof (ir_id))       &&
+           ReserveArray ((void**) &module -> blocks,
+                         &module -> blocks_capacity,
+                         IR_INIT_CAPACITY, sizeof (ir_block))    &&
+           ReserveArray ((void**) &module -> funcs,
+                         &module -> funcs_capacity,
+                         IR_INIT_CAPACITY, sizeof (ir_function));
+}
+
+void
+IrModuleDtor (ir_module* const module)
+{
+    assert (module);
+
+    free (module -> instrs);
+    free (module -> operands);
+    free (module -> blocks);
+    free (module -> funcs);
+
+    *module = {};
+}
+
+/* grows the array twice, so that appending takes O(1) on average */
+static bool
+ReserveArray (      void**   const array,
+                    size_t*  const capacity,
+              const size_t         n_elems,
+              const size_t         elem_size)
+{
+    assert (array);
+    assert (capacity);
+
+    if (n_elems <= *capacity) return true;
+
+    size_t new_capacity = *capacity ? *capacity : IR_INIT_CAPACITY;
+
+    while (new_capacity < n_elems)
+        new_capacity *= 2;
+
+    /* ids are 32 bit and IR_NONE is none of them */
+    if (new_capacity > IR_NONE)
+        new_capacity = IR_NONE;
+
+    if (n_elems > new_capacity) return false;
+
+    void* const new_array = realloc (*array, new_capacity * elem_size);
+    if (!new_array)
+    {
+        perror ("ir array allocation error");
+        return false;
+    }
+
+    *array    = new_array;
+    *capacity = new_capacity;
+
+    return true;
+}
+
+ir_id
+IrAddInstr (      ir_module* const module,
+            const ir_opcode        opcode,
+            const ir_id            block,
+            const size_t           n_operands)
+{
+    assert (module);
+    assert (block < module -> n_blocks);
+    assert (n_operands <= UINT16_MAX);
+
+    if (!ReserveArray ((void**) &module -> instrs, &module -> instrs_capacity,
+                       (size_t) module -> n_instrs + 1, sizeof (ir_instr)) ||
+        !ReserveArray ((void**) &module -> operands,
+                       &module -> operands_capacity,
+                       (size_t) module -> n_operands + n_operands,
+                       sizeof (ir_id)))
+    {
+        return IR_NONE;
+    }
+
+    const ir_id instr = module -> n_instrs++;
+
+    module -> instrs [instr] = {.opcode     = (uint8_t)  opcode,
+                                .op_code    = OP_CODE_POISON,
+                                .n_operands = (uint16_t) n_operands,
+                                .block      = block,
+                                .next       = IR_NONE,
+                                .operands   = module -> n_operands,
+                                .number     = 0};
+
+    for (size_t i = 0; i < n_operands; i++)
+        module -> operands [module -> n_operands++] = IR_NONE;
+
+    ir_block* const block_ptr = &module -> blocks [block];
+
+    if (block_ptr -> last == IR_NONE)
+        block_ptr -> first = instr;
+    else
+        module -> instrs [block_ptr -> last] .next = instr;
+
+    block_ptr -> last = instr;
+
+    return instr;
+}
+
+ir_id
+IrAddPhi (      ir_module* const module,
+          const ir_id            block,
+          const size_t           n_operands)
+{
+    assert (module);
+
+    const ir_id old_last = module -> blocks [block] .last;
+
+    const ir_id phi = IrAddInstr (module, IR_PHI, block, n_operands);
+    if (phi == IR_NONE) return IR_NONE;
+
+    ir_block* const block_ptr = &module -> blocks [block];
+
+    if (old_last == IR_NONE) return phi;
+
+    module -> instrs [old_last] .next = IR_NONE;
+    block_ptr -> last                 = old_last;
+
+    module -> instrs [phi] .next = block_ptr -> first;
+    block_ptr -> first           = phi;
+
+    return phi;
+}
+
+ir_id
+IrAddBlock (ir_module* const module)
+{
+    assert (module);
+
+    if (!ReserveArray ((void**) &module -> blocks, &module -> blocks_capacity,
+                       (size_t) module -> n_blocks + 1, sizeof (ir_block)))
+    {
+        return IR_NONE;
+    }
+
+    const ir_id block = module -> n_blocks++;
+
+    module -> blocks [block] = {.first   = IR_NONE,
+                                .last    = IR_NONE,
+                                .preds   = {IR_NONE, IR_NONE},
+                                .succs   = {IR_NONE, IR_NONE},
+                                .n_preds = 0,
+                                .n_succs = 0};
+
+    return block;
+}
+
+ir_id
+IrAddFunction (      ir_module*     const module,
+               const var_index_type       func_index)
+{
+    assert (module);
+
+    if (!ReserveArray ((void**) &module -> funcs, &module -> funcs_capacity,
+                       (size_t) module -> n_funcs + 1, sizeof (ir_function)))
+    {
+        return IR_NONE;
+    }
+
+    const ir_id func = module -> n_funcs++;
+
+    module -> funcs [func] = {.func_index  = func_index,
+                              .first_block = module -> n_blocks,
+                              .n_blocks    = 0,
+                              .first_instr = module -> n_instrs,
+                              .n_instrs    = 0};
+
+    return func;
+}
+
+void
+IrAddEdge (      ir_module* const module,
+           const ir_id            from,
+           const ir_id            to)
+{
+    assert (module);
+
+    ir_block* const from_ptr = &module -> blocks [from];
+    ir_block* const to_ptr   = &module -> blocks [to];
+
+    assert (from_ptr -> n_succs < IR_MAX_SUCCS);
+    assert (to_ptr   -> n_preds < IR_MAX_PREDS);
+
+    from_ptr -> succs [from_ptr -> n_succs++] = to;
+    to_ptr   -> preds [to_ptr   -> n_preds++] = from;
+}
+
+bool
+IrIsTerminator (const uint8_t opcode)
+{
+    return opcode >= IR_JUMP;
+}
+
+bool
+IrHasValue (const uint8_t opcode)
+{
+    switch ((ir_opcode) opcode)
+    {
+        case IR_CONST:   [[fallthrough]];
+        case IR_LOAD:    [[fallthrough]];
+        case IR_UNARY:   [[fallthrough]];
+        case IR_BINARY:  [[fallthrough]];
+        case IR_INPUT:   [[fallthrough]];
+        case IR_RESULT:
+            return true;
+
+        case IR_ENTRY:   [[fallthrough]];
+        case IR_PARAM:   [[fallthrough]];
+        case IR_STORE:   [[fallthrough]];
+        case IR_OUTPUT:  [[fallthrough]];
+        case IR_SAVE:    [[fallthrough]];
+        case IR_CALL:    [[fallthrough]];
+        case IR_RESTORE: [[fallthrough]];
+        case IR_PHI:     [[fallthrough]];
+        case IR_JUMP:    [[fallthrough]];
+        case IR_BRANCH:  [[fallthrough]];
+        case IR_RETURN:  [[fallthrough]];
+        case IR_EXIT:    [[fallthrough]];
+
+        default:
+            return false;
+    }
+}
+
+bool
+IrHasVersion (const uint8_t opcode)
+{
+    switch ((ir_opcode) opcode)
+    {
+        case IR_ENTRY:   [[fallthrough]];
+        case IR_PARAM:   [[fallthrough]];
+        case IR_STORE:   [[fallthrough]];
+        case IR_CALL:    [[fallthrough]];
+        case IR_RESTORE: [[fallthrough]];
+        case IR_PHI:
+            return true;
+
+        case IR_CONST:   [[fallthrough]];
+        case IR_LOAD:    [[fallthrough]];
+        case IR_UNARY:   [[fallthrough]];
+        case IR_BINARY:  [[fallthrough]];
+        case IR_INPUT:   [[fallthrough]];
+        case IR_OUTPUT:  [[fallthrough]];
+        case IR_SAVE:    [[fallthrough]];
+        case IR_RESULT:  [[fallthrough]];
+        case IR_JUMP:    [[fallthrough]];
+        case IR_BRANCH:  [[fallthrough]];
+        case IR_RETURN:  [[fallthrough]];
+        case IR_EXIT:    [[fallthrough]];
+
+        default:
+            return false;
+    }
+}
+
+ir_id
+IrGetOperand (const ir_module* const module,
+              const ir_id            instr,
+              const size_t           index)
+{
+    assert (module);
+    assert (index < module -> instrs [instr] .n_operands);
+
+    return module -> operands [module -> instrs [instr] .operands + index];
+}
+
+void
+IrSetOperand (      ir_module* const module,
+              const ir_id            instr,
+              const size_t           index,
+              const ir_id            value)
+{
+    assert (module);
+    assert (index < module -> instrs [instr] .n_operands);
+
+    module -> operands [module -> instrs [instr] .operands + index] = value;
+}
+
+void
+DumpIrModule (const ir_module* const module,
+                    FILE*      const stream)
+{
+    assert (module);
+    assert (stream);
+
+    for (ir_id func = 0; func < module -> n_funcs; func++)
+        DumpFunction (module, &module -> funcs [func], stream);
+}
+
+static void
+DumpFunction (const ir_module*   const module,
+              const ir_function* const func,
+                    FILE*        const stream)
+{
+    assert (module);
+    assert (func);
+    assert (stream);
+
+    if (func -> func_index == 0)
+        fprintf (stream, "main:\n");
+    else
+        fprintf (stream, "func%zu:\n", func -> func_index);
+
+    for (ir_id block = func -> first_block;
+               block < func -> first_block + func -> n_blocks; block++)
+    {
+        const ir_block* const block_ptr = &module -> blocks [block];
+
+        fprintf (stream, "  block%u:", block);
+
+        if (block_ptr -> n_preds)
+        {
+            fprintf (stream, "%*s; preds", 20, "");
+
+            for (size_t i = 0; i < block_ptr -> n_preds; i++)
+                fprintf (stream, " block%u", block_ptr -> preds [i]);
+        }
+
+        fprintf (stream, "\n");
+
+        for (ir_id instr = block_ptr -> first; instr != IR_NONE;
+                   instr = module -> instrs [instr] .next)
+        {
+            DumpInstr (module, instr, stream);
+        }
+    }
+
+    fprintf (stream, "\n");
+}
+
+static void
+DumpInstr (const ir_module* const module,
+           const ir_id            instr,
+                 FILE*      const stream)
+{
+    assert (module);
+    assert (stream);
+
+    const ir_instr* const instr_ptr = &module -> instrs [instr];
+
+    fprintf (stream, "    ");
+
+    if (IrHasValue (instr_ptr -> opcode) || IrHasVersion (instr_ptr -> opcode))
+        fprintf (stream, "v%u = ", instr);
+
+    fprintf (stream, "%s", ir_opcode_names [instr_ptr -> opcode]);
+
+    switch ((ir_opcode) instr_ptr -> opcode)
+    {
+        case IR_CONST:
+        {
+            char number_str [DOUBLE_OUTPUT_MAX_LEN] = "";
+
+            FormatDouble (instr_ptr -> number, number_str);
+            fprintf (stream, " %s", number_str);
+            break;
+        }
+
+        case IR_UNARY:   [[fallthrough]];
+        case IR_BINARY:  [[fallthrough]];
+        case IR_OUTPUT:
+            fprintf (stream, " %s", GetAsmOperation (instr_ptr -> op_code));
+            break;
+
+        case IR_PARAM:   [[fallthrough]];
+        case IR_LOAD:    [[fallthrough]];
+        case IR_STORE:   [[fallthrough]];
+        case IR_SAVE:    [[fallthrough]];
+        case IR_RESTORE: [[fallthrough]];
+        case IR_PHI:
+            fprintf (stream, " [%u]", instr_ptr -> slot);
+            break;
+
+        case IR_CALL:
+            fprintf (stream, " func%u", instr_ptr -> func);
+            break;
+
+        case IR_ENTRY:   [[fallthrough]];
+        case IR_INPUT:   [[fallthrough]];
+        case IR_RESULT:  [[fallthrough]];
+        case IR_JUMP:    [[fallthrough]];
+        case IR_BRANCH:  [[fallthrough]];
+        case IR_RETURN:  [[fallthrough]];
+        case IR_EXIT:    [[fallthrough]];
+
+        default:
+            break;
+    }
+
+    for (size_t i = 0; i < instr_ptr -> n_operands; i++)
+    {
+        const ir_id operand = IrGetOperand (module, instr, i);
+
+        fprintf (stream, i ? ", " : " ");
+
+        if (operand == IR_NONE)
+            fprintf (stream, "none");
+        else
+            fprintf (stream, "v%u", operand);
+    }
+
+    const ir_block* const block_ptr = &module -> blocks [instr_ptr -> block];
+
+    if (IrIsTerminator (instr_ptr -> opcode))
+    {
+        for (size_t i = 0; i < block_ptr -> n_succs; i++)
+            fprintf (stream, i || instr_ptr -> n_operands ? ", block%u"
+                                                          : " block%u",
+                     block_ptr -> succs [i]);
+    }
+
+    fprintf (stream, "\n");
+}
@@ -0,0 +1,1104 @@
+#include "ir.h"
+#include "optimize.h"
+
+/*
+ * Lowering of the tree into the CFG, with SSA versions of the slots
+ * built on the way.
+ *
+ * The version every slot has at the current point is kept in an
+ * array, and every change of it goes to an undo log. A branch or a
+ * loop body is lowered, the slots it defined are collected from the
+ * log and the log is undone, so that the state before it comes back:
+ *
+ *     - after an if, a slot defined in a branch gets a phi of the
+ *       versions the two ends of the branches give it;
+ *
+ *     - after a loop body, a slot defined in it gets a phi in the
+ *       header, of the version before the loop and the one at the
+ *       end of the body. The body was lowered reading the version
+ *       before the loop, so these reads are pointed at the phi.
+ *
+ * Control flow is structured, so a join has two preds at most and
+ * the work is linear in the size of the tree, but for loops that
+ * scan their instructions once per level of nesting.
+ */
+
+struct slot_def
+{
+    uint32_t slot;
+    ir_id    version;
+};
+
+struct ir_builder
+{
+    ir_module*       module;
+    optimize_context context;       // to find what calls assign
+
+    ir_id*           versions;      // IR_NONE for the one at the entry
+    ir_id            entry;
+    ir_id            block;         // the one being filled, open
+
+    slot_def*        log;           // old versions of changed slots
+    size_t           n_log;
+    size_t           log_capacity;
+
+    slot_def*        defs;          // collected from the log
+    size_t           n_defs;
+    size_t           defs_capacity;
+
+    ir_id*           saves;         // of the calls being lowered
+    size_t           n_saves;
+    size_t           saves_capacity;
+
+    uint32_t*        stamps;        // marks slots in one collection
+    ir_id*           marked;        // what is known of a marked slot
+    uint32_t         stamp;
+
+    uint32_t**       clobbers;      // slots a call assigns, by callee
+    size_t*          n_clobbers;
+
+    bool             is_failed;
+};
+
+static bool
+BuilderCtor     (      ir_builder* const builder,
+                       ir_module*  const module,
+                 const BinTree*    const tree);
+
+static void
+BuilderDtor     (ir_builder* const builder);
+
+static void
+LowerFunction   (      ir_builder*   const builder,
+                 const BinTree_node* const func);
+
+static void
+LowerFormals    (      ir_builder*   const builder,
+                 const BinTree_node* const formals);
+
+static void
+LowerStatement  (      ir_builder*   const builder,
+                 const BinTree_node*       node);
+
+static void
+LowerIf         (      ir_builder*   const builder,
+                 const BinTree_node* const node);
+
+static void
+LowerWhile      (      ir_builder*   const builder,
+                 const BinTree_node* const node);
+
+static ir_id
+LowerValue      (      ir_builder*   const builder,
+                 const BinTree_node* const node);
+
+static ir_id
+LowerCall       (      ir_builder*   const builder,
+                 const BinTree_node* const node,
+                 const bool                is_operand);
+
+static void
+LowerSaves      (      ir_builder*   const builder,
+                 const BinTree_node* const node);
+
+static ir_id
+AddInstr        (      ir_builder* const builder,
+                 const ir_opcode         opcode,
+                 const size_t            n_operands);
+
+static ir_id
+AddBlock        (ir_builder* const builder);
+
+static void
+Terminate       (      ir_builder* const builder,
+                 const ir_opcode         opcode,
+                 const ir_id             operand);
+
+static ir_id
+GetVersion      (const ir_builder* const builder,
+                 const uint32_t          slot);
+
+static void
+DefineVersion   (      ir_builder* const builder,
+                 const uint32_t          slot,
+                 const ir_id             version);
+
+static size_t
+CollectDefs     (      ir_builder* const builder,
+                 const size_t            log_mark);
+
+static void
+UndoLog         (      ir_builder* const builder,
+                 const size_t            log_mark);
+
+static void
+MergeBranches   (      ir_builder* const builder,
+                 const size_t            then_defs,
+                 const size_t            n_then_defs,
+                 const size_t            n_else_defs);
+
+static void
+RenameLoopReads (      ir_builder* const builder,
+                 const ir_id             first_instr,
+                 const ir_id             end_instr);
+
+static bool
+GetClobbers     (      ir_builder*    const builder,
+                 const var_index_type       func_index);
+
+static bool
+PushElem        (      void**  const array,
+                       size_t* const n_elems,
+                       size_t* const capacity,
+                 const void*   const elem,
+                 const size_t        elem_size);
+
+bool
+BuildIrModule (      ir_module* const module,
+               const BinTree*   const tree,
+               const bool*      const is_skipped)
+{
+    assert (module);
+    assert (tree);
+
+    if (!tree -> root) return true;
+
+    ir_builder builder = {};
+
+    if (!BuilderCtor (&builder, module, tree))
+    {
+        BuilderDtor (&builder);
+        return false;
+    }
+
+    size_t position = 0;
+
+    for (const BinTree_node* func = tree -> root;
+                             func && !builder .is_failed; func = func -> right, position++)
+    {
+        if (is_skipped && is_skipped [position]) continue;
+
+        LowerFunction (&builder, func);
+    }
+
+    const bool is_built = !builder .is_failed;
+
+    BuilderDtor (&builder);
+
+    return is_built;
+}
+
+static bool
+BuilderCtor (      ir_builder* const builder,
+                   ir_module*  const module,
+             const BinTree*    const tree)
+{
+    assert (builder);
+    assert (module);
+    assert (tree);
+
+    /* the analyses the context is for only read the tree */
+    builder -> module  = module;
+    builder -> context = {.tree      = const_cast <BinTree*> (tree),
+                          .config    = nullptr,
+                          .n_vars    = 0,
+                          .n_funcs   = 0,
+                          .is_failed = false};
+
+    CountContextIndices (&builder -> context);
+
+    const var_index_type n_vars  = builder -> context .n_vars;
+    const var_index_type n_funcs = builder -> context .n_funcs;
+
+    if (n_vars >= IR_NONE)
+    {
+        fprintf (stderr, "Too many variables for the IR.\n");
+        return false;
+    }
+
+    module -> n_slots = (uint32_t) n_vars;
+
+    builder -> versions   = (ir_id*)     calloc (n_vars  + 1, sizeof (ir_id));
+    builder -> stamps     = (uint32_t*)  calloc (n_vars  + 1, sizeof (uint32_t));
+    builder -> marked     = (ir_id*)     calloc (n_vars  + 1, sizeof (ir_id));
+    builder -> clobbers   = (uint32_t**) calloc (n_funcs + 1, sizeof (uint32_t*));
+    builder -> n_clobbers = (size_t*)    calloc (n_funcs + 1, sizeof (size_t));
+
+    if (!builder -> versions || !builder -> stamps   || !builder -> marked ||
+        !builder -> clobbers || !builder -> n_clobbers)
+    {
+        perror ("ir builder allocation error");
+        return false;
+    }
+
+    for (var_index_type slot = 0; slot < n_vars; slot++)
+        builder -> versions [slot] = IR_NONE;
+
+    return true;
+}
+
+static void
+BuilderDtor (ir_builder* const builder)
+{
+    assert (builder);
+
+    if (builder -> clobbers)
+    {
+        for (var_index_type func = 0; func < builder -> context .n_funcs; func++)
+            free (builder -> clobbers [func]);
+    }
+
+    free (builder -> versions);
+    free (builder -> log);
+    free (builder -> defs);
+    free (builder -> saves);
+    free (builder -> stamps);
+    free (builder -> marked);
+    free (builder -> clobbers);
+    free (builder -> n_clobbers);
+}
+
+static void
+LowerFunction (      ir_builder*   const builder,
+               const BinTree_node* const func)
+{
+    assert (builder);
+    assert (func);
+
+    ir_module* const module = builder -> module;
+
+    const ir_id func_id = IrAddFunction (module, func -> data .func_index);
+    if (func_id == IR_NONE)
+    {
+        builder -> is_failed = true;
+        return;
+    }
+
+    builder -> block = AddBlock (builder);
+    if (builder -> is_failed) return;
+
+    builder -> entry = AddInstr (builder, IR_ENTRY, 0);
+
+    /* main has no formal args, its body hangs right on the node */
+    if (func -> data .func_index == 0)
+    {
+        LowerStatement (builder, func -> left);
+    }
+
+    else
+    {
+        LowerFormals   (builder, func -> left -> right);
+        LowerStatement (builder, func -> left -> left);
+    }
+
+    Terminate (builder, IR_EXIT, IR_NONE);
+
+    /* every slot is at its entry version again for the next one */
+    UndoLog (builder, 0);
+
+    ir_function* const func_ptr = &module -> funcs [func_id];
+
+    func_ptr -> n_blocks = module -> n_blocks - func_ptr -> first_block;
+    func_ptr -> n_instrs = module -> n_instrs - func_ptr -> first_instr;
+}
+
+/* the last formal is on top of the stack, it goes first */
+static void
+LowerFormals (      ir_builder*   const builder,
+              const BinTree_node* const formals)
+{
+    assert (builder);
+
+    if (!formals || builder -> is_failed) return;
+
+    LowerFormals (builder, formals -> right);
+
+    const ir_id param = AddInstr (builder, IR_PARAM, 0);
+    if (param == IR_NONE) return;
+
+    const uint32_t slot = (uint32_t) formals -> left -> data .var_index;
+
+    builder -> module -> instrs [param] .slot = slot;
+    DefineVersion (builder, slot, param);
+}
+
+static void
+LowerStatement (      ir_builder*   const builder,
+                const BinTree_node*       node)
+{
+    assert (builder);
+
+    /* chains can be long, they are walked without recursion */
+    while (node && node -> data .data_type == PUNCTUATION)
+    {
+        LowerStatement (builder, node -> left);
+        node = node -> right;
+    }
+
+    if (!node || builder -> is_failed) return;
+
+    ir_module* const module = builder -> module;
+
+    switch (node -> data .data_type)
+    {
+        case BIN_OP:
+        {
+            if (node -> data .bin_op_code != ASSUME_BEGIN)
+            {
+                LowerValue (builder, node);
+                break;
+            }
+
+            const ir_id value = LowerValue (builder, node -> right);
+            const ir_id store = AddInstr   (builder, IR_STORE, 1);
+            if (store == IR_NONE) break;
+
+            const uint32_t slot = (uint32_t) node -> left -> data .var_index;
+
+            module -> instrs [store] .slot = slot;
+            IrSetOperand  (module, store, 0, value);
+            DefineVersion (builder, slot, store);
+
+            break;
+        }
+
+        case UN_OP:
+        {
+            const op_code_type op_code = node -> data .un_op_code;
+
+            if (op_code == RET)
+            {
+                Terminate (builder, IR_RETURN,
+                           LowerValue (builder, node -> right));
+
+                /* what follows is unreachable, but lowered all the same */
+                builder -> block = AddBlock (builder);
+            }
+
+            else if (op_code == IN)
+            {
+                const ir_id input = AddInstr (builder, IR_INPUT, 0);
+                const ir_id store = AddInstr (builder, IR_STORE, 1);
+                if (store == IR_NONE) break;
+
+                const uint32_t slot =
+                    (uint32_t) node -> right -> data .var_index;
+
+                module -> instrs [store] .slot = slot;
+                IrSetOperand  (module, store, 0, input);
+                DefineVersion (builder, slot, store);
+            }
+
+            else if (op_code == OUT || op_code == OUT_S)
+            {
+                const ir_id value  = LowerValue (builder, node -> right);
+                const ir_id output = AddInstr   (builder, IR_OUTPUT, 1);
+                if (output == IR_NONE) break;
+
+                module -> instrs [output] .op_code = op_code;
+                IrSetOperand (module, output, 0, value);
+            }
+
+            else
+            {
+                LowerValue (builder, node);
+            }
+
+            break;
+        }
+
+        case KEY_OP:
+        {
+            if (node -> data .key_op_code == IF)
+                LowerIf    (builder, node);
+            else
+                LowerWhile (builder, node);
+
+            break;
+        }
+
+        case FUNCTION:
+        {
+            LowerCall (builder, node, false);
+            break;
+        }
+
+        case NUMBER:      [[fallthrough]];
+        case VARIABLE:
+        {
+            LowerValue (builder, node);
+            break;
+        }
+
+        case PUNCTUATION: [[fallthrough]];
+        case NO_TYPE:     [[fallthrough]];
+
+        default:
+        {
+            fprintf (stderr, "Can't generate code for a node of type %d.\n",
+                     node -> data .data_type);
+            builder -> is_failed = true;
+            break;
+        }
+    }
+}
+
+static void
+LowerIf (      ir_builder*   const builder,
+         const BinTree_node* const node)
+{
+    assert (builder);
+    assert (node);
+
+    ir_module* const module = builder -> module;
+
+    Terminate (builder, IR_BRANCH, LowerValue (builder, node -> left));
+
+    const ir_id  cond_block = builder -> block;
+    const size_t log_mark   = builder -> n_log;
+    const size_t then_defs  = builder -> n_defs;
+
+    builder -> block = AddBlock (builder);
+    if (builder -> is_failed) return;
+
+    IrAddEdge (module, cond_block, builder -> block);
+
+    LowerStatement (builder, node -> right -> left);
+
+    const ir_id  then_end    = builder -> block;
+    const size_t n_then_defs = CollectDefs (builder, log_mark);
+
+    ir_id  else_end    = IR_NONE;
+    size_t n_else_defs = 0;
+
+    if (node -> right -> right)
+    {
+        builder -> block = AddBlock (builder);
+        if (builder -> is_failed) return;
+
+        IrAddEdge (module, cond_block, builder -> block);
+
+        LowerStatement (builder, node -> right -> right);
+
+        else_end    = builder -> block;
+        n_else_defs = CollectDefs (builder, log_mark);
+    }
+
+    const ir_id join = AddBlock (builder);
+    if (builder -> is_failed) return;
+
+    /* the preds go in the order MergeBranches makes phis in */
+    builder -> block = then_end;
+    Terminate (builder, IR_JUMP, IR_NONE);
+    IrAddEdge (module, then_end, join);
+
+    if (else_end != IR_NONE)
+    {
+        builder -> block = else_end;
+        Terminate (builder, IR_JUMP, IR_NONE);
+        IrAddEdge (module, else_end, join);
+    }
+
+    else
+    {
+        IrAddEdge (module, cond_block, join);
+    }
+
+    builder -> block = join;
+
+    MergeBranches (builder, then_defs, n_then_defs, n_else_defs);
+
+    builder -> n_defs = then_defs;
+}
+
+/*
+ * The else part of a loop is printed after the jump back, where
+ * nothing ever gets, so it is not lowered at all.
+ */
+static void
+LowerWhile (      ir_builder*   const builder,
+            const BinTree_node* const node)
+{
+    assert (builder);
+    assert (node);
+
+    ir_module* const module = builder -> module;
+
+    const ir_id pre_block = builder -> block;
+    const ir_id header    = AddBlock (builder);
+    if (builder -> is_failed) return;
+
+    Terminate (builder, IR_JUMP, IR_NONE);
+    IrAddEdge (module, pre_block, header);
+
+    builder -> block = header;
+
+    const size_t log_mark    = builder -> n_log;
+    const size_t loop_defs   = builder -> n_defs;
+    const ir_id  first_instr = module -> n_instrs;
+
+    Terminate (builder, IR_BRANCH, LowerValue (builder, node -> left));
+
+    builder -> block = AddBlock (builder);
+    if (builder -> is_failed) return;
+
+    IrAddEdge (module, header, builder -> block);
+
+    LowerStatement (builder, node -> right -> left);
+
+    const ir_id body_end = builder -> block;
+
+    Terminate (builder, IR_JUMP, IR_NONE);
+    IrAddEdge (module, body_end, header);
+
+    const ir_id exit = AddBlock (builder);
+    if (builder -> is_failed) return;
+
+    IrAddEdge (module, header, exit);
+
+    const size_t n_loop_defs = CollectDefs (builder, log_mark);
+    const ir_id  end_instr   = module -> n_instrs;
+
+    builder -> stamp++;
+
+    for (size_t i = loop_defs; i < loop_defs + n_loop_defs; i++)
+    {
+        const slot_def def = builder -> defs [i];
+
+        const ir_id phi = IrAddPhi (module, header, 2);
+        if (phi == IR_NONE)
+        {
+            builder -> is_failed = true;
+            return;
+        }
+
+        module -> instrs [phi] .slot = def .slot;
+        IrSetOperand (module, phi, 0, GetVersion (builder, def .slot));
+        IrSetOperand (module, phi, 1, def .version);
+
+        builder -> stamps [def .slot] = builder -> stamp;
+        builder -> marked [def .slot] = phi;
+    }
+
+    RenameLoopReads (builder, first_instr, end_instr);
+
+    for (size_t i = loop_defs; i < loop_defs + n_loop_defs; i++)
+    {
+        const uint32_t slot = builder -> defs [i] .slot;
+
+        DefineVersion (builder, slot, builder -> marked [slot]);
+    }
+
+    builder -> n_defs = loop_defs;
+    builder -> block  = exit;
+}
+
+static ir_id
+LowerValue (      ir_builder*   const builder,
+            const BinTree_node* const node)
+{
+    assert (builder);
+
+    if (!node || builder -> is_failed) return IR_NONE;
+
+    ir_module* const module = builder -> module;
+
+    switch (node -> data .data_type)
+    {
+        case NUMBER:
+        {
+            const ir_id number = AddInstr (builder, IR_CONST, 0);
+
+            if (number != IR_NONE)
+                module -> instrs [number] .number = node -> data .num_value;
+
+            return number;
+        }
+
+        case VARIABLE:
+        {
+            const uint32_t slot = (uint32_t) node -> data .var_index;
+
+            const ir_id load = AddInstr (builder, IR_LOAD, 1);
+            if (load == IR_NONE) return IR_NONE;
+
+            module -> instrs [load] .slot = slot;
+            IrSetOperand (module, load, 0, GetVersion (builder, slot));
+
+            return load;
+        }
+
+        case FUNCTION:
+        {
+            return LowerCall (builder, node, true);
+        }
+
+        case BIN_OP:
+        {
+            if (node -> data .bin_op_code == ASSUME_BEGIN)
+                break;
+
+            const ir_id left  = LowerValue (builder, node -> left);
+            const ir_id right = LowerValue (builder, node -> right);
+
+            const ir_id binary = AddInstr (builder, IR_BINARY, 2);
+            if (binary == IR_NONE) return IR_NONE;
+
+            module -> instrs [binary] .op_code = node -> data .bin_op_code;
+            IrSetOperand (module, binary, 0, left);
+            IrSetOperand (module, binary, 1, right);
+
+            return binary;
+        }
+
+        case UN_OP:
+        {
+            if (node -> data .un_op_code != DIFF &&
+                node -> data .un_op_code >  NOT)
+            {
+                break;
+            }
+
+            const ir_id value = LowerValue (builder, node -> right);
+
+            const ir_id unary = AddInstr (builder, IR_UNARY, 1);
+            if (unary == IR_NONE) return IR_NONE;
+
+            module -> instrs [unary] .op_code = node -> data .un_op_code;
+            IrSetOperand (module, unary, 0, value);
+
+            return unary;
+        }
+
+        case PUNCTUATION: [[fallthrough]];
+        case KEY_OP:      [[fallthrough]];
+        case NO_TYPE:     [[fallthrough]];
+
+        default:
+            break;
+    }
+
+    fprintf (stderr, "Can't use a node of type %d as a value.\n",
+             node -> data .data_type);
+    builder -> is_failed = true;
+
+    return IR_NONE;
+}
+
+/*
+ * Every variable of the args is saved before them and restored
+ * after the call, the callee may assign the rest of what it can
+ * reach. Only a call used in an operation pushes what it returned.
+ */
+static ir_id
+LowerCall (      ir_builder*   const builder,
+           const BinTree_node* const node,
+           const bool                is_operand)
+{
+    assert (builder);
+    assert (node);
+
+    ir_module* const module = builder -> module;
+
+    const size_t first_save = builder -> n_saves;
+
+    LowerSaves (builder, node -> right);
+
+    size_t n_args = 0;
+
+    /* the args are lowered first, the call takes them from the saves */
+    for (const BinTree_node* arg = node -> right; arg; arg = arg -> right)
+    {
+        /* "Fellowship of the Ring" with nothing in it */
+        if (!arg -> left) continue;
+
+        n_args++;
+
+        const ir_id value = LowerValue (builder, arg -> left);
+
+        if (!PushElem ((void**) &builder -> saves, &builder -> n_saves,
+                       &builder -> saves_capacity, &value, sizeof (ir_id)))
+        {
+            builder -> is_failed = true;
+            return IR_NONE;
+        }
+    }
+
+    const ir_id call = AddInstr (builder, IR_CALL, n_args);
+
+    if (call == IR_NONE || builder -> n_saves < first_save + n_args ||
+        !GetClobbers (builder, node -> data .func_index))
+    {
+        builder -> is_failed = true;
+        return IR_NONE;
+    }
+
+    builder -> n_saves -= n_args;
+
+    module -> instrs [call] .func = (uint32_t) node -> data .func_index;
+
+    for (size_t i = 0; i < n_args; i++)
+        IrSetOperand (module, call, i, builder -> saves [builder -> n_saves + i]);
+
+    const var_index_type callee = node -> data .func_index;
+
+    for (size_t i = 0; i < builder -> n_clobbers [callee]; i++)
+        DefineVersion (builder, builder -> clobbers [callee][i], call);
+
+    while (builder -> n_saves > first_save)
+    {
+        const ir_id save    = builder -> saves [--builder -> n_saves];
+        const ir_id restore = AddInstr (builder, IR_RESTORE, 1);
+        if (restore == IR_NONE) return IR_NONE;
+
+        const uint32_t slot = module -> instrs [save] .slot;
+
+        module -> instrs [restore] .slot = slot;
+        IrSetOperand  (module, restore, 0, save);
+        DefineVersion (builder, slot, restore);
+    }
+
+    if (!is_operand) return call;
+
+    const ir_id result = AddInstr (builder, IR_RESULT, 1);
+    if (result == IR_NONE) return IR_NONE;
+
+    IrSetOperand (module, result, 0, call);
+
+    return result;
+}
+
+/* in the order the tree has them, nested calls included */
+static void
+LowerSaves (      ir_builder*   const builder,
+            const BinTree_node* const node)
+{
+    assert (builder);
+
+    if (!node || builder -> is_failed) return;
+
+    if (node -> data .data_type == VARIABLE)
+    {
+        const uint32_t slot = (uint32_t) node -> data .var_index;
+
+        const ir_id save = AddInstr (builder, IR_SAVE, 1);
+        if (save == IR_NONE) return;
+
+        builder -> module -> instrs [save] .slot = slot;
+        IrSetOperand (builder -> module, save, 0, GetVersion (builder, slot));
+
+        if (!PushElem ((void**) &builder -> saves, &builder -> n_saves,
+                       &builder -> saves_capacity, &save, sizeof (ir_id)))
+        {
+            builder -> is_failed = true;
+        }
+    }
+
+    LowerSaves (builder, node -> left);
+    LowerSaves (builder, node -> right);
+}
+
+static ir_id
+AddInstr (      ir_builder* const builder,
+          const ir_opcode         opcode,
+          const size_t            n_operands)
+{
+    assert (builder);
+
+    if (builder -> is_failed) return IR_NONE;
+
+    const ir_id instr = IrAddInstr (builder -> module, opcode,
+                                    builder -> block, n_operands);
+
+    if (instr == IR_NONE)
+        builder -> is_failed = true;
+
+    return instr;
+}
+
+static ir_id
+AddBlock (ir_builder* const builder)
+{
+    assert (builder);
+
+    if (builder -> is_failed) return IR_NONE;
+
+    const ir_id block = IrAddBlock (builder -> module);
+
+    if (block == IR_NONE)
+        builder -> is_failed = true;
+
+    return block;
+}
+
+static void
+Terminate (      ir_builder* const builder,
+           const ir_opcode         opcode,
+           const ir_id             operand)
+{
+    assert (builder);
+
+    const bool has_operand = opcode == IR_BRANCH ||
+                             (opcode == IR_RETURN && operand != IR_NONE);
+
+    const ir_id terminator = AddInstr (builder, opcode, has_operand);
+
+    if (terminator != IR_NONE && has_operand)
+        IrSetOperand (builder -> module, terminator, 0, operand);
+}
+
+static ir_id
+GetVersion (const ir_builder* const builder,
+            const uint32_t          slot)
+{
+    assert (builder);
+
+    const ir_id version = builder -> versions [slot];
+
+    return version == IR_NONE ? builder -> entry : version;
+}
+
+static void
+DefineVersion (      ir_builder* const builder,
+               const uint32_t          slot,
+               const ir_id             version)
+{
+    assert (builder);
+
+    const slot_def old_def = {.slot    = slot,
+                              .version = builder -> versions [slot]};
+
+    if (!PushElem ((void**) &builder -> log, &builder -> n_log,
+                   &builder -> log_capacity, &old_def, sizeof (slot_def)))
+    {
+        builder -> is_failed = true;
+        return;
+    }
+
+    builder -> versions [slot] = version;
+}
+
+/*
+ * Pushes the last version of every slot changed since the mark to
+ * defs, and brings back the versions at the mark. Returns how many
+ * slots were changed.
+ */
+static size_t
+CollectDefs (      ir_builder* const builder,
+             const size_t            log_mark)
+{
+    assert (builder);
+
+    builder -> stamp++;
+
+    size_t n_collected = 0;
+
+    for (size_t i = log_mark; i < builder -> n_log; i++)
+    {
+        const uint32_t slot = builder -> log [i] .slot;
+
+        if (builder -> stamps [slot] == builder -> stamp) continue;
+
+        builder -> stamps [slot] = builder -> stamp;
+
+        const slot_def def = {.slot    = slot,
+                              .version = builder -> versions [slot]};
+
+        if (!PushElem ((void**) &builder -> defs, &builder -> n_defs,
+                       &builder -> defs_capacity, &def, sizeof (slot_def)))
+        {
+            builder -> is_failed = true;
+            break;
+        }
+
+        n_collected++;
+    }
+
+    UndoLog (builder, log_mark);
+
+    return n_collected;
+}
+
+static void
+UndoLog (      ir_builder* const builder,
+         const size_t            log_mark)
+{
+    assert (builder);
+
+    while (builder -> n_log > log_mark)
+    {
+        const slot_def old_def = builder -> log [--builder -> n_log];
+
+        builder -> versions [old_def .slot] = old_def .version;
+    }
+}
+
+/*
+ * The then defs are followed by the else defs in defs, a slot
+ * missing in one of the branches has the version before the if.
+ */
+static void
+MergeBranches (      ir_builder* const builder,
+               const size_t            then_defs,
+               const size_t            n_then_defs,
+               const size_t            n_else_defs)
+{
+    assert (builder);
+
+    ir_module* const module = builder -> module;
+
+    const size_t else_defs = then_defs + n_then_defs;
+    const size_t end_defs  = else_defs + n_else_defs;
+
+    builder -> stamp++;
+
+    for (size_t i = else_defs; i < end_defs; i++)
+    {
+        builder -> stamps [builder -> defs [i] .slot] = builder -> stamp;
+        builder -> marked [builder -> defs [i] .slot] = builder -> defs [i] .version;
+    }
+
+    for (size_t i = then_defs; i < end_defs && !builder -> is_failed; i++)
+    {
+        const slot_def def     = builder -> defs [i];
+        const bool     is_then = i < else_defs;
+
+        /* an else def merged with a then one is done */
+        if (!is_then && builder -> stamps [def .slot] != builder -> stamp)
+            continue;
+
+        const bool  is_in_else = builder -> stamps [def .slot] == builder -> stamp;
+        const ir_id before     = GetVersion (builder, def .slot);
+
+        const ir_id then_version = is_then    ? def .version : before;
+        const ir_id else_version = is_in_else ? builder -> marked [def .slot]
+                                              : before;
+
+        builder -> stamps [def .slot] = 0;
+
+        const ir_id phi = AddInstr (builder, IR_PHI, 2);
+        if (phi == IR_NONE) return;
+
+        module -> instrs [phi] .slot = def .slot;
+        IrSetOperand  (module, phi, 0, then_version);
+        IrSetOperand  (module, phi, 1, else_version);
+        DefineVersion (builder, def .slot, phi);
+    }
+}
+
+/*
+ * Reads in the loop of a slot that got a header phi and still read
+ * the version before the loop are the reads of the phi. The slots
+ * are marked with the current stamp, with their phis.
+ */
+static void
+RenameLoopReads (      ir_builder* const builder,
+                 const ir_id             first_instr,
+                 const ir_id             end_instr)
+{
+    assert (builder);
+
+    ir_module* const module = builder -> module;
+
+    for (ir_id instr = first_instr; instr < end_instr; instr++)
+    {
+        const ir_instr* const instr_ptr = &module -> instrs [instr];
+
+        if (instr_ptr -> opcode != IR_LOAD && instr_ptr -> opcode != IR_SAVE &&
+            instr_ptr -> opcode != IR_PHI)
+        {
+            continue;
+        }
+
+        const uint32_t slot = instr_ptr -> slot;
+
+        if (builder -> stamps [slot] != builder -> stamp) continue;
+
+        const ir_id before = GetVersion (builder, slot);
+
+        for (size_t i = 0; i < instr_ptr -> n_operands; i++)
+        {
+            if (IrGetOperand (module, instr, i) == before)
+                IrSetOperand (module, instr, i, builder -> marked [slot]);
+        }
+    }
+}
+
+/* the slots a call of the function may assign, once per callee */
+static bool
+GetClobbers (      ir_builder*    const builder,
+             const var_index_type       func_index)
+{
+    assert (builder);
+
+    if (builder -> clobbers [func_index]) return true;
+
+    optimize_context* const context = &builder -> context;
+
+    bool* const assigned = (bool*) calloc (context -> n_vars + 1, sizeof (bool));
+    if (!assigned)
+    {
+        perror ("assigned allocation error");
+        return false;
+    }
+
+    MarkCallClobbers (func_index, assigned, context);
+
+    size_t n_assigned = 0;
+
+    for (var_index_type slot = 0; slot < context -> n_vars; slot++)
+        n_assigned += assigned [slot];
+
+    builder -> clobbers [func_index] =
+        (uint32_t*) calloc (n_assigned + 1, sizeof (uint32_t));
+    if (!builder -> clobbers [func_index])
+    {
+        perror ("clobbers allocation error");
+        free (assigned);
+        return false;
+    }
+
+    for (var_index_type slot = 0; slot < context -> n_vars; slot++)
+    {
+        if (assigned [slot])
+            builder -> clobbers [func_index][builder -> n_clobbers [func_index]++] =
+                (uint32_t) slot;
+    }
+
+    free (assigned);
+
+    return true;
+}
+
+static bool
+PushElem (      void**  const array,
+                size_t* const n_elems,
+                size_t* const capacity,
+          const void*   const elem,
+          const size_t        elem_size)
+{
+    assert (array);
+    assert (n_elems);
+    assert (capacity);
+    assert (elem);
+
+    if (*n_elems == *capacity)
+    {
+        const size_t new_capacity = *capacity ? 2 * *capacity : IR_INIT_CAPACITY;
+
+        void* const new_array = realloc (*array, new_capacity * elem_size);
+        if (!new_array)
+        {
+            perror ("ir builder allocation error");
+            return false;
+        }
+
+        *array    = new_array;
+        *capacity = new_capacity;
+    }
+
+    memcpy ((char*) *array + *n_elems * elem_size, elem, elem_size);
+    (*n_elems)++;
+
+    return true;
+}
@@ -0,0 +1,712 @@
+#include "ir.h"
+
+/*
+ * Checks of what the builder promises and code generation relies on:
+ *
+ *     - every block ends with its only terminator, phis go first and
+ *       have an operand per pred, preds and succs agree;
+ *
+ *     - operands are of the right kind: values, versions of the same
+ *       slot, the save of a restore, the call of a result;
+ *
+ *     - a definition dominates its uses, the use of a phi operand is
+ *       at the end of its pred. Unreachable blocks are not checked;
+ *
+ *     - the operands of an instruction are on top of the stack when
+ *       it runs, and a block leaves nothing on it.
+ */
+
+struct verify_state
+{
+    const ir_module*   module;
+    const ir_function* func;
+          FILE*        stream;
+
+    size_t  n_errors;
+
+    ir_id*  positions;      // in the block, by instruction - first_instr
+    ir_id*  idoms;          // by block - first_block, IR_NONE if unreachable
+    ir_id*  rpo;            // reachable blocks in reverse postorder
+    ir_id*  rpo_numbers;
+    ir_id   n_rpo;
+
+    ir_id*  dom_enter;      // preorder interval in the dominator tree
+    ir_id*  dom_exit;
+
+    ir_id*  stack;
+    size_t  stack_capacity;
+};
+
+static void
+VerifyFunction      (      verify_state* const state);
+
+static void
+VerifyBlock         (      verify_state* const state,
+                     const ir_id               block);
+
+static void
+VerifyOperands      (      verify_state* const state,
+                     const ir_id               instr);
+
+static void
+VerifyStack         (      verify_state* const state,
+                     const ir_id               block);
+
+static bool
+ComputeDominators   (      verify_state* const state);
+
+static bool
+NumberDomTree       (      verify_state* const state);
+
+static bool
+Dominates           (const verify_state* const state,
+                     const ir_id               def,
+                     const ir_id               use_block,
+                     const bool                is_at_end);
+
+static void
+ReportError         (      verify_state* const state,
+                     const ir_id               block,
+                     const ir_id               instr,
+                     const char*         const message);
+
+static size_t
+CountExpectedOperands (const ir_module* const module,
+                       const ir_id            instr);
+
+bool
+VerifyIrModule (const ir_module* const module,
+                      FILE*      const stream)
+{
+    assert (module);
+    assert (stream);
+
+    verify_state state = {.module = module,
+                          .stream = stream};
+
+    for (ir_id func = 0; func < module -> n_funcs; func++)
+    {
+        state .func = &module -> funcs [func];
+
+        VerifyFunction (&state);
+    }
+
+    free (state .stack);
+
+    return state .n_errors == 0;
+}
+
+static void
+VerifyFunction (verify_state* const state)
+{
+    assert (state);
+
+    const ir_function* const func = state -> func;
+
+    state -> positions   = (ir_id*) calloc (func -> n_instrs + 1, sizeof (ir_id));
+    state -> idoms       = (ir_id*) calloc (func -> n_blocks + 1, sizeof (ir_id));
+    state -> rpo         = (ir_id*) calloc (func -> n_blocks + 1, sizeof (ir_id));
+    state -> rpo_numbers = (ir_id*) calloc (func -> n_blocks + 1, sizeof (ir_id));
+    state -> dom_enter   = (ir_id*) calloc (func -> n_blocks + 1, sizeof (ir_id));
+    state -> dom_exit    = (ir_id*) calloc (func -> n_blocks + 1, sizeof (ir_id));
+
+    if (!state -> positions   || !state -> idoms     || !state -> rpo ||
+        !state -> rpo_numbers || !state -> dom_enter || !state -> dom_exit)
+    {
+        perror ("ir verifier allocation error");
+        state -> n_errors++;
+    }
+
+    else
+    {
+        const size_t n_errors = state -> n_errors;
+
+        for (ir_id block = func -> first_block;
+                   block < func -> first_block + func -> n_blocks; block++)
+        {
+            VerifyBlock (state, block);
+        }
+
+        /* dominance makes no sense on a broken graph */
+        if (n_errors == state -> n_errors && ComputeDominators (state) &&
+            NumberDomTree (state))
+        {
+            for (ir_id instr = func -> first_instr;
+                       instr < func -> first_instr + func -> n_instrs; instr++)
+            {
+                VerifyOperands (state, instr);
+            }
+
+            for (ir_id block = func -> first_block;
+                       block < func -> first_block + func -> n_blocks; block++)
+            {
+                VerifyStack (state, block);
+            }
+        }
+    }
+
+    free (state -> positions);
+    free (state -> idoms);
+    free (state -> rpo);
+    free (state -> rpo_numbers);
+    free (state -> dom_enter);
+    free (state -> dom_exit);
+}
+
+static void
+VerifyBlock (      verify_state* const state,
+             const ir_id               block)
+{
+    assert (state);
+
+    const ir_module*   const module = state -> module;
+    const ir_function* const func   = state -> func;
+    const ir_block*    const bl     = &module -> blocks [block];
+
+    const ir_id first_block = func -> first_block;
+    const ir_id end_block   = first_block + func -> n_blocks;
+
+    if (bl -> first == IR_NONE)
+    {
+        ReportError (state, block, IR_NONE, "empty block");
+        return;
+    }
+
+    ir_id position  = 0;
+    bool  is_phi_ok = true;
+
+    for (ir_id instr = bl -> first; instr != IR_NONE;
+               instr = module -> instrs [instr] .next)
+    {
+        const ir_instr* const instr_ptr = &module -> instrs [instr];
+
+        if (instr < func -> first_instr ||
+            instr >= func -> first_instr + func -> n_instrs)
+        {
+            ReportError (state, block, instr, "instruction of another function");
+            return;
+        }
+
+        state -> positions [instr - func -> first_instr] = position++;
+
+        if (instr_ptr -> block != block)
+            ReportError (state, block, instr, "instruction names another block");
+
+        if (instr_ptr -> opcode == IR_PHI && !is_phi_ok)
+            ReportError (state, block, instr, "phi after other instructions");
+
+        is_phi_ok &= instr_ptr -> opcode == IR_PHI;
+
+        if (IrIsTerminator (instr_ptr -> opcode) != (instr == bl -> last))
+            ReportError (state, block, instr, "terminator not at the end");
+
+        if (instr_ptr -> n_operands != CountExpectedOperands (module, instr))
+            ReportError (state, block, instr, "wrong number of operands");
+    }
+
+    const uint8_t terminator = module -> instrs [bl -> last] .opcode;
+
+    const size_t n_succs = terminator == IR_JUMP   ? 1 :
+                           terminator == IR_BRANCH ? 2 : 0;
+
+    if (bl -> n_succs != n_succs)
+        ReportError (state, block, bl -> last, "wrong number of succs");
+
+    if (block == first_block && bl -> n_preds)
+        ReportError (state, block, IR_NONE, "entry has preds");
+
+    for (size_t i = 0; i < bl -> n_succs; i++)
+    {
+        const ir_id succ = bl -> succs [i];
+
+        if (succ < first_block || succ >= end_block)
+        {
+            ReportError (state, block, IR_NONE, "succ out of the function");
+            continue;
+        }
+
+        const ir_block* const succ_ptr = &module -> blocks [succ];
+
+        if (!(succ_ptr -> n_preds > 0 && succ_ptr -> preds [0] == block) &&
+            !(succ_ptr -> n_preds > 1 && succ_ptr -> preds [1] == block))
+        {
+            ReportError (state, block, IR_NONE, "succ doesn't list the block");
+        }
+    }
+
+    for (size_t i = 0; i < bl -> n_preds; i++)
+    {
+        const ir_id pred = bl -> preds [i];
+
+        if (pred < first_block || pred >= end_block)
+        {
+            ReportError (state, block, IR_NONE, "pred out of the function");
+            continue;
+        }
+
+        const ir_block* const pred_ptr = &module -> blocks [pred];
+
+        if (!(pred_ptr -> n_succs > 0 && pred_ptr -> succs [0] == block) &&
+            !(pred_ptr -> n_succs > 1 && pred_ptr -> succs [1] == block))
+        {
+            ReportError (state, block, IR_NONE, "pred doesn't list the block");
+        }
+    }
+}
+
+static size_t
+CountExpectedOperands (const ir_module* const module,
+                       const ir_id            instr)
+{
+    assert (module);
+
+    const ir_instr* const instr_ptr = &module -> instrs [instr];
+
+    switch ((ir_opcode) instr_ptr -> opcode)
+    {
+        case IR_ENTRY:   [[fallthrough]];
+        case IR_PARAM:   [[fallthrough]];
+        case IR_CONST:   [[fallthrough]];
+        case IR_INPUT:   [[fallthrough]];
+        case IR_JUMP:    [[fallthrough]];
+        case IR_EXIT:
+            return 0;
+
+        case IR_BINARY:
+            return 2;
+
+        case IR_PHI:
+            return module -> blocks [instr_ptr -> block] .n_preds;
+
+        /* the count of args is whatever the call has */
+        case IR_CALL:    [[fallthrough]];
+
+        /* a return may have no value */
+        case IR_RETURN:
+            return instr_ptr -> n_operands;
+
+        case IR_LOAD:    [[fallthrough]];
+        case IR_STORE:   [[fallthrough]];
+        case IR_UNARY:   [[fallthrough]];
+        case IR_OUTPUT:  [[fallthrough]];
+        case IR_SAVE:    [[fallthrough]];
+        case IR_RESTORE: [[fallthrough]];
+        case IR_RESULT:  [[fallthrough]];
+        case IR_BRANCH:  [[fallthrough]];
+
+        default:
+            return 1;
+    }
+}
+
+static void
+VerifyOperands (      verify_state* const state,
+                const ir_id               instr)
+{
+    assert (state);
+
+    const ir_module*   const module    = state -> module;
+    const ir_function* const func      = state -> func;
+    const ir_instr*    const instr_ptr = &module -> instrs [instr];
+
+    const ir_id block = instr_ptr -> block;
+
+    /* nothing runs there, nothing to check */
+    if (state -> idoms [block - func -> first_block] == IR_NONE)
+        return;
+
+    for (size_t i = 0; i < instr_ptr -> n_operands; i++)
+    {
+        const ir_id operand = IrGetOperand (module, instr, i);
+
+        if (operand < func -> first_instr ||
+            operand >= func -> first_instr + func -> n_instrs)
+        {
+            ReportError (state, block, instr, "operand out of the function");
+            continue;
+        }
+
+        const ir_instr* const def = &module -> instrs [operand];
+
+        switch ((ir_opcode) instr_ptr -> opcode)
+        {
+            case IR_LOAD:   [[fallthrough]];
+            case IR_SAVE:   [[fallthrough]];
+            case IR_PHI:
+            {
+                const bool is_many_slots = def -> opcode == IR_ENTRY ||
+                                           def -> opcode == IR_CALL;
+
+                if (!IrHasVersion (def -> opcode) ||
+                    (!is_many_slots && def -> slot != instr_ptr -> slot))
+                {
+                    ReportError (state, block, instr,
+                                 "operand is no version of the slot");
+                }
+
+                break;
+            }
+
+            case IR_RESTORE:
+            {
+                if (def -> opcode != IR_SAVE || def -> slot != instr_ptr -> slot)
+                    ReportError (state, block, instr, "operand is no save of the slot");
+                break;
+            }
+
+            case IR_RESULT:
+            {
+                if (def -> opcode != IR_CALL)
+                    ReportError (state, block, instr, "operand is no call");
+                break;
+            }
+
+            case IR_ENTRY:  [[fallthrough]];
+            case IR_PARAM:  [[fallthrough]];
+            case IR_CONST:  [[fallthrough]];
+            case IR_STORE:  [[fallthrough]];
+            case IR_UNARY:  [[fallthrough]];
+            case IR_BINARY: [[fallthrough]];
+            case IR_INPUT:  [[fallthrough]];
+            case IR_OUTPUT: [[fallthrough]];
+            case IR_CALL:   [[fallthrough]];
+            case IR_JUMP:   [[fallthrough]];
+            case IR_BRANCH: [[fallthrough]];
+            case IR_RETURN: [[fallthrough]];
+            case IR_EXIT:   [[fallthrough]];
+
+            default:
+            {
+                if (!IrHasValue (def -> opcode))
+                    ReportError (state, block, instr, "operand is no value");
+                break;
+            }
+        }
+
+        const bool  is_phi    = instr_ptr -> opcode == IR_PHI;
+        const ir_id use_block = is_phi ? module -> blocks [block] .preds [i]
+                                       : block;
+
+        if (!is_phi && def -> block == block)
+        {
+            if (state -> positions [operand - func -> first_instr] >=
+                state -> positions [instr   - func -> first_instr])
+            {
+                ReportError (state, block, instr, "operand defined after the use");
+            }
+        }
+
+        else if (!Dominates (state, operand, use_block, is_phi))
+        {
+            ReportError (state, block, instr, "operand doesn't dominate the use");
+        }
+    }
+}
+
+static void
+VerifyStack (      verify_state* const state,
+             const ir_id               block)
+{
+    assert (state);
+
+    const ir_module* const module = state -> module;
+
+    size_t n_stack = 0;
+
+    for (ir_id instr = module -> blocks [block] .first; instr != IR_NONE;
+               instr = module -> instrs [instr] .next)
+    {
+        const ir_instr* const instr_ptr = &module -> instrs [instr];
+
+        const bool is_on_stack = instr_ptr -> opcode != IR_LOAD   &&
+                                 instr_ptr -> opcode != IR_SAVE   &&
+                                 instr_ptr -> opcode != IR_PHI    &&
+                                 instr_ptr -> opcode != IR_RESULT;
+
+        for (size_t i = instr_ptr -> n_operands; is_on_stack && i > 0; i--)
+        {
+            if (n_stack == 0 ||
+                state -> stack [n_stack - 1] != IrGetOperand (module, instr, i - 1))
+            {
+                ReportError (state, block, instr, "operand is not on the stack top");
+                return;
+            }
+
+            n_stack--;
+        }
+
+        if (!IrHasValue (instr_ptr -> opcode) && instr_ptr -> opcode != IR_SAVE)
+            continue;
+
+        if (n_stack == state -> stack_capacity)
+        {
+            const size_t new_capacity = n_stack ? 2 * n_stack : IR_INIT_CAPACITY;
+
+            ir_id* const new_stack =
+                (ir_id*) realloc (state -> stack, new_capacity * sizeof (ir_id));
+            if (!new_stack)
+            {
+                perror ("ir verifier stack allocation error");
+                state -> n_errors++;
+                return;
+            }
+
+            state -> stack          = new_stack;
+            state -> stack_capacity = new_capacity;
+        }
+
+        state -> stack [n_stack++] = instr;
+    }
+
+    if (n_stack)
+        ReportError (state, block, state -> stack [n_stack - 1],
+                     "value left on the stack");
+}
+
+/*
+ * The iterative algorithm of Cooper, Harvey and Kennedy on the
+ * reverse postorder, converges in a couple of passes on structured
+ * code.
+ */
+static bool
+ComputeDominators (verify_state* const state)
+{
+    assert (state);
+
+    const ir_module*   const module = state -> module;
+    const ir_function* const func   = state -> func;
+
+    const ir_id first_block = func -> first_block;
+    const ir_id n_blocks    = func -> n_blocks;
+
+    /* postorder by a walk with an explicit stack of (block, next succ) */
+    ir_id*   const walk      = (ir_id*)   calloc (n_blocks + 1, sizeof (ir_id));
+    uint8_t* const next_succ = (uint8_t*) calloc (n_blocks + 1, sizeof (uint8_t));
+    bool*    const visited   = (bool*)    calloc (n_blocks + 1, sizeof (bool));
+
+    if (!walk || !next_succ || !visited)
+    {
+        perror ("ir verifier allocation error");
+        state -> n_errors++;
+        free (walk);
+        free (next_succ);
+        free (visited);
+        return false;
+    }
+
+    ir_id n_walk = 0;
+    ir_id n_post = 0;
+
+    walk [n_walk++]  = first_block;
+    visited [0]      = true;
+
+    while (n_walk)
+    {
+        const ir_id     block = walk [n_walk - 1];
+        const ir_block* bl    = &module -> blocks [block];
+
+        if (next_succ [block - first_block] < bl -> n_succs)
+        {
+            const ir_id succ = bl -> succs [next_succ [block - first_block]++];
+
+            if (!visited [succ - first_block])
+            {
+                visited [succ - first_block] = true;
+                walk [n_walk++] = succ;
+            }
+
+            continue;
+        }
+
+        /* postorder goes to the end of rpo, it is reversed below */
+        state -> rpo [n_blocks - 1 - n_post++] = block;
+        n_walk--;
+    }
+
+    state -> n_rpo = n_post;
+    memmove (state -> rpo, state -> rpo + n_blocks - n_post, n_post * sizeof (ir_id));
+
+    for (ir_id block = 0; block < n_blocks; block++)
+    {
+        state -> idoms       [block] = IR_NONE;
+        state -> rpo_numbers [block] = IR_NONE;
+    }
+
+    for (ir_id i = 0; i < n_post; i++)
+        state -> rpo_numbers [state -> rpo [i] - first_block] = i;
+
+    state -> idoms [0] = first_block;
+
+    bool is_changed = true;
+
+    while (is_changed)
+    {
+        is_changed = false;
+
+        for (ir_id i = 1; i < n_post; i++)
+        {
+            const ir_id           block = state -> rpo [i];
+            const ir_block* const bl    = &module -> blocks [block];
+
+            ir_id new_idom = IR_NONE;
+
+            for (size_t j = 0; j < bl -> n_preds; j++)
+            {
+                ir_id pred = bl -> preds [j];
+
+                if (state -> idoms [pred - first_block] == IR_NONE) continue;
+
+                if (new_idom == IR_NONE)
+                {
+                    new_idom = pred;
+                    continue;
+                }
+
+                /* the intersection walks up to the common dominator */
+                ir_id other = new_idom;
+
+                while (pred != other)
+                {
+                    while (state -> rpo_numbers [pred  - first_block] >
+                           state -> rpo_numbers [other - first_block])
+                        pred  = state -> idoms [pred  - first_block];
+
+                    while (state -> rpo_numbers [other - first_block] >
+                           state -> rpo_numbers [pred  - first_block])
+                        other = state -> idoms [other - first_block];
+                }
+
+                new_idom = pred;
+            }
+
+            if (state -> idoms [block - first_block] != new_idom)
+            {
+                state -> idoms [block - first_block] = new_idom;
+                is_changed = true;
+            }
+        }
+    }
+
+    free (walk);
+    free (next_succ);
+    free (visited);
+
+    return true;
+}
+
+/*
+ * Numbers the dominator tree in preorder, so that a block dominates
+ * another one if the interval of the other is in its interval.
+ */
+static bool
+NumberDomTree (verify_state* const state)
+{
+    assert (state);
+
+    const ir_id first_block = state -> func -> first_block;
+    const ir_id n_blocks    = state -> func -> n_blocks;
+
+    ir_id* const first_child  = (ir_id*) calloc (n_blocks + 1, sizeof (ir_id));
+    ir_id* const next_sibling = (ir_id*) calloc (n_blocks + 1, sizeof (ir_id));
+    ir_id* const walk         = (ir_id*) calloc (n_blocks + 1, sizeof (ir_id));
+
+    if (!first_child || !next_sibling || !walk)
+    {
+        perror ("ir verifier allocation error");
+        state -> n_errors++;
+        free (first_child);
+        free (next_sibling);
+        free (walk);
+        return false;
+    }
+
+    for (ir_id block = 0; block < n_blocks; block++)
+    {
+        first_child  [block] = IR_NONE;
+        next_sibling [block] = IR_NONE;
+    }
+
+    for (ir_id i = state -> n_rpo; i > 1; i--)
+    {
+        const ir_id block = state -> rpo [i - 1] - first_block;
+        const ir_id idom  = state -> idoms [block] - first_block;
+
+        next_sibling [block] = first_child [idom];
+        first_child  [idom]  = block;
+    }
+
+    ir_id n_walk  = 0;
+    ir_id counter = 0;
+
+    walk [n_walk++] = 0;
+    state -> dom_enter [0] = counter++;
+
+    /* first_child is used up as the next child to enter */
+    while (n_walk)
+    {
+        const ir_id block = walk [n_walk - 1];
+        const ir_id child = first_child [block];
+
+        if (child != IR_NONE)
+        {
+            first_child [block] = next_sibling [child];
+
+            state -> dom_enter [child] = counter++;
+            walk [n_walk++] = child;
+
+            continue;
+        }
+
+        state -> dom_exit [block] = counter++;
+        n_walk--;
+    }
+
+    free (first_child);
+    free (next_sibling);
+    free (walk);
+
+    return true;
+}
+
+/* a def in an unreachable block dominates nothing reachable */
+static bool
+Dominates (const verify_state* const state,
+           const ir_id               def,
+           const ir_id               use_block,
+           const bool                is_at_end)
+{
+    assert (state);
+
+    const ir_id first_block = state -> func -> first_block;
+
+    const ir_id def_block = state -> module -> instrs [def] .block - first_block;
+    const ir_id use       = use_block - first_block;
+
+    /* a phi operand is used where its pred ends, whatever is there */
+    if (is_at_end && state -> idoms [use] == IR_NONE) return true;
+
+    if (state -> idoms [def_block] == IR_NONE) return false;
+
+    return state -> dom_enter [def_block] <= state -> dom_enter [use] &&
+           state -> dom_exit  [use]       <= state -> dom_exit  [def_block];
+}
+
+static void
+ReportError (      verify_state* const state,
+             const ir_id               block,
+             const ir_id               instr,
+             const char*         const message)
+{
+    assert (state);
+    assert (message);
+
+    state -> n_errors++;
+
+    fprintf (state -> stream, "ir: func%zu: block%u: ",
+             state -> func -> func_index, block);
+
+    if (instr != IR_NONE)
+        fprintf (state -> stream, "v%u: ", instr);
+
+    fprintf (state -> stream, "%s\n", message);
+}
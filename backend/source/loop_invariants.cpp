@@ -0,0 +1,234 @@
+#include "optimize.h"
+
+/*
+ * An expression is invariant in a loop if it reads only variables
+ * that neither the loop nor the functions it calls assign. Such
+ * expressions are computed once into a fresh slot in front of the
+ * loop, equal ones share the slot.
+ *
+ * Call arguments are never touched: the variables met in them are
+ * the ones saved and restored around the call.
+ */
+
+struct loop_info
+{
+    const bool*           assigned;
+          var_index_type  n_assigned;
+
+          BinTree_node*   hoisted;          // chain of assignments
+          BinTree_node**  hoisted_tail;
+};
+
+static bool
+HoistFromChain  (BinTree_node**    const chain_link,
+                 optimize_context* const context);
+
+static BinTree_node**
+HoistFromLoop   (BinTree_node**    const link,
+                 optimize_context* const context);
+
+static bool
+HoistFromNode   (BinTree_node**    const node_ptr,
+                 loop_info*        const loop,
+                 optimize_context* const context);
+
+static bool
+IsInvariant     (const BinTree_node* const node,
+                 const loop_info*    const loop);
+
+static void
+HoistExpression (BinTree_node**    const node_ptr,
+                 loop_info*        const loop,
+                 optimize_context* const context);
+
+bool
+HoistLoopInvariants (optimize_context* const context)
+{
+    assert (context);
+
+    bool is_hoisted = false;
+
+    for (BinTree_node* func = context -> tree -> root;
+                       func; func = func -> right)
+    {
+        is_hoisted |= HoistFromChain (GetFunctionBodyLink (func), context);
+    }
+
+    return is_hoisted;
+}
+
+/*
+ * Outer loops go first, so that an expression invariant in both
+ * loops leaves the whole nest at once.
+ */
+static bool
+HoistFromChain (BinTree_node**    const chain_link,
+                optimize_context* const context)
+{
+    assert (chain_link);
+    assert (context);
+
+    bool is_hoisted = false;
+
+    for (BinTree_node** link = chain_link; *link; link = &(*link) -> right)
+    {
+        BinTree_node* statement = (*link) -> left;
+
+        if (!statement || statement -> data .data_type != KEY_OP)
+            continue;
+
+        if (statement -> data .key_op_code == WHILE)
+        {
+            BinTree_node** const loop_link = HoistFromLoop (link, context);
+
+            is_hoisted |= loop_link != link;
+            link = loop_link;
+        }
+
+        is_hoisted |= HoistFromChain (&statement -> right -> left,  context);
+        is_hoisted |= HoistFromChain (&statement -> right -> right, context);
+    }
+
+    return is_hoisted;
+}
+
+/*
+ * Returns the link that points to the loop after the hoisted
+ * assignments are spliced in front of it.
+ */
+static BinTree_node**
+HoistFromLoop (BinTree_node**    const link,
+               optimize_context* const context)
+{
+    assert (link);
+    assert (context);
+
+    BinTree_node* const node      = *link;
+    BinTree_node* const statement = node -> left;
+
+    bool* const assigned = (bool*) calloc (context -> n_vars + 1,
+                                           sizeof (bool));
+    if (!assigned)
+    {
+        perror ("assigned allocation error");
+        return link;
+    }
+
+    MarkAssignedVariables (statement, assigned, context);
+
+    loop_info loop = {.assigned     = assigned,
+                      .n_assigned   = context -> n_vars,
+                      .hoisted      = nullptr,
+                      .hoisted_tail = nullptr};
+
+    loop .hoisted_tail = &loop .hoisted;
+
+    HoistFromNode (&statement -> left,  &loop, context);
+    HoistFromNode (&statement -> right, &loop, context);
+
+    free (assigned);
+
+    if (!loop .hoisted) return link;
+
+    *loop .hoisted_tail = node;
+    *link               = loop .hoisted;
+
+    return loop .hoisted_tail;
+}
+
+static bool
+HoistFromNode (BinTree_node**    const node_ptr,
+               loop_info*        const loop,
+               optimize_context* const context)
+{
+    assert (node_ptr);
+    assert (loop);
+
+    BinTree_node* const node = *node_ptr;
+    if (!node || node -> data .data_type == FUNCTION) return false;
+
+    if (IsValueOperation (node) && IsInvariant (node, loop))
+    {
+        HoistExpression (node_ptr, loop, context);
+        return true;
+    }
+
+    bool is_hoisted = false;
+
+    /* the left child of an assignment is where it writes to */
+    if (!(node -> data .data_type   == BIN_OP &&
+          node -> data .bin_op_code == ASSUME_BEGIN))
+    {
+        is_hoisted |= HoistFromNode (&node -> left, loop, context);
+    }
+
+    is_hoisted |= HoistFromNode (&node -> right, loop, context);
+
+    return is_hoisted;
+}
+
+static bool
+IsInvariant (const BinTree_node* const node,
+             const loop_info*    const loop)
+{
+    assert (loop);
+
+    if (!node) return true;
+
+    switch (node -> data .data_type)
+    {
+        case NUMBER:
+            return true;
+
+        case VARIABLE:
+            return node -> data .var_index < loop -> n_assigned &&
+                   !loop -> assigned [node -> data .var_index];
+
+        case BIN_OP: [[fallthrough]];
+        case UN_OP:
+            return IsValueOperation (node)                  &&
+                   IsInvariant      (node -> left,  loop)   &&
+                   IsInvariant      (node -> right, loop);
+
+        case PUNCTUATION: [[fallthrough]];
+        case KEY_OP:      [[fallthrough]];
+        case FUNCTION:    [[fallthrough]];
+        case NO_TYPE:     [[fallthrough]];
+
+        default:
+            return false;
+    }
+}
+
+static void
+HoistExpression (BinTree_node**    const node_ptr,
+                 loop_info*        const loop,
+                 optimize_context* const context)
+{
+    assert (node_ptr);
+    assert (loop);
+    assert (context);
+
+    BinTree*      const tree       = context -> tree;
+    BinTree_node* const expression = *node_ptr;
+
+    for (const BinTree_node* hoisted = loop -> hoisted;
+                             hoisted; hoisted = hoisted -> right)
+    {
+        if (SubtreesEqual (hoisted -> left -> right, expression))
+        {
+            *node_ptr = CopyNode (hoisted -> left -> left, nullptr, tree);
+            BinTree_DestroySubtree (expression, tree);
+
+            return;
+        }
+    }
+
+    const var_index_type temp_index = AllocateVariable (context);
+
+    loop -> hoisted_tail =
+        AppendStatement (loop -> hoisted_tail,
+                         MakeAssume (temp_index, expression, tree), tree);
+
+    *node_ptr = MakeVariable (temp_index, tree);
+}
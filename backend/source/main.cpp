@@ -1,18 +1,205 @@
 #include "BinTree_make_image.h"
 #include "read_tree.h"
 #include "print_asm.h"
+#include "optimize.h"
+#include "thread_pool.h"
+#include "compile_cache.h"
+#include "incremental.h"
 
-int main (const int32_t /*argc*/, const char** argv)
+int main (const int32_t argc, const char** argv)
 {
+    optimize_config config = {};
+    InitOptimizeConfig (&config);
+
+    const char* input_file_name = nullptr;
+
+    bool is_ir_dumped   = false;
+    bool is_ir_verified = false;
+
+    /* the output doesn't depend on it */
+    size_t n_jobs = GetHardwareThreads ();
+
+    cache_config cache_config = {};
+    InitCacheConfig (&cache_config);
+
+    /* the options that change the asm are a part of the cache key */
+    const char** const key_options = (const char**) calloc ((size_t) argc, sizeof (char*));
+    size_t n_key_options = 0;
+
+    if (!key_options)
+    {
+        perror ("key_options allocation error");
+        return 1;
+    }
+
+    for (int32_t i = 1; i < argc; i++)
+    {
+        if (ParseOptimizeOption (argv [i], &config))
+        {
+            key_options [n_key_options++] = argv [i];
+            continue;
+        }
+
+        if (ParseCacheOption (argv [i], &cache_config)) continue;
+
+        if (strcmp (argv [i], "--dump-ir") == 0)
+        {
+            is_ir_dumped = true;
+            continue;
+        }
+
+        if (strcmp (argv [i], "--verify-ir") == 0)
+        {
+            is_ir_verified = true;
+            continue;
+        }
+
+        if (strncmp (argv [i], "--jobs=", strlen ("--jobs=")) == 0)
+        {
+            n_jobs = strtoul (argv [i] + strlen ("--jobs="), nullptr, 10);
+            continue;
+        }
+
+        if (argv [i][0] == '-')
+        {
+            fprintf (stderr, "Unknown option %s\n", argv [i]);
+            free (key_options);
+            return 1;
+        }
+
+        input_file_name = argv [i];
+    }
+
+    if (cache_config .is_stats_printed)
+    {
+        PrintCacheStats (&cache_config, stdout);
+        free (key_options);
+        return 0;
+    }
+
+    if (!input_file_name)
+    {
+        fprintf (stderr, "No input file with tree\n");
+        free (key_options);
+        return 1;
+    }
+
+    /* what goes to stderr is not kept, so these compile every time */
+    const bool is_cacheable = !is_ir_dumped && !is_ir_verified && !config .report_purity &&
+                              config .stats_format == PASS_STATS_NONE;
+
+    compile_cache cache = {};
+    bool is_cached = is_cacheable &&
+                     InitCompileCache (&cache, &cache_config, "backend", key_options,
+                                       n_key_options, input_file_name);
+
+    free (key_options);
+
+    if (is_cached && CacheLoad (&cache, stdout))
+        return 0;
+
     BinTree tree = {};
     BINTREE_CTOR (&tree);
 
-    ReadTreeFromFile (&tree, argv [1]);
+    ReadTreeFromFile (&tree, input_file_name);
+
+    pass_report report = {};
+    pass_report* const report_ptr =
+        (config .stats_format != PASS_STATS_NONE) ? &report : nullptr;
+
+    if (report_ptr && !PassReportCtor (report_ptr))
+    {
+        BINTREE_DTOR (&tree);
+        return 1;
+    }
+
+    if (!OptimizeTree (&tree, &config, report_ptr))
+    {
+        if (report_ptr) PassReportDtor (report_ptr);
+        BINTREE_DTOR (&tree);
+        return 1;
+    }
+
     BinTree_MakeTreeImage (&tree);
 
-    PrintTreeToAsm (&tree);
+    char*  asm_text = nullptr;
+    size_t asm_size = 0;
+
+    FILE* asm_stream = stdout;
+
+    if (is_cached && !(asm_stream = open_memstream (&asm_text, &asm_size)))
+    {
+        perror ("asm buffer open error");
+
+        asm_stream = stdout;
+        is_cached  = false;
+    }
+
+    /* only the functions that changed are lowered, nothing is reported then */
+    if (is_cached)
+    {
+        bool is_printed = PrintTreeToAsmIncremental (&tree, &cache_config, asm_stream, n_jobs);
+
+        /* sets the text and its size */
+        is_printed = (fclose (asm_stream) == 0) && is_printed;
+
+        if (is_printed)
+        {
+            fwrite (asm_text, sizeof (char), asm_size, stdout);
+            CacheStore (&cache, asm_text, asm_size);
+        }
+
+        free (asm_text);
+        BINTREE_DTOR (&tree);
+
+        return is_printed ? 0 : 1;
+    }
+
+    ir_module module = {};
+
+    const double lower_start = GetWallTime ();
+
+    if (!IrModuleCtor (&module) || !BuildIrModule (&module, &tree))
+    {
+        if (report_ptr) PassReportDtor (report_ptr);
+        IrModuleDtor (&module);
+        BINTREE_DTOR (&tree);
+        return 1;
+    }
+
+    /* the last row, the instructions the optimized tree turned into */
+    if (report_ptr)
+    {
+        const size_t n_nodes = report .n_stats ?
+                               report .stats [report .n_stats - 1] .nodes_after : 0;
+
+        const pass_stat lower_stat = {.name         = "lower-ir",
+                                      .seconds      = GetWallTime () - lower_start,
+                                      .nodes_before = n_nodes,
+                                      .nodes_after  = n_nodes,
+                                      .n_instrs     = module .n_instrs,
+                                      .is_changed   = true};
+
+        if (PassReportAdd (report_ptr, &lower_stat))
+            PrintPassReport (stderr, report_ptr, config .stats_format);
+
+        PassReportDtor (report_ptr);
+    }
+
+    if (is_ir_dumped)
+        DumpIrModule (&module, stderr);
+
+    if (is_ir_verified && !VerifyIrModule (&module, stderr))
+    {
+        IrModuleDtor (&module);
+        BINTREE_DTOR (&tree);
+        return 1;
+    }
+
+    const bool is_printed = PrintIrToAsm (&module, stdout, n_jobs);
 
+    IrModuleDtor (&module);
     BINTREE_DTOR (&tree);
 
-    return 0;
+    return is_printed ? 0 : 1;
 }
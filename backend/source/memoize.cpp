@@ -0,0 +1,472 @@
+#include "optimize.h"
+
+/*
+ * Memoization of pure functions. The processor has no indexed
+ * addressing, so the table is up to memo_size buckets of plain slots and
+ * a bucket is picked by a binary tree of ifs over a hash of the args:
+ *
+ *     h = sin (c1 * a1 + c2 * a2 + ...)
+ *
+ * sin of a well spread argument has the arcsine distribution, its
+ * quantiles -cos (pi * j / n_buckets) split it into equally likely
+ * buckets. A bucket keeps a valid flag, the args and the value.
+ *
+ * The body of a memoized function moves into a new function and the
+ * old one becomes a wrapper: look the bucket up and return its value,
+ * or call the body and store the value in the bucket. Recursive calls
+ * still go to the wrapper. main clears the valid flags first.
+ *
+ * Every bucket costs a lookup, a store, two ifs of the tree and a
+ * clear in main, so there are no more buckets than MAX_MEMO_NODES
+ * of this code pay for, and fewer the more args there are.
+ */
+
+const double MEMO_HASH_FACTORS [] = {12.9898, 78.233, 37.719, 45.164,
+                                     93.989,  67.345, 23.141, 51.727};
+
+/* nodes a bucket adds and the ones each arg adds to it, then the same for the hash and the call */
+static const size_t MEMO_BUCKET_NODES   = 31;
+static const size_t MEMO_ARG_NODES      = 8;
+static const size_t MEMO_CALL_NODES     = 12;
+static const size_t MEMO_CALL_ARG_NODES = 10;
+
+struct memo_table
+{
+    var_index_type  hash;
+    var_index_type  value;      // what the body returned
+    var_index_type* valid;      // per bucket
+    var_index_type* values;     // per bucket
+    var_index_type* keys;       // per bucket, n_args in a row
+
+    size_t          n_buckets;
+    size_t          n_args;
+    BinTree_node*   formals;
+};
+
+static bool
+IsMemoRequested     (const optimize_config* const config,
+                     const var_index_type         func_index,
+                     const bool                   is_recursive);
+
+static bool
+MemoizeFunction     (BinTree_node*     const func,
+                     optimize_context* const context);
+
+static BinTree_node*
+MakeHash            (const memo_table* const table,
+                           BinTree*    const tree);
+
+static BinTree_node**
+SelectBucket        (const memo_table*   const table,
+                     const size_t               first,
+                     const size_t               last,
+                     const bool                 is_lookup,
+                           BinTree_node** const tail_link,
+                           BinTree*       const tree);
+
+static BinTree_node**
+AppendLookup        (const memo_table*   const table,
+                     const size_t               bucket,
+                           BinTree_node** const tail_link,
+                           BinTree*       const tree);
+
+static BinTree_node**
+AppendStore         (const memo_table*   const table,
+                     const size_t               bucket,
+                           BinTree_node** const tail_link,
+                           BinTree*       const tree);
+
+static BinTree_node*
+MakeIf              (      BinTree_node* const condition,
+                           BinTree_node* const true_chain,
+                           BinTree_node* const false_chain,
+                           BinTree*      const tree);
+
+bool
+MemoizePureFunctions (optimize_context* const context)
+{
+    assert (context);
+
+    const optimize_config* const config  = context -> config;
+    const var_index_type         n_funcs = context -> n_funcs;
+
+    purity_verdict* const verdicts =
+        (purity_verdict*) calloc (n_funcs + 1, sizeof (purity_verdict));
+    bool* const is_recursive = (bool*) calloc (n_funcs + 1, sizeof (bool));
+
+    if (!verdicts || !is_recursive)
+    {
+        perror ("purity verdicts allocation error");
+        free (verdicts);
+        free (is_recursive);
+        return false;
+    }
+
+    if (!ClassifyFunctions (context, verdicts, is_recursive))
+    {
+        free (verdicts);
+        free (is_recursive);
+        return false;
+    }
+
+    if (config -> report_purity)
+        PrintPurityReport (stderr, verdicts, n_funcs);
+
+    bool is_changed = false;
+
+    /* wrappers get appended, only the original functions are visited */
+    for (var_index_type func_index = 1; func_index < n_funcs; func_index++)
+    {
+        if (!IsMemoRequested (config, func_index, is_recursive [func_index]))
+            continue;
+
+        if (verdicts [func_index] != PURE)
+        {
+            fprintf (stderr, "func%zu is not memoized: it is not pure\n",
+                     (size_t) func_index);
+            continue;
+        }
+
+        BinTree_node* const func =
+            GetFunctionByIndex (context -> tree -> root, func_index);
+
+        if (func && MemoizeFunction (func, context))
+            is_changed = true;
+    }
+
+    free (verdicts);
+    free (is_recursive);
+
+    return is_changed;
+}
+
+static bool
+IsMemoRequested (const optimize_config* const config,
+                 const var_index_type         func_index,
+                 const bool                   is_recursive)
+{
+    assert (config);
+
+    if (!config -> memoize_list)
+        return config -> memoize_recursive && is_recursive;
+
+    /* the list is like "1,4,5" */
+    const char* position = config -> memoize_list;
+
+    while (*position)
+    {
+        char* end = nullptr;
+        const size_t listed = strtoul (position, &end, 10);
+
+        if (end == position) break;
+        if (listed == func_index) return true;
+
+        position = (*end == ',') ? end + 1 : end;
+    }
+
+    return false;
+}
+
+static bool
+MemoizeFunction (BinTree_node*     const func,
+                 optimize_context* const context)
+{
+    assert (func);
+    assert (context);
+
+    BinTree* const tree = context -> tree;
+
+    const size_t n_args     = CountListElems (GetFunctionFormals (func));
+    const size_t call_nodes = MEMO_CALL_NODES + MEMO_CALL_ARG_NODES * n_args;
+
+    const size_t max_fit = (call_nodes < MAX_MEMO_NODES) ?
+                           (MAX_MEMO_NODES - call_nodes) /
+                           (MEMO_BUCKET_NODES + MEMO_ARG_NODES * n_args) : 0;
+    const size_t n_buckets  = (context -> config -> memo_size < max_fit) ?
+                              context -> config -> memo_size : max_fit;
+
+    if (n_buckets == 0)
+    {
+        fprintf (stderr, "func%zu is not memoized: its table takes more than %zu nodes\n",
+                 (size_t) func -> data .func_index, MAX_MEMO_NODES);
+        return false;
+    }
+
+    memo_table table = {.hash      = AllocateVariable (context),
+                        .value     = AllocateVariable (context),
+                        .valid     = nullptr,
+                        .values    = nullptr,
+                        .keys      = nullptr,
+                        .n_buckets = n_buckets,
+                        .n_args    = n_args,
+                        .formals   = GetFunctionFormals (func)};
+
+    table .valid  = (var_index_type*) calloc (table .n_buckets,
+                                              sizeof (var_index_type));
+    table .values = (var_index_type*) calloc (table .n_buckets,
+                                              sizeof (var_index_type));
+    table .keys   = (var_index_type*) calloc (table .n_buckets *
+                                              table .n_args + 1,
+                                              sizeof (var_index_type));
+
+    if (!table .valid || !table .values || !table .keys)
+    {
+        perror ("memo table allocation error");
+        free (table .valid);
+        free (table .values);
+        free (table .keys);
+        return false;
+    }
+
+    for (size_t bucket = 0; bucket < table .n_buckets; bucket++)
+    {
+        table .valid  [bucket] = AllocateVariable (context);
+        table .values [bucket] = AllocateVariable (context);
+
+        for (size_t arg = 0; arg < table .n_args; arg++)
+            table .keys [bucket * table .n_args + arg] =
+                AllocateVariable (context);
+    }
+
+    /* the body moves into a new function with the same formals */
+    BinTree_node** const body_link = GetFunctionBodyLink (func);
+
+    const var_index_type body_index = context -> n_funcs++;
+
+    BinTree_node* const body_func =
+        BinTree_CtorNode (FUNCTION, (double) body_index,
+                          BinTree_CtorNode (PUNCTUATION, END_OF_OPERATION,
+                                            *body_link,
+                                            CopyNode (table .formals,
+                                                      nullptr, tree),
+                                            nullptr, tree),
+                          nullptr, nullptr, tree);
+
+    BinTree_node* last_func = tree -> root;
+    while (last_func -> right) last_func = last_func -> right;
+
+    last_func -> right = body_func;
+
+    /* the call passes the formals on as they are */
+    BinTree_node*  args      = nullptr;
+    BinTree_node** args_tail = &args;
+
+    for (const BinTree_node* formal = table .formals; formal;
+                             formal = formal -> right)
+    {
+        args_tail = AppendStatement (args_tail,
+                                     CopyNode (formal -> left, nullptr, tree),
+                                     tree);
+    }
+
+    *body_link = nullptr;
+    BinTree_node** tail = body_link;
+
+    tail = AppendStatement (tail, MakeAssume (table .hash,
+                                              MakeHash (&table, tree), tree),
+                            tree);
+    tail = SelectBucket (&table, 0, table .n_buckets, true, tail, tree);
+    tail = AppendStatement (tail, MakeAssume (table .value,
+                                              BinTree_CtorNode (FUNCTION,
+                                                  (double) body_index,
+                                                  nullptr, args,
+                                                  nullptr, tree),
+                                              tree), tree);
+
+    /* the body may call the wrapper back and overwrite the hash */
+    tail = AppendStatement (tail, MakeAssume (table .hash,
+                                              MakeHash (&table, tree), tree),
+                            tree);
+    tail = SelectBucket (&table, 0, table .n_buckets, false, tail, tree);
+    tail = AppendStatement (tail, BinTree_CtorNode (UN_OP, RET, nullptr,
+                                                    MakeVariable (table .value,
+                                                                  tree),
+                                                    nullptr, tree), tree);
+
+    /* slots of the processor are not zeroed, clear the flags in main */
+    BinTree_node** const main_link = GetFunctionBodyLink (tree -> root);
+    BinTree_node*  const main_body = *main_link;
+
+    *main_link = nullptr;
+    tail       = main_link;
+
+    for (size_t bucket = 0; bucket < table .n_buckets; bucket++)
+    {
+        tail = AppendStatement (tail, MakeAssume (table .valid [bucket],
+                                                  MakeNumber (0, tree), tree),
+                                tree);
+    }
+
+    *tail = main_body;
+
+    free (table .valid);
+    free (table .values);
+    free (table .keys);
+
+    return true;
+}
+
+static BinTree_node*
+MakeHash (const memo_table* const table,
+                BinTree*    const tree)
+{
+    assert (table);
+    assert (tree);
+
+    BinTree_node* sum = MakeNumber (0, tree);
+    size_t        arg = 0;
+
+    const size_t n_factors = sizeof (MEMO_HASH_FACTORS) /
+                             sizeof (MEMO_HASH_FACTORS [0]);
+
+    for (const BinTree_node* formal = table -> formals; formal;
+                             formal = formal -> right, arg++)
+    {
+        BinTree_node* const term =
+            BinTree_CtorNode (BIN_OP, MUL,
+                              MakeNumber (MEMO_HASH_FACTORS [arg % n_factors],
+                                          tree),
+                              CopyNode (formal -> left, nullptr, tree),
+                              nullptr, tree);
+
+        sum = BinTree_CtorNode (BIN_OP, ADD, sum, term, nullptr, tree);
+    }
+
+    return BinTree_CtorNode (UN_OP, SIN, nullptr, sum, nullptr, tree);
+}
+
+/* appends statements choosing one of the buckets [first, last) */
+static BinTree_node**
+SelectBucket (const memo_table*   const table,
+              const size_t               first,
+              const size_t               last,
+              const bool                 is_lookup,
+                    BinTree_node** const tail_link,
+                    BinTree*       const tree)
+{
+    assert (table);
+    assert (tail_link);
+    assert (tree);
+    assert (first < last);
+
+    if (last - first == 1)
+    {
+        return is_lookup ? AppendLookup (table, first, tail_link, tree)
+                         : AppendStore  (table, first, tail_link, tree);
+    }
+
+    const size_t middle = first + (last - first) / 2;
+
+    const double threshold =
+        -cos (M_PI * (double) middle / (double) table -> n_buckets);
+
+    BinTree_node* const condition =
+        BinTree_CtorNode (BIN_OP, LESS, MakeVariable (table -> hash, tree),
+                          MakeNumber (threshold, tree), nullptr, tree);
+
+    BinTree_node* lower_chain = nullptr;
+    BinTree_node* upper_chain = nullptr;
+
+    SelectBucket (table, first,  middle, is_lookup, &lower_chain, tree);
+    SelectBucket (table, middle, last,   is_lookup, &upper_chain, tree);
+
+    return AppendStatement (tail_link,
+                            MakeIf (condition, lower_chain, upper_chain, tree),
+                            tree);
+}
+
+/* if (valid and key1 == a1 and ...) return value */
+static BinTree_node**
+AppendLookup (const memo_table*   const table,
+              const size_t               bucket,
+                    BinTree_node** const tail_link,
+                    BinTree*       const tree)
+{
+    assert (table);
+    assert (tail_link);
+    assert (tree);
+
+    BinTree_node* condition = MakeVariable (table -> valid [bucket], tree);
+    size_t        arg       = 0;
+
+    for (const BinTree_node* formal = table -> formals; formal;
+                             formal = formal -> right, arg++)
+    {
+        BinTree_node* const is_equal =
+            BinTree_CtorNode (BIN_OP, IS_EQUAL,
+                              MakeVariable (table -> keys [bucket *
+                                                           table -> n_args +
+                                                           arg], tree),
+                              CopyNode (formal -> left, nullptr, tree),
+                              nullptr, tree);
+
+        condition = BinTree_CtorNode (BIN_OP, MUL, condition, is_equal,
+                                      nullptr, tree);
+    }
+
+    BinTree_node* hit_chain = nullptr;
+
+    AppendStatement (&hit_chain,
+                     BinTree_CtorNode (UN_OP, RET, nullptr,
+                                       MakeVariable (table -> values [bucket],
+                                                     tree),
+                                       nullptr, tree),
+                     tree);
+
+    return AppendStatement (tail_link, MakeIf (condition, hit_chain,
+                                               nullptr, tree), tree);
+}
+
+/* valid = 1, key1 = a1, ..., value = what the body returned */
+static BinTree_node**
+AppendStore (const memo_table*   const table,
+             const size_t               bucket,
+                   BinTree_node** const tail_link,
+                   BinTree*       const tree)
+{
+    assert (table);
+    assert (tail_link);
+    assert (tree);
+
+    BinTree_node** tail = tail_link;
+
+    tail = AppendStatement (tail, MakeAssume (table -> valid [bucket],
+                                              MakeNumber (1, tree), tree),
+                            tree);
+
+    size_t arg = 0;
+
+    for (const BinTree_node* formal = table -> formals; formal;
+                             formal = formal -> right, arg++)
+    {
+        tail = AppendStatement (tail,
+                                MakeAssume (table -> keys [bucket *
+                                                           table -> n_args +
+                                                           arg],
+                                            CopyNode (formal -> left,
+                                                      nullptr, tree),
+                                            tree),
+                                tree);
+    }
+
+    return AppendStatement (tail, MakeAssume (table -> values [bucket],
+                                              MakeVariable (table -> value,
+                                                            tree),
+                                              tree), tree);
+}
+
+static BinTree_node*
+MakeIf (BinTree_node* const condition,
+        BinTree_node* const true_chain,
+        BinTree_node* const false_chain,
+        BinTree*      const tree)
+{
+    assert (condition);
+    assert (tree);
+
+    return BinTree_CtorNode (KEY_OP, IF, condition,
+                             BinTree_CtorNode (PUNCTUATION, END_OF_OPERATION,
+                                               true_chain, false_chain,
+                                               nullptr, tree),
+                             nullptr, tree);
+}
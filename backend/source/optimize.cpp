@@ -0,0 +1,583 @@
+#include "optimize.h"
+#include "num_io.h"
+
+static void
+CountIndices (const BinTree_node*    const node,
+                    optimize_context* const context);
+
+static void
+MarkAssigned (const BinTree_node*     const node,
+                    bool*             const assigned,
+                    bool*             const visited_funcs,
+                    optimize_context* const context);
+
+void
+InitOptimizeConfig (optimize_config* const config)
+{
+    assert (config);
+
+    config -> fold_constants   = false;
+    config -> inline_functions = false;
+    config -> hoist_invariants = false;
+    config -> fast_math        = false;
+
+    config -> eliminate_dead_code       = false;
+    config -> eliminate_common_subexprs = false;
+    config -> memoize_recursive         = false;
+    config -> report_purity             = false;
+    config -> partial_eval              = false;
+    config -> specialize_functions      = false;
+    config -> unroll_loops              = false;
+    config -> convert_ifs               = false;
+
+    config -> inline_budget    = DEFAULT_INLINE_BUDGET;
+    config -> memo_size        = DEFAULT_MEMO_SIZE;
+    config -> eval_budget      = DEFAULT_EVAL_BUDGET;
+    config -> clone_budget     = DEFAULT_CLONE_BUDGET;
+    config -> unroll_factor    = DEFAULT_UNROLL_FACTOR;
+    config -> unroll_limit     = DEFAULT_UNROLL_LIMIT;
+    config -> select_budget    = DEFAULT_SELECT_BUDGET;
+    config -> memoize_list     = nullptr;
+    config -> pass_list        = nullptr;
+
+    config -> stats_format     = PASS_STATS_NONE;
+    config -> verify_passes    = false;
+}
+
+bool
+ParseOptimizeOption (const char*      const option,
+                     optimize_config* const config)
+{
+    assert (option);
+    assert (config);
+
+    if (strcmp (option, "-ffold") == 0)
+    {
+        config -> fold_constants = true;
+    }
+
+    else if (strcmp (option, "-finline") == 0)
+    {
+        config -> inline_functions = true;
+    }
+
+    else if (strcmp (option, "-flicm") == 0)
+    {
+        config -> hoist_invariants = true;
+    }
+
+    else if (strcmp (option, "-ffast-math") == 0)
+    {
+        config -> fast_math = true;
+    }
+
+    else if (strcmp (option, "-fdce") == 0)
+    {
+        config -> eliminate_dead_code = true;
+    }
+
+    else if (strcmp (option, "-fcse") == 0)
+    {
+        config -> eliminate_common_subexprs = true;
+    }
+
+    else if (strcmp (option, "-fmemoize") == 0)
+    {
+        config -> memoize_recursive = true;
+    }
+
+    else if (strcmp (option, "--purity-report") == 0)
+    {
+        config -> report_purity = true;
+    }
+
+    else if (strcmp (option, "-fpartial-eval") == 0)
+    {
+        config -> partial_eval = true;
+    }
+
+    else if (strncmp (option, "--eval-budget=",
+                      strlen ("--eval-budget=")) == 0)
+    {
+        config -> eval_budget =
+            strtoul (option + strlen ("--eval-budget="), nullptr, 10);
+    }
+
+    else if (strcmp (option, "-fspecialize") == 0)
+    {
+        config -> specialize_functions = true;
+    }
+
+    else if (strncmp (option, "--clone-budget=",
+                      strlen ("--clone-budget=")) == 0)
+    {
+        config -> clone_budget =
+            strtoul (option + strlen ("--clone-budget="), nullptr, 10);
+    }
+
+    else if (strcmp (option, "-funroll") == 0)
+    {
+        config -> unroll_loops = true;
+    }
+
+    else if (strncmp (option, "--unroll-factor=",
+                      strlen ("--unroll-factor=")) == 0)
+    {
+        config -> unroll_factor =
+            strtoul (option + strlen ("--unroll-factor="), nullptr, 10);
+    }
+
+    else if (strncmp (option, "--unroll-limit=",
+                      strlen ("--unroll-limit=")) == 0)
+    {
+        config -> unroll_limit =
+            strtoul (option + strlen ("--unroll-limit="), nullptr, 10);
+    }
+
+    else if (strcmp (option, "-fif-convert") == 0)
+    {
+        config -> convert_ifs = true;
+    }
+
+    else if (strncmp (option, "--select-budget=",
+                      strlen ("--select-budget=")) == 0)
+    {
+        config -> select_budget =
+            strtoul (option + strlen ("--select-budget="), nullptr, 10);
+    }
+
+    else if (strncmp (option, "--memoize=", strlen ("--memoize=")) == 0)
+    {
+        config -> memoize_list = option + strlen ("--memoize=");
+    }
+
+    else if (strncmp (option, "--memo-size=", strlen ("--memo-size=")) == 0)
+    {
+        config -> memo_size =
+            strtoul (option + strlen ("--memo-size="), nullptr, 10);
+    }
+
+    else if (strncmp (option, "--inline-budget=",
+                      strlen ("--inline-budget=")) == 0)
+    {
+        config -> inline_budget =
+            strtoul (option + strlen ("--inline-budget="), nullptr, 10);
+    }
+
+    else
+    {
+        return ParsePassOption (option, config);
+    }
+
+    return true;
+}
+
+bool
+OptimizeTree (      BinTree*         const tree,
+              const optimize_config* const config,
+                    pass_report*     const report)
+{
+    if (!tree || !config)
+    {
+        fprintf (stderr, "Invalid pointer to tree or config.\n");
+        return false;
+    }
+
+    if (!tree -> root) return true;
+
+    optimize_context context = {.tree      = tree,
+                                .config    = config,
+                                .n_vars    = 0,
+                                .n_funcs   = 0,
+                                .is_failed = false};
+
+    CountContextIndices (&context);
+
+    const bool is_optimized = RunPassPipeline (&context, report);
+
+    SetParents (nullptr, tree -> root);
+
+    return is_optimized;
+}
+
+void
+CountContextIndices (optimize_context* const context)
+{
+    assert (context);
+    assert (context -> tree);
+
+    CountIndices (context -> tree -> root, context);
+}
+
+static void
+CountIndices (const BinTree_node*    const node,
+                    optimize_context* const context)
+{
+    assert (context);
+
+    if (!node) return;
+
+    if (node -> data .data_type == VARIABLE &&
+        node -> data .var_index >= context -> n_vars)
+    {
+        context -> n_vars = node -> data .var_index + 1;
+    }
+
+    else if (node -> data .data_type == FUNCTION &&
+             node -> data .func_index >= context -> n_funcs)
+    {
+        context -> n_funcs = node -> data .func_index + 1;
+    }
+
+    CountIndices (node -> left,  context);
+    CountIndices (node -> right, context);
+}
+
+BinTree_node*
+GetFunctionByIndex (      BinTree_node* const root,
+                    const var_index_type      func_index)
+{
+    for (BinTree_node* func = root; func; func = func -> right)
+    {
+        if (func -> data .func_index == func_index)
+            return func;
+    }
+
+    return nullptr;
+}
+
+BinTree_node**
+GetFunctionBodyLink (BinTree_node* const func)
+{
+    assert (func);
+
+    /* main has no formal args, so its body hangs right on the node */
+    if (func -> data .func_index == 0)
+        return &func -> left;
+
+    return &func -> left -> left;
+}
+
+BinTree_node*
+GetFunctionFormals (BinTree_node* const func)
+{
+    assert (func);
+
+    if (func -> data .func_index == 0)
+        return nullptr;
+
+    return func -> left -> right;
+}
+
+size_t
+CountNodes (const BinTree_node* const node)
+{
+    if (!node) return 0;
+
+    return 1 + CountNodes (node -> left) + CountNodes (node -> right);
+}
+
+size_t
+CountListElems (const BinTree_node* const list)
+{
+    size_t n_elems = 0;
+
+    for (const BinTree_node* elem = list; elem; elem = elem -> right)
+    {
+        n_elems++;
+    }
+
+    return n_elems;
+}
+
+bool
+ContainsCall (const BinTree_node* const node)
+{
+    if (!node) return false;
+
+    if (node -> data .data_type == FUNCTION)
+        return true;
+
+    return ContainsCall (node -> left) || ContainsCall (node -> right);
+}
+
+bool
+ChainReturns (const BinTree_node* const chain)
+{
+    for (const BinTree_node* elem = chain; elem; elem = elem -> right)
+    {
+        const BinTree_node* const statement = elem -> left;
+
+        if (IsStatementOperation (statement, RET))
+            return true;
+
+        if (!statement || statement -> data .data_type != KEY_OP)
+            continue;
+
+        if (statement -> data .key_op_code == IF &&
+            ChainReturns (statement -> right -> left) &&
+            ChainReturns (statement -> right -> right))
+        {
+            return true;
+        }
+
+        /* an endless loop never ends without a return */
+        if (statement -> data .key_op_code == WHILE &&
+            statement -> left -> data .data_type == NUMBER &&
+            !IsNumberNode (statement -> left, 0))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool
+IsStatementOperation (const BinTree_node* const node,
+                      const op_code_type        un_op_code)
+{
+    return node                                &&
+           node -> data .data_type  == UN_OP   &&
+           node -> data .un_op_code == un_op_code;
+}
+
+void
+MarkMentionedVariables (const BinTree_node*    const node,
+                              bool*            const is_mentioned,
+                        const var_index_type         n_vars)
+{
+    assert (is_mentioned);
+
+    if (!node) return;
+
+    if (node -> data .data_type == VARIABLE &&
+        node -> data .var_index < n_vars)
+    {
+        is_mentioned [node -> data .var_index] = true;
+    }
+
+    MarkMentionedVariables (node -> left,  is_mentioned, n_vars);
+    MarkMentionedVariables (node -> right, is_mentioned, n_vars);
+}
+
+var_index_type
+AllocateVariable (optimize_context* const context)
+{
+    assert (context);
+
+    return context -> n_vars++;
+}
+
+BinTree_node*
+MakeAssume (const var_index_type      var_index,
+                  BinTree_node* const expression,
+                  BinTree*      const tree)
+{
+    assert (tree);
+
+    return BinTree_CtorNode (BIN_OP, ASSUME_BEGIN,
+                             MakeVariable (var_index, tree),
+                             expression, nullptr, tree);
+}
+
+BinTree_node**
+AppendStatement (BinTree_node** const tail_link,
+                 BinTree_node*  const statement,
+                 BinTree*       const tree)
+{
+    assert (tail_link);
+    assert (tree);
+
+    *tail_link = BinTree_CtorNode (PUNCTUATION, END_OF_OPERATION,
+                                   statement, nullptr, nullptr, tree);
+
+    return &(*tail_link) -> right;
+}
+
+BinTree_node*
+MakeNumber (const double        value,
+                  BinTree* const tree)
+{
+    assert (tree);
+
+    return BinTree_CtorNode (NUMBER, value, nullptr,
+                             nullptr, nullptr, tree);
+}
+
+BinTree_node*
+MakeVariable (const var_index_type      var_index,
+                    BinTree*      const tree)
+{
+    assert (tree);
+
+    return BinTree_CtorNode (VARIABLE, (double) var_index, nullptr,
+                             nullptr, nullptr, tree);
+}
+
+bool
+IsValueOperation (const BinTree_node* const node)
+{
+    if (!node) return false;
+
+    if (node -> data .data_type == BIN_OP)
+        return node -> data .bin_op_code != ASSUME_BEGIN;
+
+    if (node -> data .data_type == UN_OP)
+        return node -> data .un_op_code <= NOT;
+
+    return false;
+}
+
+bool
+IsPrintedExactly (const double value)
+{
+    char number_str [DOUBLE_OUTPUT_MAX_LEN] = "";
+
+    FormatDouble (value, number_str);
+
+    double printed_value = 0;
+    ParseDouble (number_str, &printed_value);
+
+    return memcmp (&value, &printed_value, sizeof (double)) == 0;
+}
+
+bool
+IsNumberNode (const BinTree_node* const node,
+              const double              value)
+{
+    return node && node -> data .data_type == NUMBER &&
+           !(node -> data .num_value < value)        &&
+           !(node -> data .num_value > value);
+}
+
+bool
+SubtreesEqual (const BinTree_node* const left,
+               const BinTree_node* const right)
+{
+    if (!left || !right) return left == right;
+
+    if (left -> data .data_type != right -> data .data_type)
+        return false;
+
+    switch (left -> data .data_type)
+    {
+        case NUMBER:
+            if (memcmp (&left  -> data .num_value,
+                        &right -> data .num_value, sizeof (double)) != 0)
+                return false;
+            break;
+
+        case VARIABLE:
+            if (left -> data .var_index != right -> data .var_index)
+                return false;
+            break;
+
+        case FUNCTION:
+            if (left -> data .func_index != right -> data .func_index)
+                return false;
+            break;
+
+        case PUNCTUATION: [[fallthrough]];
+        case BIN_OP:      [[fallthrough]];
+        case UN_OP:       [[fallthrough]];
+        case KEY_OP:      [[fallthrough]];
+        case NO_TYPE:     [[fallthrough]];
+
+        default:
+            /* all op codes share the same union member */
+            if (left -> data .punct_op_code != right -> data .punct_op_code)
+                return false;
+            break;
+    }
+
+    return SubtreesEqual (left -> left,  right -> left) &&
+           SubtreesEqual (left -> right, right -> right);
+}
+
+void
+MarkAssignedVariables (const BinTree_node*     const node,
+                             bool*             const assigned,
+                             optimize_context* const context)
+{
+    assert (assigned);
+    assert (context);
+
+    bool* const visited_funcs =
+        (bool*) calloc (context -> n_funcs + 1, sizeof (bool));
+    if (!visited_funcs)
+    {
+        perror ("visited_funcs allocation error");
+        return;
+    }
+
+    MarkAssigned (node, assigned, visited_funcs, context);
+
+    free (visited_funcs);
+}
+
+void
+MarkCallClobbers (const var_index_type       func_index,
+                        bool*             const assigned,
+                        optimize_context* const context)
+{
+    assert (assigned);
+    assert (context);
+
+    BinTree_node* const callee = GetFunctionByIndex (context -> tree -> root, func_index);
+    if (!callee) return;
+
+    for (const BinTree_node* formal = GetFunctionFormals (callee);
+                             formal; formal = formal -> right)
+    {
+        assigned [formal -> left -> data .var_index] = true;
+    }
+
+    MarkAssignedVariables (*GetFunctionBodyLink (callee), assigned, context);
+}
+
+static void
+MarkAssigned (const BinTree_node*     const node,
+                    bool*             const assigned,
+                    bool*             const visited_funcs,
+                    optimize_context* const context)
+{
+    if (!node) return;
+
+    const bool is_assume = node -> data .data_type   == BIN_OP &&
+                           node -> data .bin_op_code == ASSUME_BEGIN;
+
+    if (is_assume || IsStatementOperation (node, IN))
+    {
+        const BinTree_node* const target = is_assume ? node -> left
+                                                     : node -> right;
+
+        if (target -> data .var_index < context -> n_vars)
+            assigned [target -> data .var_index] = true;
+    }
+
+    if (node -> data .data_type == FUNCTION && node -> data .func_index <
+        context -> n_funcs && !visited_funcs [node -> data .func_index])
+    {
+        visited_funcs [node -> data .func_index] = true;
+
+        BinTree_node* const callee =
+            GetFunctionByIndex (context -> tree -> root,
+                                node -> data .func_index);
+
+        if (callee)
+        {
+            for (const BinTree_node* formal = GetFunctionFormals (callee);
+                                     formal; formal = formal -> right)
+            {
+                assigned [formal -> left -> data .var_index] = true;
+            }
+
+            MarkAssigned (*GetFunctionBodyLink (callee), assigned,
+                          visited_funcs, context);
+        }
+    }
+
+    MarkAssigned (node -> left,  assigned, visited_funcs, context);
+    MarkAssigned (node -> right, assigned, visited_funcs, context);
+}
@@ -0,0 +1,810 @@
+#include "optimize.h"
+
+/*
+ * Partial evaluation: the tree is run the way the processor runs it,
+ * as long as nothing unknown is met.
+ *   - main is run from the start statement by statement until one
+ *     needs input, reads a slot nobody has set or runs out of steps;
+ *     the statements run are replaced by their outputs as literals
+ *     and assignments of the slots they left;
+ *   - calls of pure functions with literal args are replaced by
+ *     the values they return.
+ * One step budget serves the whole pass, a step is a node run.
+ */
+
+const size_t MAX_EVAL_DEPTH = 512;
+
+enum eval_result
+{
+    EVAL_NEXT   = 0,
+    EVAL_RETURN = 1,
+    EVAL_STUCK  = 2,
+};
+
+struct eval_state
+{
+    optimize_context* context;
+    BinTree_node**    funcs;        // by index, nullptr for holes
+    var_index_type    n_vars;
+
+    double*           slots;
+    bool*             is_set;
+    bool*             is_written;
+
+    double*           outputs;
+    size_t            n_outputs;
+    size_t            outputs_capacity;
+
+    double            rax;
+    bool              is_rax_set;
+
+    size_t            steps_left;
+    size_t            depth;
+};
+
+struct saved_slot
+{
+    var_index_type    var_index;
+    double            value;
+    bool              is_set;
+};
+
+struct eval_snapshot
+{
+    double*           slots;
+    bool*             is_set;
+    bool*             is_written;
+
+    size_t            n_outputs;
+    double            rax;
+    bool              is_rax_set;
+};
+
+static bool
+EvalStateCtor       (eval_state*       const state,
+                     optimize_context* const context);
+
+static void
+EvalStateDtor       (eval_state* const state);
+
+static void
+ForgetSlots         (eval_state* const state);
+
+static bool
+TakeSnapshot        (const eval_state*    const state,
+                           eval_snapshot* const snapshot);
+
+static void
+RestoreSnapshot     (      eval_state*    const state,
+                     const eval_snapshot* const snapshot);
+
+static bool
+IsStateExact        (const eval_state* const state,
+                     const size_t            first_output);
+
+static bool
+EvaluateMainPrefix  (eval_state* const state,
+                     const bool        is_rax_unused);
+
+static bool
+FoldPureCalls       (BinTree_node**        const node_ptr,
+                     const bool                  is_in_operation,
+                     const purity_verdict* const verdicts,
+                           eval_state*     const state);
+
+static eval_result
+RunChain            (const BinTree_node* const chain,
+                           eval_state*   const state);
+
+static eval_result
+RunStatement        (const BinTree_node* const statement,
+                           eval_state*   const state);
+
+static bool
+Evaluate            (const BinTree_node* const node,
+                           eval_state*   const state,
+                           double*       const value);
+
+static bool
+CallFunction        (const BinTree_node* const call,
+                           eval_state*   const state);
+
+static size_t
+CountSavedSlots     (const BinTree_node* const node);
+
+static void
+SaveSlots           (const BinTree_node* const node,
+                           saved_slot*   const saved,
+                           size_t*       const saved_index,
+                     const eval_state*   const state);
+
+static void
+AssignFormals       (const BinTree_node* const formal,
+                     const double*       const args,
+                           eval_state*   const state);
+
+static bool
+IsZeroValue         (const double value);
+
+static bool
+PushOutput          (      eval_state* const state,
+                     const double            value);
+
+bool
+PartialEvaluate (optimize_context* const context)
+{
+    assert (context);
+
+    eval_state state = {};
+    if (!EvalStateCtor (&state, context)) return false;
+
+    purity_verdict* const verdicts =
+        (purity_verdict*) calloc (context -> n_funcs + 1,
+                                  sizeof (purity_verdict));
+    bool* const is_recursive =
+        (bool*) calloc (context -> n_funcs + 1, sizeof (bool));
+
+    if (!verdicts || !is_recursive ||
+        !ClassifyFunctions (context, verdicts, is_recursive))
+    {
+        free (verdicts);
+        free (is_recursive);
+        EvalStateDtor (&state);
+        return false;
+    }
+
+    /* a function falling off its end returns what rax kept */
+    bool is_rax_unused = true;
+
+    for (BinTree_node* func = context -> tree -> root -> right; func;
+                       func = func -> right)
+    {
+        if (!ChainReturns (*GetFunctionBodyLink (func)))
+            is_rax_unused = false;
+    }
+
+    bool is_changed = EvaluateMainPrefix (&state, is_rax_unused);
+
+    if (is_rax_unused)
+    {
+        for (BinTree_node* func = context -> tree -> root; func;
+                           func = func -> right)
+        {
+            if (FoldPureCalls (GetFunctionBodyLink (func), false,
+                               verdicts, &state))
+            {
+                is_changed = true;
+            }
+        }
+    }
+
+    free (verdicts);
+    free (is_recursive);
+    EvalStateDtor (&state);
+
+    return is_changed;
+}
+
+static bool
+EvalStateCtor (eval_state*       const state,
+               optimize_context* const context)
+{
+    assert (state);
+    assert (context);
+
+    const var_index_type n_vars  = context -> n_vars;
+    const var_index_type n_funcs = context -> n_funcs;
+
+    state -> context    = context;
+    state -> n_vars     = n_vars;
+    state -> steps_left = context -> config -> eval_budget;
+    state -> depth      = 0;
+
+    state -> funcs      = (BinTree_node**) calloc (n_funcs + 1,
+                                                   sizeof (BinTree_node*));
+    state -> slots      = (double*) calloc (n_vars + 1, sizeof (double));
+    state -> is_set     = (bool*)   calloc (n_vars + 1, sizeof (bool));
+    state -> is_written = (bool*)   calloc (n_vars + 1, sizeof (bool));
+
+    state -> outputs          = nullptr;
+    state -> n_outputs        = 0;
+    state -> outputs_capacity = 0;
+
+    state -> rax        = 0;
+    state -> is_rax_set = false;
+
+    if (!state -> funcs || !state -> slots ||
+        !state -> is_set || !state -> is_written)
+    {
+        perror ("eval state allocation error");
+        EvalStateDtor (state);
+        return false;
+    }
+
+    for (BinTree_node* func = context -> tree -> root; func;
+                       func = func -> right)
+    {
+        if (func -> data .func_index < n_funcs)
+            state -> funcs [func -> data .func_index] = func;
+    }
+
+    return true;
+}
+
+static void
+EvalStateDtor (eval_state* const state)
+{
+    assert (state);
+
+    free (state -> funcs);
+    free (state -> slots);
+    free (state -> is_set);
+    free (state -> is_written);
+    free (state -> outputs);
+
+    state -> funcs      = nullptr;
+    state -> slots      = nullptr;
+    state -> is_set     = nullptr;
+    state -> is_written = nullptr;
+    state -> outputs    = nullptr;
+}
+
+static void
+ForgetSlots (eval_state* const state)
+{
+    assert (state);
+
+    memset (state -> is_set,     0, state -> n_vars * sizeof (bool));
+    memset (state -> is_written, 0, state -> n_vars * sizeof (bool));
+
+    state -> n_outputs  = 0;
+    state -> is_rax_set = false;
+    state -> depth      = 0;
+}
+
+static bool
+TakeSnapshot (const eval_state*    const state,
+                    eval_snapshot* const snapshot)
+{
+    assert (state);
+    assert (snapshot);
+
+    const var_index_type n_vars = state -> n_vars;
+
+    if (!snapshot -> slots)
+    {
+        snapshot -> slots      = (double*) calloc (n_vars + 1, sizeof (double));
+        snapshot -> is_set     = (bool*)   calloc (n_vars + 1, sizeof (bool));
+        snapshot -> is_written = (bool*)   calloc (n_vars + 1, sizeof (bool));
+
+        if (!snapshot -> slots || !snapshot -> is_set ||
+            !snapshot -> is_written)
+        {
+            perror ("snapshot allocation error");
+            return false;
+        }
+    }
+
+    memcpy (snapshot -> slots,      state -> slots,  n_vars * sizeof (double));
+    memcpy (snapshot -> is_set,     state -> is_set, n_vars * sizeof (bool));
+    memcpy (snapshot -> is_written, state -> is_written,
+            n_vars * sizeof (bool));
+
+    snapshot -> n_outputs  = state -> n_outputs;
+    snapshot -> rax        = state -> rax;
+    snapshot -> is_rax_set = state -> is_rax_set;
+
+    return true;
+}
+
+static void
+RestoreSnapshot (      eval_state*    const state,
+                 const eval_snapshot* const snapshot)
+{
+    assert (state);
+    assert (snapshot);
+
+    const var_index_type n_vars = state -> n_vars;
+
+    memcpy (state -> slots,      snapshot -> slots,  n_vars * sizeof (double));
+    memcpy (state -> is_set,     snapshot -> is_set, n_vars * sizeof (bool));
+    memcpy (state -> is_written, snapshot -> is_written,
+            n_vars * sizeof (bool));
+
+    state -> n_outputs  = snapshot -> n_outputs;
+    state -> rax        = snapshot -> rax;
+    state -> is_rax_set = snapshot -> is_rax_set;
+}
+
+/* the new outputs and every slot written so far survive as literals */
+static bool
+IsStateExact (const eval_state* const state,
+              const size_t            first_output)
+{
+    assert (state);
+
+    for (size_t output = first_output; output < state -> n_outputs; output++)
+    {
+        if (!IsPrintedExactly (state -> outputs [output]))
+            return false;
+    }
+
+    for (var_index_type var = 0; var < state -> n_vars; var++)
+    {
+        if (state -> is_written [var] && state -> is_set [var] &&
+            !IsPrintedExactly (state -> slots [var]))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool
+EvaluateMainPrefix (eval_state* const state,
+                    const bool        is_rax_unused)
+{
+    assert (state);
+
+    BinTree*       const tree      = state -> context -> tree;
+    BinTree_node** const main_link = GetFunctionBodyLink (tree -> root);
+
+    eval_snapshot snapshot = {};
+
+    BinTree_node*  rest     = *main_link;
+    BinTree_node*  last_run = nullptr;
+    size_t         n_run    = 0;
+
+    while (rest && TakeSnapshot (state, &snapshot))
+    {
+        const size_t first_output = state -> n_outputs;
+
+        /* a return from main leaves the processor with an empty stack */
+        if (RunStatement (rest -> left, state) != EVAL_NEXT ||
+            !IsStateExact (state, first_output))
+        {
+            RestoreSnapshot (state, &snapshot);
+            break;
+        }
+
+        last_run = rest;
+        rest     = rest -> right;
+        n_run++;
+    }
+
+    free (snapshot .slots);
+    free (snapshot .is_set);
+    free (snapshot .is_written);
+
+    /* the rest may call a function that returns the rax we don't set */
+    if (n_run == 0 || (rest && !is_rax_unused)) return false;
+
+    BinTree_node* const run_chain = *main_link;
+
+    last_run -> right = nullptr;
+    BinTree_DestroySubtree (run_chain, tree);
+
+    *main_link = nullptr;
+    BinTree_node** tail = main_link;
+
+    for (size_t output = 0; output < state -> n_outputs; output++)
+    {
+        tail = AppendStatement (tail,
+                                BinTree_CtorNode (UN_OP, OUT, nullptr,
+                                    MakeNumber (state -> outputs [output],
+                                                tree),
+                                    nullptr, tree),
+                                tree);
+    }
+
+    /* when main has run to the end nobody reads the slots */
+    for (var_index_type var = 0; rest && var < state -> n_vars; var++)
+    {
+        if (state -> is_written [var] && state -> is_set [var])
+        {
+            tail = AppendStatement (tail,
+                                    MakeAssume (var,
+                                                MakeNumber (state -> slots [var],
+                                                            tree),
+                                                tree),
+                                    tree);
+        }
+    }
+
+    *tail = rest;
+
+    return true;
+}
+
+static bool
+FoldPureCalls (BinTree_node**        const node_ptr,
+               const bool                  is_in_operation,
+               const purity_verdict* const verdicts,
+                     eval_state*     const state)
+{
+    assert (node_ptr);
+    assert (verdicts);
+    assert (state);
+
+    BinTree_node* const node = *node_ptr;
+    if (!node) return false;
+
+    /* chain elements hold statements or args, as the chain does */
+    const bool is_chain = node -> data .data_type     == PUNCTUATION &&
+                          node -> data .punct_op_code == END_OF_OPERATION;
+    const bool is_loop  = node -> data .data_type     == KEY_OP;
+
+    bool is_changed = FoldPureCalls (&node -> left,
+                                     !is_chain || is_in_operation,
+                                     verdicts, state);
+
+    is_changed = FoldPureCalls (&node -> right,
+                                is_chain ? is_in_operation : !is_loop,
+                                verdicts, state) || is_changed;
+
+    if (!is_in_operation || node -> data .data_type != FUNCTION ||
+        node -> data .func_index >= state -> context -> n_funcs ||
+        verdicts [node -> data .func_index] != PURE)
+    {
+        return is_changed;
+    }
+
+    for (const BinTree_node* arg = node -> right; arg; arg = arg -> right)
+    {
+        if (arg -> left -> data .data_type != NUMBER)
+            return is_changed;
+    }
+
+    /* a pure function reads its formals only, the rest may stay unset */
+    ForgetSlots (state);
+
+    if (!CallFunction (node, state) || !IsPrintedExactly (state -> rax))
+        return is_changed;
+
+    BinTree* const tree = state -> context -> tree;
+
+    *node_ptr = MakeNumber (state -> rax, tree);
+    BinTree_DestroySubtree (node, tree);
+
+    return true;
+}
+
+static eval_result
+RunChain (const BinTree_node* const chain,
+                eval_state*   const state)
+{
+    assert (state);
+
+    for (const BinTree_node* elem = chain; elem; elem = elem -> right)
+    {
+        const eval_result result = RunStatement (elem -> left, state);
+
+        if (result != EVAL_NEXT) return result;
+    }
+
+    return EVAL_NEXT;
+}
+
+static eval_result
+RunStatement (const BinTree_node* const statement,
+                    eval_state*   const state)
+{
+    assert (state);
+
+    if (!statement) return EVAL_NEXT;
+
+    if (state -> steps_left == 0) return EVAL_STUCK;
+    state -> steps_left--;
+
+    double value = 0;
+
+    switch (statement -> data .data_type)
+    {
+        case BIN_OP:
+            if (statement -> data .bin_op_code != ASSUME_BEGIN ||
+                !Evaluate (statement -> right, state, &value))
+            {
+                return EVAL_STUCK;
+            }
+
+            state -> slots      [statement -> left -> data .var_index] = value;
+            state -> is_set     [statement -> left -> data .var_index] = true;
+            state -> is_written [statement -> left -> data .var_index] = true;
+
+            return EVAL_NEXT;
+
+        case UN_OP:
+            if (statement -> data .un_op_code == OUT)
+            {
+                if (!Evaluate (statement -> right, state, &value) ||
+                    !PushOutput (state, value))
+                {
+                    return EVAL_STUCK;
+                }
+
+                return EVAL_NEXT;
+            }
+
+            if (statement -> data .un_op_code == RET)
+            {
+                if (!Evaluate (statement -> right, state, &state -> rax))
+                    return EVAL_STUCK;
+
+                state -> is_rax_set = true;
+
+                return EVAL_RETURN;
+            }
+
+            /* input is what we can't know */
+            return EVAL_STUCK;
+
+        case KEY_OP:
+        {
+            const BinTree_node* const branches = statement -> right;
+
+            if (statement -> data .key_op_code == IF)
+            {
+                if (!Evaluate (statement -> left, state, &value))
+                    return EVAL_STUCK;
+
+                return RunChain (IsZeroValue (value) ? branches -> right
+                                                     : branches -> left,
+                                 state);
+            }
+
+            while (true)
+            {
+                if (!Evaluate (statement -> left, state, &value))
+                    return EVAL_STUCK;
+
+                if (IsZeroValue (value)) return EVAL_NEXT;
+
+                const eval_result result = RunChain (branches -> left, state);
+
+                if (result != EVAL_NEXT) return result;
+            }
+        }
+
+        case FUNCTION:
+            return CallFunction (statement, state) ? EVAL_NEXT : EVAL_STUCK;
+
+        case NUMBER:      [[fallthrough]];
+        case VARIABLE:    [[fallthrough]];
+        case PUNCTUATION: [[fallthrough]];
+        case NO_TYPE:     [[fallthrough]];
+
+        /* a bare value would stay on the stack */
+        default:
+            return EVAL_STUCK;
+    }
+}
+
+static bool
+Evaluate (const BinTree_node* const node,
+                eval_state*   const state,
+                double*       const value)
+{
+    assert (node);
+    assert (state);
+    assert (value);
+
+    if (state -> steps_left == 0) return false;
+    state -> steps_left--;
+
+    switch (node -> data .data_type)
+    {
+        case NUMBER:
+            *value = node -> data .num_value;
+            return true;
+
+        case VARIABLE:
+            if (!state -> is_set [node -> data .var_index]) return false;
+
+            *value = state -> slots [node -> data .var_index];
+            return true;
+
+        case FUNCTION:
+            if (!CallFunction (node, state)) return false;
+
+            *value = state -> rax;
+            return true;
+
+        case BIN_OP: [[fallthrough]];
+        case UN_OP:
+        {
+            if (!IsValueOperation (node)) return false;
+
+            const bool is_bin_op = node -> data .data_type == BIN_OP;
+
+            double left  = 0;
+            double right = 0;
+
+            if (is_bin_op && !Evaluate (node -> left, state, &left))
+                return false;
+
+            if (!Evaluate (node -> right, state, &right))
+                return false;
+
+            return EvaluateOperation (is_bin_op ? node -> data .bin_op_code
+                                                : node -> data .un_op_code,
+                                      left, right, value);
+        }
+
+        case PUNCTUATION: [[fallthrough]];
+        case KEY_OP:      [[fallthrough]];
+        case NO_TYPE:     [[fallthrough]];
+
+        default:
+            return false;
+    }
+}
+
+/*
+ * Runs the call as the generated code does: slots mentioned in the
+ * args are saved first and restored after, the args go to the formals
+ * and the value comes back in rax.
+ */
+static bool
+CallFunction (const BinTree_node* const call,
+                    eval_state*   const state)
+{
+    assert (call);
+    assert (state);
+
+    const var_index_type func_index = call -> data .func_index;
+
+    if (func_index >= state -> context -> n_funcs || func_index == 0 ||
+        !state -> funcs [func_index] || state -> depth >= MAX_EVAL_DEPTH)
+    {
+        return false;
+    }
+
+    BinTree_node* const callee  = state -> funcs [func_index];
+    BinTree_node* const formals = GetFunctionFormals (callee);
+
+    const size_t n_args = CountListElems (call -> right);
+    if (n_args != CountListElems (formals)) return false;
+
+    const size_t n_saved = CountSavedSlots (call -> right);
+
+    double*     const args  = (double*)     calloc (n_args  + 1,
+                                                    sizeof (double));
+    saved_slot* const saved = (saved_slot*) calloc (n_saved + 1,
+                                                    sizeof (saved_slot));
+    if (!args || !saved)
+    {
+        perror ("call frame allocation error");
+        free (args);
+        free (saved);
+        return false;
+    }
+
+    size_t saved_index = 0;
+    SaveSlots (call -> right, saved, &saved_index, state);
+
+    bool   is_done   = true;
+    size_t arg_index = 0;
+
+    for (const BinTree_node* arg = call -> right; is_done && arg;
+                             arg = arg -> right, arg_index++)
+    {
+        is_done = Evaluate (arg -> left, state, &args [arg_index]);
+    }
+
+    if (is_done)
+    {
+        /* formals are popped last first, the first one wins a tie */
+        AssignFormals (formals, args, state);
+
+        state -> depth++;
+
+        const eval_result result = RunChain (*GetFunctionBodyLink (callee),
+                                             state);
+        state -> depth--;
+
+        is_done = result != EVAL_STUCK && state -> is_rax_set;
+    }
+
+    for (size_t i = n_saved; i > 0; i--)
+    {
+        state -> slots  [saved [i - 1] .var_index] = saved [i - 1] .value;
+        state -> is_set [saved [i - 1] .var_index] = saved [i - 1] .is_set;
+    }
+
+    free (args);
+    free (saved);
+
+    return is_done;
+}
+
+static size_t
+CountSavedSlots (const BinTree_node* const node)
+{
+    if (!node) return 0;
+
+    return (node -> data .data_type == VARIABLE) +
+           CountSavedSlots (node -> left) + CountSavedSlots (node -> right);
+}
+
+static void
+SaveSlots (const BinTree_node* const node,
+                 saved_slot*   const saved,
+                 size_t*       const saved_index,
+           const eval_state*   const state)
+{
+    assert (saved);
+    assert (saved_index);
+    assert (state);
+
+    if (!node) return;
+
+    if (node -> data .data_type == VARIABLE)
+    {
+        const var_index_type var = node -> data .var_index;
+
+        saved [(*saved_index)++] = {.var_index = var,
+                                    .value     = state -> slots  [var],
+                                    .is_set    = state -> is_set [var]};
+    }
+
+    SaveSlots (node -> left,  saved, saved_index, state);
+    SaveSlots (node -> right, saved, saved_index, state);
+}
+
+static void
+AssignFormals (const BinTree_node* const formal,
+               const double*       const args,
+                     eval_state*   const state)
+{
+    assert (args);
+    assert (state);
+
+    if (!formal) return;
+
+    AssignFormals (formal -> right, args + 1, state);
+
+    const var_index_type var = formal -> left -> data .var_index;
+
+    state -> slots      [var] = *args;
+    state -> is_set     [var] = true;
+    state -> is_written [var] = true;
+}
+
+static bool
+IsZeroValue (const double value)
+{
+    double is_zero = 0;
+
+    EvaluateOperation (NOT, 0, value, &is_zero);
+
+    return is_zero > 0;
+}
+
+static bool
+PushOutput (      eval_state* const state,
+            const double            value)
+{
+    assert (state);
+
+    if (state -> n_outputs == state -> outputs_capacity)
+    {
+        const size_t capacity = state -> outputs_capacity ?
+                                2 * state -> outputs_capacity : 16;
+
+        double* const outputs =
+            (double*) realloc (state -> outputs, capacity * sizeof (double));
+        if (!outputs)
+        {
+            perror ("outputs allocation error");
+            return false;
+        }
+
+        state -> outputs          = outputs;
+        state -> outputs_capacity = capacity;
+    }
+
+    state -> outputs [state -> n_outputs++] = value;
+
+    return true;
+}
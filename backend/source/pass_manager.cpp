@@ -0,0 +1,500 @@
+#include <time.h>
+#include "optimize.h"
+#include "ir.h"
+
+/*
+ * The passes known by name. The table is in the order the -O levels
+ * and -f options run them in, an explicit --passes= list picks its
+ * own order and runs nothing it doesn't name.
+ *
+ * In the fixed order fold runs first, and again after every pass
+ * marked is_folded, if that pass changed the tree: the literals
+ * inlining and evaluating leave are folded into their users before
+ * the next pass sees them. A --passes= list folds where it says so.
+ */
+
+struct pass_info
+{
+    const char* name;
+
+    bool (*run) (optimize_context* const context);
+
+    bool optimize_config::* flag;
+
+    size_t level;       // the least -O level that runs it, 0 for none
+    bool   is_folded;
+};
+
+static const pass_info PASSES [] =
+    {
+     {.name = "fold",         .run = FoldConstants,
+      .flag = &optimize_config::fold_constants,       .level = 1, .is_folded = false},
+
+     /* before the rest, whatever it reduces they don't have to look at */
+     {.name = "partial-eval", .run = PartialEvaluate,
+      .flag = &optimize_config::partial_eval,         .level = 2, .is_folded = true},
+
+     {.name = "specialize",   .run = SpecializeFunctions,
+      .flag = &optimize_config::specialize_functions, .level = 2, .is_folded = true},
+
+     /* inlined arguments are often literals, fold them in */
+     {.name = "inline",       .run = InlineFunctions,
+      .flag = &optimize_config::inline_functions,     .level = 1, .is_folded = true},
+
+     {.name = "fast-math",    .run = ReduceStrength,
+      .flag = &optimize_config::fast_math,            .level = 0, .is_folded = true},
+
+     /* before hoisting, a select of invariants is invariant itself */
+     {.name = "if-convert",   .run = ConvertIfsToSelects,
+      .flag = &optimize_config::convert_ifs,          .level = 0, .is_folded = true},
+
+     {.name = "licm",         .run = HoistLoopInvariants,
+      .flag = &optimize_config::hoist_invariants,     .level = 2, .is_folded = false},
+
+     /* after hoisting, so that the copies don't repeat invariants */
+     {.name = "unroll",       .run = UnrollLoops,
+      .flag = &optimize_config::unroll_loops,         .level = 2, .is_folded = true},
+
+     {.name = "cse",          .run = EliminateCommonSubexpressions,
+      .flag = &optimize_config::eliminate_common_subexprs, .level = 1, .is_folded = false},
+
+     /* last, as the passes above leave temporaries nobody reads */
+     {.name = "dce",          .run = EliminateDeadCode,
+      .flag = &optimize_config::eliminate_dead_code,  .level = 1, .is_folded = true},
+
+     /* on the final tree, so that the report tells what is emitted */
+     {.name = "memoize",      .run = MemoizePureFunctions,
+      .flag = &optimize_config::memoize_recursive,    .level = 0, .is_folded = false},
+    };
+
+static const size_t N_PASSES = sizeof (PASSES) / sizeof (PASSES [0]);
+
+static const size_t MAX_OPTIMIZE_LEVEL = 2;
+
+static const pass_info*
+FindPass        (const char*  const name,
+                 const size_t       name_len);
+
+static bool
+IsPassEnabled   (const pass_info*       const pass,
+                 const optimize_config* const config);
+
+static bool
+RunListedPasses (optimize_context* const context,
+                 pass_report*      const report);
+
+static bool
+RunPass         (optimize_context* const context,
+                 const char*       const name,
+                 bool (*run) (optimize_context* const context),
+                 pass_report*      const report,
+                 bool*             const is_changed);
+
+static bool
+VerifyAfterPass (optimize_context* const context,
+                 const char*       const name,
+                 pass_stat*        const stat);
+
+static size_t
+CountTreeNodes  (const BinTree* const tree);
+
+bool
+ParsePassOption (const char*      const option,
+                 optimize_config* const config)
+{
+    assert (option);
+    assert (config);
+
+    if (strncmp (option, "-O", strlen ("-O")) == 0)
+    {
+        char* end = nullptr;
+        const size_t level = strtoul (option + strlen ("-O"), &end, 10);
+
+        if (end == option + strlen ("-O") || *end || level > MAX_OPTIMIZE_LEVEL)
+            return false;
+
+        /* a level replaces what the options before it asked for */
+        for (size_t i = 0; i < N_PASSES; i++)
+            config ->* PASSES [i] .flag = PASSES [i] .level &&
+                                          PASSES [i] .level <= level;
+
+        config -> pass_list = nullptr;
+    }
+
+    else if (strncmp (option, "--passes=", strlen ("--passes=")) == 0)
+    {
+        config -> pass_list = option + strlen ("--passes=");
+
+        /* the passes read their knobs from the config, memoize included */
+        for (const char* name = config -> pass_list; *name; )
+        {
+            const size_t name_len = strcspn (name, ",");
+            const pass_info* const pass = FindPass (name, name_len);
+
+            if (pass)
+                config ->* pass -> flag = true;
+
+            name += name_len;
+            if (*name == ',') name++;
+        }
+    }
+
+    else if (strcmp (option, "--pass-stats") == 0 ||
+             strcmp (option, "--pass-stats=table") == 0)
+    {
+        config -> stats_format = PASS_STATS_TABLE;
+    }
+
+    else if (strcmp (option, "--pass-stats=json") == 0)
+    {
+        config -> stats_format = PASS_STATS_JSON;
+    }
+
+    else if (strcmp (option, "--verify-passes") == 0)
+    {
+        config -> verify_passes = true;
+    }
+
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+bool
+RunPassPipeline (optimize_context* const context,
+                 pass_report*      const report)
+{
+    assert (context);
+
+    const optimize_config* const config = context -> config;
+
+    /* runs always, the processor has no instruction for it */
+    bool is_expanded = false;
+
+    if (!RunPass (context, "expand-diff", ExpandDerivatives, report, &is_expanded) ||
+        context -> is_failed)
+    {
+        return false;
+    }
+
+    if (config -> pass_list)
+        return RunListedPasses (context, report);
+
+    const pass_info* const fold = &PASSES [0];
+    const bool is_fold_enabled  = IsPassEnabled (fold, config);
+
+    bool is_changed = false;
+
+    for (size_t i = 0; i < N_PASSES; i++)
+    {
+        const pass_info* const pass = &PASSES [i];
+
+        if (!IsPassEnabled (pass, config)) continue;
+
+        if (!RunPass (context, pass -> name, pass -> run, report, &is_changed))
+            return false;
+
+        if (pass -> is_folded && is_changed && is_fold_enabled &&
+            !RunPass (context, fold -> name, fold -> run, report, &is_changed))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool
+RunListedPasses (optimize_context* const context,
+                 pass_report*      const report)
+{
+    assert (context);
+    assert (context -> config -> pass_list);
+
+    for (const char* name = context -> config -> pass_list; *name; )
+    {
+        const size_t name_len = strcspn (name, ",");
+        const pass_info* const pass = FindPass (name, name_len);
+
+        if (!pass)
+        {
+            fprintf (stderr, "Unknown pass %.*s\n", (int) name_len, name);
+            return false;
+        }
+
+        bool is_changed = false;
+
+        if (!RunPass (context, pass -> name, pass -> run, report, &is_changed))
+            return false;
+
+        name += name_len;
+        if (*name == ',') name++;
+    }
+
+    return true;
+}
+
+/*
+ * Times the pass alone: the nodes are counted and the IR is checked
+ * outside of the measured span.
+ */
+static bool
+RunPass (optimize_context* const context,
+         const char*       const name,
+         bool (*run) (optimize_context* const context),
+         pass_report*      const report,
+         bool*             const is_changed)
+{
+    assert (context);
+    assert (name);
+    assert (run);
+    assert (is_changed);
+
+    pass_stat stat = {.name         = name,
+                      .seconds      = 0,
+                      .nodes_before = 0,
+                      .nodes_after  = 0,
+                      .n_instrs     = 0,
+                      .is_changed   = false};
+
+    if (report)
+        stat .nodes_before = CountTreeNodes (context -> tree);
+
+    const double start = GetWallTime ();
+
+    stat .is_changed = run (context);
+
+    stat .seconds = GetWallTime () - start;
+
+    *is_changed = stat .is_changed;
+
+    if (report)
+        stat .nodes_after = CountTreeNodes (context -> tree);
+
+    if (context -> config -> verify_passes &&
+        !VerifyAfterPass (context, name, &stat))
+    {
+        return false;
+    }
+
+    return !report || PassReportAdd (report, &stat);
+}
+
+/*
+ * Lowers the tree as the code generator would and checks the IR,
+ * which catches a pass that left an operation without operands,
+ * a use of a value on a path it isn't computed on and the like.
+ */
+static bool
+VerifyAfterPass (optimize_context* const context,
+                 const char*       const name,
+                 pass_stat*        const stat)
+{
+    assert (context);
+    assert (name);
+    assert (stat);
+
+    ir_module module = {};
+
+    if (!IrModuleCtor (&module) || !BuildIrModule (&module, context -> tree))
+    {
+        fprintf (stderr, "after %s: the tree can't be lowered\n", name);
+        IrModuleDtor (&module);
+        return false;
+    }
+
+    const bool is_valid = VerifyIrModule (&module, stderr);
+
+    if (!is_valid)
+        fprintf (stderr, "after %s: the IR is invalid\n", name);
+
+    stat -> n_instrs = module .n_instrs;
+
+    IrModuleDtor (&module);
+
+    return is_valid;
+}
+
+static const pass_info*
+FindPass (const char*  const name,
+          const size_t       name_len)
+{
+    assert (name);
+
+    for (size_t i = 0; i < N_PASSES; i++)
+    {
+        if (strlen (PASSES [i] .name) == name_len &&
+            strncmp (PASSES [i] .name, name, name_len) == 0)
+        {
+            return &PASSES [i];
+        }
+    }
+
+    return nullptr;
+}
+
+static bool
+IsPassEnabled (const pass_info*       const pass,
+               const optimize_config* const config)
+{
+    assert (pass);
+    assert (config);
+
+    /* the purity report and a list of functions need it too */
+    if (pass -> run == MemoizePureFunctions)
+        return config -> memoize_recursive || config -> memoize_list ||
+               config -> report_purity;
+
+    return config ->* pass -> flag;
+}
+
+static size_t
+CountTreeNodes (const BinTree* const tree)
+{
+    assert (tree);
+
+    size_t n_nodes = 0;
+
+    /* functions hang on the right of each other, don't recurse there */
+    for (const BinTree_node* func = tree -> root; func; func = func -> right)
+        n_nodes += 1 + CountNodes (func -> left);
+
+    return n_nodes;
+}
+
+bool
+PassReportCtor (pass_report* const report)
+{
+    assert (report);
+
+    report -> n_stats  = 0;
+    report -> capacity = PASS_REPORT_INIT_CAPACITY;
+    report -> stats    = (pass_stat*) calloc (report -> capacity, sizeof (pass_stat));
+
+    if (!report -> stats)
+    {
+        perror ("pass report allocation error");
+        return false;
+    }
+
+    return true;
+}
+
+void
+PassReportDtor (pass_report* const report)
+{
+    assert (report);
+
+    free (report -> stats);
+
+    report -> stats    = nullptr;
+    report -> n_stats  = 0;
+    report -> capacity = 0;
+}
+
+bool
+PassReportAdd (      pass_report* const report,
+               const pass_stat*   const stat)
+{
+    assert (report);
+    assert (stat);
+
+    if (report -> n_stats == report -> capacity)
+    {
+        const size_t new_capacity = report -> capacity * 2;
+
+        pass_stat* const new_stats =
+            (pass_stat*) realloc (report -> stats, new_capacity * sizeof (pass_stat));
+
+        if (!new_stats)
+        {
+            perror ("pass report allocation error");
+            return false;
+        }
+
+        report -> stats    = new_stats;
+        report -> capacity = new_capacity;
+    }
+
+    report -> stats [report -> n_stats++] = *stat;
+
+    return true;
+}
+
+/* deltas are signed, the passes may grow the tree as well */
+void
+PrintPassReport (      FILE*              const stream,
+                 const pass_report*       const report,
+                 const pass_stats_format        format)
+{
+    assert (stream);
+    assert (report);
+
+    double total_seconds = 0;
+
+    for (size_t i = 0; i < report -> n_stats; i++)
+        total_seconds += report -> stats [i] .seconds;
+
+    switch (format)
+    {
+        case PASS_STATS_TABLE:
+            fprintf (stream, "%-14s %10s %8s %8s %8s %8s %s\n",
+                     "pass", "ms", "before", "after", "delta", "instrs", "changed");
+
+            for (size_t i = 0; i < report -> n_stats; i++)
+            {
+                const pass_stat* const stat = &report -> stats [i];
+
+                fprintf (stream, "%-14s %10.3lf %8zu %8zu %+8lld ",
+                         stat -> name, stat -> seconds * 1000,
+                         stat -> nodes_before, stat -> nodes_after,
+                         (long long) stat -> nodes_after -
+                         (long long) stat -> nodes_before);
+
+                if (stat -> n_instrs)
+                    fprintf (stream, "%8zu ", stat -> n_instrs);
+                else
+                    fprintf (stream, "%8s ", "-");
+
+                fprintf (stream, "%s\n", stat -> is_changed ? "yes" : "no");
+            }
+
+            fprintf (stream, "%-14s %10.3lf\n", "total", total_seconds * 1000);
+            break;
+
+        case PASS_STATS_JSON:
+            fprintf (stream, "{\"passes\": [");
+
+            for (size_t i = 0; i < report -> n_stats; i++)
+            {
+                const pass_stat* const stat = &report -> stats [i];
+
+                fprintf (stream, "%s\n  {\"name\": \"%s\", \"ms\": %.3lf, "
+                                 "\"nodes_before\": %zu, \"nodes_after\": %zu, "
+                                 "\"instrs\": %zu, \"changed\": %s}",
+                         i ? "," : "", stat -> name, stat -> seconds * 1000,
+                         stat -> nodes_before, stat -> nodes_after,
+                         stat -> n_instrs, stat -> is_changed ? "true" : "false");
+            }
+
+            fprintf (stream, "\n ],\n \"total_ms\": %.3lf}\n", total_seconds * 1000);
+            break;
+
+        case PASS_STATS_NONE:   [[fallthrough]];
+
+        default:
+            break;
+    }
+}
+
+double
+GetWallTime ()
+{
+    timespec now = {};
+    clock_gettime (CLOCK_MONOTONIC, &now);
+
+    return (double) now .tv_sec + (double) now .tv_nsec * 1e-9;
+}
@@ -1,9 +1,11 @@
 #include "print_asm.h"
+#include "instr_select.h"
+#include "thread_pool.h"
 
 static const char* const asm_op_array [NUM_OF_KEY_WORDS] =
     {
      "SIN", "COS", "SQRT", "LN", "!", "OUT", "OUT_S", "IN",
-     "return_value",
+     "return_value", "DIFF",
 
      "ADD", "SUB", "MUL", "DIV", "POW",
      "IS_EQUAL", "GREATER", "LESS", "GOE", "LOE", "NOT_EQUAL",
@@ -15,316 +17,292 @@ static const char* const asm_op_array [NUM_OF_KEY_WORDS] =
      ";"
     };
 
-#define IF_TRUE_LABEL     ":if_true_label%d\n"
-#define IF_FALSE_LABEL    ":if_false_label%d\n"
+#define BLOCK_LABEL       BLOCK_NAME "\n"
 
-#define WHILE_TRUE_LABEL  ":while_true_label%d\n"
-#define WHILE_FALSE_LABEL ":while_false_label%d\n"
+#define FUNC_LABEL        FUNC_NAME "\n"
 
-#define FUNC_LABEL        ":func%zd\n"
-
-static void
-PrintMainFunction       (const BinTree_node* const node);
-
-static void
-PrintFunction           (const BinTree_node* const node);
-
-static void
-PrintFunctionFormalArgs (const BinTree_node* const node);
-
-static void
-PrintNodeToAsm          (const BinTree_node* const node,
-                         const bool is_in_operation);
-
-static void
-PrintIfOperation        (const BinTree_node* const node);
-
-static void
-PrintWhileOperation     (const BinTree_node* const node);
-
-static void
-PrintRetOperation       (const BinTree_node* const node);
-
-static void
-PrintFunctionCall       (const BinTree_node* const node,
-                         const bool is_in_operation);
-
-static void
-PushSavingVariables     (const BinTree_node* const node);
-
-static void
-PopSavingVariables      (const BinTree_node* const node);
-
-static void
-PrintFactualArguments   (const BinTree_node* const node);
-
-void
-PrintTreeToAsm (const BinTree* const tree)
+/* functions go to buffers of their own and are printed in order */
+struct asm_job
+{
+    const ir_module* module;
+    bool             is_main_last;  // in the order of the output, not of the module
+
+    char**  texts;
+    size_t* text_sizes;
+};
+
+static bool
+PrintFunctionTask   (void*  const job_ptr,
+                     const size_t index);
+
+static bool
+PrintFunction       (const ir_module*   const module,
+                     const ir_function* const func,
+                           FILE*        const stream);
+
+static const ir_function*
+GetFunctionInOrder  (const ir_module* const module,
+                     const size_t           index);
+
+static bool
+MarkReachable       (const ir_module*   const module,
+                     const ir_function* const func,
+                           bool*        const is_reachable);
+
+bool
+PrintTreeToAsm (const BinTree* const tree,
+                      FILE*    const stream)
 {
     if (!tree)
     {
         fprintf (stderr, "Invalid pointer to tree struct.\n");
-        return;
+        return false;
     }
 
-    PrintMainFunction (tree -> root);
-}
-
-static void
-PrintMainFunction (const BinTree_node* const node)
-{
-    assert (node);
-
-    printf ("\t\tjmp :main\n\n");
+    assert (stream);
 
-    PrintFunction (node -> right);
+    ir_module module = {};
 
-    printf (":main\n");
+    const bool is_printed = IrModuleCtor (&module) && BuildIrModule (&module, tree) &&
+                            PrintIrToAsm (&module, stream, 1);
 
-    PrintNodeToAsm (node -> left, NOT_IN_OPERATION);
+    IrModuleDtor (&module);
 
-    printf ("\t\thlt\n");
+    return is_printed;
 }
 
-static void
-PrintFunction (const BinTree_node* const node)
+/*
+ * The code of a function depends on nothing but the function, so
+ * with n_jobs > 1 they are generated at once and the buffers are
+ * concatenated in the order the serial mode prints them in.
+ */
+bool
+PrintIrToAsm (const ir_module* const module,
+                    FILE*      const stream,
+              const size_t           n_jobs)
 {
-    if (!node) return;
-
-    static size_t func_number = FIRST_FUNC_NUMBER;
-
-    printf (FUNC_LABEL, func_number++);
+    assert (module);
+    assert (stream);
 
-    PrintFunctionFormalArgs (node -> left -> right);
+    if (!module -> n_funcs) return true;
 
-    PrintNodeToAsm          (node -> left -> left, NOT_IN_OPERATION);
+    fprintf (stream, "\t\tjmp :main\n\n");
 
-    printf ("\t\tret\n\n");
-
-    PrintFunction (node -> right);
-}
+    const size_t n_funcs = module -> n_funcs;
 
-static void
-PrintFunctionFormalArgs (const BinTree_node* const node)
-{
-    if (!node) return;
-
-    PrintFunctionFormalArgs (node -> right);
-
-    printf ("\t\tPOP [%zd]\n", node -> left -> data .var_index);
-}
-
-static void
-PrintNodeToAsm (const BinTree_node* const node,
-                const bool is_in_operation)
-{
-    if (!node) return;
-
-    switch (node -> data .data_type)
+    if (n_jobs <= 1 || n_funcs == 1)
     {
-        case PUNCTUATION:
+        for (size_t i = 0; i < n_funcs; i++)
         {
-            PrintNodeToAsm (node -> left,  is_in_operation);
-            PrintNodeToAsm (node -> right, is_in_operation);
-
-            break;
+            if (!PrintFunction (module, GetFunctionInOrder (module, i), stream))
+                return false;
         }
 
-        case BIN_OP:
-        {
-            if (node -> data .bin_op_code == ASSUME_BEGIN)
-            {
-                PrintNodeToAsm (node -> right, IN_OPERATION);
-                printf ("\t\tPOP [%zd]\n", node -> left -> data .var_index);
-            }
-
-            else
-            {
-                PrintNodeToAsm (node -> left,  IN_OPERATION);
-                PrintNodeToAsm (node -> right, IN_OPERATION);
-
-                printf ("\t\t%s\n", asm_op_array [node -> data .bin_op_code]);
-            }
+        return true;
+    }
 
-            break;
-        }
+    asm_job job = {.module       = module,
+                   .is_main_last = true,
+                   .texts        = (char**)  calloc (n_funcs, sizeof (char*)),
+                   .text_sizes   = (size_t*) calloc (n_funcs, sizeof (size_t))};
 
-        case UN_OP:
-        {
-            if (node -> data .un_op_code == RET)
-            {
-                PrintRetOperation (node);
-            }
-
-            else if (node -> data .un_op_code == IN)
-            {
-                printf ("\t\t%s\n", asm_op_array [node -> data .un_op_code]);
-                printf ("\t\tPOP [%zd]\n", node -> right -> data .var_index);
-            }
-
-            else
-            {
-                PrintNodeToAsm (node -> right, IN_OPERATION);
-                printf ("\t\t%s\n", asm_op_array [node -> data .un_op_code]);
-            }
-
-            break;
-        }
+    bool is_printed = job .texts && job .text_sizes;
 
-        case KEY_OP:
-        {
-            switch (node -> data .key_op_code)
-            {
-                case IF:
-                    PrintIfOperation    (node);
-                    break;
-
-                case WHILE:
-                    PrintWhileOperation (node);
-                    break;
-            }
-
-            break;
-        }
+    if (!is_printed)
+        perror ("asm buffers allocation error");
 
-        case NUMBER:
-        {
-            printf ("\t\tPUSH %lg\n", node -> data .num_value);
-            break;
-        }
+    is_printed = is_printed && RunTasks (PrintFunctionTask, &job, n_funcs, n_jobs);
 
-        case VARIABLE:
-        {
-            printf ("\t\tPUSH [%zd]\n", node -> data .var_index);
-            break;
-        }
+    for (size_t i = 0; i < n_funcs && job .texts; i++)
+    {
+        if (is_printed)
+            fwrite (job .texts [i], sizeof (char), job .text_sizes [i], stream);
 
-        case FUNCTION:
-        {
-            PrintFunctionCall (node, is_in_operation);
-            break;
-        }
+        free (job .texts [i]);
+    }
 
-        case NO_TYPE:
-        {
-            [[fallthrough]];
-        }
+    free (job .texts);
+    free (job .text_sizes);
 
-        default:
-        {
-            exit (1); //AAA
-        }
-    }
+    return is_printed;
 }
 
-static void
-PrintIfOperation (const BinTree_node* const node)
+bool
+PrintIrFunctions (const ir_module* const module,
+                        char**     const texts,
+                        size_t*    const text_sizes,
+                  const size_t           n_jobs)
 {
-    assert (node);
-
-    // to struct
-    static int8_t if_number = 0;
-    const  int8_t cur_if_number = if_number;
+    assert (module);
+    assert (texts);
+    assert (text_sizes);
 
-    PrintNodeToAsm (node -> left, IN_OPERATION);
-    printf ("\t\tPUSH 0\n");
-    printf ("\t\tje " IF_FALSE_LABEL, cur_if_number);
-    if_number++;
+    asm_job job = {.module       = module,
+                   .is_main_last = false,
+                   .texts        = texts,
+                   .text_sizes   = text_sizes};
 
-    PrintNodeToAsm (node -> right -> left, IN_OPERATION);
-    printf ("\t\tjmp " IF_TRUE_LABEL, cur_if_number);
+    return RunTasks (PrintFunctionTask, &job, module -> n_funcs, n_jobs);
+}
 
-    printf (IF_FALSE_LABEL, cur_if_number);
-    PrintNodeToAsm (node -> right -> right, IN_OPERATION);
+const char*
+GetAsmOperation (const op_code_type op_code)
+{
+    assert (0 <= op_code && op_code < NUM_OF_KEY_WORDS);
 
-    printf (IF_TRUE_LABEL, cur_if_number);
+    return asm_op_array [op_code];
 }
 
-static void
-PrintWhileOperation (const BinTree_node* const node)
+static bool
+PrintFunctionTask (void*  const job_ptr,
+                   const size_t index)
 {
-    assert (node);
-
-    // to struct
-    static int8_t while_number = 0;
-    const  int8_t cur_while_number = while_number;
+    assert (job_ptr);
 
-    printf (WHILE_TRUE_LABEL, cur_while_number);
+    asm_job* const job = (asm_job*) job_ptr;
 
-    PrintNodeToAsm (node -> left, IN_OPERATION);
-    printf ("\t\tPUSH 0\n");
-    printf ("\t\tje " WHILE_FALSE_LABEL, cur_while_number);
-    while_number++;
+    FILE* const buffer = open_memstream (&job -> texts [index], &job -> text_sizes [index]);
+    if (!buffer)
+    {
+        perror ("asm buffer open error");
+        return false;
+    }
 
-    PrintNodeToAsm (node -> right -> left, IN_OPERATION);
-    printf ("\t\tjmp " WHILE_TRUE_LABEL, cur_while_number);
+    const ir_function* const func = job -> is_main_last ?
+                                    GetFunctionInOrder (job -> module, index) :
+                                    &job -> module -> funcs [index];
 
-    PrintNodeToAsm (node -> right -> right, IN_OPERATION);
+    const bool is_printed = PrintFunction (job -> module, func, buffer);
 
-    printf (WHILE_FALSE_LABEL, cur_while_number);
+    /* sets the text and its size */
+    return fclose (buffer) == 0 && is_printed;
 }
 
-static void
-PrintRetOperation (const BinTree_node* const node)
+/* main goes last, after the functions it calls */
+static const ir_function*
+GetFunctionInOrder (const ir_module* const module,
+                    const size_t           index)
 {
-    assert (node);
+    assert (module);
+    assert (index < module -> n_funcs);
 
-    PrintNodeToAsm (node -> right, IN_OPERATION);
-    printf ("\t\tPOP rax\n\t\tret\n");
+    return (index + 1 < module -> n_funcs) ? &module -> funcs [index + 1] :
+                                             &module -> funcs [0];
 }
 
-static void
-PrintFunctionCall (const BinTree_node* const node,
-                   const bool is_in_operation)
+/*
+ * Blocks go in the order they were built in, which is the order of
+ * the tree, so that a branch falls through to its then block and a
+ * jump to the next block is not needed. Unreachable ones are left out.
+ */
+static bool
+PrintFunction (const ir_module*   const module,
+               const ir_function* const func,
+                     FILE*        const stream)
 {
-    assert (node);
+    assert (module);
+    assert (func);
+    assert (stream);
 
-    PushSavingVariables   (node -> right);
-    PrintFactualArguments (node -> right);
+    const bool is_main = func -> func_index == 0;
 
-    printf ("\t\tcall " FUNC_LABEL, node -> data .func_index);
+    bool* const is_reachable = (bool*) calloc (func -> n_blocks + 1, sizeof (bool));
+    if (!is_reachable || !MarkReachable (module, func, is_reachable))
+    {
+        perror ("is_reachable allocation error");
+        free (is_reachable);
+        return false;
+    }
 
-    PopSavingVariables    (node -> right);
+    asm_context context = {.module    = module,
+                           .func      = func,
+                           .stream    = stream,
+                           .selection = {}};
 
-    if (is_in_operation)
+    if (!AsmSelectionCtor (&context .selection, func))
     {
-        printf ("\t\tPUSH rax\n");
+        free (is_reachable);
+        return false;
     }
-}
 
-static void
-PushSavingVariables (const BinTree_node* const node)
-{
-    if (!node) return;
+    if (!SelectInstructions (module, func, &context .selection))
+    {
+        AsmSelectionDtor (&context .selection);
+        free (is_reachable);
+        return false;
+    }
+
+    /* labels follow the indices calls use, removed functions leave gaps */
+    if (is_main)
+        fprintf (stream, ":main\n");
+    else
+        fprintf (stream, FUNC_LABEL, (size_t) func -> func_index);
+
+    const ir_id first_block = func -> first_block;
+    const ir_id end_block   = first_block + func -> n_blocks;
 
-    if (node -> data .data_type == VARIABLE)
+    for (ir_id block = first_block; block < end_block; block++)
     {
-        printf ("\t\tPUSH [%zd]\n", node -> data .var_index);
+        if (!is_reachable [block - first_block]) continue;
+
+        ir_id next_block = block + 1;
+
+        while (next_block < end_block && !is_reachable [next_block - first_block])
+            next_block++;
+
+        if (block != first_block)
+            fprintf (stream, BLOCK_LABEL, (size_t) func -> func_index,
+                     (size_t) (block - first_block));
+
+        for (ir_id instr = module -> blocks [block] .first; instr != IR_NONE;
+                   instr = module -> instrs [instr] .next)
+        {
+            EmitInstr (&context, instr, next_block);
+        }
     }
 
-    PushSavingVariables (node -> left);
-    PushSavingVariables (node -> right);
+    if (!is_main)
+        fprintf (stream, "\n");
+
+    AsmSelectionDtor (&context .selection);
+    free (is_reachable);
+
+    return true;
 }
 
-static void
-PopSavingVariables (const BinTree_node* const node)
+static bool
+MarkReachable (const ir_module*   const module,
+               const ir_function* const func,
+                     bool*        const is_reachable)
 {
-    if (!node) return;
+    assert (module);
+    assert (func);
+    assert (is_reachable);
+
+    ir_id* const walk = (ir_id*) calloc (func -> n_blocks + 1, sizeof (ir_id));
+    if (!walk) return false;
+
+    ir_id n_walk = 0;
 
-    PopSavingVariables (node -> right);
-    PopSavingVariables (node -> left);
+    walk [n_walk++] = func -> first_block;
+    is_reachable [0] = true;
 
-    if (node -> data .data_type == VARIABLE)
+    while (n_walk)
     {
-        printf ("\t\tPOP [%zd]\n", node -> data .var_index);
+        const ir_block* const block = &module -> blocks [walk [--n_walk]];
+
+        for (size_t i = 0; i < block -> n_succs; i++)
+        {
+            const ir_id succ = block -> succs [i] - func -> first_block;
+
+            if (is_reachable [succ]) continue;
+
+            is_reachable [succ] = true;
+            walk [n_walk++]     = block -> succs [i];
+        }
     }
-}
 
-static void
-PrintFactualArguments (const BinTree_node* const node)
-{
-    if (!node) return;
+    free (walk);
 
-    PrintNodeToAsm (node -> left, IN_OPERATION);
-    PrintFactualArguments (node -> right);
+    return true;
 }
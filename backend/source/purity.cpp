@@ -0,0 +1,543 @@
+#include "optimize.h"
+
+/*
+ * A function is pure if a call of it may be replaced by the value
+ * it returned for the same arguments before:
+ *   - neither it nor its callees do input or output;
+ *   - it calls pure functions only;
+ *   - it reads only its formals and slots it has assigned before;
+ *   - nobody sees the slots it writes: every other function mentioning
+ *     one doesn't read it before assigning and saves it around the
+ *     calls that may reach the function;
+ *   - it returns a value on every path.
+ *
+ * Per function sets are rows of n_funcs x n_vars bool matrices.
+ */
+
+struct function_facts
+{
+    optimize_context* context;
+    var_index_type    n_vars;
+    var_index_type    n_funcs;
+
+    BinTree_node**    funcs;            // by index, nullptr for holes
+
+    bool*             mentioned;
+    bool*             written;          // own assignments and formals
+    bool*             read_unassigned;  // read before any assignment
+    bool*             reaches;          // n_funcs x n_funcs
+    bool*             has_io;           // own statements only
+};
+
+static bool
+FactsCtor           (function_facts*   const facts,
+                     optimize_context* const context);
+
+static void
+FactsDtor           (function_facts* const facts);
+
+static void
+CollectOwnFacts     (const BinTree_node*   const node,
+                     const var_index_type        func_index,
+                           function_facts* const facts);
+
+static void
+CloseReaches        (function_facts* const facts);
+
+static bool
+MarkUnassignedReads (const BinTree_node*   const chain,
+                           bool*           const assigned,
+                           bool*           const read_unassigned,
+                     const var_index_type        n_vars);
+
+static void
+MarkReads           (const BinTree_node*   const node,
+                     const bool*           const assigned,
+                           bool*           const read_unassigned,
+                     const var_index_type        n_vars);
+
+static void
+CheckCallSites      (const BinTree_node*   const node,
+                     const var_index_type        caller,
+                           bool*           const saved,
+                           purity_verdict* const verdicts,
+                           function_facts* const facts);
+
+bool
+ClassifyFunctions (optimize_context* const context,
+                   purity_verdict*   const verdicts,
+                   bool*             const is_recursive)
+{
+    assert (context);
+    assert (verdicts);
+    assert (is_recursive);
+
+    function_facts facts = {};
+    if (!FactsCtor (&facts, context)) return false;
+
+    const var_index_type n_vars  = facts .n_vars;
+    const var_index_type n_funcs = facts .n_funcs;
+
+    for (var_index_type func = 0; func < n_funcs; func++)
+    {
+        is_recursive [func] = facts .reaches [func * n_funcs + func];
+
+        verdicts [func] = PURE;
+
+        if (!facts .funcs [func] || func == 0)
+        {
+            verdicts [func] = IMPURE_ENTRY;
+            continue;
+        }
+
+        bool does_io = facts .has_io [func];
+
+        for (var_index_type callee = 0; callee < n_funcs; callee++)
+        {
+            if (facts .reaches [func * n_funcs + callee])
+                does_io = does_io || facts .has_io [callee];
+        }
+
+        bool reads_unassigned = false;
+
+        for (var_index_type var = 0; var < n_vars; var++)
+        {
+            reads_unassigned = reads_unassigned ||
+                               facts .read_unassigned [func * n_vars + var];
+        }
+
+        if (does_io)
+            verdicts [func] = IMPURE_IO;
+
+        else if (!ChainReturns (*GetFunctionBodyLink (facts .funcs [func])))
+            verdicts [func] = IMPURE_NO_RETURN;
+
+        else if (reads_unassigned)
+            verdicts [func] = IMPURE_READ;
+    }
+
+    /* a slot is seen if another function reads it before assigning */
+    for (var_index_type func = 1; func < n_funcs; func++)
+    {
+        if (verdicts [func] != PURE) continue;
+
+        for (var_index_type other = 0; other < n_funcs; other++)
+        {
+            if (other == func || !facts .funcs [other]) continue;
+
+            for (var_index_type var = 0; var < n_vars; var++)
+            {
+                if (facts .written         [func  * n_vars + var] &&
+                    facts .read_unassigned [other * n_vars + var])
+                {
+                    verdicts [func] = IMPURE_WRITE;
+                }
+            }
+        }
+    }
+
+    /* or if a call reaching it doesn't save it */
+    bool* const saved = (bool*) calloc (n_vars + 1, sizeof (bool));
+    if (!saved)
+    {
+        perror ("saved allocation error");
+        FactsDtor (&facts);
+        return false;
+    }
+
+    for (var_index_type caller = 0; caller < n_funcs; caller++)
+    {
+        if (facts .funcs [caller])
+            CheckCallSites (*GetFunctionBodyLink (facts .funcs [caller]),
+                            caller, saved, verdicts, &facts);
+    }
+
+    free (saved);
+
+    /* skipping a call skips its callees too, they must be pure */
+    bool is_changed = true;
+
+    while (is_changed)
+    {
+        is_changed = false;
+
+        for (var_index_type func = 1; func < n_funcs; func++)
+        {
+            if (verdicts [func] != PURE) continue;
+
+            for (var_index_type callee = 1; callee < n_funcs; callee++)
+            {
+                if (callee != func                               &&
+                    facts .reaches [func * n_funcs + callee]     &&
+                    verdicts [callee] != PURE)
+                {
+                    verdicts [func] = IMPURE_CALLEE;
+                    is_changed      = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    FactsDtor (&facts);
+
+    return true;
+}
+
+void
+PrintPurityReport (      FILE*           const stream,
+                   const purity_verdict* const verdicts,
+                   const var_index_type        n_funcs)
+{
+    assert (stream);
+    assert (verdicts);
+
+    static const char* const VERDICT_NAMES [] =
+    {
+        "pure",
+        "entry point",
+        "impure, does input or output",
+        "impure, calls an impure function",
+        "impure, reads a slot it wasn't given",
+        "impure, writes a slot read after it returns",
+        "impure, may end without a return",
+    };
+
+    for (var_index_type func = 1; func < n_funcs; func++)
+    {
+        if (verdicts [func] == IMPURE_ENTRY) continue;
+
+        fprintf (stream, "func%zu: %s\n", (size_t) func,
+                 VERDICT_NAMES [verdicts [func]]);
+    }
+}
+
+static bool
+FactsCtor (function_facts*   const facts,
+           optimize_context* const context)
+{
+    assert (facts);
+    assert (context);
+
+    const var_index_type n_vars  = context -> n_vars;
+    const var_index_type n_funcs = context -> n_funcs;
+
+    facts -> context = context;
+    facts -> n_vars  = n_vars;
+    facts -> n_funcs = n_funcs;
+
+    const size_t n_cells = n_funcs * n_vars + 1;
+
+    facts -> funcs           = (BinTree_node**) calloc (n_funcs + 1,
+                                                        sizeof (BinTree_node*));
+    facts -> mentioned       = (bool*) calloc (n_cells, sizeof (bool));
+    facts -> written         = (bool*) calloc (n_cells, sizeof (bool));
+    facts -> read_unassigned = (bool*) calloc (n_cells, sizeof (bool));
+    facts -> reaches         = (bool*) calloc (n_funcs * n_funcs + 1,
+                                               sizeof (bool));
+    facts -> has_io          = (bool*) calloc (n_funcs + 1, sizeof (bool));
+
+    bool* const assigned = (bool*) calloc (n_vars + 1, sizeof (bool));
+
+    if (!facts -> funcs   || !facts -> mentioned       ||
+        !facts -> written || !facts -> read_unassigned ||
+        !facts -> reaches || !facts -> has_io          || !assigned)
+    {
+        perror ("function facts allocation error");
+        free (assigned);
+        FactsDtor (facts);
+        return false;
+    }
+
+    for (BinTree_node* func = context -> tree -> root; func;
+                       func = func -> right)
+    {
+        if (func -> data .func_index < n_funcs)
+            facts -> funcs [func -> data .func_index] = func;
+    }
+
+    for (var_index_type func = 0; func < n_funcs; func++)
+    {
+        if (!facts -> funcs [func]) continue;
+
+        memset (assigned, 0, n_vars * sizeof (bool));
+
+        for (const BinTree_node* formal =
+                 GetFunctionFormals (facts -> funcs [func]);
+             formal; formal = formal -> right)
+        {
+            const var_index_type var = formal -> left -> data .var_index;
+
+            facts -> mentioned [func * n_vars + var] = true;
+            facts -> written   [func * n_vars + var] = true;
+            assigned [var] = true;
+        }
+
+        const BinTree_node* const body =
+            *GetFunctionBodyLink (facts -> funcs [func]);
+
+        CollectOwnFacts (body, func, facts);
+
+        MarkUnassignedReads (body, assigned,
+                             facts -> read_unassigned + func * n_vars, n_vars);
+    }
+
+    free (assigned);
+
+    CloseReaches (facts);
+
+    return true;
+}
+
+static void
+FactsDtor (function_facts* const facts)
+{
+    assert (facts);
+
+    free (facts -> funcs);
+    free (facts -> mentioned);
+    free (facts -> written);
+    free (facts -> read_unassigned);
+    free (facts -> reaches);
+    free (facts -> has_io);
+
+    facts -> funcs           = nullptr;
+    facts -> mentioned       = nullptr;
+    facts -> written         = nullptr;
+    facts -> read_unassigned = nullptr;
+    facts -> reaches         = nullptr;
+    facts -> has_io          = nullptr;
+}
+
+static void
+CollectOwnFacts (const BinTree_node*   const node,
+                 const var_index_type        func_index,
+                       function_facts* const facts)
+{
+    if (!node) return;
+
+    const var_index_type n_vars = facts -> n_vars;
+
+    switch (node -> data .data_type)
+    {
+        case VARIABLE:
+            facts -> mentioned [func_index * n_vars +
+                                node -> data .var_index] = true;
+            break;
+
+        case FUNCTION:
+            if (node -> data .func_index < facts -> n_funcs)
+                facts -> reaches [func_index * facts -> n_funcs +
+                                  node -> data .func_index] = true;
+            break;
+
+        case BIN_OP:
+            if (node -> data .bin_op_code == ASSUME_BEGIN)
+                facts -> written [func_index * n_vars +
+                                  node -> left -> data .var_index] = true;
+            break;
+
+        case UN_OP:
+            if (node -> data .un_op_code == IN)
+                facts -> written [func_index * n_vars +
+                                  node -> right -> data .var_index] = true;
+
+            if (node -> data .un_op_code == IN  ||
+                node -> data .un_op_code == OUT ||
+                node -> data .un_op_code == OUT_S)
+                facts -> has_io [func_index] = true;
+            break;
+
+        case NUMBER:      [[fallthrough]];
+        case PUNCTUATION: [[fallthrough]];
+        case KEY_OP:      [[fallthrough]];
+        case NO_TYPE:     [[fallthrough]];
+
+        default:
+            break;
+    }
+
+    CollectOwnFacts (node -> left,  func_index, facts);
+    CollectOwnFacts (node -> right, func_index, facts);
+}
+
+static void
+CloseReaches (function_facts* const facts)
+{
+    assert (facts);
+
+    const var_index_type n_funcs = facts -> n_funcs;
+
+    /* plain closure by propagation, call graphs are small */
+    bool is_changed = true;
+
+    while (is_changed)
+    {
+        is_changed = false;
+
+        for (var_index_type func = 0; func < n_funcs; func++)
+        {
+            bool* const row = facts -> reaches + func * n_funcs;
+
+            for (var_index_type callee = 0; callee < n_funcs; callee++)
+            {
+                if (!row [callee]) continue;
+
+                const bool* const callee_row =
+                    facts -> reaches + callee * n_funcs;
+
+                for (var_index_type next = 0; next < n_funcs; next++)
+                {
+                    if (callee_row [next] && !row [next])
+                    {
+                        row [next] = true;
+                        is_changed = true;
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Walks the chain keeping the slots surely assigned on every path.
+ * Returns false if there is no memory left for the branch copies,
+ * the reads are then marked as if nothing was assigned.
+ */
+static bool
+MarkUnassignedReads (const BinTree_node*   const chain,
+                           bool*           const assigned,
+                           bool*           const read_unassigned,
+                     const var_index_type        n_vars)
+{
+    assert (assigned);
+    assert (read_unassigned);
+
+    for (const BinTree_node* elem = chain; elem; elem = elem -> right)
+    {
+        const BinTree_node* const statement = elem -> left;
+        if (!statement) continue;
+
+        if (statement -> data .data_type   == BIN_OP &&
+            statement -> data .bin_op_code == ASSUME_BEGIN)
+        {
+            MarkReads (statement -> right, assigned, read_unassigned, n_vars);
+            assigned [statement -> left -> data .var_index] = true;
+        }
+
+        else if (IsStatementOperation (statement, IN))
+        {
+            assigned [statement -> right -> data .var_index] = true;
+        }
+
+        else if (statement -> data .data_type == KEY_OP)
+        {
+            MarkReads (statement -> left, assigned, read_unassigned, n_vars);
+
+            bool* const branch_assigned =
+                (bool*) calloc (n_vars + 1, sizeof (bool));
+            if (!branch_assigned)
+            {
+                perror ("branch_assigned allocation error");
+                memset (assigned, 0, n_vars * sizeof (bool));
+                return false;
+            }
+
+            memcpy (branch_assigned, assigned, n_vars * sizeof (bool));
+
+            if (!MarkUnassignedReads (statement -> right -> left,
+                                      branch_assigned, read_unassigned,
+                                      n_vars))
+            {
+                free (branch_assigned);
+                return false;
+            }
+
+            /* what a loop body assigns is not sure after the loop */
+            if (statement -> data .key_op_code == IF)
+            {
+                if (!MarkUnassignedReads (statement -> right -> right,
+                                          assigned, read_unassigned, n_vars))
+                {
+                    free (branch_assigned);
+                    return false;
+                }
+
+                for (var_index_type var = 0; var < n_vars; var++)
+                    assigned [var] = assigned [var] && branch_assigned [var];
+            }
+
+            free (branch_assigned);
+        }
+
+        else
+        {
+            MarkReads (statement, assigned, read_unassigned, n_vars);
+        }
+    }
+
+    return true;
+}
+
+static void
+MarkReads (const BinTree_node*   const node,
+           const bool*           const assigned,
+                 bool*           const read_unassigned,
+           const var_index_type        n_vars)
+{
+    if (!node) return;
+
+    if (node -> data .data_type == VARIABLE &&
+        node -> data .var_index < n_vars    &&
+        !assigned [node -> data .var_index])
+    {
+        read_unassigned [node -> data .var_index] = true;
+    }
+
+    MarkReads (node -> left,  assigned, read_unassigned, n_vars);
+    MarkReads (node -> right, assigned, read_unassigned, n_vars);
+}
+
+static void
+CheckCallSites (const BinTree_node*   const node,
+                const var_index_type        caller,
+                      bool*           const saved,
+                      purity_verdict* const verdicts,
+                      function_facts* const facts)
+{
+    if (!node) return;
+
+    const var_index_type n_vars  = facts -> n_vars;
+    const var_index_type n_funcs = facts -> n_funcs;
+
+    if (node -> data .data_type == FUNCTION &&
+        node -> data .func_index < n_funcs)
+    {
+        const var_index_type callee = node -> data .func_index;
+
+        memset (saved, 0, n_vars * sizeof (bool));
+        MarkMentionedVariables (node -> right, saved, n_vars);
+
+        for (var_index_type func = 1; func < n_funcs; func++)
+        {
+            if (verdicts [func] != PURE ||
+                (func != callee && !facts -> reaches [callee * n_funcs + func]))
+            {
+                continue;
+            }
+
+            for (var_index_type var = 0; var < n_vars; var++)
+            {
+                if (facts -> written   [func   * n_vars + var] &&
+                    facts -> mentioned [caller * n_vars + var] && !saved [var])
+                {
+                    verdicts [func] = IMPURE_WRITE;
+                    break;
+                }
+            }
+        }
+    }
+
+    CheckCallSites (node -> left,  caller, saved, verdicts, facts);
+    CheckCallSites (node -> right, caller, saved, verdicts, facts);
+}
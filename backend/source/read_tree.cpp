@@ -1,4 +1,5 @@
 #include "read_tree.h"
+#include "num_io.h"
 
 #define SKIP_SPACES(input, input_shift)     \
     while (isspace (input [*input_shift]))  \
@@ -63,15 +64,18 @@ ReadNode (BinTree*      const tree,
         return nullptr;
     }
 
-    data_type data_type  = NO_TYPE;
-    double    data_value = BinTree_POISON;
+    char* type_end = nullptr;
 
-    uint32_t n_read_symbols = 0;
+    const data_type data_type =
+        (enum data_type) strtol (input_str + *input_shift, &type_end, 10);
 
-    sscanf (input_str + *input_shift, "%d %lg %n",
-            &data_type, &data_value, &n_read_symbols);
+    *input_shift = (size_t) (type_end - input_str);
 
-    (*input_shift) += n_read_symbols;
+    SKIP_SPACES (input_str, input_shift);
+
+    double data_value = BinTree_POISON;
+
+    (*input_shift) += ParseDouble (input_str + *input_shift, &data_value);
 
     SKIP_SPACES (input_str, input_shift);
 
@@ -0,0 +1,505 @@
+#include "optimize.h"
+
+/*
+ * Function specialization: a call passing literals gets a clone of the
+ * callee made for them, one clone per callee and set of literal args.
+ * The clone takes the other args only. It starts with assignments of
+ * the literals to their formals, as slots outlive the call. Reads of
+ * such a formal become the literal up to where it may be reassigned.
+ * Folding and dead code elimination finish the job.
+ *
+ * Clones get fresh indices past the existing ones and go to the end of
+ * the function list, the labels follow the indices.
+ */
+
+struct clone_signature
+{
+    var_index_type func_index;
+    var_index_type clone_index;
+
+    size_t         n_args;
+    bool*          is_literal;
+    double*        values;
+};
+
+/* a literal formal being substituted through a chain in run order */
+struct substitution
+{
+    optimize_context* context;
+    bool*             assigned;     // scratch for calls
+
+    var_index_type    var_index;
+    double            value;
+
+    bool              is_dry;       // only finds out where it stops
+    bool              is_stopped;   // the formal may hold another value
+};
+
+struct clone_table
+{
+    clone_signature* signatures;
+    size_t           n_signatures;
+    size_t           capacity;      // the clone budget
+
+    var_index_type   n_original_funcs;
+};
+
+static bool
+SpecializeCalls     (BinTree_node*     const node,
+                     clone_table*      const table,
+                     optimize_context* const context);
+
+static bool
+IsSpecializable     (const BinTree_node*     const call,
+                           BinTree_node*     const callee,
+                     const optimize_context* const context);
+
+static var_index_type
+FindClone           (const clone_table*  const table,
+                     const BinTree_node* const call);
+
+static bool
+MakeClone           (const BinTree_node*     const call,
+                           BinTree_node*     const callee,
+                           clone_table*      const table,
+                           optimize_context* const context);
+
+static void
+SubstituteChain     (BinTree_node* const chain,
+                     substitution* const subst);
+
+static void
+SubstituteReads     (BinTree_node** const node_ptr,
+                     substitution*  const subst);
+
+static bool
+IsVariableMentioned (const BinTree_node*  const node,
+                     const var_index_type       var_index);
+
+static void
+DropLiteralArgs     (BinTree_node* const call,
+                     BinTree*      const tree);
+
+bool
+SpecializeFunctions (optimize_context* const context)
+{
+    assert (context);
+
+    clone_table table = {.signatures       = nullptr,
+                         .n_signatures     = 0,
+                         .capacity         = context -> config -> clone_budget,
+                         .n_original_funcs = context -> n_funcs};
+
+    if (table .capacity == 0) return false;
+
+    table .signatures =
+        (clone_signature*) calloc (table .capacity, sizeof (clone_signature));
+    if (!table .signatures)
+    {
+        perror ("clone table allocation error");
+        return false;
+    }
+
+    bool is_changed = false;
+
+    /* clones are appended, only the original functions are walked */
+    for (BinTree_node* func = context -> tree -> root; func;
+                       func = func -> right)
+    {
+        if (func -> data .func_index >= table .n_original_funcs) break;
+
+        if (SpecializeCalls (*GetFunctionBodyLink (func), &table, context))
+            is_changed = true;
+    }
+
+    for (size_t i = 0; i < table .n_signatures; i++)
+    {
+        free (table .signatures [i] .is_literal);
+        free (table .signatures [i] .values);
+    }
+
+    free (table .signatures);
+
+    return is_changed;
+}
+
+static bool
+SpecializeCalls (BinTree_node*     const node,
+                 clone_table*      const table,
+                 optimize_context* const context)
+{
+    assert (table);
+    assert (context);
+
+    if (!node) return false;
+
+    bool is_changed = SpecializeCalls (node -> left,  table, context);
+    is_changed      = SpecializeCalls (node -> right, table, context) ||
+                      is_changed;
+
+    if (node -> data .data_type != FUNCTION ||
+        node -> data .func_index == 0       ||
+        node -> data .func_index >= table -> n_original_funcs)
+    {
+        return is_changed;
+    }
+
+    BinTree_node* const callee =
+        GetFunctionByIndex (context -> tree -> root, node -> data .func_index);
+
+    if (!callee || !IsSpecializable (node, callee, context))
+        return is_changed;
+
+    var_index_type clone_index = FindClone (table, node);
+
+    if (clone_index == 0)
+    {
+        if (table -> n_signatures == table -> capacity ||
+            !MakeClone (node, callee, table, context))
+        {
+            return is_changed;
+        }
+
+        clone_index = table -> signatures [table -> n_signatures - 1]
+                          .clone_index;
+    }
+
+    node -> data .func_index = clone_index;
+    DropLiteralArgs (node, context -> tree);
+
+    return true;
+}
+
+static bool
+IsSpecializable (const BinTree_node*     const call,
+                       BinTree_node*     const callee,
+                 const optimize_context* const context)
+{
+    assert (call);
+    assert (callee);
+    assert (context);
+
+    const BinTree_node* const formals = GetFunctionFormals (callee);
+
+    if (CountListElems (call -> right) != CountListElems (formals))
+        return false;
+
+    if (CountNodes (callee -> left) > MAX_CLONED_NODES)
+        return false;
+
+    bool has_literal = false;
+
+    for (const BinTree_node* arg = call -> right; arg; arg = arg -> right)
+    {
+        if (arg -> left -> data .data_type == NUMBER)
+            has_literal = true;
+    }
+
+    /* with a repeated formal the order of pops decides, keep it */
+    for (const BinTree_node* formal = formals; formal; formal = formal -> right)
+    {
+        for (const BinTree_node* other = formal -> right; other;
+                                 other = other -> right)
+        {
+            if (formal -> left -> data .var_index ==
+                other  -> left -> data .var_index)
+            {
+                return false;
+            }
+        }
+    }
+
+    return has_literal;
+}
+
+/* returns 0 if there is no clone yet, main is never a clone */
+static var_index_type
+FindClone (const clone_table*  const table,
+           const BinTree_node* const call)
+{
+    assert (table);
+    assert (call);
+
+    for (size_t i = 0; i < table -> n_signatures; i++)
+    {
+        const clone_signature* const signature = &table -> signatures [i];
+
+        if (signature -> func_index != call -> data .func_index)
+            continue;
+
+        bool is_equal = true;
+        size_t arg_index = 0;
+
+        for (const BinTree_node* arg = call -> right; is_equal && arg;
+                                 arg = arg -> right, arg_index++)
+        {
+            const BinTree_node* const value = arg -> left;
+            const bool is_literal = value -> data .data_type == NUMBER;
+
+            is_equal = is_literal == signature -> is_literal [arg_index] &&
+                       (!is_literal ||
+                        memcmp (&value -> data .num_value,
+                                &signature -> values [arg_index],
+                                sizeof (double)) == 0);
+        }
+
+        if (is_equal) return signature -> clone_index;
+    }
+
+    return 0;
+}
+
+static bool
+MakeClone (const BinTree_node*     const call,
+                 BinTree_node*     const callee,
+                 clone_table*      const table,
+                 optimize_context* const context)
+{
+    assert (call);
+    assert (callee);
+    assert (table);
+    assert (context);
+
+    BinTree* const tree = context -> tree;
+
+    clone_signature* const signature =
+        &table -> signatures [table -> n_signatures];
+
+    signature -> n_args     = CountListElems (call -> right);
+    signature -> is_literal = (bool*)   calloc (signature -> n_args + 1,
+                                                sizeof (bool));
+    signature -> values     = (double*) calloc (signature -> n_args + 1,
+                                                sizeof (double));
+    bool* const assigned    = (bool*)   calloc (context -> n_vars + 1,
+                                                sizeof (bool));
+
+    if (!signature -> is_literal || !signature -> values || !assigned)
+    {
+        perror ("clone signature allocation error");
+        free (signature -> is_literal);
+        free (signature -> values);
+        free (assigned);
+        return false;
+    }
+
+    signature -> func_index  = call -> data .func_index;
+    signature -> clone_index = context -> n_funcs++;
+
+    BinTree_node*  body       = CopyNode (*GetFunctionBodyLink (callee),
+                                          nullptr, tree);
+    BinTree_node*  prologue   = nullptr;
+    BinTree_node** prologue_tail = &prologue;
+
+    BinTree_node*  formals    = nullptr;
+    BinTree_node** formals_tail  = &formals;
+
+    const BinTree_node* arg = call -> right;
+    size_t arg_index = 0;
+
+    for (const BinTree_node* formal = GetFunctionFormals (callee); formal;
+                             formal = formal -> right, arg = arg -> right,
+                                                       arg_index++)
+    {
+        const var_index_type var = formal -> left -> data .var_index;
+
+        if (arg -> left -> data .data_type != NUMBER)
+        {
+            formals_tail = AppendStatement (formals_tail,
+                                            MakeVariable (var, tree), tree);
+            continue;
+        }
+
+        const double value = arg -> left -> data .num_value;
+
+        signature -> is_literal [arg_index] = true;
+        signature -> values     [arg_index] = value;
+
+        prologue_tail = AppendStatement (prologue_tail,
+                                         MakeAssume (var,
+                                                     MakeNumber (value, tree),
+                                                     tree),
+                                         tree);
+
+        substitution subst = {.context    = context,
+                              .assigned   = assigned,
+                              .var_index  = var,
+                              .value      = value,
+                              .is_dry     = false,
+                              .is_stopped = false};
+
+        SubstituteChain (body, &subst);
+    }
+
+    *prologue_tail = body;
+
+    BinTree_node* const clone =
+        BinTree_CtorNode (FUNCTION, (double) signature -> clone_index,
+                          BinTree_CtorNode (PUNCTUATION, END_OF_OPERATION,
+                                            prologue, formals, nullptr, tree),
+                          nullptr, nullptr, tree);
+
+    BinTree_node* last_func = tree -> root;
+    while (last_func -> right) last_func = last_func -> right;
+
+    last_func -> right = clone;
+
+    table -> n_signatures++;
+
+    free (assigned);
+
+    return true;
+}
+
+static void
+SubstituteChain (BinTree_node* const chain,
+                 substitution* const subst)
+{
+    assert (subst);
+
+    const var_index_type var = subst -> var_index;
+
+    for (BinTree_node* elem = chain; elem && !subst -> is_stopped;
+                       elem = elem -> right)
+    {
+        BinTree_node* const statement = elem -> left;
+        if (!statement) continue;
+
+        if (statement -> data .data_type   == BIN_OP &&
+            statement -> data .bin_op_code == ASSUME_BEGIN)
+        {
+            SubstituteReads (&statement -> right, subst);
+
+            if (statement -> left -> data .var_index == var)
+                subst -> is_stopped = true;
+        }
+
+        else if (IsStatementOperation (statement, IN))
+        {
+            if (statement -> right -> data .var_index == var)
+                subst -> is_stopped = true;
+        }
+
+        else if (statement -> data .data_type   == KEY_OP &&
+                 statement -> data .key_op_code == IF)
+        {
+            SubstituteReads (&statement -> left, subst);
+            if (subst -> is_stopped) break;
+
+            substitution false_subst = *subst;
+
+            SubstituteChain (statement -> right -> left,  subst);
+            SubstituteChain (statement -> right -> right, &false_subst);
+
+            subst -> is_stopped = subst -> is_stopped ||
+                                  false_subst .is_stopped;
+        }
+
+        else if (statement -> data .data_type == KEY_OP)
+        {
+            /* the condition is read again after the body */
+            substitution dry_subst = *subst;
+            dry_subst .is_dry = true;
+
+            SubstituteReads (&statement -> left, &dry_subst);
+            SubstituteChain (statement -> right -> left, &dry_subst);
+
+            if (dry_subst .is_stopped)
+            {
+                subst -> is_stopped = true;
+                break;
+            }
+
+            SubstituteReads (&statement -> left, subst);
+            SubstituteChain (statement -> right -> left, subst);
+        }
+
+        else
+        {
+            SubstituteReads (&elem -> left, subst);
+        }
+    }
+}
+
+static void
+SubstituteReads (BinTree_node** const node_ptr,
+                 substitution*  const subst)
+{
+    assert (node_ptr);
+    assert (subst);
+
+    BinTree_node* const node = *node_ptr;
+    if (!node || subst -> is_stopped) return;
+
+    if (node -> data .data_type == VARIABLE)
+    {
+        if (node -> data .var_index == subst -> var_index && !subst -> is_dry)
+        {
+            BinTree* const tree = subst -> context -> tree;
+
+            *node_ptr = MakeNumber (subst -> value, tree);
+            BinTree_DestroySubtree (node, tree);
+        }
+
+        return;
+    }
+
+    if (node -> data .data_type == FUNCTION)
+    {
+        memset (subst -> assigned, 0,
+                subst -> context -> n_vars * sizeof (bool));
+        MarkAssignedVariables (node, subst -> assigned, subst -> context);
+
+        /* the call saves and restores the slots its args mention */
+        if (subst -> assigned [subst -> var_index])
+        {
+            if (!IsVariableMentioned (node -> right, subst -> var_index))
+                subst -> is_stopped = true;
+
+            return;
+        }
+    }
+
+    SubstituteReads (&node -> left,  subst);
+    SubstituteReads (&node -> right, subst);
+}
+
+static bool
+IsVariableMentioned (const BinTree_node*  const node,
+                     const var_index_type       var_index)
+{
+    if (!node) return false;
+
+    if (node -> data .data_type == VARIABLE &&
+        node -> data .var_index == var_index)
+    {
+        return true;
+    }
+
+    return IsVariableMentioned (node -> left,  var_index) ||
+           IsVariableMentioned (node -> right, var_index);
+}
+
+static void
+DropLiteralArgs (BinTree_node* const call,
+                 BinTree*      const tree)
+{
+    assert (call);
+    assert (tree);
+
+    BinTree_node** link = &call -> right;
+
+    while (*link)
+    {
+        BinTree_node* const arg = *link;
+
+        if (arg -> left -> data .data_type != NUMBER)
+        {
+            link = &arg -> right;
+            continue;
+        }
+
+        *link        = arg -> right;
+        arg -> right = nullptr;
+        BinTree_DestroySubtree (arg, tree);
+    }
+}
@@ -0,0 +1,370 @@
+#include "optimize.h"
+
+/*
+ * Fast math rewrites:
+ *   x pow n  -> multiplications by squaring, n is an integer literal
+ *   x div c  -> x mul (1 / c), c is a power of two
+ *   x mul 2  -> x add x,       x is a variable
+ *
+ * Division and doubling give the same bits, a multiplication chain
+ * may differ from pow in the last bit for |n| > 2.
+ *
+ * Squares used twice go to fresh slots assigned in front of the
+ * statement. That is impossible in a while condition and unsafe if
+ * the statement has calls, as they may change the base, so there
+ * only chains without temporaries (n up to 3) are built.
+ *
+ * x pow 0 -> 1 drops the variables of x. In the arguments of a call
+ * that is kept for x without variables: the call saves and restores
+ * the variables named in them, and a callee writing a dropped one
+ * would change it for the caller.
+ */
+
+struct reduce_state
+{
+    bool               can_splice;
+    size_t             n_open_calls;    // whose arguments the walk is in
+
+    BinTree_node*      spliced;
+    BinTree_node**     spliced_tail;
+
+    optimize_context*  context;
+};
+
+static bool
+ReduceInChain     (BinTree_node**    const chain_link,
+                   optimize_context* const context);
+
+static bool
+ReduceNode        (BinTree_node** const node_ptr,
+                   reduce_state*  const state);
+
+static bool
+ReducePow         (BinTree_node** const node_ptr,
+                   reduce_state*  const state);
+
+static bool
+ReduceDiv         (BinTree_node* const node);
+
+static bool
+ReduceMul         (BinTree_node* const node);
+
+static BinTree_node*
+BuildPower        (const var_index_type       base_index,
+                   const size_t               exponent,
+                         reduce_state*  const state);
+
+static var_index_type
+SpliceTemporary   (BinTree_node* const expression,
+                   reduce_state* const state);
+
+static bool
+ContainsVariable  (const BinTree_node* const node);
+
+bool
+ReduceStrength (optimize_context* const context)
+{
+    assert (context);
+
+    bool is_reduced = false;
+
+    for (BinTree_node* func = context -> tree -> root;
+                       func; func = func -> right)
+    {
+        is_reduced |= ReduceInChain (GetFunctionBodyLink (func), context);
+    }
+
+    return is_reduced;
+}
+
+static bool
+ReduceInChain (BinTree_node**    const chain_link,
+               optimize_context* const context)
+{
+    assert (chain_link);
+    assert (context);
+
+    bool is_reduced = false;
+
+    for (BinTree_node** link = chain_link; *link; link = &(*link) -> right)
+    {
+        BinTree_node* const node      = *link;
+        BinTree_node* const statement = node -> left;
+
+        if (!statement) continue;
+
+        reduce_state state = {.can_splice   = !ContainsCall (statement),
+                              .n_open_calls = 0,
+                              .spliced      = nullptr,
+                              .spliced_tail = nullptr,
+                              .context      = context};
+
+        state .spliced_tail = &state .spliced;
+
+        if (statement -> data .data_type == KEY_OP)
+        {
+            state .can_splice = statement -> data .key_op_code == IF &&
+                                !ContainsCall (statement -> left);
+
+            is_reduced |= ReduceNode (&statement -> left, &state);
+
+            is_reduced |= ReduceInChain (&statement -> right -> left,
+                                         context);
+            is_reduced |= ReduceInChain (&statement -> right -> right,
+                                         context);
+        }
+
+        else
+        {
+            is_reduced |= ReduceNode (&node -> left, &state);
+        }
+
+        if (state .spliced)
+        {
+            *state .spliced_tail = node;
+            *link                = state .spliced;
+            link                 = state .spliced_tail;
+        }
+    }
+
+    return is_reduced;
+}
+
+static bool
+ReduceNode (BinTree_node** const node_ptr,
+            reduce_state*  const state)
+{
+    assert (node_ptr);
+    assert (state);
+
+    BinTree_node* const node = *node_ptr;
+    if (!node) return false;
+
+    bool is_reduced = false;
+
+    if (!(node -> data .data_type   == BIN_OP &&
+          node -> data .bin_op_code == ASSUME_BEGIN))
+    {
+        is_reduced |= ReduceNode (&node -> left, state);
+    }
+
+    if (node -> data .data_type == FUNCTION)
+    {
+        state -> n_open_calls++;
+        is_reduced |= ReduceNode (&node -> right, state);
+        state -> n_open_calls--;
+
+        return is_reduced;
+    }
+
+    is_reduced |= ReduceNode (&node -> right, state);
+
+    if (node -> data .data_type != BIN_OP) return is_reduced;
+
+    switch (node -> data .bin_op_code)
+    {
+        case POW: return ReducePow (node_ptr, state) || is_reduced;
+        case DIV: return ReduceDiv (node)            || is_reduced;
+        case MUL: return ReduceMul (node)            || is_reduced;
+
+        default:  return is_reduced;
+    }
+}
+
+static bool
+ReducePow (BinTree_node** const node_ptr,
+           reduce_state*  const state)
+{
+    assert (node_ptr);
+    assert (state);
+
+    BinTree_node* const node = *node_ptr;
+    BinTree*      const tree = state -> context -> tree;
+
+    if (!node -> right || node -> right -> data .data_type != NUMBER)
+        return false;
+
+    const double exponent = node -> right -> data .num_value;
+
+    if (fabs (exponent) > (double) MAX_POW_EXPONENT ||
+        !IsNumberNode (node -> right, (double) (int64_t) exponent))
+    {
+        return false;
+    }
+
+    const size_t abs_exponent = (size_t) fabs (exponent);
+
+    if (abs_exponent == 0)
+    {
+        /* pow (x, 0) is 1 even for nan */
+        if (ContainsCall (node -> left) ||
+            (state -> n_open_calls && ContainsVariable (node -> left)))
+        {
+            return false;
+        }
+
+        *node_ptr = MakeNumber (1, tree);
+        BinTree_DestroySubtree (node, tree);
+
+        return true;
+    }
+
+    const bool is_base_var = node -> left -> data .data_type == VARIABLE;
+
+    if ((!is_base_var || abs_exponent > 3) && !state -> can_splice)
+        return false;
+
+    var_index_type base_index = VAR_INDEX_POISON;
+
+    if (is_base_var)
+    {
+        base_index = node -> left -> data .var_index;
+    }
+
+    else
+    {
+        base_index = SpliceTemporary (node -> left, state);
+        node -> left = nullptr;
+    }
+
+    BinTree_node* power = BuildPower (base_index, abs_exponent, state);
+
+    if (exponent < 0)
+    {
+        power = BinTree_CtorNode (BIN_OP, DIV, MakeNumber (1, tree),
+                                  power, nullptr, tree);
+    }
+
+    *node_ptr = power;
+    BinTree_DestroySubtree (node, tree);
+
+    return true;
+}
+
+static bool
+ReduceDiv (BinTree_node* const node)
+{
+    assert (node);
+
+    if (!node -> right || node -> right -> data .data_type != NUMBER)
+        return false;
+
+    const double divisor = node -> right -> data .num_value;
+
+    int    divisor_exp      = 0;
+    double divisor_mantissa = frexp (divisor, &divisor_exp);
+
+    /* only powers of two have an exact reciprocal */
+    if (fabs (divisor_mantissa) < 0.5 || fabs (divisor_mantissa) > 0.5)
+        return false;
+
+    const double reciprocal = 1 / divisor;
+
+    if (!isnormal (reciprocal) || !IsPrintedExactly (reciprocal))
+        return false;
+
+    node -> data .bin_op_code        = MUL;
+    node -> right -> data .num_value = reciprocal;
+
+    return true;
+}
+
+static bool
+ReduceMul (BinTree_node* const node)
+{
+    assert (node);
+
+    BinTree_node* factor = nullptr;
+    BinTree_node* two    = nullptr;
+
+    if (IsNumberNode (node -> right, 2))
+    {
+        factor = node -> left;
+        two    = node -> right;
+    }
+
+    else if (IsNumberNode (node -> left, 2))
+    {
+        factor = node -> right;
+        two    = node -> left;
+    }
+
+    if (!factor || factor -> data .data_type != VARIABLE) return false;
+
+    /* the node with 2 becomes the second operand of the addition */
+    two -> data .data_type = VARIABLE;
+    two -> data .var_index = factor -> data .var_index;
+
+    node -> data .bin_op_code = ADD;
+
+    return true;
+}
+
+/*
+ * x^n = x^(n-1) * x for odd n and (x^(n/2))^2 for even n,
+ * x^(n/2) goes to a temporary unless it is x itself.
+ */
+static BinTree_node*
+BuildPower (const var_index_type       base_index,
+            const size_t               exponent,
+                  reduce_state*  const state)
+{
+    assert (state);
+    assert (exponent > 0);
+
+    BinTree* const tree = state -> context -> tree;
+
+    if (exponent == 1)
+        return MakeVariable (base_index, tree);
+
+    if (exponent % 2 == 1)
+    {
+        return BinTree_CtorNode (BIN_OP, MUL,
+                                 BuildPower (base_index, exponent - 1, state),
+                                 MakeVariable (base_index, tree),
+                                 nullptr, tree);
+    }
+
+    var_index_type half_index = base_index;
+
+    if (exponent / 2 > 1)
+    {
+        half_index =
+            SpliceTemporary (BuildPower (base_index, exponent / 2, state),
+                             state);
+    }
+
+    return BinTree_CtorNode (BIN_OP, MUL,
+                             MakeVariable (half_index, tree),
+                             MakeVariable (half_index, tree),
+                             nullptr, tree);
+}
+
+static var_index_type
+SpliceTemporary (BinTree_node* const expression,
+                 reduce_state* const state)
+{
+    assert (expression);
+    assert (state);
+    assert (state -> can_splice);
+
+    const var_index_type temp_index = AllocateVariable (state -> context);
+
+    state -> spliced_tail =
+        AppendStatement (state -> spliced_tail,
+                         MakeAssume (temp_index, expression,
+                                     state -> context -> tree),
+                         state -> context -> tree);
+
+    return temp_index;
+}
+
+static bool
+ContainsVariable (const BinTree_node* const node)
+{
+    if (!node) return false;
+
+    if (node -> data .data_type == VARIABLE) return true;
+
+    return ContainsVariable (node -> left) || ContainsVariable (node -> right);
+}
@@ -0,0 +1,478 @@
+#include "optimize.h"
+
+/*
+ * Unrolling of counted loops:
+ *
+ *     i = c0 ... while (i < n) { ... i = i + s ... }
+ *
+ * i is assigned once in the body, at its top level, and nowhere else
+ * in the loop or in the functions it calls; n is a literal or a slot
+ * the loop doesn't assign. c0 and s are integer literals, so every
+ * value of i is exact and i + k * s is what k steps give.
+ *
+ * If the trip count is known and the copies fit unroll_limit nodes,
+ * the loop becomes that many copies of the body. Otherwise a loop
+ * doing unroll_factor bodies per check goes in front of it:
+ *
+ *     while (i + (factor - 1) * s < n) { body ... body }
+ *     while (i < n) { body }
+ */
+
+const size_t MAX_FULL_TRIP_COUNT = 1024;
+
+/* integers up to it are exact, and so are sums of a few of them */
+const double MAX_EXACT_COUNTER   = 4503599627370496.0;   // 2^52
+
+struct counted_loop
+{
+    var_index_type      counter;
+    double              init;
+    double              step;
+    op_code_type        compare;    // with the counter on the left
+    const BinTree_node* bound;
+};
+
+static bool
+UnrollChain         (BinTree_node**    const chain_link,
+                     optimize_context* const context);
+
+static bool
+MatchCountedLoop    (const BinTree_node*     const chain,
+                     const BinTree_node*     const loop_elem,
+                           counted_loop*     const loop,
+                           optimize_context* const context);
+
+static bool
+MatchCompare        (const BinTree_node*  const condition,
+                     const bool                 is_counter_left,
+                           counted_loop*  const loop);
+
+static bool
+MatchStep           (const BinTree_node*     const body,
+                           counted_loop*     const loop,
+                           bool*             const assigned,
+                           optimize_context* const context);
+
+static bool
+MatchInit           (const BinTree_node*     const chain,
+                     const BinTree_node*     const loop_elem,
+                           counted_loop*     const loop,
+                           bool*             const assigned,
+                           optimize_context* const context);
+
+static bool
+IsExactInteger      (const double value);
+
+static bool
+CountTrips          (const counted_loop* const loop,
+                           size_t*       const n_trips);
+
+static BinTree_node*
+CopyBodies          (      BinTree_node* const body,
+                     const size_t              n_copies,
+                           BinTree*      const tree);
+
+bool
+UnrollLoops (optimize_context* const context)
+{
+    assert (context);
+
+    bool is_unrolled = false;
+
+    for (BinTree_node* func = context -> tree -> root;
+                       func; func = func -> right)
+    {
+        is_unrolled |= UnrollChain (GetFunctionBodyLink (func), context);
+    }
+
+    return is_unrolled;
+}
+
+/* inner loops go first, an outer one then copies them unrolled */
+static bool
+UnrollChain (BinTree_node**    const chain_link,
+             optimize_context* const context)
+{
+    assert (chain_link);
+    assert (context);
+
+    BinTree* const tree = context -> tree;
+
+    const size_t factor = context -> config -> unroll_factor;
+    const size_t limit  = context -> config -> unroll_limit;
+
+    bool is_unrolled = false;
+
+    BinTree_node** link = chain_link;
+
+    while (*link)
+    {
+        BinTree_node** const loop_link = link;
+        BinTree_node*  const elem      = *link;
+        BinTree_node*  const statement = elem -> left;
+
+        link = &elem -> right;
+
+        if (!statement || statement -> data .data_type != KEY_OP)
+            continue;
+
+        is_unrolled |= UnrollChain (&statement -> right -> left,  context);
+        is_unrolled |= UnrollChain (&statement -> right -> right, context);
+
+        counted_loop loop = {};
+
+        if (statement -> data .key_op_code != WHILE ||
+            !MatchCountedLoop (*chain_link, elem, &loop, context))
+        {
+            continue;
+        }
+
+        BinTree_node* const body      = statement -> right -> left;
+        const size_t        body_size = CountNodes (body);
+
+        size_t n_trips = 0;
+
+        if (CountTrips (&loop, &n_trips) && n_trips * body_size <= limit)
+        {
+            /* the copies are unrolled already, go on after them */
+            link  = loop_link;
+            *link = CopyBodies (body, n_trips, tree);
+
+            while (*link) link = &(*link) -> right;
+
+            *link         = elem -> right;
+            elem -> right = nullptr;
+            BinTree_DestroySubtree (elem, tree);
+
+            is_unrolled = true;
+            continue;
+        }
+
+        if (factor < 2 || factor * body_size > limit ||
+            loop .compare == NOT_EQUAL)
+        {
+            continue;
+        }
+
+        /* i + (factor - 1) * s passes the check iff all the steps do */
+        BinTree_node* const guard =
+            BinTree_CtorNode (BIN_OP, loop .compare,
+                              BinTree_CtorNode (BIN_OP, ADD,
+                                  MakeVariable (loop .counter, tree),
+                                  MakeNumber ((double) (factor - 1) *
+                                              loop .step, tree),
+                                  nullptr, tree),
+                              loop .bound -> data .data_type == NUMBER ?
+                                  MakeNumber   (loop .bound -> data .num_value, tree) :
+                                  MakeVariable (loop .bound -> data .var_index, tree),
+                              nullptr, tree);
+
+        BinTree_node* const unrolled =
+            BinTree_CtorNode (KEY_OP, WHILE, guard,
+                              BinTree_CtorNode (PUNCTUATION, END_OF_OPERATION,
+                                                CopyBodies (body, factor,
+                                                            tree),
+                                                nullptr, nullptr, tree),
+                              nullptr, tree);
+
+        /* the original loop stays behind it for the remainder */
+        *loop_link = BinTree_CtorNode (PUNCTUATION, END_OF_OPERATION,
+                                       unrolled, elem, nullptr, tree);
+
+        is_unrolled = true;
+    }
+
+    return is_unrolled;
+}
+
+static bool
+MatchCountedLoop (const BinTree_node*     const chain,
+                  const BinTree_node*     const loop_elem,
+                        counted_loop*     const loop,
+                        optimize_context* const context)
+{
+    assert (loop_elem);
+    assert (loop);
+    assert (context);
+
+    const BinTree_node* const statement = loop_elem -> left;
+
+    bool* const assigned = (bool*) calloc (context -> n_vars + 1,
+                                           sizeof (bool));
+    if (!assigned)
+    {
+        perror ("assigned allocation error");
+        return false;
+    }
+
+    bool is_matched = false;
+
+    for (int side = 0; side < 2 && !is_matched; side++)
+    {
+        is_matched = MatchCompare (statement -> left, side == 0, loop)    &&
+                     MatchStep (statement -> right -> left, loop,
+                                assigned, context)                        &&
+                     MatchInit (chain, loop_elem, loop, assigned, context);
+    }
+
+    free (assigned);
+
+    return is_matched;
+}
+
+static bool
+MatchCompare (const BinTree_node*  const condition,
+              const bool                 is_counter_left,
+                    counted_loop*  const loop)
+{
+    assert (condition);
+    assert (loop);
+
+    if (condition -> data .data_type != BIN_OP) return false;
+
+    const BinTree_node* const counter = is_counter_left ? condition -> left
+                                                        : condition -> right;
+    const BinTree_node* const bound   = is_counter_left ? condition -> right
+                                                        : condition -> left;
+
+    if (counter -> data .data_type != VARIABLE) return false;
+
+    if (bound -> data .data_type != NUMBER &&
+        (bound -> data .data_type != VARIABLE ||
+         bound -> data .var_index == counter -> data .var_index))
+    {
+        return false;
+    }
+
+    op_code_type compare = condition -> data .bin_op_code;
+
+    switch (compare)
+    {
+        case LESS:             compare = is_counter_left ? LESS    : GREATER;
+                               break;
+        case GREATER:          compare = is_counter_left ? GREATER : LESS;
+                               break;
+        case LESS_OR_EQUAL:    compare = is_counter_left ? LESS_OR_EQUAL
+                                                         : GREATER_OR_EQUAL;
+                               break;
+        case GREATER_OR_EQUAL: compare = is_counter_left ? GREATER_OR_EQUAL
+                                                         : LESS_OR_EQUAL;
+                               break;
+        case NOT_EQUAL:        break;
+
+        default:
+            return false;
+    }
+
+    loop -> counter = counter -> data .var_index;
+    loop -> compare = compare;
+    loop -> bound   = bound;
+
+    return true;
+}
+
+/*
+ * The body must assign the counter once at its top level by a literal
+ * step and leave the counter and the bound alone everywhere else.
+ */
+static bool
+MatchStep (const BinTree_node*     const body,
+                 counted_loop*     const loop,
+                 bool*             const assigned,
+                 optimize_context* const context)
+{
+    assert (loop);
+    assert (assigned);
+    assert (context);
+
+    const var_index_type counter = loop -> counter;
+
+    size_t n_steps = 0;
+
+    for (const BinTree_node* elem = body; elem; elem = elem -> right)
+    {
+        const BinTree_node* const statement = elem -> left;
+
+        const bool is_step = statement                                   &&
+                             statement -> data .data_type   == BIN_OP    &&
+                             statement -> data .bin_op_code ==
+                                 ASSUME_BEGIN                            &&
+                             statement -> left -> data .var_index ==
+                                 counter;
+
+        if (is_step)
+        {
+            const BinTree_node* const value = statement -> right;
+            if (value -> data .data_type != BIN_OP) return false;
+
+            const BinTree_node* const left  = value -> left;
+            const BinTree_node* const right = value -> right;
+
+            const bool is_left_counter  = left  -> data .data_type == VARIABLE &&
+                                          left  -> data .var_index == counter;
+            const bool is_right_counter = right -> data .data_type == VARIABLE &&
+                                          right -> data .var_index == counter;
+
+            if (value -> data .bin_op_code == ADD && is_left_counter &&
+                right -> data .data_type == NUMBER)
+            {
+                loop -> step = right -> data .num_value;
+            }
+
+            else if (value -> data .bin_op_code == ADD && is_right_counter &&
+                     left -> data .data_type == NUMBER)
+            {
+                loop -> step = left -> data .num_value;
+            }
+
+            else if (value -> data .bin_op_code == SUB && is_left_counter &&
+                     right -> data .data_type == NUMBER)
+            {
+                loop -> step = -right -> data .num_value;
+            }
+
+            else
+            {
+                return false;
+            }
+
+            n_steps++;
+            continue;
+        }
+
+        memset (assigned, 0, context -> n_vars * sizeof (bool));
+        MarkAssignedVariables (statement, assigned, context);
+
+        if (assigned [counter]) return false;
+
+        if (loop -> bound -> data .data_type == VARIABLE &&
+            assigned [loop -> bound -> data .var_index])
+        {
+            return false;
+        }
+    }
+
+    if (n_steps != 1 || !IsExactInteger (loop -> step) ||
+        !(loop -> step < 0 || loop -> step > 0))
+    {
+        return false;
+    }
+
+    /* a step away from the bound never ends the loop, leave it alone */
+    switch (loop -> compare)
+    {
+        case LESS:             [[fallthrough]];
+        case LESS_OR_EQUAL:    return loop -> step > 0;
+
+        case GREATER:          [[fallthrough]];
+        case GREATER_OR_EQUAL: return loop -> step < 0;
+
+        default:
+            return true;
+    }
+}
+
+/* the counter must get an integer literal in front of the loop */
+static bool
+MatchInit (const BinTree_node*     const chain,
+           const BinTree_node*     const loop_elem,
+                 counted_loop*     const loop,
+                 bool*             const assigned,
+                 optimize_context* const context)
+{
+    assert (loop_elem);
+    assert (loop);
+    assert (assigned);
+    assert (context);
+
+    bool is_known = false;
+
+    for (const BinTree_node* elem = chain; elem != loop_elem;
+                             elem = elem -> right)
+    {
+        const BinTree_node* const statement = elem -> left;
+
+        if (statement                                            &&
+            statement -> data .data_type   == BIN_OP             &&
+            statement -> data .bin_op_code == ASSUME_BEGIN       &&
+            statement -> left  -> data .var_index == loop -> counter &&
+            statement -> right -> data .data_type == NUMBER)
+        {
+            loop -> init = statement -> right -> data .num_value;
+            is_known     = IsExactInteger (loop -> init);
+            continue;
+        }
+
+        memset (assigned, 0, context -> n_vars * sizeof (bool));
+        MarkAssignedVariables (statement, assigned, context);
+
+        if (assigned [loop -> counter]) is_known = false;
+    }
+
+    return is_known;
+}
+
+static bool
+IsExactInteger (const double value)
+{
+    return isfinite (value) && fabs (value) < MAX_EXACT_COUNTER &&
+           !(floor (value) < value) && !(floor (value) > value);
+}
+
+/* runs the checks the way the processor would, for a literal bound */
+static bool
+CountTrips (const counted_loop* const loop,
+                  size_t*       const n_trips)
+{
+    assert (loop);
+    assert (n_trips);
+
+    if (loop -> bound -> data .data_type != NUMBER) return false;
+
+    const double bound = loop -> bound -> data .num_value;
+
+    double counter = loop -> init;
+    size_t trips   = 0;
+
+    for (; trips <= MAX_FULL_TRIP_COUNT; trips++)
+    {
+        double is_running = 0;
+
+        if (!EvaluateOperation (loop -> compare, counter, bound, &is_running))
+            return false;
+
+        if (!(is_running < 0 || is_running > 0)) break;
+
+        if (!EvaluateOperation (ADD, counter, loop -> step, &counter) ||
+            !IsExactInteger (counter))
+        {
+            return false;
+        }
+    }
+
+    if (trips > MAX_FULL_TRIP_COUNT) return false;
+
+    *n_trips = trips;
+
+    return true;
+}
+
+static BinTree_node*
+CopyBodies (      BinTree_node* const body,
+            const size_t              n_copies,
+                  BinTree*      const tree)
+{
+    assert (tree);
+
+    BinTree_node*  copies    = nullptr;
+    BinTree_node** tail_link = &copies;
+
+    for (size_t copy = 0; copy < n_copies; copy++)
+    {
+        *tail_link = CopyNode (body, nullptr, tree);
+
+        while (*tail_link) tail_link = &(*tail_link) -> right;
+    }
+
+    return copies;
+}
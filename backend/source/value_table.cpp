@@ -0,0 +1,225 @@
+#include "value_table.h"
+
+static size_t
+HashValueKey    (const value_key* const key);
+
+static bool
+IsKeyEqual      (const value_key* const left,
+                 const value_key* const right);
+
+static bool
+ValueTableGrow  (value_table* const table);
+
+static bool
+AllocateSlots   (value_table* const table,
+                 const size_t       capacity);
+
+bool
+ValueTableCtor (value_table* const table)
+{
+    assert (table);
+
+    table -> n_keys     = 0;
+    table -> generation = 1;
+    table -> n_ids      = 0;
+
+    return AllocateSlots (table, VALUE_TABLE_INIT_CAPACITY);
+}
+
+void
+ValueTableDtor (value_table* const table)
+{
+    assert (table);
+
+    free (table -> keys);
+    free (table -> ids);
+    free (table -> generations);
+
+    table -> keys        = nullptr;
+    table -> ids         = nullptr;
+    table -> generations = nullptr;
+    table -> capacity    = 0;
+}
+
+void
+ValueTableClear (value_table* const table)
+{
+    assert (table);
+
+    table -> generation++;
+    table -> n_keys = 0;
+    table -> n_ids  = 0;
+}
+
+value_id_type
+GetValueId (      value_table* const table,
+            const value_key*   const key)
+{
+    assert (table);
+    assert (key);
+
+    /* keep the load under a half so that probe chains stay short */
+    if (2 * (table -> n_keys + 1) > table -> capacity &&
+        !ValueTableGrow (table))
+    {
+        return NO_VALUE_ID;
+    }
+
+    const size_t mask = table -> capacity - 1;
+
+    for (size_t slot = HashValueKey (key) & mask; ; slot = (slot + 1) & mask)
+    {
+        if (table -> generations [slot] != table -> generation)
+        {
+            table -> keys        [slot] = *key;
+            table -> ids         [slot] = NewValueId (table);
+            table -> generations [slot] = table -> generation;
+
+            table -> n_keys++;
+
+            return table -> ids [slot];
+        }
+
+        if (IsKeyEqual (&table -> keys [slot], key))
+            return table -> ids [slot];
+    }
+}
+
+value_id_type
+NewValueId (value_table* const table)
+{
+    assert (table);
+
+    return table -> n_ids++;
+}
+
+value_key
+MakeNumberKey (const double value)
+{
+    value_key key = {.type  = NUMBER,
+                     .op    = 0,
+                     .left  = NO_VALUE_ID,
+                     .right = NO_VALUE_ID};
+
+    memcpy (&key .op, &value, sizeof (double));
+
+    return key;
+}
+
+value_key
+MakeOperationKey (const data_type           type,
+                  const op_code_type        op_code,
+                  const value_id_type       left,
+                  const value_id_type       right)
+{
+    value_key key = {.type  = type,
+                     .op    = (uint64_t) op_code,
+                     .left  = left,
+                     .right = right};
+
+    return key;
+}
+
+static size_t
+HashValueKey (const value_key* const key)
+{
+    assert (key);
+
+    uint64_t hash = key -> op * 0x9E3779B97F4A7C15ull;
+
+    hash ^= (uint64_t) key -> left  + 0x632BE59BD9B4E019ull + (hash << 6);
+    hash ^= (uint64_t) key -> right + 0x85EBCA77C2B2AE63ull + (hash << 6);
+    hash ^= (uint64_t) key -> type;
+
+    /* the low bits pick the slot, mix the high ones down */
+    hash ^= hash >> 29;
+    hash *= 0xBF58476D1CE4E5B9ull;
+    hash ^= hash >> 32;
+
+    return (size_t) hash;
+}
+
+static bool
+IsKeyEqual (const value_key* const left,
+            const value_key* const right)
+{
+    return left -> type  == right -> type  &&
+           left -> op    == right -> op    &&
+           left -> left  == right -> left  &&
+           left -> right == right -> right;
+}
+
+static bool
+ValueTableGrow (value_table* const table)
+{
+    assert (table);
+
+    value_key*     const old_keys        = table -> keys;
+    value_id_type* const old_ids         = table -> ids;
+    size_t*        const old_generations = table -> generations;
+    const size_t         old_capacity    = table -> capacity;
+
+    if (!AllocateSlots (table, 2 * old_capacity))
+    {
+        table -> keys        = old_keys;
+        table -> ids         = old_ids;
+        table -> generations = old_generations;
+        table -> capacity    = old_capacity;
+
+        return false;
+    }
+
+    const size_t mask = table -> capacity - 1;
+
+    for (size_t i = 0; i < old_capacity; i++)
+    {
+        if (old_generations [i] != table -> generation) continue;
+
+        size_t slot = HashValueKey (&old_keys [i]) & mask;
+
+        while (table -> generations [slot] == table -> generation)
+            slot = (slot + 1) & mask;
+
+        table -> keys        [slot] = old_keys [i];
+        table -> ids         [slot] = old_ids  [i];
+        table -> generations [slot] = table -> generation;
+    }
+
+    free (old_keys);
+    free (old_ids);
+    free (old_generations);
+
+    return true;
+}
+
+static bool
+AllocateSlots (value_table* const table,
+               const size_t       capacity)
+{
+    assert (table);
+
+    table -> keys        = (value_key*)     calloc (capacity,
+                                                    sizeof (value_key));
+    table -> ids         = (value_id_type*) calloc (capacity,
+                                                    sizeof (value_id_type));
+    table -> generations = (size_t*)        calloc (capacity,
+                                                    sizeof (size_t));
+    table -> capacity    = capacity;
+
+    if (!table -> keys || !table -> ids || !table -> generations)
+    {
+        perror ("value table allocation error");
+
+        free (table -> keys);
+        free (table -> ids);
+        free (table -> generations);
+
+        table -> keys        = nullptr;
+        table -> ids         = nullptr;
+        table -> generations = nullptr;
+
+        return false;
+    }
+
+    return true;
+}
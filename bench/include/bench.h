@@ -0,0 +1,78 @@
+#pragma once
+
+#include "generate.h"
+#include "optimize.h"
+
+/* the base shape is scaled by the number of functions */
+const char DEFAULT_SWEEP[] = "1,4,16,64";
+
+const size_t MAX_SWEEP_POINTS = 16;
+
+const size_t DEFAULT_BENCH_REPEATS = 3;
+
+/* the shapes that are not scaled: a value in many parentheses and many names */
+const size_t ADVERSARIAL_NESTING_DEPTH = 10000;
+
+const size_t ADVERSARIAL_N_VARS        = 100000;
+const size_t ADVERSARIAL_N_FUNCS       = 100;
+
+const size_t BENCH_POINT_NAME_LEN = 32;
+
+enum bench_format
+{
+    BENCH_CSV  = 0,
+    BENCH_JSON = 1,
+};
+
+/* the best time of the repeats, every stage on its own */
+struct stage_times
+{
+    double lex;
+    double parse;
+    double write_tree;
+    double read_tree;
+    double optimize;
+    double codegen;
+};
+
+struct bench_point
+{
+    char          name [BENCH_POINT_NAME_LEN];
+    program_shape shape;
+
+    size_t        source_size;  // bytes
+    size_t        n_nodes;      // of the tree the frontend writes
+    stage_times   seconds;
+};
+
+struct bench_config
+{
+    const optimize_config* optimize;
+    const char*            work_dir;    // where the programs, trees and asm go
+    size_t                 n_jobs;      // of the frontend and of codegen
+    size_t                 n_repeats;
+};
+
+/*
+ * Generates the program of the point's shape and compiles it n_repeats
+ * times as the frontend and the backend do: lexing, parsing, writing
+ * the tree, reading it back, the passes and codegen. Sets the sizes
+ * and the times of the point, returns false if a stage fails.
+ */
+bool
+RunBenchPoint       (const bench_config* const config,
+                           bench_point*  const point);
+
+void
+PrintBenchHeader    (      FILE*         const stream,
+                     const bench_format        format);
+
+void
+PrintBenchPoint     (      FILE*         const stream,
+                     const bench_point*  const point,
+                     const bench_format        format,
+                     const bool                is_first);
+
+void
+PrintBenchFooter    (      FILE*         const stream,
+                     const bench_format        format);
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* names are a letter and base-26 digits, padded to the length asked for */
+const size_t MIN_NAME_LEN = 4;
+
+/* the frontend keeps names up to VAR_NAME_MAX_LEN - 1 characters */
+const size_t MAX_NAME_LEN = 48;
+
+const size_t MAX_EXPR_DEPTH = 16;
+
+const size_t N_FUNC_PARAMS = 2;
+
+/*
+ * What a generated program looks like. Main is one of the functions,
+ * the others are called by the ones before them only, so none of
+ * them recurses. Statement k of the program assigns variable
+ * k % n_vars, so all of the variables are there if there are
+ * at least n_vars statements.
+ */
+struct program_shape
+{
+    size_t   n_funcs;
+    size_t   n_statements;      // per function, an if with its body is one
+    size_t   expr_depth;        // levels of operators, 2^depth values in an expression
+    size_t   n_vars;            // distinct variable names
+    size_t   name_len;          // of variables and functions
+    size_t   comment_percent;   // of statements after a comment
+    size_t   nesting_depth;     // Unexpected ... Journey around a value of main, 0 for none
+    uint64_t seed;
+};
+
+/* a small program, the base of the sweep of the benchmark */
+const program_shape DEFAULT_PROGRAM_SHAPE = {.n_funcs         = 16,
+                                             .n_statements    = 32,
+                                             .expr_depth      = 3,
+                                             .n_vars          = 64,
+                                             .name_len        = 8,
+                                             .comment_percent = 10,
+                                             .nesting_depth   = 0,
+                                             .seed            = 1};
+
+/* takes --funcs=, --statements=, --depth=, --vars=, --name-len=, --comments=, --nesting= and --seed= */
+bool
+ParseShapeOption (const char*          const option,
+                        program_shape* const shape);
+
+/* returns false if the shape is out of its limits or the stream fails */
+bool
+GenerateProgram  (const program_shape* const shape,
+                        FILE*          const stream);
@@ -0,0 +1,298 @@
+#include <assert.h>
+#include <float.h>
+#include <limits.h>
+#include "bench.h"
+#include "read_code.h"
+#include "BinTree_PrintPreOrder.h"
+#include "read_tree.h"
+#include "print_asm.h"
+
+static bool
+WriteBenchProgram (const bench_point* const point,
+                   const char*        const source_name,
+                         size_t*      const source_size);
+
+static bool
+RunStages         (const bench_config* const config,
+                   const char*         const source_name,
+                   const char*         const tree_name,
+                   const char*         const asm_name,
+                         size_t*       const n_nodes,
+                         stage_times*  const seconds);
+
+static void
+KeepBestTimes     (      stage_times* const best,
+                   const stage_times* const times);
+
+/*
+ * The tree the frontend reads is destroyed before the backend reads
+ * its text, as if they were two processes. Freeing is not timed.
+ */
+bool
+RunBenchPoint (const bench_config* const config,
+                     bench_point*  const point)
+{
+    assert (config);
+    assert (config -> work_dir);
+    assert (config -> optimize);
+    assert (point);
+
+    char source_name [PATH_MAX] = "";
+    char tree_name   [PATH_MAX] = "";
+    char asm_name    [PATH_MAX] = "";
+
+    snprintf (source_name, sizeof (source_name), "%s/bench_%s.txt",  config -> work_dir, point -> name);
+    snprintf (tree_name,   sizeof (tree_name),   "%s/bench_%s.tree", config -> work_dir, point -> name);
+    snprintf (asm_name,    sizeof (asm_name),    "%s/bench_%s.asm",  config -> work_dir, point -> name);
+
+    if (!WriteBenchProgram (point, source_name, &point -> source_size))
+        return false;
+
+    point -> seconds = {.lex        = DBL_MAX,
+                        .parse      = DBL_MAX,
+                        .write_tree = DBL_MAX,
+                        .read_tree  = DBL_MAX,
+                        .optimize   = DBL_MAX,
+                        .codegen    = DBL_MAX};
+
+    const size_t n_repeats = config -> n_repeats ? config -> n_repeats : 1;
+
+    for (size_t i = 0; i < n_repeats; i++)
+    {
+        stage_times times = {};
+
+        if (!RunStages (config, source_name, tree_name, asm_name, &point -> n_nodes, &times))
+        {
+            fprintf (stderr, "%s: benchmark failed\n", source_name);
+            return false;
+        }
+
+        KeepBestTimes (&point -> seconds, &times);
+    }
+
+    return true;
+}
+
+void
+PrintBenchHeader (      FILE*        const stream,
+                  const bench_format       format)
+{
+    assert (stream);
+
+    switch (format)
+    {
+        case BENCH_CSV:
+            fprintf (stream, "name,funcs,statements,depth,vars,nesting,bytes,nodes,"
+                             "lex_ms,parse_ms,write_ms,read_ms,optimize_ms,codegen_ms,"
+                             "total_ms,mb_per_s\n");
+            break;
+
+        case BENCH_JSON:
+            fprintf (stream, "{\"points\": [");
+            break;
+
+        default:
+            break;
+    }
+}
+
+/* the throughput is of the source, through all of the stages */
+void
+PrintBenchPoint (      FILE*        const stream,
+                 const bench_point* const point,
+                 const bench_format       format,
+                 const bool               is_first)
+{
+    assert (stream);
+    assert (point);
+
+    const stage_times*   const seconds = &point -> seconds;
+    const program_shape* const shape   = &point -> shape;
+
+    const double total_seconds = seconds -> lex        + seconds -> parse     +
+                                 seconds -> write_tree + seconds -> read_tree +
+                                 seconds -> optimize   + seconds -> codegen;
+
+    const double mb_per_second = total_seconds > 0 ?
+                                 (double) point -> source_size / total_seconds / 1e6 : 0;
+
+    switch (format)
+    {
+        case BENCH_CSV:
+            fprintf (stream, "%s,%zu,%zu,%zu,%zu,%zu,%zu,%zu,"
+                             "%.3lf,%.3lf,%.3lf,%.3lf,%.3lf,%.3lf,%.3lf,%.3lf\n",
+                     point -> name, shape -> n_funcs, shape -> n_statements,
+                     shape -> expr_depth, shape -> n_vars, shape -> nesting_depth,
+                     point -> source_size, point -> n_nodes,
+                     seconds -> lex * 1000,        seconds -> parse * 1000,
+                     seconds -> write_tree * 1000, seconds -> read_tree * 1000,
+                     seconds -> optimize * 1000,   seconds -> codegen * 1000,
+                     total_seconds * 1000, mb_per_second);
+            break;
+
+        case BENCH_JSON:
+            fprintf (stream, "%s\n  {\"name\": \"%s\", \"funcs\": %zu, \"statements\": %zu, "
+                             "\"depth\": %zu, \"vars\": %zu, \"nesting\": %zu, "
+                             "\"bytes\": %zu, \"nodes\": %zu,\n"
+                             "   \"lex_ms\": %.3lf, \"parse_ms\": %.3lf, \"write_ms\": %.3lf, "
+                             "\"read_ms\": %.3lf, \"optimize_ms\": %.3lf, \"codegen_ms\": %.3lf, "
+                             "\"total_ms\": %.3lf, \"mb_per_s\": %.3lf}",
+                     is_first ? "" : ",", point -> name, shape -> n_funcs,
+                     shape -> n_statements, shape -> expr_depth, shape -> n_vars,
+                     shape -> nesting_depth, point -> source_size, point -> n_nodes,
+                     seconds -> lex * 1000,        seconds -> parse * 1000,
+                     seconds -> write_tree * 1000, seconds -> read_tree * 1000,
+                     seconds -> optimize * 1000,   seconds -> codegen * 1000,
+                     total_seconds * 1000, mb_per_second);
+            break;
+
+        default:
+            break;
+    }
+}
+
+void
+PrintBenchFooter (      FILE*        const stream,
+                  const bench_format       format)
+{
+    assert (stream);
+
+    if (format == BENCH_JSON)
+        fprintf (stream, "\n ]}\n");
+}
+
+static bool
+WriteBenchProgram (const bench_point* const point,
+                   const char*        const source_name,
+                         size_t*      const source_size)
+{
+    assert (point);
+    assert (source_name);
+    assert (source_size);
+
+    FILE* const source = fopen (source_name, "wb");
+    if (!source)
+    {
+        perror (source_name);
+        return false;
+    }
+
+    const bool is_written = GenerateProgram (&point -> shape, source);
+
+    const long size = ftell (source);
+    *source_size = (size > 0) ? (size_t) size : 0;
+
+    return (fclose (source) == 0) && is_written;
+}
+
+static bool
+RunStages (const bench_config* const config,
+           const char*         const source_name,
+           const char*         const tree_name,
+           const char*         const asm_name,
+                 size_t*       const n_nodes,
+                 stage_times*  const seconds)
+{
+    assert (config);
+    assert (source_name);
+    assert (tree_name);
+    assert (asm_name);
+    assert (n_nodes);
+    assert (seconds);
+
+    const read_config read = {.n_jobs       = config -> n_jobs,
+                              .is_pipelined = false};
+
+    BinTree code_tree = {};
+    BINTREE_CTOR (&code_tree);
+
+    /* on the heap, -fstack-protector leaves a function with a List on the stack unguarded */
+    List* const tokens_list = (List*) calloc (1, sizeof (List));
+    if (!tokens_list)
+    {
+        perror ("tokens_list allocation error");
+        BINTREE_DTOR (&code_tree);
+        return false;
+    }
+
+    double start = GetWallTime ();
+
+    LexCode (source_name, tokens_list, &code_tree, &read);
+
+    seconds -> lex = GetWallTime () - start;
+    start          = GetWallTime ();
+
+    ParseTokens (tokens_list, &code_tree, &read);
+
+    seconds -> parse = GetWallTime () - start;
+
+    List_Dtor (tokens_list);
+    free (tokens_list);
+
+    *n_nodes = code_tree .n_elem;
+
+    start = GetWallTime ();
+
+    FILE* const tree_out = fopen (tree_name, "wb");
+
+    bool is_done = tree_out && PrintTreeToStream (&code_tree, tree_out);
+
+    is_done = tree_out && (fclose (tree_out) == 0) && is_done;
+
+    seconds -> write_tree = GetWallTime () - start;
+
+    BINTREE_DTOR (&code_tree);
+
+    if (!is_done)
+    {
+        perror (tree_name);
+        return false;
+    }
+
+    BinTree tree = {};
+    BINTREE_CTOR (&tree);
+
+    start = GetWallTime ();
+
+    is_done = ReadTreeFromFile (&tree, tree_name) != nullptr;
+
+    seconds -> read_tree = GetWallTime () - start;
+    start                = GetWallTime ();
+
+    is_done = is_done && OptimizeTree (&tree, config -> optimize, nullptr);
+
+    seconds -> optimize = GetWallTime () - start;
+
+    ir_module module = {};
+
+    start = GetWallTime ();
+
+    FILE* const asm_out = fopen (asm_name, "wb");
+
+    is_done = is_done && asm_out && IrModuleCtor (&module) && BuildIrModule (&module, &tree) &&
+              PrintIrToAsm (&module, asm_out, config -> n_jobs);
+
+    is_done = asm_out && (fclose (asm_out) == 0) && is_done;
+
+    seconds -> codegen = GetWallTime () - start;
+
+    IrModuleDtor (&module);
+    BINTREE_DTOR (&tree);
+
+    return is_done;
+}
+
+static void
+KeepBestTimes (      stage_times* const best,
+               const stage_times* const times)
+{
+    assert (best);
+    assert (times);
+
+    if (times -> lex        < best -> lex)        best -> lex        = times -> lex;
+    if (times -> parse      < best -> parse)      best -> parse      = times -> parse;
+    if (times -> write_tree < best -> write_tree) best -> write_tree = times -> write_tree;
+    if (times -> read_tree  < best -> read_tree)  best -> read_tree  = times -> read_tree;
+    if (times -> optimize   < best -> optimize)   best -> optimize   = times -> optimize;
+    if (times -> codegen    < best -> codegen)    best -> codegen    = times -> codegen;
+}
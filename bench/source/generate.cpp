@@ -0,0 +1,401 @@
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include "generate.h"
+
+static const size_t NAME_RADIX = 26;
+
+static const size_t MAX_LOOP_COUNT = 16;
+
+/* the first letters of names start no key word */
+static const char VAR_PREFIX   = 'v';
+static const char FUNC_PREFIX  = 'f';
+static const char PARAM_PREFIX = 'x';
+static const char NAME_PADDING = 'q';
+
+enum statement_kind
+{
+    STATEMENT_ASSIGN = 0,
+    STATEMENT_IF     = 1,
+    STATEMENT_WHILE  = 2,
+    STATEMENT_CALL   = 3,
+};
+
+struct program_writer
+{
+    const program_shape* shape;
+          FILE*          stream;
+
+    uint64_t rng_state;
+    size_t   n_digits;      // of the names, enough for the biggest index
+    size_t   name_len;
+    size_t   n_statements;  // written so far, the next one assigns n_statements % n_vars
+};
+
+static bool
+WriteFunction   (program_writer* const writer,
+                 const size_t          func_index);
+
+static void
+WriteStatement  (program_writer* const writer,
+                 const size_t          func_index);
+
+static void
+WriteExpression (program_writer* const writer,
+                 const size_t          depth,
+                 const size_t          n_params);
+
+static void
+WriteValue      (program_writer* const writer,
+                 const size_t          n_params);
+
+static void
+WriteName       (program_writer* const writer,
+                 const char            prefix,
+                 const size_t          index);
+
+static void
+WriteComment    (program_writer* const writer);
+
+static uint64_t
+GetRandom       (program_writer* const writer,
+                 const uint64_t        bound);
+
+static bool
+ParseSizeOption (const char* const option,
+                 const char* const prefix,
+                       size_t* const value);
+
+bool
+ParseShapeOption (const char*          const option,
+                        program_shape* const shape)
+{
+    assert (option);
+    assert (shape);
+
+    if (strncmp (option, "--seed=", strlen ("--seed=")) == 0)
+    {
+        shape -> seed = strtoull (option + strlen ("--seed="), nullptr, 10);
+        return true;
+    }
+
+    return ParseSizeOption (option, "--funcs=",      &shape -> n_funcs)         ||
+           ParseSizeOption (option, "--statements=", &shape -> n_statements)    ||
+           ParseSizeOption (option, "--depth=",      &shape -> expr_depth)      ||
+           ParseSizeOption (option, "--vars=",       &shape -> n_vars)          ||
+           ParseSizeOption (option, "--name-len=",   &shape -> name_len)        ||
+           ParseSizeOption (option, "--comments=",   &shape -> comment_percent) ||
+           ParseSizeOption (option, "--nesting=",    &shape -> nesting_depth);
+}
+
+/*
+ * The program is the same for the same shape and seed. A name is
+ * as long as asked for, but not shorter than the digits of the
+ * biggest index need.
+ */
+bool
+GenerateProgram (const program_shape* const shape,
+                       FILE*          const stream)
+{
+    assert (shape);
+    assert (stream);
+
+    if (!shape -> n_funcs || !shape -> n_statements || !shape -> n_vars ||
+        shape -> expr_depth > MAX_EXPR_DEPTH || shape -> comment_percent > 100)
+    {
+        fprintf (stderr, "Invalid program shape\n");
+        return false;
+    }
+
+    program_writer writer = {.shape        = shape,
+                             .stream       = stream,
+                             .rng_state    = shape -> seed ? shape -> seed : 1,
+                             .n_digits     = 1,
+                             .name_len     = 0,
+                             .n_statements = 0};
+
+    const size_t max_index = (shape -> n_vars > shape -> n_funcs) ? shape -> n_vars :
+                                                                    shape -> n_funcs;
+
+    for (size_t limit = NAME_RADIX; limit < max_index; limit *= NAME_RADIX)
+        writer .n_digits++;
+
+    writer .name_len = (shape -> name_len > writer .n_digits + 1) ? shape -> name_len :
+                                                                    writer .n_digits + 1;
+
+    if (shape -> name_len < MIN_NAME_LEN || writer .name_len > MAX_NAME_LEN)
+    {
+        fprintf (stderr, "Names are %zu to %zu characters long\n", MIN_NAME_LEN, MAX_NAME_LEN);
+        return false;
+    }
+
+    for (size_t i = 0; i < shape -> n_funcs; i++)
+    {
+        if (!WriteFunction (&writer, i))
+            return false;
+    }
+
+    return !ferror (stream);
+}
+
+/* main has no parameters and prints what it computed */
+static bool
+WriteFunction (program_writer* const writer,
+               const size_t          func_index)
+{
+    assert (writer);
+
+    const program_shape* const shape = writer -> shape;
+
+    const size_t n_params = func_index ? N_FUNC_PARAMS : 0;
+
+    if (func_index)
+    {
+        fprintf (writer -> stream, "Mellon ");
+        WriteName (writer, FUNC_PREFIX, func_index);
+
+        fprintf (writer -> stream, "\nFellowship ");
+
+        for (size_t i = 0; i < n_params; i++)
+        {
+            if (i) fprintf (writer -> stream, " Gollum ");
+            WriteName (writer, PARAM_PREFIX, i);
+        }
+
+        fprintf (writer -> stream, " of the Ring\nBlack\n");
+    }
+    else
+        fprintf (writer -> stream, "Mellon main\nBlack\n");
+
+    for (size_t i = 0; i < shape -> n_statements; i++)
+        WriteStatement (writer, func_index);
+
+    if (func_index)
+    {
+        fprintf (writer -> stream, "    Return of the King ");
+        WriteExpression (writer, shape -> expr_depth, n_params);
+        fprintf (writer -> stream, " Precious\n");
+    }
+    else
+    {
+        const size_t n_nested = shape -> nesting_depth;
+
+        fprintf (writer -> stream, "    Give him ");
+        WriteName (writer, VAR_PREFIX, 0);
+        fprintf (writer -> stream, " A pony ");
+
+        for (size_t i = 0; i < n_nested; i++)
+            fprintf (writer -> stream, "Unexpected ");
+
+        WriteName (writer, VAR_PREFIX, writer -> n_statements % shape -> n_vars);
+
+        for (size_t i = 0; i < n_nested; i++)
+            fprintf (writer -> stream, " Journey");
+
+        fprintf (writer -> stream, " Precious\n    Some form of Elvish ");
+        WriteName (writer, VAR_PREFIX, 0);
+        fprintf (writer -> stream, " Precious\n");
+    }
+
+    fprintf (writer -> stream, "Gates\n\n");
+
+    return !ferror (writer -> stream);
+}
+
+/* every kind assigns the next variable, the ifs and loops in their bodies */
+static void
+WriteStatement (program_writer* const writer,
+                const size_t          func_index)
+{
+    assert (writer);
+
+    const program_shape* const shape = writer -> shape;
+          FILE*          const stream = writer -> stream;
+
+    const size_t n_params = func_index ? N_FUNC_PARAMS : 0;
+    const size_t target   = writer -> n_statements++ % shape -> n_vars;
+
+    if (GetRandom (writer, 100) < shape -> comment_percent)
+        WriteComment (writer);
+
+    statement_kind kind = (statement_kind) GetRandom (writer, 8);
+
+    /* functions call the ones after them, the last one calls nothing */
+    if (kind == STATEMENT_CALL && func_index + 1 == shape -> n_funcs)
+        kind = STATEMENT_ASSIGN;
+
+    switch (kind)
+    {
+        case STATEMENT_IF:
+            fprintf (stream, "    One does not simply walk into Mordor Unexpected ");
+            WriteExpression (writer, shape -> expr_depth / 2, n_params);
+            fprintf (stream, " < ");
+            WriteExpression (writer, shape -> expr_depth / 2, n_params);
+            fprintf (stream, " Journey\n    Black\n        Give him ");
+            WriteName (writer, VAR_PREFIX, target);
+            fprintf (stream, " A pony ");
+            WriteExpression (writer, shape -> expr_depth, n_params);
+            fprintf (stream, " Precious\n    Gates Precious\n");
+            break;
+
+        case STATEMENT_WHILE:
+            fprintf (stream, "    Give him ");
+            WriteName (writer, VAR_PREFIX, target);
+            fprintf (stream, " A pony 0 Precious\n    So it begins Unexpected ");
+            WriteName (writer, VAR_PREFIX, target);
+            fprintf (stream, " < %zu Journey\n    Black\n        Give him ",
+                     (size_t) GetRandom (writer, MAX_LOOP_COUNT) + 1);
+            WriteName (writer, VAR_PREFIX, target);
+            fprintf (stream, " A pony ");
+            WriteName (writer, VAR_PREFIX, target);
+            fprintf (stream, " add 1 Precious\n    Gates Precious\n");
+            break;
+
+        case STATEMENT_CALL:
+            fprintf (stream, "    Give him ");
+            WriteName (writer, VAR_PREFIX, target);
+            fprintf (stream, " A pony ");
+            WriteName (writer, FUNC_PREFIX,
+                       func_index + 1 + GetRandom (writer, shape -> n_funcs - func_index - 1));
+            fprintf (stream, " Fellowship ");
+
+            for (size_t i = 0; i < N_FUNC_PARAMS; i++)
+            {
+                if (i) fprintf (stream, " Gollum ");
+                WriteExpression (writer, shape -> expr_depth / 2, n_params);
+            }
+
+            fprintf (stream, " of the Ring Precious\n");
+            break;
+
+        case STATEMENT_ASSIGN: [[fallthrough]];
+
+        default:
+            fprintf (stream, "    Give him ");
+            WriteName (writer, VAR_PREFIX, target);
+            fprintf (stream, " A pony ");
+            WriteExpression (writer, shape -> expr_depth, n_params);
+            fprintf (stream, " Precious\n");
+            break;
+    }
+}
+
+/* operands that are not values go in parentheses, so the tree is the one of the shape */
+static void
+WriteExpression (program_writer* const writer,
+                 const size_t          depth,
+                 const size_t          n_params)
+{
+    assert (writer);
+
+    static const char* const operations [] = {"add", "sub", "mul"};
+
+    if (!depth)
+    {
+        WriteValue (writer, n_params);
+        return;
+    }
+
+    for (size_t i = 0; i < 2; i++)
+    {
+        if (i)
+            fprintf (writer -> stream, " %s ",
+                     operations [GetRandom (writer, sizeof (operations) / sizeof (*operations))]);
+
+        if (depth > 1) fprintf (writer -> stream, "Unexpected ");
+
+        WriteExpression (writer, depth - 1, n_params);
+
+        if (depth > 1) fprintf (writer -> stream, " Journey");
+    }
+}
+
+static void
+WriteValue (program_writer* const writer,
+            const size_t          n_params)
+{
+    assert (writer);
+
+    const uint64_t choice = GetRandom (writer, 8);
+
+    if (choice < 2)
+        fprintf (writer -> stream, "%zu", (size_t) GetRandom (writer, 100));
+    else if (choice < 3)
+        fprintf (writer -> stream, "%zu.%zu", (size_t) GetRandom (writer, 100),
+                                              (size_t) GetRandom (writer, 100));
+    else if (choice < 4 && n_params)
+        WriteName (writer, PARAM_PREFIX, GetRandom (writer, n_params));
+    else
+        WriteName (writer, VAR_PREFIX, GetRandom (writer, writer -> shape -> n_vars));
+}
+
+/* the prefix, the index in base 26 and the padding */
+static void
+WriteName (program_writer* const writer,
+           const char            prefix,
+           const size_t          index)
+{
+    assert (writer);
+
+    char name [MAX_NAME_LEN + 1] = "";
+
+    memset (name, NAME_PADDING, writer -> name_len);
+
+    name [0] = prefix;
+
+    size_t rest = index;
+
+    for (size_t i = writer -> n_digits; i > 0; i--)
+    {
+        name [i] = (char) ('a' + rest % NAME_RADIX);
+        rest    /= NAME_RADIX;
+    }
+
+    fprintf (writer -> stream, "%s", name);
+}
+
+static void
+WriteComment (program_writer* const writer)
+{
+    assert (writer);
+
+    fprintf (writer -> stream, "    # statement %zu of the generated program,"
+                               " it gives the next variable a value #\n",
+             writer -> n_statements);
+}
+
+/* xorshift64*, the same numbers on every platform */
+static uint64_t
+GetRandom (program_writer* const writer,
+           const uint64_t        bound)
+{
+    assert (writer);
+    assert (bound);
+
+    uint64_t state = writer -> rng_state;
+
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+
+    writer -> rng_state = state;
+
+    return ((state * 0x2545F4914F6CDD1DULL) >> 32) % bound;
+}
+
+static bool
+ParseSizeOption (const char* const option,
+                 const char* const prefix,
+                       size_t* const value)
+{
+    assert (option);
+    assert (prefix);
+    assert (value);
+
+    if (strncmp (option, prefix, strlen (prefix)) != 0)
+        return false;
+
+    *value = strtoul (option + strlen (prefix), nullptr, 10);
+
+    return true;
+}
@@ -0,0 +1,193 @@
+#include "bench.h"
+#include "thread_pool.h"
+
+static size_t
+AddSweepPoints       (const char*          const sweep,
+                      const program_shape* const base_shape,
+                            bench_point*   const points);
+
+static size_t
+AddAdversarialPoints (const program_shape* const base_shape,
+                            bench_point*   const points);
+
+int main (const int32_t argc, const char** argv)
+{
+    optimize_config optimize = {};
+    InitOptimizeConfig (&optimize);
+
+    program_shape shape = DEFAULT_PROGRAM_SHAPE;
+
+    bench_config config = {.optimize  = &optimize,
+                           .work_dir  = "/tmp",
+                           .n_jobs    = GetHardwareThreads (),
+                           .n_repeats = DEFAULT_BENCH_REPEATS};
+
+    bench_format format = BENCH_CSV;
+    const char*  sweep  = DEFAULT_SWEEP;
+
+    bool is_generated   = false;
+    bool is_adversarial = true;
+
+    for (int32_t i = 1; i < argc; i++)
+    {
+        if (ParseShapeOption    (argv [i], &shape))    continue;
+        if (ParseOptimizeOption (argv [i], &optimize)) continue;
+
+        if (strcmp (argv [i], "--generate") == 0)
+        {
+            is_generated = true;
+            continue;
+        }
+
+        if (strcmp (argv [i], "--no-adversarial") == 0)
+        {
+            is_adversarial = false;
+            continue;
+        }
+
+        if (strcmp (argv [i], "--format=json") == 0)
+        {
+            format = BENCH_JSON;
+            continue;
+        }
+
+        if (strcmp (argv [i], "--format=csv") == 0)
+        {
+            format = BENCH_CSV;
+            continue;
+        }
+
+        if (strncmp (argv [i], "--sweep=", strlen ("--sweep=")) == 0)
+        {
+            sweep = argv [i] + strlen ("--sweep=");
+            continue;
+        }
+
+        if (strncmp (argv [i], "--repeat=", strlen ("--repeat=")) == 0)
+        {
+            config .n_repeats = strtoul (argv [i] + strlen ("--repeat="), nullptr, 10);
+            continue;
+        }
+
+        if (strncmp (argv [i], "--jobs=", strlen ("--jobs=")) == 0)
+        {
+            config .n_jobs = strtoul (argv [i] + strlen ("--jobs="), nullptr, 10);
+            continue;
+        }
+
+        if (strncmp (argv [i], "--work-dir=", strlen ("--work-dir=")) == 0)
+        {
+            config .work_dir = argv [i] + strlen ("--work-dir=");
+            continue;
+        }
+
+        fprintf (stderr, "Unknown option %s\n", argv [i]);
+        return 1;
+    }
+
+    /* prints the program of the shape and nothing else */
+    if (is_generated)
+        return GenerateProgram (&shape, stdout) ? 0 : 1;
+
+    /* the passes report to stderr, the report is the table of the stages */
+    optimize .report_purity = false;
+    optimize .stats_format  = PASS_STATS_NONE;
+
+    bench_point points [MAX_SWEEP_POINTS + 2] = {};
+
+    const size_t n_sweep_points = AddSweepPoints (sweep, &shape, points);
+
+    size_t n_points = n_sweep_points;
+
+    if (is_adversarial)
+        n_points += AddAdversarialPoints (&shape, points + n_points);
+
+    /* the adversarial shapes are for how the stages scale, they take long and run once */
+    bench_config adversarial_config = config;
+    adversarial_config .n_repeats = 1;
+
+    PrintBenchHeader (stdout, format);
+
+    bool is_done = true;
+
+    for (size_t i = 0; i < n_points && is_done; i++)
+    {
+        is_done = RunBenchPoint ((i < n_sweep_points) ? &config : &adversarial_config,
+                                 &points [i]);
+
+        if (is_done)
+        {
+            PrintBenchPoint (stdout, &points [i], format, i == 0);
+            fflush (stdout);
+        }
+    }
+
+    PrintBenchFooter (stdout, format);
+
+    return is_done ? 0 : 1;
+}
+
+/* "1,4,16" scales the number of functions of the base shape by 1, 4 and 16 */
+static size_t
+AddSweepPoints (const char*          const sweep,
+                const program_shape* const base_shape,
+                      bench_point*   const points)
+{
+    assert (sweep);
+    assert (base_shape);
+    assert (points);
+
+    size_t n_points = 0;
+
+    for (const char* factor_str = sweep; *factor_str && n_points < MAX_SWEEP_POINTS; )
+    {
+        char* factor_end = nullptr;
+        const size_t factor = strtoul (factor_str, &factor_end, 10);
+
+        if (factor_end == factor_str)
+        {
+            fprintf (stderr, "Invalid sweep %s\n", sweep);
+            break;
+        }
+
+        bench_point* const point = &points [n_points++];
+
+        snprintf (point -> name, sizeof (point -> name), "sweep_%zu", factor);
+
+        point -> shape = *base_shape;
+        point -> shape .n_funcs *= factor;
+
+        factor_str = (*factor_end == ',') ? factor_end + 1 : factor_end;
+    }
+
+    return n_points;
+}
+
+/*
+ * A value of main in ADVERSARIAL_NESTING_DEPTH parentheses, which the
+ * parser and the passes go through recursively, and a program with
+ * a statement for each of ADVERSARIAL_N_VARS variables.
+ */
+static size_t
+AddAdversarialPoints (const program_shape* const base_shape,
+                            bench_point*   const points)
+{
+    assert (base_shape);
+    assert (points);
+
+    snprintf (points [0] .name, sizeof (points [0] .name), "deep_nesting");
+
+    points [0] .shape = *base_shape;
+    points [0] .shape .n_funcs       = 1;
+    points [0] .shape .nesting_depth = ADVERSARIAL_NESTING_DEPTH;
+
+    snprintf (points [1] .name, sizeof (points [1] .name), "many_vars");
+
+    points [1] .shape = *base_shape;
+    points [1] .shape .n_funcs      = ADVERSARIAL_N_FUNCS;
+    points [1] .shape .n_statements = ADVERSARIAL_N_VARS / ADVERSARIAL_N_FUNCS;
+    points [1] .shape .expr_depth   = 1;
+    points [1] .shape .n_vars       = ADVERSARIAL_N_VARS;
+
+    return 2;
+}
@@ -0,0 +1,273 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "protocol.h"
+
+/* the client of lotrc --serve: sends one request and prints the answer */
+
+static const size_t STDIN_CHUNK_SIZE  = 1 << 16;
+static const size_t ANSWER_CHUNK_SIZE = 4096;
+
+static int
+ConnectToServer (const char* const socket_name);
+
+static bool
+SendRequest     (      FILE*  const stream,
+                 const char*  const input,
+                 const bool         is_tree,
+                 const char** const options,
+                 const size_t       n_options);
+
+static char*
+ReadStdin       (size_t* const size);
+
+static int
+ReadAnswer      (FILE* const stream);
+
+int main (const int32_t argc, const char** argv)
+{
+    const char* socket_name = DEFAULT_SOCKET_NAME;
+    const char* input       = nullptr;
+
+    bool is_tree    = false;
+    bool is_stopped = false;
+
+    const char* options [MAX_REQUEST_OPTIONS] = {};
+    size_t      n_options = 0;
+
+    for (int32_t i = 1; i < argc; i++)
+    {
+        if (strncmp (argv [i], "--socket=", strlen ("--socket=")) == 0)
+        {
+            socket_name = argv [i] + strlen ("--socket=");
+            continue;
+        }
+
+        if (strcmp (argv [i], "--tree") == 0)
+        {
+            is_tree = true;
+            continue;
+        }
+
+        if (strcmp (argv [i], "--stop") == 0)
+        {
+            is_stopped = true;
+            continue;
+        }
+
+        /* "-" is the standard input, other options are the server's to check */
+        if (argv [i][0] == '-' && argv [i][1] != '\0')
+        {
+            if (n_options == MAX_REQUEST_OPTIONS)
+            {
+                fprintf (stderr, "Too many options\n");
+                return 1;
+            }
+
+            options [n_options++] = argv [i];
+            continue;
+        }
+
+        input = argv [i];
+    }
+
+    if (!input && !is_stopped)
+    {
+        fprintf (stderr, "No source file, \"-\" is the standard input\n");
+        return 1;
+    }
+
+    const int conn = ConnectToServer (socket_name);
+    if (conn < 0)
+        return 1;
+
+    /* closes conn */
+    FILE* const stream = fdopen (conn, "r+b");
+    if (!stream)
+    {
+        perror ("connection open error");
+        close (conn);
+        return 1;
+    }
+
+    bool is_sent = false;
+
+    if (is_stopped)
+        is_sent = fprintf (stream, "%s\n", REQUEST_STOP) > 0;
+    else
+        is_sent = SendRequest (stream, input, is_tree, options, n_options);
+
+    /* a stream that reads after writing has to be flushed in between */
+    is_sent = (fflush (stream) == 0) && is_sent;
+
+    const int exit_code = is_sent ? ReadAnswer (stream) : 1;
+
+    fclose (stream);
+
+    return exit_code;
+}
+
+static int
+ConnectToServer (const char* const socket_name)
+{
+    assert (socket_name);
+
+    sockaddr_un address = {};
+    address .sun_family = AF_UNIX;
+
+    if (strlen (socket_name) >= sizeof (address .sun_path))
+    {
+        fprintf (stderr, "Socket name %s is too long\n", socket_name);
+        return -1;
+    }
+
+    strcpy (address .sun_path, socket_name);
+
+    const int conn = socket (AF_UNIX, SOCK_STREAM, 0);
+    if (conn < 0)
+    {
+        perror ("socket error");
+        return -1;
+    }
+
+    if (connect (conn, (const sockaddr*) &address, sizeof (address)) != 0)
+    {
+        perror (socket_name);
+        close (conn);
+        return -1;
+    }
+
+    return conn;
+}
+
+/* a file is sent by its full name, the server may run in another directory */
+static bool
+SendRequest (      FILE*  const stream,
+             const char*  const input,
+             const bool         is_tree,
+             const char** const options,
+             const size_t       n_options)
+{
+    assert (stream);
+    assert (input);
+    assert (options);
+
+    fprintf (stream, "%s %s\n", REQUEST_OUTPUT, is_tree ? OUTPUT_TREE_NAME : OUTPUT_ASM_NAME);
+
+    for (size_t i = 0; i < n_options; i++)
+        fprintf (stream, "%s %s\n", REQUEST_OPTION, options [i]);
+
+    if (strcmp (input, "-") != 0)
+    {
+        char full_name [PATH_MAX] = "";
+
+        if (!realpath (input, full_name))
+        {
+            perror (input);
+            return false;
+        }
+
+        return fprintf (stream, "%s %s\n", REQUEST_FILE, full_name) > 0;
+    }
+
+    size_t size = 0;
+
+    char* const source = ReadStdin (&size);
+    if (!source)
+        return false;
+
+    fprintf (stream, "%s %zu\n", REQUEST_SOURCE, size);
+
+    const bool is_sent = fwrite (source, sizeof (char), size, stream) == size;
+
+    free (source);
+
+    return is_sent;
+}
+
+static char*
+ReadStdin (size_t* const size)
+{
+    assert (size);
+
+    char*  source   = nullptr;
+    size_t capacity = 0;
+
+    *size = 0;
+
+    do
+    {
+        if (*size + STDIN_CHUNK_SIZE > MAX_SOURCE_SIZE)
+        {
+            fprintf (stderr, "Source is bigger than %zu bytes\n", MAX_SOURCE_SIZE);
+            free (source);
+            return nullptr;
+        }
+
+        capacity += STDIN_CHUNK_SIZE;
+
+        char* const new_source = (char*) realloc (source, capacity);
+        if (!new_source)
+        {
+            perror ("source allocation error");
+            free (source);
+            return nullptr;
+        }
+
+        source = new_source;
+        *size += fread (source + *size, sizeof (char), capacity - *size, stdin);
+    }
+    while (*size == capacity);
+
+    if (ferror (stdin))
+    {
+        perror ("stdin");
+        free (source);
+        return nullptr;
+    }
+
+    return source;
+}
+
+/* the output goes to stdout, the messages of a failed request to stderr */
+static int
+ReadAnswer (FILE* const stream)
+{
+    assert (stream);
+
+    char   answer [sizeof (ANSWER_ERROR)] = "";
+    size_t size = 0;
+
+    if (fscanf (stream, "%5s %zu", answer, &size) != 2 || fgetc (stream) != '\n')
+    {
+        fprintf (stderr, "Invalid answer of the server\n");
+        return 1;
+    }
+
+    const bool  is_ok  = strcmp (answer, ANSWER_OK) == 0;
+    FILE* const output = is_ok ? stdout : stderr;
+
+    char buffer [ANSWER_CHUNK_SIZE] = "";
+
+    while (size)
+    {
+        const size_t n_read = fread (buffer, sizeof (char),
+                                     size < sizeof (buffer) ? size : sizeof (buffer), stream);
+        if (!n_read)
+        {
+            fprintf (stderr, "Answer of the server is cut off\n");
+            return 1;
+        }
+
+        fwrite (buffer, sizeof (char), n_read, output);
+        size -= n_read;
+    }
+
+    return is_ok ? 0 : 1;
+}
@@ -28,6 +28,7 @@ struct file_input
     size_t buffer_size;
     size_t number_of_lines;
     struct line_struct* lines_array;
+    size_t mapped_size; ///< Size of the mapping of the buffer, 0 if it is calloced.
 };
 
 /// @brief Gets file size.
@@ -45,6 +46,14 @@ char* MakeBuffer(size_t buffer_size);
 /// @param buffer_info A struct-container for input from the file.
 void ReadFileToBuffer(const char* file_name, struct file_input* buffer_info);
 
+/// @brief Maps file to buffer, followed by at least one zero byte. The buffer is read-only
+/// unless it is to be parted. Reads the file with ReadFileToBuffer() if it can't be mapped.
+/// @param file_name Name of file to open and map.
+/// @param buffer_info A struct-container for input from the file.
+/// @param is_separated Tells whether the buffer should be writable to be parted.
+void MapFileToBuffer(const char* file_name, struct file_input* buffer_info,
+                     enum partition is_separated);
+
 /// @brief Gets number of lines in the buffer. Changes new line symbols into null-terminated symbols.
 /// @param buffer_info A struct-container for input from the file.
 void GetNumberOfLines(struct file_input* buffer_info);
@@ -65,4 +74,13 @@ void FreeFileInput(struct file_input* buffer_info);
 void GetFileInput(const char* file_name, struct file_input* buffer_info,
                   enum partition is_separated);
 
+/// @brief Starts the process of getting file input without copying the file.
+/// Calls for MapFileToBuffer() and, if the buffer should be parted, GetNumberOfLines()
+/// and MakeArrayOfStrings(). buffer[buffer_size] is a null-terminating symbol.
+/// @param file_name Name of file to open and map.
+/// @param buffer_info A struct-container for input from the file.
+/// @param is_separated Tells whether the buffer should be parted or not.
+void GetMappedFileInput(const char* file_name, struct file_input* buffer_info,
+                        enum partition is_separated);
+
 void PrintParray(line_struct* pointer_array, size_t number_of_lines);
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stdio.h>
+#include <stddef.h>
+
+/// @brief Length of a cache key, the hex of a 128-bit hash.
+const size_t CACHE_KEY_LEN = 32;
+
+/// @brief FNV-1a hash the cache keys are made of.
+typedef unsigned __int128 cache_hash;
+
+const size_t DEFAULT_CACHE_MAX_SIZE = (size_t) 256 << 20;
+
+/// @brief Name of the file with hits, misses and the size of the entries in the cache directory.
+const char CACHE_STATS_FILE_NAME[] = "stats";
+
+/// @brief Where the cache is and how big it may get. Without a directory there is no cache.
+struct cache_config
+{
+    const char* dir;                ///< LOTR_CACHE_DIR or --cache-dir=, nullptr if there is none.
+    size_t      max_size;           ///< LOTR_CACHE_MAX_SIZE or --cache-max-size=, in bytes.
+    bool        is_stats_printed;   ///< --cache-stats, print the statistics instead of compiling.
+};
+
+/// @brief The cache entry of one compilation: its key is the hash of the tool, the executable,
+/// the options that change the output and the input file.
+struct compile_cache
+{
+    const char* dir;            ///< The one of the config.
+    size_t      max_size;
+    char        key [CACHE_KEY_LEN + 1];
+    bool        is_fragment;    ///< A part of an output, its lookups are not counted.
+};
+
+/// @brief Sets the config from LOTR_CACHE_DIR and LOTR_CACHE_MAX_SIZE.
+/// @param config Config to set.
+void InitCacheConfig (cache_config* config);
+
+/// @brief Takes --cache-dir=, --cache-max-size= and --cache-stats.
+/// @param option Command line option.
+/// @param config Config to change.
+/// @return It returns false if the option is not one of them.
+bool ParseCacheOption (const char* option, cache_config* config);
+
+/// @brief Finds the key of a compilation. The executable is identified by its size and mtime,
+/// so a rebuilt compiler doesn't reuse the entries of the old one.
+/// @param cache Cache to set.
+/// @param config Config with the cache directory, it is created if there is none.
+/// It must live as long as the cache does.
+/// @param tool Name of the tool, the entries of tools don't mix.
+/// @param options Options the output depends on, in the order given.
+/// @param n_options Number of options.
+/// @param input_file_name Name of the file to compile.
+/// @return It returns false if there is no cache directory or the input can't be read,
+/// the compilation goes without the cache then.
+bool InitCompileCache (compile_cache*      cache,
+                       const cache_config* config,
+                       const char*         tool,
+                       const char* const*  options,
+                       size_t              n_options,
+                       const char*         input_file_name);
+
+/// @brief Starts a key with the tool and the executable, the way InitCompileCache() does,
+/// for the entries of parts of an output, e.g. the code of a function.
+/// @param config Config with the cache directory, it is created if there is none.
+/// @param tool Name of the tool, the entries of tools don't mix.
+/// @param hash Hash to start.
+/// @return It returns false if there is no cache directory.
+bool StartCacheHash (const cache_config* config, const char* tool, cache_hash* hash);
+
+/// @brief Adds bytes to a hash.
+/// @param hash Hash started by StartCacheHash().
+/// @param data Bytes to add.
+/// @param size Number of bytes.
+void HashBytes (cache_hash* hash, const void* data, size_t size);
+
+/// @brief Sets the cache to the entry of a fragment.
+/// @param cache Cache to set.
+/// @param config Config StartCacheHash() was called with.
+/// @param hash Key of the entry.
+void SetFragmentCache (compile_cache* cache, const cache_config* config, cache_hash hash);
+
+/// @brief Copies the entry to the stream if there is one and counts a hit or a miss.
+/// A hit makes the entry the most recently used one.
+/// @param cache Cache set by InitCompileCache().
+/// @param stream Stream for the output.
+/// @return It returns false on a miss.
+bool CacheLoad (compile_cache* cache, FILE* stream);
+
+/// @brief Does what CacheLoad() does, but creates the output file only on a hit.
+/// @param cache Cache set by InitCompileCache().
+/// @param file_name Name of the output file.
+/// @return It returns false on a miss.
+bool CacheLoadToFile (compile_cache* cache, const char* file_name);
+
+/// @brief Saves the output as the entry. It is written to a temporary file first and renamed,
+/// so other processes see either no entry or the whole one. Least recently used entries are
+/// removed if the cache gets bigger than its max size.
+/// @param cache Cache set by InitCompileCache().
+/// @param data Output of the compilation.
+/// @param size Size of the output.
+/// @return It returns false if the entry could not be saved.
+bool CacheStore (compile_cache* cache, const char* data, size_t size);
+
+/// @brief Does what CacheStore() does with the output in a file.
+/// @param cache Cache set by InitCompileCache().
+/// @param file_name Name of the output file.
+/// @return It returns false if the entry could not be saved.
+bool CacheStoreFile (compile_cache* cache, const char* file_name);
+
+/// @brief Prints hits, misses and the size of the cache.
+/// @param config Config with the cache directory.
+/// @param stream Stream to print to.
+void PrintCacheStats (const cache_config* config, FILE* stream);
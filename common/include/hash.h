@@ -38,6 +38,18 @@
     ErrorType StackDataFindHash (Stack*  const stk,
                                  Hash_t* const hash_ptr);
 
+/// @brief This function updates the hash after one element of stack data is changed.
+/// The bytes of the struct are summed anew, of the data only the changed element.
+/// @param stk Pointer to stack.
+/// @param old_stack_hash Hash of the stack struct (StackFindHash) before the change.
+/// @param old_value The element before the change.
+/// @param index Index of the changed element.
+/// @return It returns stack_err struct type of ErrorType.
+    ErrorType StackUpdateHash   (Stack*  const stk,
+                                 const Hash_t  old_stack_hash,
+                                 Elem_t        old_value,
+                                 const size_t  index);
+
 /// @brief This function checks whether the hash value in stack struct is equal to new-counted.
 /// @param stk Pointer to stack.
 /// @return It returns stack_err struct type of ErrorType.
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stddef.h>
+
+/// @brief Max length of a number FormatDouble prints, the null terminator included.
+const size_t DOUBLE_OUTPUT_MAX_LEN = 32;
+
+/// @brief Reads a number as strtod does: an optional sign, digits with an optional point
+/// and an optional exponent. The result is rounded correctly, a decimal of up to 19 digits
+/// is converted with the Eisel-Lemire algorithm, others and inf, nan, hex go to strtod.
+/// @param str String to read the number from, no spaces are skipped.
+/// @param value Pointer to the result, it is set only if a number was read.
+/// @return Number of characters read, 0 if there is no number.
+size_t ParseDouble (const char* str, double* value);
+
+/// @brief Prints the shortest decimal that ParseDouble reads back to the same value,
+/// found with the Ryu algorithm. The layout is the one of %g: the exponent form is used
+/// for exponents below -4 and from the number of digits, but at least 6, on.
+/// @param value Number to print.
+/// @param buffer Buffer of at least DOUBLE_OUTPUT_MAX_LEN characters.
+/// @return Length of the printed number.
+size_t FormatDouble (double value, char* buffer);
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stddef.h>
+
+/// @brief A task of a batch, gets the shared argument and its index in the batch.
+/// @return It returns false if the task failed.
+typedef bool (*task_func) (void* arg, size_t index);
+
+/// @brief Gets the number of threads the hardware runs at once.
+/// @return At least 1.
+size_t GetHardwareThreads ();
+
+/// @brief Runs tasks 0 .. n_tasks - 1 on up to n_threads threads, the calling one included.
+/// Every thread gets a share of the indices and runs it in order; a thread that is out of
+/// them steals the back half of what another thread has left. So the order tasks finish in
+/// is unknown, results should go to per-index storage. With n_threads <= 1 the tasks run in order.
+/// @param task Function to run for every index.
+/// @param arg Argument shared by all tasks.
+/// @param n_tasks Number of tasks.
+/// @param n_threads Max number of threads.
+/// @return It returns false if any task failed.
+bool RunTasks (task_func    task,
+               void*        arg,
+               size_t       n_tasks,
+               size_t       n_threads);
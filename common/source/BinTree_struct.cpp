@@ -155,7 +155,7 @@ MakeNodeByData (BinTree_node*      const node_left,
                                      node_left, node_right, parent, tree);
 
         case KEY_OP:
-            return BinTree_CtorNode (UN_OP, node_data -> key_op_code,
+            return BinTree_CtorNode (KEY_OP, node_data -> key_op_code,
                                      node_left, node_right, parent, tree);
 
         case NUMBER:
@@ -219,8 +219,23 @@ BinTree_DestroyNameTable (BinTree* const tree)
         return BINTREE_STRUCT_NULLPTR;
     }
 
-    STACK_DTOR (tree -> name_table .var_table);
-    STACK_DTOR (tree -> name_table .func_table);
+    /* the names are the table's, the reader copied them for it */
+    Stack* const tables [] = {tree -> name_table .var_table,
+                              tree -> name_table .func_table};
+
+    for (size_t i = 0; i < sizeof (tables) / sizeof (*tables); i++)
+    {
+        if (!tables [i]) continue;
+
+        for (size_t j = 0; j < tables [i] -> data_size; j++)
+            free (tables [i] -> data [j]);
+
+        STACK_DTOR (tables [i]);
+        free (tables [i]);
+    }
+
+    tree -> name_table .var_table  = nullptr;
+    tree -> name_table .func_table = nullptr;
 
     for (op_code_type key_word_index = 0;
                       key_word_index <= NUM_OF_KEY_WORDS;
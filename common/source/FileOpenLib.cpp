@@ -1,3 +1,7 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "FileOpenLib.h"
 
 void PrintParray(line_struct* pointer_array, size_t number_of_lines)
@@ -49,18 +53,76 @@ void ReadFileToBuffer(const char* file_name, struct file_input* buffer_info)
     return;
 }
 
+void MapFileToBuffer(const char* file_name, struct file_input* buffer_info,
+                     enum partition is_separated)
+{
+    assert(buffer_info);
+
+    int fd = open(file_name, O_RDONLY);
+    assert(fd >= 0);
+
+    struct stat file_stat = {};
+
+    // pipes and the like are read
+    if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode))
+    {
+        close(fd);
+        ReadFileToBuffer(file_name, buffer_info);
+        return;
+    }
+
+    size_t file_size   = (size_t)file_stat.st_size;
+    size_t page_size   = (size_t)sysconf(_SC_PAGESIZE);
+    size_t mapped_size = (file_size / page_size + 1) * page_size;   // a zero byte after the file
+
+    // parting writes to the buffer, the file itself is not changed
+    int protection = is_separated ? PROT_READ | PROT_WRITE : PROT_READ;
+
+    // zero pages are reserved and the file is mapped over them
+    char* buffer = (char*)mmap(NULL, mapped_size, protection,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (buffer != MAP_FAILED && file_size > 0 &&
+        mmap(buffer, file_size, protection, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+        munmap(buffer, mapped_size);
+        buffer = (char*)MAP_FAILED;
+    }
+
+    close(fd);
+    fd = -1;
+
+    if (buffer == MAP_FAILED)
+    {
+        ReadFileToBuffer(file_name, buffer_info);
+        return;
+    }
+
+    if (file_size > 0)
+        madvise(buffer, file_size, MADV_SEQUENTIAL);
+
+    buffer_info->buffer      = buffer;
+    buffer_info->buffer_size = file_size;
+    buffer_info->mapped_size = mapped_size;
+
+    return;
+}
+
 void GetNumberOfLines(struct file_input* buffer_info)
 {
     assert(buffer_info);
     assert(buffer_info->buffer);
 
     buffer_info->number_of_lines = 0;
-    for (size_t buffer_index = 0; buffer_index < buffer_info->buffer_size; ++buffer_index)
+
+    const char* const buffer_end = buffer_info->buffer + buffer_info->buffer_size;
+
+    // memchr goes through many bytes at once
+    for (const char* separator = buffer_info->buffer;
+         (separator = (const char*)memchr(separator, ' ', (size_t)(buffer_end - separator)));
+         ++separator)
     {
-        if (buffer_info->buffer[buffer_index] == ' ')
-        {
-            ++(buffer_info->number_of_lines);
-        }
+        ++(buffer_info->number_of_lines);
     }
 
     if (buffer_info->buffer[buffer_info->buffer_size - 1] != ' ')
@@ -104,9 +166,12 @@ void FreeFileInput(struct file_input* buffer_info)
 {
     assert(buffer_info);
 
-    if (buffer_info->buffer)
+    if (buffer_info->buffer && buffer_info->mapped_size)
+        munmap(buffer_info->buffer, buffer_info->mapped_size);
+    else if (buffer_info->buffer)
         free(buffer_info->buffer);
-    buffer_info->buffer = NULL;
+    buffer_info->buffer      = NULL;
+    buffer_info->mapped_size = 0;
 
     if (buffer_info->lines_array)
         free(buffer_info->lines_array);
@@ -132,3 +197,20 @@ void GetFileInput(const char* file_name, struct file_input* buffer_info,
 
     return;
 }
+
+void GetMappedFileInput(const char* file_name, struct file_input* buffer_info,
+                        enum partition is_separated)
+{
+    assert(buffer_info);
+
+    MapFileToBuffer(file_name, buffer_info, is_separated);
+
+    // lines are counted only for the ones who need them
+    if (is_separated)
+    {
+        GetNumberOfLines(buffer_info);
+        MakeArrayOfStrings(buffer_info);
+    }
+
+    return;
+}
@@ -0,0 +1,641 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "../include/compile_cache.h"
+
+/* FNV-1a with 128 bits */
+static const cache_hash FNV128_OFFSET = ((cache_hash) 0x6C62272E07BB0142 << 64) | 0x62B821756295C58D;
+static const cache_hash FNV128_PRIME  = ((cache_hash) 0x0000000001000000 << 64) | 0x000000000000013B;
+
+static const size_t CACHE_COPY_CHUNK_SIZE = 1 << 16;
+
+static const size_t CACHE_STATS_MAX_LEN = 128;
+
+/* left by a process that died between writing and renaming */
+static const time_t CACHE_TEMP_MAX_AGE = 60 * 60;
+
+struct cache_stats
+{
+    size_t n_hits;
+    size_t n_misses;
+    size_t size;      ///< Sum of the entry sizes, rescanned when the cache is trimmed.
+    size_t replaced;  ///< Size of the entry a new one replaced, only in a change of stats.
+};
+
+struct cache_entry_info
+{
+    char            name [CACHE_KEY_LEN + 1];
+    struct timespec mtime;
+    size_t          size;
+};
+
+static bool   HashFile          (cache_hash* hash, const char* file_name);
+static void   SetCacheKey       (compile_cache* cache, const cache_config* config, cache_hash hash);
+static bool   GetEntryPath      (const compile_cache* cache, char* path);
+static bool   CopyStream        (FILE* from, FILE* to, size_t* size);
+static bool   CommitEntry       (compile_cache* cache, FILE* temp, const char* temp_path, size_t size);
+static bool   UpdateCacheStats  (const char* dir, const cache_stats* delta, size_t max_size);
+static void   ReadCacheStats    (int fd, cache_stats* stats);
+static size_t TrimCache         (const char* dir, size_t target_size);
+static bool   IsEntryName       (const char* name);
+static int    CompareEntryTimes (const void* first, const void* second);
+
+void InitCacheConfig (cache_config* config)
+{
+    assert (config);
+
+    const char* const dir      = getenv ("LOTR_CACHE_DIR");
+    const char* const max_size = getenv ("LOTR_CACHE_MAX_SIZE");
+
+    config -> dir              = (dir && *dir) ? dir : nullptr;
+    config -> max_size         = (max_size && *max_size) ? strtoull (max_size, nullptr, 10) :
+                                                           DEFAULT_CACHE_MAX_SIZE;
+    config -> is_stats_printed = false;
+}
+
+bool ParseCacheOption (const char* option, cache_config* config)
+{
+    assert (option);
+    assert (config);
+
+    if (strncmp (option, "--cache-dir=", strlen ("--cache-dir=")) == 0)
+    {
+        const char* const dir = option + strlen ("--cache-dir=");
+
+        config -> dir = *dir ? dir : nullptr;
+        return true;
+    }
+
+    if (strncmp (option, "--cache-max-size=", strlen ("--cache-max-size=")) == 0)
+    {
+        config -> max_size = strtoull (option + strlen ("--cache-max-size="), nullptr, 10);
+        return true;
+    }
+
+    if (strcmp (option, "--cache-stats") == 0)
+    {
+        config -> is_stats_printed = true;
+        return true;
+    }
+
+    return false;
+}
+
+bool InitCompileCache (compile_cache*      cache,
+                       const cache_config* config,
+                       const char*         tool,
+                       const char* const*  options,
+                       size_t              n_options,
+                       const char*         input_file_name)
+{
+    assert (cache);
+    assert (config);
+    assert (tool);
+    assert (options || n_options == 0);
+
+    cache_hash hash = 0;
+
+    if (!input_file_name || !StartCacheHash (config, tool, &hash)) return false;
+
+    HashBytes (&hash, &n_options, sizeof (n_options));
+
+    /* strings go with their null terminators, so that they can't run into each other */
+    for (size_t i = 0; i < n_options; i++)
+        HashBytes (&hash, options [i], strlen (options [i]) + 1);
+
+    if (!HashFile (&hash, input_file_name)) return false;
+
+    SetCacheKey (cache, config, hash);
+
+    cache -> is_fragment = false;
+
+    return true;
+}
+
+bool StartCacheHash (const cache_config* config, const char* tool, cache_hash* hash)
+{
+    assert (config);
+    assert (tool);
+    assert (hash);
+
+    if (!config -> dir) return false;
+
+    if (mkdir (config -> dir, 0755) != 0 && errno != EEXIST)
+    {
+        perror ("cache directory mkdir() error");
+        return false;
+    }
+
+    struct stat exe_stat = {};
+
+    if (stat ("/proc/self/exe", &exe_stat) != 0)
+    {
+        perror ("compiler executable stat() error");
+        return false;
+    }
+
+    *hash = FNV128_OFFSET;
+
+    HashBytes (hash, tool, strlen (tool) + 1);
+
+    HashBytes (hash, &exe_stat .st_size,  sizeof (exe_stat .st_size));
+    HashBytes (hash, &exe_stat .st_mtim,  sizeof (exe_stat .st_mtim));
+    HashBytes (hash, &exe_stat .st_ino,   sizeof (exe_stat .st_ino));
+
+    return true;
+}
+
+void HashBytes (cache_hash* hash, const void* data, size_t size)
+{
+    assert (hash);
+    assert (data || size == 0);
+
+    const unsigned char* const bytes = (const unsigned char*) data;
+
+    cache_hash value = *hash;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        value ^= bytes [i];
+        value *= FNV128_PRIME;
+    }
+
+    *hash = value;
+}
+
+void SetFragmentCache (compile_cache* cache, const cache_config* config, cache_hash hash)
+{
+    assert (cache);
+    assert (config);
+
+    SetCacheKey (cache, config, hash);
+
+    cache -> is_fragment = true;
+}
+
+bool CacheLoad (compile_cache* cache, FILE* stream)
+{
+    assert (cache);
+    assert (stream);
+
+    char path [PATH_MAX] = "";
+    if (!GetEntryPath (cache, path)) return false;
+
+    FILE* const entry = fopen (path, "rb");
+
+    cache_stats delta = {.n_hits = 0, .n_misses = 0, .size = 0, .replaced = 0};
+
+    const bool is_hit = entry && CopyStream (entry, stream, nullptr);
+
+    if (entry)
+        fclose (entry);
+
+    /* the mtime is the time of the last use */
+    if (is_hit)
+        utimensat (AT_FDCWD, path, nullptr, 0);
+
+    (is_hit ? delta .n_hits : delta .n_misses) = 1;
+
+    if (!cache -> is_fragment)
+        UpdateCacheStats (cache -> dir, &delta, cache -> max_size);
+
+    return is_hit;
+}
+
+bool CacheLoadToFile (compile_cache* cache, const char* file_name)
+{
+    assert (cache);
+    assert (file_name);
+
+    char path [PATH_MAX] = "";
+    if (!GetEntryPath (cache, path)) return false;
+
+    /* the output is left as it is on a miss */
+    if (access (path, R_OK) != 0)
+    {
+        const cache_stats delta = {.n_hits = 0, .n_misses = 1, .size = 0, .replaced = 0};
+
+        if (!cache -> is_fragment)
+            UpdateCacheStats (cache -> dir, &delta, cache -> max_size);
+        return false;
+    }
+
+    FILE* const output = fopen (file_name, "wb");
+    if (!output)
+    {
+        perror ("cached output fopen() error");
+        return false;
+    }
+
+    const bool is_hit = CacheLoad (cache, output);
+
+    return (fclose (output) == 0) && is_hit;
+}
+
+bool CacheStore (compile_cache* cache, const char* data, size_t size)
+{
+    assert (cache);
+    assert (data || size == 0);
+
+    char temp_path [PATH_MAX] = "";
+
+    if ((size_t) snprintf (temp_path, PATH_MAX, "%s/tmp.%d.%s", cache -> dir,
+                           (int) getpid (), cache -> key) >= PATH_MAX)
+        return false;
+
+    FILE* const temp = fopen (temp_path, "wb");
+    if (!temp)
+    {
+        perror ("cache entry fopen() error");
+        return false;
+    }
+
+    if (fwrite (data, sizeof (char), size, temp) != size)
+    {
+        fclose (temp);
+        unlink (temp_path);
+        return false;
+    }
+
+    return CommitEntry (cache, temp, temp_path, size);
+}
+
+bool CacheStoreFile (compile_cache* cache, const char* file_name)
+{
+    assert (cache);
+    assert (file_name);
+
+    char temp_path [PATH_MAX] = "";
+
+    if ((size_t) snprintf (temp_path, PATH_MAX, "%s/tmp.%d.%s", cache -> dir,
+                           (int) getpid (), cache -> key) >= PATH_MAX)
+        return false;
+
+    FILE* const output = fopen (file_name, "rb");
+    if (!output)
+    {
+        perror ("output fopen() error");
+        return false;
+    }
+
+    FILE* const temp = fopen (temp_path, "wb");
+    if (!temp)
+    {
+        perror ("cache entry fopen() error");
+        fclose (output);
+        return false;
+    }
+
+    size_t size = 0;
+
+    const bool is_copied = CopyStream (output, temp, &size);
+
+    fclose (output);
+
+    if (!is_copied)
+    {
+        fclose (temp);
+        unlink (temp_path);
+        return false;
+    }
+
+    return CommitEntry (cache, temp, temp_path, size);
+}
+
+void PrintCacheStats (const cache_config* config, FILE* stream)
+{
+    assert (config);
+    assert (stream);
+
+    if (!config -> dir)
+    {
+        fprintf (stream, "No cache directory, set LOTR_CACHE_DIR or --cache-dir=\n");
+        return;
+    }
+
+    char path [PATH_MAX] = "";
+    snprintf (path, PATH_MAX, "%s/%s", config -> dir, CACHE_STATS_FILE_NAME);
+
+    cache_stats stats = {.n_hits = 0, .n_misses = 0, .size = 0, .replaced = 0};
+
+    const int fd = open (path, O_RDONLY);
+
+    if (fd >= 0)
+    {
+        flock (fd, LOCK_SH);
+        ReadCacheStats (fd, &stats);
+        close (fd);
+    }
+
+    const size_t n_lookups = stats .n_hits + stats .n_misses;
+
+    fprintf (stream, "cache directory: %s\n"
+                     "hits:            %zu\n"
+                     "misses:          %zu\n"
+                     "hit rate:        %.1f%%\n"
+                     "size:            %zu of %zu bytes\n",
+             config -> dir, stats .n_hits, stats .n_misses,
+             n_lookups ? 100.0 * (double) stats .n_hits / (double) n_lookups : 0.0,
+             stats .size, config -> max_size);
+}
+
+static bool HashFile (cache_hash* hash, const char* file_name)
+{
+    assert (hash);
+    assert (file_name);
+
+    FILE* const input = fopen (file_name, "rb");
+    if (!input) return false;
+
+    char* const chunk = (char*) calloc (CACHE_COPY_CHUNK_SIZE, sizeof (char));
+    if (!chunk)
+    {
+        perror ("hash chunk allocation error");
+        fclose (input);
+        return false;
+    }
+
+    size_t n_read = 0;
+
+    while ((n_read = fread (chunk, sizeof (char), CACHE_COPY_CHUNK_SIZE, input)) > 0)
+        HashBytes (hash, chunk, n_read);
+
+    const bool is_read = !ferror (input);
+
+    free (chunk);
+    fclose (input);
+
+    return is_read;
+}
+
+static void SetCacheKey (compile_cache* cache, const cache_config* config, cache_hash hash)
+{
+    assert (cache);
+    assert (config);
+
+    cache -> dir      = config -> dir;
+    cache -> max_size = config -> max_size;
+
+    snprintf (cache -> key, sizeof (cache -> key), "%016llx%016llx",
+              (unsigned long long) (hash >> 64), (unsigned long long) hash);
+}
+
+static bool GetEntryPath (const compile_cache* cache, char* path)
+{
+    assert (cache);
+    assert (path);
+
+    return (size_t) snprintf (path, PATH_MAX, "%s/%s", cache -> dir, cache -> key) < PATH_MAX;
+}
+
+static bool CopyStream (FILE* from, FILE* to, size_t* size)
+{
+    assert (from);
+    assert (to);
+
+    char* const chunk = (char*) calloc (CACHE_COPY_CHUNK_SIZE, sizeof (char));
+    if (!chunk)
+    {
+        perror ("copy chunk allocation error");
+        return false;
+    }
+
+    size_t n_read   = 0;
+    size_t n_copied = 0;
+    bool   is_done  = true;
+
+    while (is_done && (n_read = fread (chunk, sizeof (char), CACHE_COPY_CHUNK_SIZE, from)) > 0)
+    {
+        is_done   = fwrite (chunk, sizeof (char), n_read, to) == n_read;
+        n_copied += n_read;
+    }
+
+    free (chunk);
+
+    if (size)
+        *size = n_copied;
+
+    return is_done && !ferror (from);
+}
+
+/* closes the temporary file and renames it to the entry, over an old one if there is any */
+static bool CommitEntry (compile_cache* cache, FILE* temp, const char* temp_path, size_t size)
+{
+    assert (cache);
+    assert (temp);
+    assert (temp_path);
+
+    char path [PATH_MAX] = "";
+
+    if (fclose (temp) != 0 || !GetEntryPath (cache, path))
+    {
+        perror ("cache entry commit error");
+        unlink (temp_path);
+        return false;
+    }
+
+    /* processes that compiled the same input at once replace each other's entries */
+    struct stat old_stat = {};
+    const size_t replaced = (stat (path, &old_stat) == 0) ? (size_t) old_stat .st_size : 0;
+
+    if (rename (temp_path, path) != 0)
+    {
+        perror ("cache entry rename() error");
+        unlink (temp_path);
+        return false;
+    }
+
+    const cache_stats delta = {.n_hits = 0, .n_misses = 0, .size = size, .replaced = replaced};
+
+    return UpdateCacheStats (cache -> dir, &delta, cache -> max_size);
+}
+
+/*
+ * The stats file is changed under an exclusive lock, which also keeps
+ * two processes from trimming the cache at once.
+ */
+static bool UpdateCacheStats (const char* dir, const cache_stats* delta, size_t max_size)
+{
+    assert (dir);
+    assert (delta);
+
+    char path [PATH_MAX] = "";
+
+    if ((size_t) snprintf (path, PATH_MAX, "%s/%s", dir, CACHE_STATS_FILE_NAME) >= PATH_MAX)
+        return false;
+
+    const int fd = open (path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0 || flock (fd, LOCK_EX) != 0)
+    {
+        perror ("cache stats open error");
+
+        if (fd >= 0)
+            close (fd);
+
+        return false;
+    }
+
+    cache_stats stats = {.n_hits = 0, .n_misses = 0, .size = 0, .replaced = 0};
+    ReadCacheStats (fd, &stats);
+
+    stats .n_hits   += delta -> n_hits;
+    stats .n_misses += delta -> n_misses;
+    stats .size     += delta -> size;
+    stats .size      = (stats .size > delta -> replaced) ? stats .size - delta -> replaced : 0;
+
+    /* down to 90% so that the next entries don't trim it again */
+    if (stats .size > max_size)
+        stats .size = TrimCache (dir, max_size / 10 * 9);
+
+    char stats_str [CACHE_STATS_MAX_LEN] = "";
+
+    const int stats_len = snprintf (stats_str, CACHE_STATS_MAX_LEN, "%zu %zu %zu\n",
+                                    stats .n_hits, stats .n_misses, stats .size);
+
+    const bool is_written = ftruncate (fd, 0) == 0 &&
+                            pwrite (fd, stats_str, (size_t) stats_len, 0) == stats_len;
+
+    close (fd);
+
+    return is_written;
+}
+
+static void ReadCacheStats (int fd, cache_stats* stats)
+{
+    assert (stats);
+
+    char stats_str [CACHE_STATS_MAX_LEN] = "";
+
+    const ssize_t n_read = pread (fd, stats_str, CACHE_STATS_MAX_LEN - 1, 0);
+
+    if (n_read <= 0 ||
+        sscanf (stats_str, "%zu %zu %zu", &stats -> n_hits, &stats -> n_misses,
+                                          &stats -> size) != 3)
+    {
+        stats -> n_hits   = 0;
+        stats -> n_misses = 0;
+        stats -> size     = 0;
+    }
+}
+
+/*
+ * Removes the least recently used entries until the rest take no more
+ * than target_size. Returns the size of the rest.
+ */
+static size_t TrimCache (const char* dir, size_t target_size)
+{
+    assert (dir);
+
+    DIR* const dir_stream = opendir (dir);
+    if (!dir_stream)
+    {
+        perror ("cache directory opendir() error");
+        return 0;
+    }
+
+    const int dir_fd = dirfd (dir_stream);
+
+    cache_entry_info* entries    = nullptr;
+    size_t            n_entries  = 0;
+    size_t            capacity   = 0;
+    size_t            total_size = 0;
+
+    const time_t now = time (nullptr);
+
+    for (const dirent* file = readdir (dir_stream); file; file = readdir (dir_stream))
+    {
+        struct stat file_stat = {};
+
+        if (fstatat (dir_fd, file -> d_name, &file_stat, 0) != 0 || !S_ISREG (file_stat .st_mode))
+            continue;
+
+        if (strncmp (file -> d_name, "tmp.", strlen ("tmp.")) == 0)
+        {
+            if (now - file_stat .st_mtim .tv_sec > CACHE_TEMP_MAX_AGE)
+                unlinkat (dir_fd, file -> d_name, 0);
+
+            continue;
+        }
+
+        if (!IsEntryName (file -> d_name)) continue;
+
+        if (n_entries == capacity)
+        {
+            const size_t new_capacity = capacity ? 2 * capacity : 64;
+
+            cache_entry_info* const new_entries =
+                (cache_entry_info*) realloc (entries, new_capacity * sizeof (cache_entry_info));
+
+            if (!new_entries)
+            {
+                perror ("cache entries allocation error");
+                break;
+            }
+
+            entries  = new_entries;
+            capacity = new_capacity;
+        }
+
+        cache_entry_info* const entry = &entries [n_entries++];
+
+        memcpy (entry -> name, file -> d_name, CACHE_KEY_LEN + 1);
+        entry -> mtime = file_stat .st_mtim;
+        entry -> size  = (size_t) file_stat .st_size;
+
+        total_size += entry -> size;
+    }
+
+    if (entries)
+        qsort (entries, n_entries, sizeof (cache_entry_info), CompareEntryTimes);
+
+    for (size_t i = 0; i < n_entries && total_size > target_size; i++)
+    {
+        if (unlinkat (dir_fd, entries [i] .name, 0) == 0)
+            total_size -= entries [i] .size;
+    }
+
+    free (entries);
+    closedir (dir_stream);
+
+    return total_size;
+}
+
+static bool IsEntryName (const char* name)
+{
+    assert (name);
+
+    size_t len = 0;
+
+    for (; name [len]; len++)
+    {
+        const bool is_hex = ('0' <= name [len] && name [len] <= '9') ||
+                            ('a' <= name [len] && name [len] <= 'f');
+
+        if (!is_hex || len >= CACHE_KEY_LEN) return false;
+    }
+
+    return len == CACHE_KEY_LEN;
+}
+
+static int CompareEntryTimes (const void* first, const void* second)
+{
+    const cache_entry_info* const first_entry  = (const cache_entry_info*) first;
+    const cache_entry_info* const second_entry = (const cache_entry_info*) second;
+
+    if (first_entry -> mtime .tv_sec != second_entry -> mtime .tv_sec)
+        return (first_entry -> mtime .tv_sec < second_entry -> mtime .tv_sec) ? -1 : 1;
+
+    if (first_entry -> mtime .tv_nsec != second_entry -> mtime .tv_nsec)
+        return (first_entry -> mtime .tv_nsec < second_entry -> mtime .tv_nsec) ? -1 : 1;
+
+    return 0;
+}
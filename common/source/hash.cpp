@@ -62,6 +62,22 @@ ErrorType StackDataFindHash (Stack*  const stk,
     return stk->stack_err;
 }
 
+ErrorType StackUpdateHash (Stack*  const stk,
+                           const Hash_t  old_stack_hash,
+                           Elem_t        old_value,
+                           const size_t  index)
+{
+    Hash_t stack_hash = 0;
+    StackFindHash (stk, &stack_hash);
+
+    stk->hash_value += stack_hash - old_stack_hash;
+
+    HashDecrease ((char*) &old_value,          &stk->hash_value, 0, sizeof (Elem_t));
+    HashIncrease ((char*) (stk->data + index), &stk->hash_value, 0, sizeof (Elem_t));
+
+    return stk->stack_err;
+}
+
 ErrorType StackHashError (Stack* const stk)
 {
     assert (stk);
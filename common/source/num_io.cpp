@@ -0,0 +1,632 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/num_io.h"
+#include "../include/num_io_tables.h"
+
+typedef unsigned __int128 uint128_t;
+
+const int DOUBLE_MANTISSA_BITS = 52;
+const int DOUBLE_EXPONENT_BITS = 11;
+const int DOUBLE_BIAS          = 1023;
+const int DOUBLE_INF_EXPONENT  = (1 << DOUBLE_EXPONENT_BITS) - 1;
+
+const uint64_t DOUBLE_HIDDEN_BIT = (uint64_t) 1 << DOUBLE_MANTISSA_BITS;
+
+/* a uint64_t takes any 19 digits */
+const int MAX_MANTISSA_DIGITS = 19;
+
+/* exponents beyond it give 0 or inf anyway */
+const int64_t MAX_EXPONENT_VALUE = 100000;
+
+/* w * 10^q is exact for w < 2^53 and these q, so a single operation rounds it right */
+const int     EXACT_POW10_MAX = 22;
+const uint64_t EXACT_MANTISSA_MAX = (uint64_t) 1 << 53;
+
+static const double EXACT_POW10 [EXACT_POW10_MAX + 1] =
+    {
+     1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+     1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+/* the layout of %g */
+const int MIN_EXP_FORM_PRECISION = 6;
+const int MIN_FIXED_FORM_EXP     = -4;
+
+static size_t   ParseWithStrtod   (const char* str, double* value);
+static bool     ComputeDouble     (int64_t exp10, uint64_t mantissa, uint64_t* bits);
+static double   BitsToDouble      (uint64_t bits);
+static uint64_t DoubleToBits      (double value);
+
+static void     FindShortest      (uint64_t ieee_mantissa, uint32_t ieee_exponent,
+                                   uint64_t* output, int32_t* exp10);
+static uint64_t MulShift          (uint64_t m, const uint64_t* mul, int32_t shift);
+static uint32_t Pow5Factor        (uint64_t value);
+static int32_t  Pow5Bits          (int32_t e);
+static uint32_t Log10Pow2         (int32_t e);
+static uint32_t Log10Pow5         (int32_t e);
+static size_t   PrintDigits       (uint64_t output, int32_t exp10, char* buffer);
+
+size_t ParseDouble (const char* str, double* value)
+{
+    assert (str);
+    assert (value);
+
+    const char* cur = str;
+
+    const bool is_negative = (*cur == '-');
+
+    if (*cur == '-' || *cur == '+')
+        cur++;
+
+    const bool has_digits = ('0' <= *cur && *cur <= '9') ||
+                            (*cur == '.' && '0' <= cur [1] && cur [1] <= '9');
+
+    /* inf, nan and hex are not worth a parser of their own */
+    if (!has_digits || (cur [0] == '0' && (cur [1] == 'x' || cur [1] == 'X')))
+        return ParseWithStrtod (str, value);
+
+    uint64_t mantissa     = 0;
+    int      n_digits     = 0;
+    int64_t  exp10        = 0;
+    bool     is_truncated = false;
+
+    for (; '0' <= *cur && *cur <= '9'; cur++)
+    {
+        if (n_digits < MAX_MANTISSA_DIGITS)
+        {
+            mantissa = mantissa * 10 + (uint64_t) (*cur - '0');
+            n_digits += (mantissa != 0);
+        }
+
+        else
+        {
+            exp10++;
+            is_truncated |= (*cur != '0');
+        }
+    }
+
+    if (*cur == '.')
+    {
+        for (cur++; '0' <= *cur && *cur <= '9'; cur++)
+        {
+            if (n_digits < MAX_MANTISSA_DIGITS)
+            {
+                mantissa = mantissa * 10 + (uint64_t) (*cur - '0');
+                n_digits += (mantissa != 0);
+                exp10--;
+            }
+
+            else
+                is_truncated |= (*cur != '0');
+        }
+    }
+
+    /* an exponent without digits is not a part of the number */
+    if (*cur == 'e' || *cur == 'E')
+    {
+        const char* exp_cur = cur + 1;
+
+        const bool is_exp_negative = (*exp_cur == '-');
+
+        if (*exp_cur == '-' || *exp_cur == '+')
+            exp_cur++;
+
+        if ('0' <= *exp_cur && *exp_cur <= '9')
+        {
+            int64_t exp_value = 0;
+
+            for (; '0' <= *exp_cur && *exp_cur <= '9'; exp_cur++)
+            {
+                if (exp_value < MAX_EXPONENT_VALUE)
+                    exp_value = exp_value * 10 + (*exp_cur - '0');
+            }
+
+            exp10 += is_exp_negative ? -exp_value : exp_value;
+            cur    = exp_cur;
+        }
+    }
+
+    /* more than 19 digits need big integers to round right */
+    if (is_truncated)
+        return ParseWithStrtod (str, value);
+
+    double result = 0;
+
+    if (mantissa == 0)
+        result = 0;
+
+    else if (-EXACT_POW10_MAX <= exp10 && exp10 <= EXACT_POW10_MAX &&
+             mantissa <= EXACT_MANTISSA_MAX)
+    {
+        result = (double) mantissa;
+
+        if (exp10 < 0)
+            result /= EXACT_POW10 [-exp10];
+        else
+            result *= EXACT_POW10 [exp10];
+    }
+
+    else
+    {
+        uint64_t bits = 0;
+
+        if (!ComputeDouble (exp10, mantissa, &bits))
+            return ParseWithStrtod (str, value);
+
+        result = BitsToDouble (bits);
+    }
+
+    *value = is_negative ? -result : result;
+
+    return (size_t) (cur - str);
+}
+
+size_t FormatDouble (double value, char* buffer)
+{
+    assert (buffer);
+
+    const uint64_t bits = DoubleToBits (value);
+
+    const uint64_t ieee_mantissa = bits & (DOUBLE_HIDDEN_BIT - 1);
+    const uint32_t ieee_exponent = (uint32_t) ((bits >> DOUBLE_MANTISSA_BITS) &
+                                               (uint64_t) DOUBLE_INF_EXPONENT);
+
+    size_t length = 0;
+
+    if (bits >> 63)
+        buffer [length++] = '-';
+
+    if (ieee_exponent == (uint32_t) DOUBLE_INF_EXPONENT)
+    {
+        memcpy (buffer + length, ieee_mantissa ? "nan" : "inf", 4);
+        return length + 3;
+    }
+
+    if (ieee_exponent == 0 && ieee_mantissa == 0)
+    {
+        memcpy (buffer + length, "0", 2);
+        return length + 1;
+    }
+
+    uint64_t output = 0;
+    int32_t  exp10  = 0;
+
+    FindShortest (ieee_mantissa, ieee_exponent, &output, &exp10);
+
+    return length + PrintDigits (output, exp10, buffer + length);
+}
+
+static size_t ParseWithStrtod (const char* str, double* value)
+{
+    assert (str);
+    assert (value);
+
+    char* end = nullptr;
+
+    const double result = strtod (str, &end);
+
+    if (end == str)
+        return 0;
+
+    *value = result;
+
+    return (size_t) (end - str);
+}
+
+/*
+ * Eisel-Lemire: the 64 top bits of the mantissa times the 128 bits of
+ * 5^q are enough to round unless the product is right at a halfway
+ * point, which only an exact product can be, or the truncated bits
+ * could carry into the kept ones. It returns false for the last case.
+ */
+static bool ComputeDouble (int64_t exp10, uint64_t mantissa, uint64_t* bits)
+{
+    assert (mantissa);
+    assert (bits);
+
+    if (exp10 < POW5_128_MIN_EXP)
+    {
+        *bits = 0;
+        return true;
+    }
+
+    if (exp10 > POW5_128_MAX_EXP)
+    {
+        *bits = (uint64_t) DOUBLE_INF_EXPONENT << DOUBLE_MANTISSA_BITS;
+        return true;
+    }
+
+    const int leading_zeros = __builtin_clzll (mantissa);
+    mantissa <<= leading_zeros;
+
+    const size_t index = (size_t) (exp10 - POW5_128_MIN_EXP);
+
+    /* 55 bits are kept: the mantissa, a guard bit and the top bit that may be 0 */
+    const uint64_t precision_mask = UINT64_MAX >> (DOUBLE_MANTISSA_BITS + 3);
+
+    const uint128_t first = (uint128_t) mantissa * POW5_128_HIGH [index];
+
+    uint64_t high = (uint64_t) (first >> 64);
+    uint64_t low  = (uint64_t) first;
+
+    if ((high & precision_mask) == precision_mask)
+    {
+        const uint64_t second_high =
+            (uint64_t) (((uint128_t) mantissa * POW5_128_LOW [index]) >> 64);
+
+        low += second_high;
+
+        if (second_high > low)
+            high++;
+
+        if (low == UINT64_MAX && (high & precision_mask) == precision_mask &&
+            (exp10 < -27 || exp10 > 55))
+            return false;
+    }
+
+    const int upper_bit = (int) (high >> 63);
+    const int shift     = upper_bit + 64 - DOUBLE_MANTISSA_BITS - 3;
+
+    uint64_t result = high >> shift;
+
+    /* floor (log2 (10^q)) + 63 from the fixed point log2 (10) */
+    int64_t power2 = ((217706 * exp10) >> 16) + 63 + upper_bit - leading_zeros + DOUBLE_BIAS;
+
+    if (power2 <= 0)
+    {
+        if (-power2 + 1 >= 64)
+        {
+            *bits = 0;
+            return true;
+        }
+
+        result >>= -power2 + 1;
+        result  += result & 1;
+        result >>= 1;
+
+        /* a subnormal that rounds up to the least normal gets its exponent */
+        power2 = (result < DOUBLE_HIDDEN_BIT) ? 0 : 1;
+
+        *bits = result | ((uint64_t) power2 << DOUBLE_MANTISSA_BITS);
+        return true;
+    }
+
+    /* halfway points are exact products, those need small q; round them to even */
+    if (low <= 1 && -4 <= exp10 && exp10 <= 23 && (result & 3) == 1 &&
+        (result << shift) == high)
+    {
+        result &= ~(uint64_t) 1;
+    }
+
+    result  += result & 1;
+    result >>= 1;
+
+    if (result >= 2 * DOUBLE_HIDDEN_BIT)
+    {
+        result = DOUBLE_HIDDEN_BIT;
+        power2++;
+    }
+
+    result &= ~DOUBLE_HIDDEN_BIT;
+
+    if (power2 >= DOUBLE_INF_EXPONENT)
+    {
+        *bits = (uint64_t) DOUBLE_INF_EXPONENT << DOUBLE_MANTISSA_BITS;
+        return true;
+    }
+
+    *bits = result | ((uint64_t) power2 << DOUBLE_MANTISSA_BITS);
+
+    return true;
+}
+
+static double BitsToDouble (uint64_t bits)
+{
+    double value = 0;
+    memcpy (&value, &bits, sizeof (double));
+
+    return value;
+}
+
+static uint64_t DoubleToBits (double value)
+{
+    uint64_t bits = 0;
+    memcpy (&bits, &value, sizeof (double));
+
+    return bits;
+}
+
+/*
+ * Ryu: the bounds of the values that round to the double are scaled by
+ * a power of 10 with 128-bit fixed point, then digits are dropped while
+ * the bounds stay apart. Exact scaled values need trailing zero checks.
+ */
+static void FindShortest (uint64_t ieee_mantissa, uint32_t ieee_exponent,
+                          uint64_t* output, int32_t* exp10)
+{
+    assert (output);
+    assert (exp10);
+
+    int32_t  e2 = 0;
+    uint64_t m2 = 0;
+
+    if (ieee_exponent == 0)
+    {
+        e2 = 1 - DOUBLE_BIAS - DOUBLE_MANTISSA_BITS - 2;
+        m2 = ieee_mantissa;
+    }
+
+    else
+    {
+        e2 = (int32_t) ieee_exponent - DOUBLE_BIAS - DOUBLE_MANTISSA_BITS - 2;
+        m2 = DOUBLE_HIDDEN_BIT | ieee_mantissa;
+    }
+
+    /* bounds are halfway to the neighbours, they belong to the value if it is even */
+    const bool accept_bounds = (m2 & 1) == 0;
+
+    const uint64_t mv = 4 * m2;
+
+    /* the lower neighbour is closer at a power of 2 */
+    const uint32_t mm_shift = (ieee_mantissa != 0 || ieee_exponent <= 1);
+
+    uint64_t vr = 0;
+    uint64_t vp = 0;
+    uint64_t vm = 0;
+
+    int32_t e10 = 0;
+
+    bool vm_is_trailing_zeros = false;
+    bool vr_is_trailing_zeros = false;
+
+    if (e2 >= 0)
+    {
+        const uint32_t q = Log10Pow2 (e2) - (e2 > 3);
+        e10 = (int32_t) q;
+
+        const int32_t k = POW5_INV_BITCOUNT + Pow5Bits ((int32_t) q) - 1;
+        const int32_t i = -e2 + (int32_t) q + k;
+
+        assert (q < (uint32_t) POW5_INV_TABLE_SIZE);
+
+        const uint64_t* const mul = &POW5_INV_SPLIT [2 * q];
+
+        vr = MulShift (4 * m2,                mul, i);
+        vp = MulShift (4 * m2 + 2,            mul, i);
+        vm = MulShift (4 * m2 - 1 - mm_shift, mul, i);
+
+        if (q <= 21)
+        {
+            /* only one of mv, mp and mm can be a multiple of 5 */
+            if (mv % 5 == 0)
+                vr_is_trailing_zeros = Pow5Factor (mv) >= q;
+
+            else if (accept_bounds)
+                vm_is_trailing_zeros = Pow5Factor (mv - 1 - mm_shift) >= q;
+
+            else
+                vp -= (Pow5Factor (mv + 2) >= q);
+        }
+    }
+
+    else
+    {
+        const uint32_t q = Log10Pow5 (-e2) - (-e2 > 1);
+        e10 = (int32_t) q + e2;
+
+        const int32_t i = -e2 - (int32_t) q;
+        const int32_t k = Pow5Bits (i) - POW5_BITCOUNT;
+        const int32_t j = (int32_t) q - k;
+
+        assert (i < POW5_TABLE_SIZE);
+
+        const uint64_t* const mul = &POW5_SPLIT [2 * i];
+
+        vr = MulShift (4 * m2,                mul, j);
+        vp = MulShift (4 * m2 + 2,            mul, j);
+        vm = MulShift (4 * m2 - 1 - mm_shift, mul, j);
+
+        if (q <= 1)
+        {
+            /* mv = 4 * m2 has at least 2 trailing zero bits */
+            vr_is_trailing_zeros = true;
+
+            if (accept_bounds)
+                vm_is_trailing_zeros = (mm_shift == 1);
+            else
+                vp--;
+        }
+
+        else if (q < 63)
+            vr_is_trailing_zeros = (mv & (((uint64_t) 1 << q) - 1)) == 0;
+    }
+
+    int32_t removed        = 0;
+    uint8_t last_removed   = 0;
+
+    if (vm_is_trailing_zeros || vr_is_trailing_zeros)
+    {
+        while (vp / 10 > vm / 10)
+        {
+            vm_is_trailing_zeros &= (vm % 10 == 0);
+            vr_is_trailing_zeros &= (last_removed == 0);
+
+            last_removed = (uint8_t) (vr % 10);
+
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+
+        if (vm_is_trailing_zeros)
+        {
+            while (vm % 10 == 0)
+            {
+                vr_is_trailing_zeros &= (last_removed == 0);
+
+                last_removed = (uint8_t) (vr % 10);
+
+                vr /= 10;
+                vp /= 10;
+                vm /= 10;
+                removed++;
+            }
+        }
+
+        /* exactly ...50..0 rounds to even */
+        if (vr_is_trailing_zeros && last_removed == 5 && vr % 2 == 0)
+            last_removed = 4;
+
+        *output = vr + ((vr == vm && (!accept_bounds || !vm_is_trailing_zeros)) ||
+                        last_removed >= 5);
+    }
+
+    else
+    {
+        bool is_round_up = false;
+
+        while (vp / 10 > vm / 10)
+        {
+            is_round_up = (vr % 10 >= 5);
+
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+
+        *output = vr + (vr == vm || is_round_up);
+    }
+
+    *exp10 = e10 + removed;
+}
+
+/* (m * mul) >> shift for the 125-bit mul, shift > 64 */
+static uint64_t MulShift (uint64_t m, const uint64_t* mul, int32_t shift)
+{
+    assert (mul);
+    assert (shift > 64);
+
+    const uint128_t low  = (uint128_t) m * mul [0];
+    const uint128_t high = (uint128_t) m * mul [1];
+
+    return (uint64_t) (((low >> 64) + high) >> (shift - 64));
+}
+
+static uint32_t Pow5Factor (uint64_t value)
+{
+    uint32_t count = 0;
+
+    while (value && value % 5 == 0)
+    {
+        value /= 5;
+        count++;
+    }
+
+    return count;
+}
+
+/* ceil (log2 (5^e)), 1 for e == 0 */
+static int32_t Pow5Bits (int32_t e)
+{
+    return (int32_t) (((uint32_t) e * 1217359) >> 19) + 1;
+}
+
+static uint32_t Log10Pow2 (int32_t e)
+{
+    return ((uint32_t) e * 78913) >> 18;
+}
+
+static uint32_t Log10Pow5 (int32_t e)
+{
+    return ((uint32_t) e * 732923) >> 20;
+}
+
+static size_t PrintDigits (uint64_t output, int32_t exp10, char* buffer)
+{
+    assert (buffer);
+
+    char digits [MAX_MANTISSA_DIGITS + 1] = "";
+    int  n_digits = 0;
+
+    for (; output; output /= 10)
+        digits [n_digits++] = (char) ('0' + output % 10);
+
+    /* reversed above */
+    for (int i = 0; i < n_digits / 2; i++)
+    {
+        const char digit = digits [i];
+
+        digits [i]                = digits [n_digits - 1 - i];
+        digits [n_digits - 1 - i] = digit;
+    }
+
+    const int point_exp = n_digits - 1 + exp10;
+    const int precision = (n_digits > MIN_EXP_FORM_PRECISION) ? n_digits :
+                                                                MIN_EXP_FORM_PRECISION;
+    size_t length = 0;
+
+    if (point_exp < MIN_FIXED_FORM_EXP || point_exp >= precision)
+    {
+        buffer [length++] = digits [0];
+
+        if (n_digits > 1)
+        {
+            buffer [length++] = '.';
+
+            memcpy (buffer + length, digits + 1, (size_t) (n_digits - 1));
+            length += (size_t) (n_digits - 1);
+        }
+
+        buffer [length++] = 'e';
+        buffer [length++] = (point_exp < 0) ? '-' : '+';
+
+        const int exp_abs = (point_exp < 0) ? -point_exp : point_exp;
+
+        /* at least 2 digits like in %g */
+        if (exp_abs >= 100)
+            buffer [length++] = (char) ('0' + exp_abs / 100);
+
+        buffer [length++] = (char) ('0' + exp_abs / 10 % 10);
+        buffer [length++] = (char) ('0' + exp_abs % 10);
+    }
+
+    else if (exp10 >= 0)
+    {
+        memcpy (buffer + length, digits, (size_t) n_digits);
+        length += (size_t) n_digits;
+
+        memset (buffer + length, '0', (size_t) exp10);
+        length += (size_t) exp10;
+    }
+
+    else if (point_exp >= 0)
+    {
+        memcpy (buffer + length, digits, (size_t) point_exp + 1);
+        length += (size_t) point_exp + 1;
+
+        buffer [length++] = '.';
+
+        memcpy (buffer + length, digits + point_exp + 1, (size_t) (-exp10));
+        length += (size_t) (-exp10);
+    }
+
+    else
+    {
+        buffer [length++] = '0';
+        buffer [length++] = '.';
+
+        memset (buffer + length, '0', (size_t) (-point_exp - 1));
+        length += (size_t) (-point_exp - 1);
+
+        memcpy (buffer + length, digits, (size_t) n_digits);
+        length += (size_t) n_digits;
+    }
+
+    buffer [length] = '\0';
+
+    return length;
+}
@@ -149,19 +149,20 @@ ErrorType StackPush (Stack* const stk, const Elem_t value)
         StackDataAlloc(stk, (Elem_t*) stk->data);
     }
 
+    /// Bytes of data_size carry into each other, so the struct is hashed anew,
+    /// the data only by the element that changed.
     #ifdef HASH_PROTECTION
-        char* hash_ptr = (char*) (stk->data + stk->data_size); // ?
-        HashDecrease (hash_ptr, &stk->hash_value, 0, sizeof (Elem_t));
+        Hash_t old_stack_hash = 0;
+        StackFindHash (stk, &old_stack_hash);
+
+        const Elem_t old_value = stk->data[stk->data_size];
     #endif
 
     /// The push itself.
     stk->data[stk->data_size++] = value;
 
     #ifdef HASH_PROTECTION
-        stk->hash_value++;
-        HashIncrease (hash_ptr, &stk->hash_value, 0, sizeof (Elem_t));
-
-        StackHashError (stk);
+        StackUpdateHash (stk, old_stack_hash, old_value, stk->data_size - 1);
     #endif
 
     return stk->stack_err;
@@ -185,8 +186,8 @@ ErrorType StackPop (Stack* const stk, Elem_t* const return_value)
     }
 
     #ifdef HASH_PROTECTION
-        char* hash_ptr = (char*) (stk->data + stk->data_size - 1);
-        HashDecrease (hash_ptr, &stk->hash_value, 0, sizeof (Elem_t));
+        Hash_t old_stack_hash = 0;
+        StackFindHash (stk, &old_stack_hash);
     #endif
 
     /// The pop itself.
@@ -194,10 +195,7 @@ ErrorType StackPop (Stack* const stk, Elem_t* const return_value)
     stk->data[stk->data_size] = POISON;
 
     #ifdef HASH_PROTECTION
-        stk->hash_value--;
-        HashIncrease (hash_ptr, &stk->hash_value, 0, sizeof (Elem_t));
-
-        StackHashError (stk);
+        StackUpdateHash (stk, old_stack_hash, *return_value, stk->data_size);
     #endif
 
     return stk->stack_err;
@@ -0,0 +1,208 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <atomic>
+#include "../include/thread_pool.h"
+
+static const size_t CACHE_LINE_SIZE = 64;
+
+/* the indices begin .. end - 1 left to a worker, it takes the front, thieves the back */
+struct alignas (CACHE_LINE_SIZE) task_deque
+{
+    pthread_mutex_t lock;
+    size_t          begin;
+    size_t          end;
+};
+
+struct task_batch
+{
+    task_func           task;
+    void*               arg;
+    size_t              n_tasks;
+
+    task_deque*         deques;
+    size_t              n_workers;
+
+    std::atomic<bool>   is_failed;
+};
+
+struct task_worker
+{
+    task_batch* batch;
+    size_t      index;
+};
+
+static void* RunWorker  (void* worker_ptr);
+
+static bool  TakeTask   (task_deque* const deque,
+                         size_t*     const index);
+
+static bool  StealTasks (task_batch* const batch,
+                         const size_t      thief);
+
+size_t GetHardwareThreads ()
+{
+    const long n_threads = sysconf (_SC_NPROCESSORS_ONLN);
+
+    return (n_threads > 0) ? (size_t) n_threads : 1;
+}
+
+bool RunTasks (task_func    task,
+               void*        arg,
+               size_t       n_tasks,
+               size_t       n_threads)
+{
+    assert (task);
+
+    if (n_threads > n_tasks)
+        n_threads = n_tasks;
+
+    if (n_threads <= 1)
+    {
+        bool is_done = true;
+
+        for (size_t i = 0; i < n_tasks; i++)
+            is_done &= task (arg, i);
+
+        return is_done;
+    }
+
+    /* the calling thread is worker 0 */
+    pthread_t*   const threads = (pthread_t*)   calloc (n_threads - 1, sizeof (pthread_t));
+    task_deque*  const deques  = (task_deque*)  aligned_alloc (CACHE_LINE_SIZE,
+                                                               n_threads * sizeof (task_deque));
+    task_worker* const workers = (task_worker*) calloc (n_threads, sizeof (task_worker));
+
+    if (!threads || !deques || !workers)
+    {
+        perror ("threads allocation error");
+        free (threads);
+        free (deques);
+        free (workers);
+        return false;
+    }
+
+    task_batch batch = {.task      = task,
+                        .arg       = arg,
+                        .n_tasks   = n_tasks,
+                        .deques    = deques,
+                        .n_workers = n_threads,
+                        .is_failed = {false}};
+
+    /* neighbouring indices stay on one worker until it is robbed */
+    for (size_t i = 0; i < n_threads; i++)
+    {
+        pthread_mutex_init (&deques [i] .lock, nullptr);
+
+        deques  [i] .begin = n_tasks *  i      / n_threads;
+        deques  [i] .end   = n_tasks * (i + 1) / n_threads;
+
+        workers [i] = {.batch = &batch, .index = i};
+    }
+
+    /* fewer threads only make it slower, the shares of the missing ones get stolen */
+    size_t n_started = 0;
+
+    while (n_started < n_threads - 1 &&
+           pthread_create (&threads [n_started], nullptr, RunWorker, &workers [n_started + 1]) == 0)
+    {
+        n_started++;
+    }
+
+    RunWorker (&workers [0]);
+
+    for (size_t i = 0; i < n_started; i++)
+        pthread_join (threads [i], nullptr);
+
+    for (size_t i = 0; i < n_threads; i++)
+        pthread_mutex_destroy (&deques [i] .lock);
+
+    free (threads);
+    free (deques);
+    free (workers);
+
+    return !batch .is_failed;
+}
+
+/* no tasks are added while a batch runs, so a worker that finds nothing to steal is done */
+static void* RunWorker (void* worker_ptr)
+{
+    assert (worker_ptr);
+
+    const task_worker* const worker = (const task_worker*) worker_ptr;
+          task_batch*  const batch  = worker->batch;
+
+    task_deque* const own = &batch->deques [worker->index];
+
+    size_t index = 0;
+
+    do
+    {
+        while (TakeTask (own, &index))
+        {
+            if (!batch->task (batch->arg, index))
+                batch->is_failed = true;
+        }
+    }
+    while (StealTasks (batch, worker->index));
+
+    return nullptr;
+}
+
+static bool TakeTask (task_deque* const deque,
+                      size_t*     const index)
+{
+    assert (deque);
+    assert (index);
+
+    pthread_mutex_lock (&deque->lock);
+
+    const bool is_taken = deque->begin < deque->end;
+
+    if (is_taken)
+        *index = deque->begin++;
+
+    pthread_mutex_unlock (&deque->lock);
+
+    return is_taken;
+}
+
+/* takes the back half of the first other worker's share that is not empty */
+static bool StealTasks (task_batch* const batch,
+                        const size_t      thief)
+{
+    assert (batch);
+
+    for (size_t i = 1; i < batch->n_workers; i++)
+    {
+        task_deque* const victim = &batch->deques [(thief + i) % batch->n_workers];
+
+        pthread_mutex_lock (&victim->lock);
+
+        /* a single task is stolen too, its owner may be a thread that never started */
+        const size_t n_stolen = (victim->end - victim->begin + 1) / 2;
+        const size_t end      = victim->end;
+
+        victim->end -= n_stolen;
+
+        pthread_mutex_unlock (&victim->lock);
+
+        if (!n_stolen)
+            continue;
+
+        task_deque* const own = &batch->deques [thief];
+
+        pthread_mutex_lock (&own->lock);
+
+        own->begin = end - n_stolen;
+        own->end   = end;
+
+        pthread_mutex_unlock (&own->lock);
+
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "optimize.h"
+
+/* a directory adds the files with it, not the ones of its subdirectories */
+const char SOURCE_SUFFIX[] = ".txt";
+
+const char ASM_SUFFIX[] = ".asm";
+
+struct batch_inputs
+{
+    char** file_names;
+    size_t n_files;
+    size_t capacity;
+};
+
+/* what every file of a batch is compiled with */
+struct batch_config
+{
+    const optimize_config* optimize;
+    const char*            out_dir;     // the asm goes next to the source if nullptr
+    size_t                 n_jobs;      // files compiled at once
+};
+
+/*
+ * Adds a source file or the sources of a directory, in the order
+ * of their names. Returns false if the path can't be read.
+ */
+bool
+AddBatchInput   (      batch_inputs* const inputs,
+                 const char*         const path);
+
+void
+BatchInputsDtor (batch_inputs* const inputs);
+
+/*
+ * Compiles every source to an asm file of its own, name.txt to
+ * name.asm, on n_jobs threads. A file that fails leaves no asm and
+ * doesn't stop the rest. Returns the number of files that failed.
+ */
+size_t
+CompileBatch    (const batch_inputs* const inputs,
+                 const batch_config* const config);
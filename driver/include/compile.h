@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdio.h>
+#include "optimize.h"
+
+enum compile_output
+{
+    OUTPUT_TREE = 0,    // what the frontend writes, before the passes
+    OUTPUT_ASM  = 1,
+};
+
+/*
+ * Reads the source on the calling thread and prints its tree or the
+ * code for it to the output. What goes wrong is printed to errors,
+ * after the name of the source. Returns false if it fails.
+ */
+bool
+CompileSource (const char*            const file_name,
+               const char*            const source_name,
+               const optimize_config* const optimize,
+               const compile_output         output_kind,
+                     FILE*            const output,
+                     FILE*            const errors);
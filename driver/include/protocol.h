@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stddef.h>
+
+/*
+ * What the server and its client say over the socket. A request is
+ * lines of text:
+ *
+ *     output asm|tree      what to send back, asm if there is no line
+ *     option <option>      an optimize option, e.g. -O2, zero or more
+ *     file <path>          the source to compile, the path is the server's
+ *   or
+ *     source <size>        followed by the size bytes of the source
+ *
+ * or the single line "stop", which shuts the server down. The answer
+ * is "ok <size>" or "error <size>" and a line, followed by the size
+ * bytes of the output or of the messages. A connection may carry any
+ * number of requests, one after another.
+ */
+
+const char DEFAULT_SOCKET_NAME[] = "/tmp/lotrc.sock";
+
+const char REQUEST_OUTPUT[] = "output";
+const char REQUEST_OPTION[] = "option";
+const char REQUEST_FILE[]   = "file";
+const char REQUEST_SOURCE[] = "source";
+const char REQUEST_STOP[]   = "stop";
+
+const char OUTPUT_ASM_NAME[]  = "asm";
+const char OUTPUT_TREE_NAME[] = "tree";
+
+const char ANSWER_OK[]    = "ok";
+const char ANSWER_ERROR[] = "error";
+
+/* bigger sources are refused, they are sent in one piece */
+const size_t MAX_SOURCE_SIZE = (size_t) 64 << 20;
+
+const size_t MAX_REQUEST_OPTIONS = 16;
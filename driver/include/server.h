@@ -0,0 +1,25 @@
+#pragma once
+
+#include "optimize.h"
+#include "compile_cache.h"
+
+struct server_config
+{
+    const char*            socket_name;
+    const optimize_config* optimize;    // what a request's options are added to
+    const char* const*     options;     // that set optimize, a part of the cache keys
+    size_t                 n_options;
+    const cache_config*    cache;       // without a directory requests are not cached
+    size_t                 n_jobs;      // requests served at once
+};
+
+/*
+ * Serves the requests of protocol.h on a Unix socket until one of
+ * them is "stop". The process stays up between requests, so no
+ * startup is paid for a compilation. A request that fails only fails
+ * its answer. An answer is kept in the compile cache by the source,
+ * the output and the options, and a repeated request gets it from
+ * there. Returns false if the socket can't be set up.
+ */
+bool
+RunServer (const server_config* const config);
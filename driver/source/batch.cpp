@@ -0,0 +1,317 @@
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "batch.h"
+#include "compile.h"
+#include "thread_pool.h"
+
+/*
+ * Every file is read, optimized and lowered in memory on a thread of
+ * the batch, the tree doesn't go through a file. The threads take the
+ * files as they become free, the biggest ones first, so that a big
+ * file doesn't start last and keep one thread busy while others idle.
+ * A file is compiled on one thread: the batch has enough of them.
+ */
+
+struct batch_file
+{
+    const char* file_name;
+    size_t      size;
+    size_t      order;      // in the inputs, for files of the same size
+};
+
+struct batch_job
+{
+    const batch_config* config;
+    batch_file*         files;
+    bool*               is_compiled;    // by file
+};
+
+static bool
+PushFileName      (      batch_inputs* const inputs,
+                   const char*         const file_name);
+
+static bool
+AddDirectory      (      batch_inputs* const inputs,
+                   const char*         const dir_name);
+
+static bool
+IsSourceName      (const char* const name);
+
+static int
+CompareNames      (const void* const first,
+                   const void* const second);
+
+static int
+CompareFileSizes  (const void* const first,
+                   const void* const second);
+
+static bool
+CompileFileTask   (void*  const job_ptr,
+                   const size_t index);
+
+static bool
+GetOutputName     (const char* const file_name,
+                   const char* const out_dir,
+                         char* const output_name);
+
+bool
+AddBatchInput (      batch_inputs* const inputs,
+               const char*         const path)
+{
+    assert (inputs);
+    assert (path);
+
+    struct stat path_stat = {};
+
+    if (stat (path, &path_stat) != 0)
+    {
+        perror (path);
+        return false;
+    }
+
+    if (S_ISDIR (path_stat .st_mode))
+        return AddDirectory (inputs, path);
+
+    return PushFileName (inputs, path);
+}
+
+void
+BatchInputsDtor (batch_inputs* const inputs)
+{
+    assert (inputs);
+
+    for (size_t i = 0; i < inputs -> n_files; i++)
+        free (inputs -> file_names [i]);
+
+    free (inputs -> file_names);
+
+    inputs -> file_names = nullptr;
+    inputs -> n_files    = 0;
+    inputs -> capacity   = 0;
+}
+
+size_t
+CompileBatch (const batch_inputs* const inputs,
+              const batch_config* const config)
+{
+    assert (inputs);
+    assert (config);
+
+    const size_t n_files = inputs -> n_files;
+
+    if (!n_files) return 0;
+
+    batch_job job = {.config      = config,
+                     .files       = (batch_file*) calloc (n_files, sizeof (batch_file)),
+                     .is_compiled = (bool*)       calloc (n_files, sizeof (bool))};
+
+    if (!job .files || !job .is_compiled)
+    {
+        perror ("batch job allocation error");
+        free (job .files);
+        free (job .is_compiled);
+        return n_files;
+    }
+
+    for (size_t i = 0; i < n_files; i++)
+    {
+        struct stat file_stat = {};
+
+        job .files [i] = {.file_name = inputs -> file_names [i],
+                          .size      = (stat (inputs -> file_names [i], &file_stat) == 0) ?
+                                       (size_t) file_stat .st_size : 0,
+                          .order     = i};
+    }
+
+    qsort (job .files, n_files, sizeof (batch_file), CompareFileSizes);
+
+    RunTasks (CompileFileTask, &job, n_files, config -> n_jobs);
+
+    size_t n_failed = 0;
+
+    for (size_t i = 0; i < n_files; i++)
+        n_failed += !job .is_compiled [i];
+
+    free (job .files);
+    free (job .is_compiled);
+
+    return n_failed;
+}
+
+static bool
+CompileFileTask (void*  const job_ptr,
+                 const size_t index)
+{
+    assert (job_ptr);
+
+    batch_job* const job = (batch_job*) job_ptr;
+
+    const char* const file_name = job -> files [index] .file_name;
+
+    char output_name [PATH_MAX] = "";
+
+    if (!GetOutputName (file_name, job -> config -> out_dir, output_name))
+    {
+        fprintf (stderr, "%s: the output name is too long\n", file_name);
+        return false;
+    }
+
+    FILE* const output = fopen (output_name, "wb");
+    if (!output)
+    {
+        perror (output_name);
+        return false;
+    }
+
+    bool is_compiled = CompileSource (file_name, file_name, job -> config -> optimize,
+                                      OUTPUT_ASM, output, stderr);
+
+    is_compiled = (fclose (output) == 0) && is_compiled;
+
+    if (!is_compiled)
+        unlink (output_name);
+
+    job -> is_compiled [index] = is_compiled;
+
+    return is_compiled;
+}
+
+static bool
+GetOutputName (const char* const file_name,
+               const char* const out_dir,
+                     char* const output_name)
+{
+    assert (file_name);
+    assert (output_name);
+
+    const char* const base_name = strrchr (file_name, '/');
+
+    /* the directory of the source or the one of the outputs */
+    int length = out_dir ? snprintf (output_name, PATH_MAX, "%s/%s", out_dir,
+                                     base_name ? base_name + 1 : file_name) :
+                           snprintf (output_name, PATH_MAX, "%s", file_name);
+
+    if (length < 0 || (size_t) length >= PATH_MAX)
+        return false;
+
+    if (IsSourceName (output_name))
+        length -= (int) strlen (SOURCE_SUFFIX);
+
+    return (size_t) snprintf (output_name + length, PATH_MAX - (size_t) length, "%s",
+                              ASM_SUFFIX) < PATH_MAX - (size_t) length;
+}
+
+static bool
+PushFileName (      batch_inputs* const inputs,
+              const char*         const file_name)
+{
+    assert (inputs);
+    assert (file_name);
+
+    if (inputs -> n_files == inputs -> capacity)
+    {
+        const size_t new_capacity = inputs -> capacity ? inputs -> capacity * 2 : 16;
+
+        char** const new_names =
+            (char**) realloc (inputs -> file_names, new_capacity * sizeof (char*));
+        if (!new_names)
+        {
+            perror ("file_names reallocation error");
+            return false;
+        }
+
+        inputs -> file_names = new_names;
+        inputs -> capacity   = new_capacity;
+    }
+
+    char* const name_copy = strdup (file_name);
+    if (!name_copy)
+    {
+        perror ("file name allocation error");
+        return false;
+    }
+
+    inputs -> file_names [inputs -> n_files++] = name_copy;
+
+    return true;
+}
+
+static bool
+AddDirectory (      batch_inputs* const inputs,
+              const char*         const dir_name)
+{
+    assert (inputs);
+    assert (dir_name);
+
+    DIR* const dir = opendir (dir_name);
+    if (!dir)
+    {
+        perror (dir_name);
+        return false;
+    }
+
+    const size_t first_file = inputs -> n_files;
+
+    bool is_added = true;
+
+    for (const struct dirent* entry = readdir (dir); entry && is_added; entry = readdir (dir))
+    {
+        if (!IsSourceName (entry -> d_name)) continue;
+
+        char path [PATH_MAX] = "";
+
+        if ((size_t) snprintf (path, PATH_MAX, "%s/%s", dir_name, entry -> d_name) >= PATH_MAX)
+            continue;
+
+        struct stat path_stat = {};
+
+        if (stat (path, &path_stat) != 0 || !S_ISREG (path_stat .st_mode)) continue;
+
+        is_added = PushFileName (inputs, path);
+    }
+
+    closedir (dir);
+
+    /* the order of readdir is the one of the file system */
+    qsort (inputs -> file_names + first_file, inputs -> n_files - first_file,
+           sizeof (char*), CompareNames);
+
+    return is_added;
+}
+
+static bool
+IsSourceName (const char* const name)
+{
+    assert (name);
+
+    const size_t length        = strlen (name);
+    const size_t suffix_length = strlen (SOURCE_SUFFIX);
+
+    return length > suffix_length &&
+           strcmp (name + length - suffix_length, SOURCE_SUFFIX) == 0;
+}
+
+static int
+CompareNames (const void* const first,
+              const void* const second)
+{
+    return strcmp (*(const char* const*) first, *(const char* const*) second);
+}
+
+/* the biggest first, equal ones in the order of the inputs */
+static int
+CompareFileSizes (const void* const first,
+                  const void* const second)
+{
+    const batch_file* const first_file  = (const batch_file*) first;
+    const batch_file* const second_file = (const batch_file*) second;
+
+    if (first_file -> size != second_file -> size)
+        return (first_file -> size < second_file -> size) ? 1 : -1;
+
+    return (first_file -> order < second_file -> order) ? -1 :
+                                                          (first_file -> order > second_file -> order);
+}
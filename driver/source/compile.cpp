@@ -0,0 +1,108 @@
+#include <errno.h>
+#include <unistd.h>
+#include "compile.h"
+#include "read_code.h"
+#include "BinTree_PrintPreOrder.h"
+#include "print_asm.h"
+
+static const size_t ERROR_MESSAGE_MAX_LEN = 128;
+
+static bool
+ReadSourceTree (const char*    const file_name,
+                const char*    const source_name,
+                      BinTree* const tree,
+                      FILE*    const errors);
+
+bool
+CompileSource (const char*            const file_name,
+               const char*            const source_name,
+               const optimize_config* const optimize,
+               const compile_output         output_kind,
+                     FILE*            const output,
+                     FILE*            const errors)
+{
+    assert (file_name);
+    assert (source_name);
+    assert (optimize);
+    assert (output);
+    assert (errors);
+
+    BinTree tree = {};
+    BINTREE_CTOR (&tree);
+
+    if (!ReadSourceTree (file_name, source_name, &tree, errors))
+    {
+        BINTREE_DTOR (&tree);
+        return false;
+    }
+
+    bool is_compiled = false;
+
+    switch (output_kind)
+    {
+        case OUTPUT_TREE:
+            is_compiled = PrintTreeToStream (&tree, output);
+            break;
+
+        case OUTPUT_ASM:
+            is_compiled = OptimizeTree   (&tree, optimize, nullptr) &&
+                          PrintTreeToAsm (&tree, output);
+            break;
+
+        default:
+            assert (0 && "Unknown output kind");
+            break;
+    }
+
+    if (!is_compiled)
+        fprintf (errors, "%s: code can't be generated\n", source_name);
+
+    BINTREE_DTOR (&tree);
+
+    return is_compiled;
+}
+
+/* a syntax error leaves the tree empty, what the read held is freed */
+static bool
+ReadSourceTree (const char*    const file_name,
+                const char*    const source_name,
+                      BinTree* const tree,
+                      FILE*    const errors)
+{
+    assert (file_name);
+    assert (source_name);
+    assert (tree);
+    assert (errors);
+
+    if (access (file_name, R_OK) != 0)
+    {
+        char message [ERROR_MESSAGE_MAX_LEN] = "";
+
+        fprintf (errors, "%s: %s\n", source_name,
+                 strerror_r (errno, message, sizeof (message)));
+        return false;
+    }
+
+    const read_config config = {.n_jobs       = 1,
+                                .is_pipelined = false};
+
+    jmp_buf syntax_error = {};
+
+    if (setjmp (syntax_error) != 0)
+    {
+        syntax_error_exit = nullptr;
+
+        FreeFailedRead (tree);
+
+        fprintf (errors, "%s: syntax error\n", source_name);
+        return false;
+    }
+
+    syntax_error_exit = &syntax_error;
+
+    ReadTree (file_name, tree, &config);
+
+    syntax_error_exit = nullptr;
+
+    return true;
+}
@@ -0,0 +1,132 @@
+#include "batch.h"
+#include "server.h"
+#include "protocol.h"
+#include "thread_pool.h"
+
+int main (const int32_t argc, const char** argv)
+{
+    optimize_config optimize = {};
+    InitOptimizeConfig (&optimize);
+
+    batch_config config = {.optimize = &optimize,
+                           .out_dir  = nullptr,
+                           .n_jobs   = GetHardwareThreads ()};
+
+    batch_inputs inputs = {};
+
+    bool        is_server   = false;
+    const char* socket_name = DEFAULT_SOCKET_NAME;
+
+    cache_config cache_config = {};
+    InitCacheConfig (&cache_config);
+
+    /* the options that change the output are a part of the cache keys of the server */
+    const char** const key_options = (const char**) calloc ((size_t) argc, sizeof (char*));
+    size_t n_key_options = 0;
+
+    if (!key_options)
+    {
+        perror ("key_options allocation error");
+        return 1;
+    }
+
+    for (int32_t i = 1; i < argc; i++)
+    {
+        if (ParseOptimizeOption (argv [i], &optimize))
+        {
+            key_options [n_key_options++] = argv [i];
+            continue;
+        }
+
+        if (ParseCacheOption (argv [i], &cache_config)) continue;
+
+        if (strncmp (argv [i], "--jobs=", strlen ("--jobs=")) == 0)
+        {
+            config .n_jobs = strtoul (argv [i] + strlen ("--jobs="), nullptr, 10);
+            continue;
+        }
+
+        if (strncmp (argv [i], "--out-dir=", strlen ("--out-dir=")) == 0)
+        {
+            config .out_dir = argv [i] + strlen ("--out-dir=");
+            continue;
+        }
+
+        if (strcmp (argv [i], "--serve") == 0)
+        {
+            is_server = true;
+            continue;
+        }
+
+        if (strncmp (argv [i], "--socket=", strlen ("--socket=")) == 0)
+        {
+            socket_name = argv [i] + strlen ("--socket=");
+            continue;
+        }
+
+        if (argv [i][0] == '-')
+        {
+            fprintf (stderr, "Unknown option %s\n", argv [i]);
+            BatchInputsDtor (&inputs);
+            free (key_options);
+            return 1;
+        }
+
+        if (!AddBatchInput (&inputs, argv [i]))
+        {
+            BatchInputsDtor (&inputs);
+            free (key_options);
+            return 1;
+        }
+    }
+
+    if (cache_config .is_stats_printed)
+    {
+        PrintCacheStats (&cache_config, stdout);
+        BatchInputsDtor (&inputs);
+        free (key_options);
+        return 0;
+    }
+
+    /* the passes report to stderr once per file, they are not for a batch */
+    optimize .report_purity = false;
+
+    if (is_server)
+    {
+        if (inputs .n_files)
+            fprintf (stderr, "Source files are ignored, they come with requests\n");
+
+        const server_config server = {.socket_name = socket_name,
+                                      .optimize    = &optimize,
+                                      .options     = key_options,
+                                      .n_options   = n_key_options,
+                                      .cache       = &cache_config,
+                                      .n_jobs      = config .n_jobs};
+
+        BatchInputsDtor (&inputs);
+
+        const bool is_served = RunServer (&server);
+
+        free (key_options);
+
+        return is_served ? 0 : 1;
+    }
+
+    free (key_options);
+
+    if (!inputs .n_files)
+    {
+        fprintf (stderr, "No source files\n");
+        BatchInputsDtor (&inputs);
+        return 1;
+    }
+
+    const size_t n_failed = CompileBatch (&inputs, &config);
+
+    if (n_failed)
+        fprintf (stderr, "%zu of %zu files failed\n", n_failed, inputs .n_files);
+
+    BatchInputsDtor (&inputs);
+
+    return n_failed ? 1 : 0;
+}
@@ -0,0 +1,565 @@
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <atomic>
+#include "server.h"
+#include "protocol.h"
+#include "compile.h"
+#include "thread_pool.h"
+
+static const char INLINE_SOURCE_NAME[] = "<source>";
+
+static const size_t FD_PATH_MAX_LEN = 32;
+
+static const size_t ERROR_MESSAGE_MAX_LEN = 128;
+
+static const char CACHE_TOOL_ASM[]  = "driver-asm";
+static const char CACHE_TOOL_TREE[] = "driver-tree";
+
+struct server_state
+{
+    const server_config* config;
+    int                  listen_fd;
+    std::atomic<bool>    is_stopped;
+};
+
+/* the lines read so far of the request being read */
+struct server_request
+{
+    const server_config* config;
+
+    compile_output  output_kind;
+    optimize_config optimize;
+    size_t          n_options;
+    char*           options [MAX_REQUEST_OPTIONS];  // copies, the line buffer is reused
+
+    FILE*  errors;          // messages of a request that can't be compiled
+    char*  error_text;
+    size_t error_size;
+};
+
+static bool
+ServeTask          (void*  const state_ptr,
+                    const size_t index);
+
+static void
+ServeConnection    (server_state* const state,
+                    const int           conn);
+
+static bool
+ServeSource        (const int             conn,
+                          FILE*     const requests,
+                          server_request* request,
+                    const char*     const size_str);
+
+static bool
+AnswerRequest      (const int             conn,
+                          server_request* request,
+                    const char*     const file_name,
+                    const char*     const source_name);
+
+static bool
+InitRequestCache   (      compile_cache*  const cache,
+                    const server_request* const request,
+                    const char*           const file_name);
+
+static bool
+StartRequest       (      server_request* const request,
+                    const server_config*  const config);
+
+static void
+FreeRequestOptions (server_request* const request);
+
+static void
+ParseRequestLine   (      server_request* const request,
+                    const char*           const word,
+                    const char*           const arg);
+
+static void
+StopServer         (server_state* const state);
+
+static bool
+SendAnswer         (const int          conn,
+                    const char*  const answer,
+                    const char*  const data,
+                    const size_t       size);
+
+static int
+OpenListenSocket   (const char* const socket_name);
+
+bool
+RunServer (const server_config* const config)
+{
+    assert (config);
+    assert (config -> socket_name);
+    assert (config -> optimize);
+
+    /* a client that hangs up fails its answer, not the server */
+    signal (SIGPIPE, SIG_IGN);
+
+    const int listen_fd = OpenListenSocket (config -> socket_name);
+    if (listen_fd < 0)
+        return false;
+
+    server_state state = {.config     = config,
+                          .listen_fd  = listen_fd,
+                          .is_stopped = {false}};
+
+    const size_t n_workers = config -> n_jobs ? config -> n_jobs : 1;
+
+    fprintf (stderr, "Serving on %s\n", config -> socket_name);
+
+    const bool is_served = RunTasks (ServeTask, &state, n_workers, n_workers);
+
+    close  (listen_fd);
+    unlink (config -> socket_name);
+
+    return is_served;
+}
+
+/* every worker takes connections until a request stops the server */
+static bool
+ServeTask (void*  const state_ptr,
+           const size_t index)
+{
+    assert (state_ptr);
+
+    (void) index;
+
+    server_state* const state = (server_state*) state_ptr;
+
+    while (!state -> is_stopped)
+    {
+        const int conn = accept (state -> listen_fd, nullptr, nullptr);
+
+        if (conn < 0)
+        {
+            if (state -> is_stopped) break;
+
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+
+            perror ("accept error");
+            StopServer (state);
+            return false;
+        }
+
+        ServeConnection (state, conn);
+    }
+
+    return true;
+}
+
+static void
+ServeConnection (server_state* const state,
+                 const int           conn)
+{
+    assert (state);
+
+    /* closes conn */
+    FILE* const requests = fdopen (conn, "rb");
+    if (!requests)
+    {
+        perror ("connection open error");
+        close (conn);
+        return;
+    }
+
+    server_request request = {};
+
+    char*  line     = nullptr;
+    size_t line_cap = 0;
+
+    bool is_open = StartRequest (&request, state -> config);
+
+    while (is_open)
+    {
+        const ssize_t line_len = getline (&line, &line_cap, requests);
+        if (line_len <= 0) break;
+
+        if (line [line_len - 1] == '\n')
+            line [line_len - 1] = '\0';
+
+        char* arg = strchr (line, ' ');
+
+        if (arg) *arg++ = '\0';
+        else     arg    = line + strlen (line);
+
+        if (strcmp (line, REQUEST_STOP) == 0)
+        {
+            SendAnswer (conn, ANSWER_OK, "", 0);
+            StopServer (state);
+            break;
+        }
+
+        if (strcmp (line, REQUEST_FILE) == 0)
+        {
+            is_open = AnswerRequest (conn, &request, arg, arg) &&
+                      StartRequest  (&request, state -> config);
+        }
+        else if (strcmp (line, REQUEST_SOURCE) == 0)
+        {
+            is_open = ServeSource  (conn, requests, &request, arg) &&
+                      StartRequest (&request, state -> config);
+        }
+        else
+            ParseRequestLine (&request, line, arg);
+    }
+
+    if (request .errors)
+        fclose (request .errors);
+
+    FreeRequestOptions (&request);
+
+    free (request .error_text);
+    free (line);
+
+    fclose (requests);
+}
+
+/*
+ * The parser reads files, so the source is put to an in-memory one
+ * and read by its /proc name. Returns false if the connection can't
+ * go on, the bytes of the source being lost.
+ */
+static bool
+ServeSource (const int             conn,
+                   FILE*     const requests,
+                   server_request* request,
+             const char*     const size_str)
+{
+    assert (requests);
+    assert (request);
+    assert (size_str);
+
+    char* size_end = nullptr;
+    const size_t size = strtoul (size_str, &size_end, 10);
+
+    if (size_end == size_str || *size_end != '\0' || size > MAX_SOURCE_SIZE)
+    {
+        fprintf (request -> errors, "Invalid source size %s\n", size_str);
+        AnswerRequest (conn, request, nullptr, INLINE_SOURCE_NAME);
+        return false;
+    }
+
+    char* const source = (char*) calloc (size + 1, sizeof (char));
+    if (!source)
+    {
+        perror ("source allocation error");
+        return false;
+    }
+
+    if (fread (source, sizeof (char), size, requests) != size)
+    {
+        free (source);
+        return false;
+    }
+
+    const int source_fd = memfd_create ("lotrc-source", 0);
+
+    bool is_written = source_fd >= 0;
+
+    for (size_t n_written = 0; is_written && n_written < size; )
+    {
+        const ssize_t n_bytes = write (source_fd, source + n_written, size - n_written);
+
+        is_written = n_bytes > 0;
+        n_written += is_written ? (size_t) n_bytes : 0;
+    }
+
+    free (source);
+
+    if (!is_written)
+    {
+        char message [ERROR_MESSAGE_MAX_LEN] = "";
+
+        fprintf (request -> errors, "Source can't be stored: %s\n",
+                 strerror_r (errno, message, sizeof (message)));
+
+        if (source_fd >= 0)
+            close (source_fd);
+
+        return AnswerRequest (conn, request, nullptr, INLINE_SOURCE_NAME);
+    }
+
+    char file_name [FD_PATH_MAX_LEN] = "";
+    snprintf (file_name, sizeof (file_name), "/proc/self/fd/%d", source_fd);
+
+    const bool is_answered = AnswerRequest (conn, request, file_name, INLINE_SOURCE_NAME);
+
+    close (source_fd);
+
+    return is_answered;
+}
+
+/*
+ * Compiles the source unless the request already went wrong, file_name
+ * is nullptr then. The output of a source compiled before is loaded from
+ * the cache, the errors are not kept, so a bad source is compiled again.
+ */
+static bool
+AnswerRequest (const int             conn,
+                     server_request* request,
+               const char*     const file_name,
+               const char*     const source_name)
+{
+    assert (request);
+    assert (source_name);
+
+    char*  output_text = nullptr;
+    size_t output_size = 0;
+
+    bool is_compiled = file_name && ftell (request -> errors) == 0;
+
+    if (is_compiled)
+    {
+        FILE* const output = open_memstream (&output_text, &output_size);
+        if (!output)
+        {
+            perror ("output buffer open error");
+            return false;
+        }
+
+        /* the passes report to the server's stderr, keep it quiet */
+        request -> optimize .report_purity = false;
+        request -> optimize .stats_format  = PASS_STATS_NONE;
+
+        compile_cache cache = {};
+
+        const bool is_cached = InitRequestCache (&cache, request, file_name);
+        const bool is_loaded = is_cached && CacheLoad (&cache, output);
+
+        if (!is_loaded)
+            is_compiled = CompileSource (file_name, source_name, &request -> optimize,
+                                         request -> output_kind, output, request -> errors);
+
+        is_compiled = (fclose (output) == 0) && is_compiled;
+
+        if (is_compiled && is_cached && !is_loaded)
+            CacheStore (&cache, output_text, output_size);
+    }
+
+    /* sets the text and its size */
+    fclose (request -> errors);
+    request -> errors = nullptr;
+
+    const bool is_sent = is_compiled ?
+                         SendAnswer (conn, ANSWER_OK,    output_text,          output_size) :
+                         SendAnswer (conn, ANSWER_ERROR, request -> error_text, request -> error_size);
+
+    free (output_text);
+
+    return is_sent;
+}
+
+/* the key is the output, the options of the server and of the request and the source */
+static bool
+InitRequestCache (      compile_cache*  const cache,
+                  const server_request* const request,
+                  const char*           const file_name)
+{
+    assert (cache);
+    assert (request);
+    assert (file_name);
+
+    const server_config* const config = request -> config;
+
+    if (!config -> cache || !config -> cache -> dir)
+        return false;
+
+    const size_t n_options = config -> n_options + request -> n_options;
+
+    const char** const options = (const char**) calloc (n_options + 1, sizeof (char*));
+    if (!options)
+    {
+        perror ("options allocation error");
+        return false;
+    }
+
+    for (size_t i = 0; i < config -> n_options; i++)
+        options [i] = config -> options [i];
+
+    for (size_t i = 0; i < request -> n_options; i++)
+        options [config -> n_options + i] = request -> options [i];
+
+    const char* const tool = (request -> output_kind == OUTPUT_TREE) ? CACHE_TOOL_TREE :
+                                                                       CACHE_TOOL_ASM;
+
+    const bool is_cached = InitCompileCache (cache, config -> cache, tool,
+                                             options, n_options, file_name);
+
+    free (options);
+
+    return is_cached;
+}
+
+static bool
+StartRequest (      server_request* const request,
+              const server_config*  const config)
+{
+    assert (request);
+    assert (config);
+    assert (config -> optimize);
+
+    FreeRequestOptions (request);
+    free (request -> error_text);
+
+    *request = {.config      = config,
+                .output_kind = OUTPUT_ASM,
+                .optimize    = *config -> optimize,
+                .n_options   = 0,
+                .options     = {},
+                .errors      = nullptr,
+                .error_text  = nullptr,
+                .error_size  = 0};
+
+    request -> errors = open_memstream (&request -> error_text, &request -> error_size);
+    if (!request -> errors)
+    {
+        perror ("error buffer open error");
+        return false;
+    }
+
+    return true;
+}
+
+static void
+ParseRequestLine (      server_request* const request,
+                  const char*           const word,
+                  const char*           const arg)
+{
+    assert (request);
+    assert (word);
+    assert (arg);
+
+    if (strcmp (word, REQUEST_OUTPUT) == 0)
+    {
+        if (strcmp (arg, OUTPUT_ASM_NAME) == 0)
+            request -> output_kind = OUTPUT_ASM;
+        else if (strcmp (arg, OUTPUT_TREE_NAME) == 0)
+            request -> output_kind = OUTPUT_TREE;
+        else
+            fprintf (request -> errors, "Unknown output %s\n", arg);
+
+        return;
+    }
+
+    if (strcmp (word, REQUEST_OPTION) == 0)
+    {
+        if (request -> n_options == MAX_REQUEST_OPTIONS)
+            fprintf (request -> errors, "Too many options\n");
+        else if (!ParseOptimizeOption (arg, &request -> optimize))
+            fprintf (request -> errors, "Unknown option %s\n", arg);
+        else if (!(request -> options [request -> n_options++] = strdup (arg)))
+            fprintf (request -> errors, "Option %s can't be stored\n", arg);
+
+        return;
+    }
+
+    fprintf (request -> errors, "Unknown request %s\n", word);
+}
+
+static void
+FreeRequestOptions (server_request* const request)
+{
+    assert (request);
+
+    for (size_t i = 0; i < request -> n_options; i++)
+    {
+        free (request -> options [i]);
+        request -> options [i] = nullptr;
+    }
+
+    request -> n_options = 0;
+}
+
+/* wakes the workers waiting in accept(), they see the flag and return */
+static void
+StopServer (server_state* const state)
+{
+    assert (state);
+
+    state -> is_stopped = true;
+
+    shutdown (state -> listen_fd, SHUT_RDWR);
+}
+
+static bool
+SendAnswer (const int          conn,
+            const char*  const answer,
+            const char*  const data,
+            const size_t       size)
+{
+    assert (answer);
+    assert (data || !size);
+
+    FILE* const stream = fdopen (dup (conn), "wb");
+    if (!stream)
+    {
+        perror ("answer stream open error");
+        return false;
+    }
+
+    fprintf (stream, "%s %zu\n", answer, size);
+
+    if (size)
+        fwrite (data, sizeof (char), size, stream);
+
+    return fclose (stream) == 0;
+}
+
+/* a socket file nobody listens on is left by a server that crashed, it is replaced */
+static int
+OpenListenSocket (const char* const socket_name)
+{
+    assert (socket_name);
+
+    sockaddr_un address = {};
+    address .sun_family = AF_UNIX;
+
+    if (strlen (socket_name) >= sizeof (address .sun_path))
+    {
+        fprintf (stderr, "Socket name %s is too long\n", socket_name);
+        return -1;
+    }
+
+    strcpy (address .sun_path, socket_name);
+
+    const int probe_fd  = socket (AF_UNIX, SOCK_STREAM, 0);
+    const int listen_fd = socket (AF_UNIX, SOCK_STREAM, 0);
+
+    if (probe_fd < 0 || listen_fd < 0)
+    {
+        perror ("socket error");
+
+        if (probe_fd  >= 0) close (probe_fd);
+        if (listen_fd >= 0) close (listen_fd);
+
+        return -1;
+    }
+
+    const bool is_served = connect (probe_fd, (const sockaddr*) &address, sizeof (address)) == 0;
+
+    close (probe_fd);
+
+    if (is_served)
+    {
+        fprintf (stderr, "%s is already served\n", socket_name);
+        close (listen_fd);
+        return -1;
+    }
+
+    unlink (socket_name);
+
+    if (bind   (listen_fd, (const sockaddr*) &address, sizeof (address)) != 0 ||
+        listen (listen_fd, SOMAXCONN) != 0)
+    {
+        perror (socket_name);
+        close (listen_fd);
+        return -1;
+    }
+
+    return listen_fd;
+}
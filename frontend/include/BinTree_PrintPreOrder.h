@@ -4,10 +4,25 @@
 
 const size_t PRINT_OUTPUT_ELEM_MAX_LEN = 10;
 
-const size_t MAX_NODE_OUTPUT_LEN = 20;
+/* a number takes up to DOUBLE_OUTPUT_MAX_LEN */
+const size_t MAX_NODE_OUTPUT_LEN = 48;
 
 const char TREE_OUTPUT_FILE_NAME[] = "../tree_out.txt";
 
 void
-PrintTreeToFile (const BinTree* const tree,
-                 const char*    const out_file_name = TREE_OUTPUT_FILE_NAME);
+PrintTreeToFile   (const BinTree* const tree,
+                   const char*    const out_file_name = TREE_OUTPUT_FILE_NAME);
+
+/* returns false if the tree can't be printed */
+bool
+PrintTreeToStream (const BinTree* const tree,
+                         FILE*    const stream);
+
+/*
+ * Prints a function node without its right child, which is the next
+ * function. Returns the text, which is to be freed, or nullptr.
+ */
+char*
+PrintFunctionHead (const BinTree_node* const func,
+                   const size_t              n_nodes,
+                         size_t*       const length);
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "BinTree_struct.h"
+
+/*
+ * Maps names to their indices in a name table by open addressing,
+ * so that every name token is looked up once while lexing and not
+ * by a walk over the table. The names belong to the table.
+ */
+struct name_interner
+{
+    const char**    names;      // by index
+    var_index_type* slots;      // index + 1, 0 is a free slot
+    size_t          capacity;   // power of two
+    size_t          n_names;
+};
+
+const size_t NAME_INTERNER_INIT_CAPACITY = 64;
+
+bool
+NameInternerCtor (name_interner* const interner);
+
+void
+NameInternerDtor (name_interner* const interner);
+
+/* returns VAR_INDEX_POISON if the name is not there */
+var_index_type
+FindName         (const name_interner* const interner,
+                  const char*          const name);
+
+/* gives the name the next index, VAR_INDEX_POISON on allocation error */
+var_index_type
+AddName          (name_interner* const interner,
+                  const char*    const name);
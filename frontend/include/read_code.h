@@ -1,8 +1,10 @@
 #pragma once
 
 #include <ctype.h>
+#include <setjmp.h>
 #include "BinTree_struct.h"
 #include "FileOpenLib.h"
+#include "compile_cache.h"
 
 struct token
 {
@@ -16,10 +18,70 @@ struct token
         double       num_value;
         char         var_name  [VAR_NAME_MAX_LEN];
     };
+
+    /* of a variable or function name, VAR_INDEX_POISON for the rest */
+    var_index_type name_index;
 };
 
 #include "List_struct.h"
 
+/* List_struct.h includes this header back through List_config.h */
+struct List;
+
+/* smaller code is lexed on one thread */
+const size_t LEX_CHUNK_MIN_SIZE = 1 << 20;
+
+/*
+ * A syntax error aborts, but on a thread that points this at a jump
+ * buffer, which is jumped to then, so that a driver reading many files
+ * goes on with the next one. Only a read on one thread, not pipelined,
+ * may be jumped out of; FreeFailedRead frees what it allocated.
+ */
+extern thread_local jmp_buf* syntax_error_exit;
+
+struct read_config
+{
+    size_t n_jobs;          // threads functions are parsed on
+    bool   is_pipelined;    // lexes on a thread of its own while parsing
+};
+
+BinTree*
+ReadTree    (const char*        const input_file_name,
+                   BinTree*     const tree,
+             const read_config* const config);
+
+/*
+ * The two steps of ReadTree, which are timed apart by the benchmark.
+ * LexCode makes the tokens and puts the names to the name table of
+ * the tree, the list is List_Dtor'ed by the caller after ParseTokens.
+ */
+void
+LexCode     (const char*        const input_file_name,
+                   List*        const tokens_list,
+                   BinTree*     const tree,
+             const read_config* const config);
+
 BinTree*
-ReadTree (const char*    const input_file_name,
-                BinTree* const tree);
+ParseTokens (const List*        const tokens_list,
+                   BinTree*     const tree,
+             const read_config* const config);
+
+/*
+ * Frees what the read on this thread held when a syntax error jumped
+ * out of it: the tokens, the mapped code and the nodes parsed so far.
+ * The tree is left without nodes, to be BINTREE_DTOR'ed by the caller.
+ */
+void
+FreeFailedRead (BinTree* const tree);
+
+/*
+ * Prints the tree of the code to the output file as ReadTree and
+ * PrintTreeToFile do, but parses only the functions whose tokens
+ * are not in the cache. Returns false if the tree is to be read
+ * the usual way: there is no cache or a function has errors.
+ */
+bool
+ReadTreeIncremental (const char*         const input_file_name,
+                     const char*         const output_file_name,
+                     const read_config*  const config,
+                     const cache_config* const cache_config);
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include "read_code.h"
+
+const size_t CACHE_LINE_SIZE     = 64;
+const size_t TOKEN_RING_CAPACITY = 1024;   // power of two
+
+/*
+ * A ring of tokens with one producer, the lexer, and one consumer,
+ * the parser, on threads of their own. Each side writes one counter
+ * on a cache line of its own and keeps a copy of the other's, which
+ * it reads again only when the ring looks full or empty to it.
+ * Tokens are numbered from the start of the stream, not the ring.
+ */
+struct token_ring
+{
+    token* slots;
+
+    /* written by the producer */
+    alignas (CACHE_LINE_SIZE) std::atomic<size_t> head;   // tokens pushed
+    std::atomic<bool> is_closed;
+    size_t            cached_tail;
+
+    /* written by the consumer */
+    alignas (CACHE_LINE_SIZE) std::atomic<size_t> tail;   // tokens released
+    size_t            cached_head;
+};
+
+bool
+TokenRingCtor    (token_ring* const ring);
+
+void
+TokenRingDtor    (token_ring* const ring);
+
+/* waits while the ring is full */
+void
+TokenRingPush    (      token_ring* const ring,
+                  const token*      const new_token);
+
+/* no tokens follow */
+void
+TokenRingClose   (token_ring* const ring);
+
+/*
+ * Waits for the token, returns nullptr if the ring is closed before it.
+ * It must not be released and at most TOKEN_RING_CAPACITY - 1 tokens
+ * after the released ones.
+ */
+token*
+TokenRingGet     (      token_ring* const ring,
+                  const size_t            index);
+
+/* the tokens before index are not read again, their slots are free */
+void
+TokenRingRelease (      token_ring* const ring,
+                  const size_t            index);
@@ -1,10 +1,16 @@
 #include "BinTree_PrintPreOrder.h"
+#include "num_io.h"
 
 static void
 PrintInPreOrder (const BinTree_node* const node,
                        char*         const output_buf,
                        int32_t*       const output_index);
 
+static void
+PrintNodeData   (const BinTree_node* const node,
+                       char*         const output_buf,
+                       int32_t*       const output_index);
+
 void
 PrintTreeToFile (const BinTree* const tree,
                  const char*    const out_file_name)
@@ -15,31 +21,67 @@ PrintTreeToFile (const BinTree* const tree,
         return;
     }
 
+    FILE* tree_out = fopen (out_file_name, "wb");
+    if (!tree_out)
+    {
+        perror ("tree_out fopen() error");
+        return;
+    }
+
+    PrintTreeToStream (tree, tree_out);
+
+    fclose (tree_out);
+}
+
+bool
+PrintTreeToStream (const BinTree* const tree,
+                         FILE*    const stream)
+{
+    assert (tree);
+    assert (stream);
+
     char* const output_buf =
-        (char* const) calloc (tree->n_elem, MAX_NODE_OUTPUT_LEN);
+        (char* const) calloc (tree->n_elem + 1, MAX_NODE_OUTPUT_LEN);
     if (!output_buf)
     {
         perror ("output_buf allocation error");
-        return;
+        return false;
     }
 
     int32_t output_index = 0;
 
     PrintInPreOrder (tree->root, output_buf, &output_index);
 
-    FILE* tree_out = fopen (out_file_name, "wb");
-    if (!tree_out)
-    {
-        perror ("tree_out fopen() error");
-        free (output_buf);
+    fprintf (stream, "%s\n", output_buf);
 
-        return;
+    free (output_buf);
+
+    return true;
+}
+
+char*
+PrintFunctionHead (const BinTree_node* const func,
+                   const size_t              n_nodes,
+                         size_t*       const length)
+{
+    assert (func);
+    assert (length);
+
+    char* const output_buf = (char*) calloc (n_nodes + 1, MAX_NODE_OUTPUT_LEN);
+    if (!output_buf)
+    {
+        perror ("output_buf allocation error");
+        return nullptr;
     }
 
-    fprintf (tree_out, "%s\n", output_buf);
+    int32_t output_index = 0;
 
-    free (output_buf);
-    fclose (tree_out);
+    PrintNodeData   (func,         output_buf, &output_index);
+    PrintInPreOrder (func -> left, output_buf, &output_index);
+
+    *length = (size_t) output_index;
+
+    return output_buf;
 }
 
 static void
@@ -57,6 +99,26 @@ PrintInPreOrder (const BinTree_node* const node,
         return;
     }
 
+    PrintNodeData (node, output_buf, output_index);
+
+    PrintInPreOrder (node -> left,  output_buf, output_index);
+
+    PrintInPreOrder (node -> right, output_buf, output_index);
+
+    output_buf [(*output_index)++] = ')';
+    output_buf [(*output_index)++] = ' ';
+}
+
+/* the opening bracket, the type and the value */
+static void
+PrintNodeData (const BinTree_node* const node,
+                     char*         const output_buf,
+                     int32_t*       const output_index)
+{
+    assert (node);
+    assert (output_index);
+    assert (output_buf);
+
     output_buf [(*output_index)++] = '(';
     output_buf [(*output_index)++] = ' ';
 
@@ -91,9 +153,9 @@ PrintInPreOrder (const BinTree_node* const node,
             break;
 
         case NUMBER:
-            *output_index += snprintf (output_buf + *output_index,
-                                       PRINT_OUTPUT_ELEM_MAX_LEN,
-                                       "%lg ", node -> data .num_value);
+            *output_index += (int32_t) FormatDouble (node -> data .num_value,
+                                                     output_buf + *output_index);
+            output_buf [(*output_index)++] = ' ';
             break;
 
         case VARIABLE:
@@ -113,11 +175,4 @@ PrintInPreOrder (const BinTree_node* const node,
                                        PRINT_OUTPUT_ELEM_MAX_LEN, "ERROR");
             break;
     }
-
-    PrintInPreOrder (node -> left,  output_buf, output_index);
-
-    PrintInPreOrder (node -> right, output_buf, output_index);
-
-    output_buf [(*output_index)++] = ')';
-    output_buf [(*output_index)++] = ' ';
 }
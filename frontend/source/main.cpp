@@ -1,26 +1,79 @@
 #include "read_code.h"
 #include "BinTree_make_image.h"
 #include "BinTree_PrintPreOrder.h"
+#include "thread_pool.h"
+#include "compile_cache.h"
 
 int main (const int32_t argc, const char** argv)
 {
-    BinTree tree = {};
-    BINTREE_CTOR (&tree);
+    const char* input_file_name  = nullptr;
+    const char* output_file_name = nullptr;
 
-    ReadTree (argv[1], &tree);
-    BinTree_MakeTreeImage (&tree);
+    /* the tree doesn't depend on them */
+    read_config config = {.n_jobs       = GetHardwareThreads (),
+                          .is_pipelined = false};
 
-    if (argc < 3)
+    cache_config cache_config = {};
+    InitCacheConfig (&cache_config);
+
+    for (int32_t i = 1; i < argc; i++)
+    {
+        if (strncmp (argv [i], "--jobs=", strlen ("--jobs=")) == 0)
+        {
+            config .n_jobs = strtoul (argv [i] + strlen ("--jobs="), nullptr, 10);
+            continue;
+        }
+
+        if (strcmp (argv [i], "--pipeline") == 0)
+        {
+            config .is_pipelined = true;
+            continue;
+        }
+
+        if (ParseCacheOption (argv [i], &cache_config)) continue;
+
+        if (!input_file_name)
+            input_file_name  = argv [i];
+        else
+            output_file_name = argv [i];
+    }
+
+    if (cache_config .is_stats_printed)
     {
-        PrintTreeToFile (&tree);
+        PrintCacheStats (&cache_config, stdout);
+        return 0;
     }
 
-    else
+    const char* const tree_file_name = output_file_name ? output_file_name :
+                                                          TREE_OUTPUT_FILE_NAME;
+
+    /* no option changes the tree, the key is the source and the compiler */
+    compile_cache cache = {};
+    const bool is_cached = InitCompileCache (&cache, &cache_config, "frontend",
+                                             nullptr, 0, input_file_name);
+
+    if (is_cached && CacheLoadToFile (&cache, tree_file_name))
+        return 0;
+
+    /* only the functions that changed are parsed, no image is made then */
+    const bool is_read = is_cached && ReadTreeIncremental (input_file_name, tree_file_name,
+                                                           &config, &cache_config);
+
+    if (!is_read)
     {
-        PrintTreeToFile (&tree, argv [2]);
+        BinTree tree = {};
+        BINTREE_CTOR (&tree);
+
+        ReadTree (input_file_name, &tree, &config);
+        BinTree_MakeTreeImage (&tree);
+
+        PrintTreeToFile (&tree, tree_file_name);
+
+        BINTREE_DTOR (&tree);
     }
 
-    BINTREE_DTOR (&tree);
+    if (is_cached)
+        CacheStoreFile (&cache, tree_file_name);
 
     return 0;
 }
@@ -0,0 +1,155 @@
+#include "name_interner.h"
+
+static size_t
+HashName       (const char* const name);
+
+static bool
+GrowInterner   (name_interner* const interner);
+
+static size_t
+FindSlot       (const name_interner* const interner,
+                const char*          const name);
+
+bool
+NameInternerCtor (name_interner* const interner)
+{
+    assert (interner);
+
+    interner -> capacity = NAME_INTERNER_INIT_CAPACITY;
+    interner -> n_names  = 0;
+
+    interner -> names = (const char**)    calloc (interner -> capacity / 2,
+                                                  sizeof (const char*));
+    interner -> slots = (var_index_type*) calloc (interner -> capacity,
+                                                  sizeof (var_index_type));
+
+    if (!interner -> names || !interner -> slots)
+    {
+        perror ("name interner allocation error");
+        NameInternerDtor (interner);
+
+        return false;
+    }
+
+    return true;
+}
+
+void
+NameInternerDtor (name_interner* const interner)
+{
+    assert (interner);
+
+    free (interner -> names);
+    free (interner -> slots);
+
+    *interner = {};
+}
+
+var_index_type
+FindName (const name_interner* const interner,
+          const char*          const name)
+{
+    assert (interner);
+    assert (name);
+
+    const var_index_type slot = interner -> slots [FindSlot (interner, name)];
+
+    return slot ? slot - 1 : VAR_INDEX_POISON;
+}
+
+var_index_type
+AddName (name_interner* const interner,
+         const char*    const name)
+{
+    assert (interner);
+    assert (name);
+
+    /* kept at most half full, so probing stays short */
+    if (2 * (interner -> n_names + 1) > interner -> capacity &&
+        !GrowInterner (interner))
+    {
+        return VAR_INDEX_POISON;
+    }
+
+    const size_t slot = FindSlot (interner, name);
+    assert (!interner -> slots [slot]);
+
+    interner -> names [interner -> n_names] = name;
+    interner -> slots [slot] = ++interner -> n_names;
+
+    return interner -> n_names - 1;
+}
+
+/* the free slot for the name if it is not there */
+static size_t
+FindSlot (const name_interner* const interner,
+          const char*          const name)
+{
+    assert (interner);
+    assert (name);
+
+    const size_t mask = interner -> capacity - 1;
+
+    size_t slot = HashName (name) & mask;
+
+    while (interner -> slots [slot] &&
+           strcmp (interner -> names [interner -> slots [slot] - 1], name) != 0)
+    {
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+static bool
+GrowInterner (name_interner* const interner)
+{
+    assert (interner);
+
+    const size_t new_capacity = interner -> capacity * 2;
+
+    const char** const new_names =
+        (const char**) realloc (interner -> names, new_capacity / 2 * sizeof (const char*));
+    if (!new_names)
+    {
+        perror ("name interner names reallocation error");
+        return false;
+    }
+
+    interner -> names = new_names;
+
+    var_index_type* const new_slots =
+        (var_index_type*) calloc (new_capacity, sizeof (var_index_type));
+    if (!new_slots)
+    {
+        perror ("name interner slots allocation error");
+        return false;
+    }
+
+    free (interner -> slots);
+
+    interner -> slots    = new_slots;
+    interner -> capacity = new_capacity;
+
+    for (size_t i = 0; i < interner -> n_names; i++)
+        interner -> slots [FindSlot (interner, interner -> names [i])] = i + 1;
+
+    return true;
+}
+
+/* FNV-1a */
+static size_t
+HashName (const char* const name)
+{
+    assert (name);
+
+    uint64_t hash = 14695981039346656037ull;
+
+    for (const char* letter = name; *letter; letter++)
+    {
+        hash ^= (uint8_t) *letter;
+        hash *= 1099511628211ull;
+    }
+
+    return (size_t) hash;
+}
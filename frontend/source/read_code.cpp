@@ -1,5 +1,11 @@
+#include <pthread.h>
 #include "read_code.h"
 #include "List_commands.h"
+#include "name_interner.h"
+#include "token_ring.h"
+#include "thread_pool.h"
+#include "num_io.h"
+#include "BinTree_PrintPreOrder.h"
 
 /*
  * Here is the description of grammar rules of the code.
@@ -38,8 +44,20 @@
  * V     ::= N | Var
  * N     ::= [+ -]? {[0 - 9]+ {.[0 - 9]*}?} | {[0 - 9]* {.[0 - 9]+}}
  * Var   ::= {[A - Z] | [a - z]} {[A - Z] | [a - z] | [0 - 9]}*
+ *
+ * Names are given their indices while lexing, so that every F of MF
+ * is parsed on its own and they are parsed on n_jobs threads at once.
+ *
+ * In the pipelined mode the lexer runs on a thread of its own and the
+ * parser reads the tokens from a ring as they come, so a name has to
+ * be told a function by the tokens around it: it is defined after
+ * "Mellon", called at the start of Op or with FArgs. A name that is
+ * called without them in E is read as Var, and all names are given
+ * their indices when the whole code is read.
  */
 
+thread_local jmp_buf* syntax_error_exit = nullptr;
+
 #undef GrammarParams
 #undef GiveParams
 #undef params_assert
@@ -55,11 +73,73 @@
 
 /* LEXICAL ANALYSIS BEGIN */
 
+/* the tokens of a chunk of the code */
+struct token_run
+{
+    token* tokens;
+    size_t n_tokens;
+    size_t capacity;
+};
+
+/* where the lexer puts the tokens, the one of them that is not nullptr */
+struct token_sink
+{
+    List*       tokens_list;
+    token_ring* ring;
+    token_run*  run;
+};
+
+/*
+ * Chunks of the code lexed on threads of their own. They are bounded
+ * by new lines, which are never a part of a token, so the chunk that
+ * is outside of a comment is lexed as the whole code would be.
+ */
+struct lex_job
+{
+    const file_input* input_parsed;
+
+    size_t*    bounds;              // n_chunks + 1
+    size_t*    starts;              // after the comment the chunk begins in, if it does
+    size_t*    ends;                // where lexing stopped
+    size_t*    n_comment_symbols;
+    bool*      is_pending;
+    bool*      is_lexed;            // false if a token could not be read
+    token_run* runs;
+};
+
 static void
-SeparateToTokens (const char*    const input_file_name,
-                        List*    const tokens_list,
+SeparateToTokens (const char*       const input_file_name,
+                        List*       const tokens_list,
+                        token_ring* const ring,
+                        BinTree*    const tree,
+                  const size_t            n_jobs);
+
+static bool
+LexRange         (const file_input* const input_parsed,
+                        size_t*     const index,
+                  const size_t            end,
+                        token_sink* const sink);
+
+static bool
+PushToken        (token_sink* const sink,
+                  token*      const new_token);
+
+static bool
+LexInChunks      (const file_input* const input_parsed,
+                        List*       const tokens_list,
+                  const size_t            n_jobs);
+
+static bool
+LexChunkTask     (void*  const job_ptr,
+                  const size_t index);
+
+static bool
+ReadTreePiped    (const char*    const input_file_name,
                         BinTree* const tree);
 
+static void*
+RunLexer         (void* const lexer_job_ptr);
+
 static void
 GetTokenData (const file_input* const input_parsed,
                     size_t*     const index,
@@ -72,15 +152,24 @@ GetTokenOperationType (      token* const cur_token,
 static BinTree_node*
 GetGrammar (const List*    const tokens_list,
                   size_t*  const token_index,
-                  BinTree* const tree);
+                  BinTree* const tree,
+            const size_t         n_jobs);
 
 static void
-GetFunctionNames (const List*    const tokens_list,
-                        BinTree* const tree);
+GetFunctionNames (const List*          const tokens_list,
+                        name_interner* const func_names,
+                        BinTree*       const tree);
 
 static void
-SetFunctionNames (const List*    const tokens_list,
-                         BinTree* const tree);
+SetNameIndices   (const List*          const tokens_list,
+                  const name_interner* const func_names,
+                        name_interner* const var_names,
+                        BinTree*       const tree);
+
+static var_index_type
+PushName         (const char*          const name,
+                        name_interner* const interner,
+                        Stack*         const table);
 
 /* LEXICAL ANALYSIS END */
 
@@ -92,19 +181,135 @@ SetFunctionNames (const List*    const tokens_list,
  * Defines are used to avoid too long calls for struct members.
  */
 #define GrammarParams                           \
-    const List_data_type* const tokens_array,   \
-          size_t*         const token_index,    \
-          BinTree*        const tree
+    token_source* const tokens,                 \
+    size_t*       const token_index,            \
+    BinTree*      const tree
 
-#define GiveParams tokens_array, token_index, tree
+#define GiveParams tokens, token_index, tree
 
 #define params_assert       \
-    assert (tokens_array);  \
+    assert (tokens);        \
     assert (token_index);   \
     assert (tree);
 
+/*
+ * The names of the pipelined mode. They are numbered as they first
+ * appear in and become functions or variables once all are read.
+ */
+struct piped_names
+{
+    name_interner   interner;
+
+    var_index_type* func_indices;   // by name, VAR_INDEX_POISON if no function has it
+    var_index_type* func_names;     // by function
+    var_index_type* var_indices;    // by name, once all are read
+    size_t          n_funcs;
+    size_t          capacity;
+};
+
+/*
+ * Where the parser reads the tokens from: the list of all of them or
+ * the ring the lexer fills, where the names are marked as they come.
+ */
+struct token_source
+{
+    const List_data_type* tokens_array;
+
+    token_ring*           ring;
+    piped_names*          names;
+    size_t                n_marked;
+    token                 prev_token;
+    token                 end_token;    // read past the last one
+};
+
+/* what the lexer thread of the pipelined mode needs */
+struct lexer_job
+{
+    const char*  input_file_name;
+    token_ring*  ring;
+    BinTree*     tree;
+};
+
+/* everything parsing a function on its own thread needs */
+struct parse_job
+{
+    const List_data_type* tokens_array;
+
+    size_t*        func_starts;   // token of "Mellon"
+    size_t*        func_ends;     // token after "Gates"
+    BinTree_node** funcs;
+    BinTree*       func_trees;    // count the nodes and errors of each function
+    bool*          is_cached;     // printed before, not parsed; nullptr if none is
+};
+
+/* the text of every function in the incremental mode, from the cache or printed */
+struct function_texts
+{
+    compile_cache* caches;
+    char**         texts;
+    size_t*        sizes;
+};
+
+/*
+ * What the read on this thread holds while a syntax error may jump out
+ * of it, for FreeFailedRead. The nodes are logged only if there is a
+ * place to jump to, as an error aborts otherwise.
+ */
+struct read_state
+{
+    List*          tokens_list;
+    file_input     input;           // copies, the frames that had them are left by the jump
+    parse_job      job;
+
+    BinTree_node** nodes;           // all the parser made, subtrees nothing points to included
+    size_t         n_nodes;
+    size_t         nodes_capacity;
+};
+
+static thread_local read_state cur_read = {};
+
+static const size_t NODE_LOG_MIN_CAPACITY = 64;
+
 static BinTree_node*
-GetMultipleFunctions (GrammarParams);
+GetMultipleFunctions (const List*    const tokens_list,
+                            size_t*  const token_index,
+                            BinTree* const tree,
+                      const size_t         n_jobs);
+
+static BinTree_node*
+GetPipedFunctions    (GrammarParams);
+
+static bool
+GetFunctionTask      (void*  const job_ptr,
+                      const size_t index);
+
+static size_t
+FindFunctionStarts   (const List*   const tokens_list,
+                            size_t* const func_starts);
+
+static bool
+LoadFunctionTexts    (const List*           const tokens_list,
+                            parse_job*      const job,
+                            function_texts* const texts,
+                      const size_t                n_funcs,
+                      const cache_config*   const cache_config);
+
+static void
+HashFunctionTokens   (const List_data_type* const tokens_array,
+                      const size_t                start,
+                      const size_t                end,
+                            cache_hash*     const hash);
+
+static bool
+PrintFunctionTexts   (const List*           const tokens_list,
+                      const parse_job*      const job,
+                            function_texts* const texts,
+                      const size_t                n_funcs);
+
+static bool
+WriteFunctionTexts   (const function_texts* const texts,
+                      const size_t                n_funcs,
+                      const char*           const output_file_name);
 
 static BinTree_node*
 GetFunction          (GrammarParams);
@@ -148,6 +353,29 @@ GetValue             (GrammarParams);
 static BinTree_node*
 GetVariable          (GrammarParams);
 
+static token*
+GetPipedToken        (      token_source* const tokens,
+                      const size_t              token_index);
+
+static void
+MarkPipedName        (      token_source* const tokens,
+                            token*        const name_token,
+                      const token*        const next_token);
+
+static bool
+PipedNamesCtor       (piped_names* const names);
+
+static void
+PipedNamesDtor       (piped_names* const names);
+
+static bool
+ResolvePipedNames    (piped_names* const names,
+                      BinTree*     const tree);
+
+static void
+SetPipedNodeNames    (const piped_names*  const names,
+                            BinTree_node* const node);
+
 /* RECURSIVE DESCENT END */
 
 
@@ -158,6 +386,20 @@ static inline void
 syn_assert_func (const size_t n_line,
                  const bool expression);
 
+static BinTree_node*
+CtorParsedNode      (const data_type           data_type,
+                     const double              data_value,
+                           BinTree_node* const left,
+                           BinTree_node* const right,
+                           BinTree_node* const parent,
+                           BinTree*      const tree);
+
+static void
+ForgetParsedSubtree (const BinTree_node* const node);
+
+static void
+ForgetReadNodes     ();
+
 #define syn_assert(expression)                      \
     syn_assert_func (__LINE__, expression);
 
@@ -166,6 +408,24 @@ IsType (const List_data_type* const tokens_array,
         const size_t                token_index,
         const data_type             type);
 
+/* "Mellon" is the only FUNCTION token that is not a name */
+static inline bool
+IsFunctionDef (const List_data_type* const tokens_array,
+               const size_t                token_index);
+
+static inline const token*
+GetToken      (      token_source* const tokens,
+               const size_t              token_index);
+
+static inline bool
+IsType        (      token_source* const tokens,
+               const size_t              token_index,
+               const data_type           type);
+
+static inline bool
+IsFunctionDef (      token_source* const tokens,
+               const size_t              token_index);
+
 #define IsBinOperation(tokens_array, token_index)   \
     IsType (tokens_array, token_index, BIN_OP)
 
@@ -189,8 +449,9 @@ IsType (const List_data_type* const tokens_array,
 
 
 BinTree*
-ReadTree (const char*    const input_file_name,
-                BinTree* const tree)
+ReadTree (const char*        const input_file_name,
+                BinTree*     const tree,
+          const read_config* const config)
 {
     if (!tree)
     {
@@ -198,92 +459,585 @@ ReadTree (const char*    const input_file_name,
         return nullptr;
     }
 
-    List tokens_list = {};
-    List_Ctor (&tokens_list);
-    tokens_list .list_data [List_DUMMY_ELEMENT] .token_data_type = NO_TYPE;
+    assert (config);
+
+    /* reads the whole code at once if the lexer thread doesn't start */
+    if (config -> is_pipelined && ReadTreePiped (input_file_name, tree))
+    {
+        ForgetReadNodes ();
+        return tree;
+    }
+
+    /* on the heap, -fstack-protector leaves a function with a List on the stack unguarded */
+    List* const tokens_list = (List*) calloc (1, sizeof (List));
+    if (!tokens_list)
+    {
+        perror ("tokens_list allocation error");
+        return nullptr;
+    }
+
+    cur_read .tokens_list = tokens_list;
+
+    LexCode     (input_file_name, tokens_list, tree, config);
+    ParseTokens (tokens_list, tree, config);
+
+    cur_read .tokens_list = nullptr;
+
+    List_Dtor (tokens_list);
+    free (tokens_list);
+
+    return tree;
+}
+
+void
+LexCode (const char*        const input_file_name,
+               List*        const tokens_list,
+               BinTree*     const tree,
+         const read_config* const config)
+{
+    assert (input_file_name);
+    assert (tokens_list);
+    assert (tree);
+    assert (config);
+
+    List_Ctor (tokens_list);
+    tokens_list -> list_data [List_DUMMY_ELEMENT] .token_data_type = NO_TYPE;
+
+    SeparateToTokens (input_file_name, tokens_list, nullptr, tree, config -> n_jobs);
+}
 
-    SeparateToTokens (input_file_name, &tokens_list, tree);
+BinTree*
+ParseTokens (const List*        const tokens_list,
+                   BinTree*     const tree,
+             const read_config* const config)
+{
+    assert (tokens_list);
+    assert (tree);
+    assert (config);
 
     size_t token_index = 0;
-    tree->root = GetGrammar (&tokens_list, &token_index, tree);
+    tree->root = GetGrammar (tokens_list, &token_index, tree, config -> n_jobs);
 
     /*
      * Null-termination check
      * Not with defines because of different form of calling
      */
-    syn_assert (IsPunctuation (tokens_list .list_data, token_index) &&
-                tokens_list.list_data [token_index]
+    syn_assert (IsPunctuation (tokens_list -> list_data, token_index) &&
+                tokens_list -> list_data [token_index]
                 .punct_op_code == NULL_TERMINATOR);
 
     SetParents (nullptr, tree -> root);
 
-    List_Dtor (&tokens_list);
+    ForgetReadNodes ();
 
     return tree;
 }
 
+/* the nodes are freed by the log, the parser drops subtrees on its stack when it jumps */
+void
+FreeFailedRead (BinTree* const tree)
+{
+    assert (tree);
+
+    for (size_t i = 0; i < cur_read .n_nodes; i++)
+        free (cur_read .nodes [i]);
+
+    tree -> root   = nullptr;
+    tree -> n_elem = 0;
+
+    ForgetReadNodes ();
+
+    free (cur_read .job .func_starts);
+    free (cur_read .job .func_ends);
+    free (cur_read .job .funcs);
+    free (cur_read .job .func_trees);
+
+    FreeFileInput (&cur_read .input);
+
+    if (cur_read .tokens_list)
+    {
+        List_Dtor (cur_read .tokens_list);
+        free (cur_read .tokens_list);
+    }
+
+    cur_read = {};
+}
+
+/*
+ * A function is parsed to the same subtree from the same tokens, so
+ * its text is kept in the cache by the hash of its tokens, the names
+ * in them by their indices. Functions chain by their right children,
+ * so the text of the tree is the texts of the functions, each without
+ * its right child, followed by the closing brackets of all of them.
+ */
+bool
+ReadTreeIncremental (const char*         const input_file_name,
+                     const char*         const output_file_name,
+                     const read_config*  const config,
+                     const cache_config* const cache_config)
+{
+    assert (output_file_name);
+    assert (config);
+    assert (cache_config);
+
+    /* keeps the names the lexer finds */
+    BinTree names_tree = {};
+    BINTREE_CTOR (&names_tree);
+
+    List* const tokens_list = (List*) calloc (1, sizeof (List));
+    if (!tokens_list)
+    {
+        perror ("tokens_list allocation error");
+        BINTREE_DTOR (&names_tree);
+        return false;
+    }
+
+    List_Ctor (tokens_list);
+    tokens_list -> list_data [List_DUMMY_ELEMENT] .token_data_type = NO_TYPE;
+
+    SeparateToTokens (input_file_name, tokens_list, nullptr, &names_tree, config -> n_jobs);
+
+    const size_t n_funcs = FindFunctionStarts (tokens_list, nullptr);
+
+    parse_job job = {.tokens_array = tokens_list -> list_data,
+                     .func_starts  = (size_t*)        calloc (n_funcs, sizeof (size_t)),
+                     .func_ends    = (size_t*)        calloc (n_funcs, sizeof (size_t)),
+                     .funcs        = (BinTree_node**) calloc (n_funcs, sizeof (BinTree_node*)),
+                     .func_trees   = (BinTree*)       calloc (n_funcs, sizeof (BinTree)),
+                     .is_cached    = (bool*)          calloc (n_funcs, sizeof (bool))};
+
+    function_texts texts = {.caches = (compile_cache*) calloc (n_funcs, sizeof (compile_cache)),
+                            .texts  = (char**)         calloc (n_funcs, sizeof (char*)),
+                            .sizes  = (size_t*)        calloc (n_funcs, sizeof (size_t))};
+
+    bool is_read = n_funcs > 0;
+
+    if (is_read && (!job .func_starts || !job .func_ends || !job .funcs ||
+                    !job .func_trees  || !job .is_cached ||
+                    !texts .caches    || !texts .texts   || !texts .sizes))
+    {
+        perror ("incremental read allocation error");
+        is_read = false;
+    }
+
+    if (is_read)
+    {
+        FindFunctionStarts (tokens_list, job .func_starts);
+
+        syn_assert (job .func_starts [0] == 1);
+    }
+
+    is_read = is_read && LoadFunctionTexts (tokens_list, &job, &texts, n_funcs, cache_config) &&
+                         RunTasks (GetFunctionTask, &job, n_funcs, config -> n_jobs)            &&
+                         PrintFunctionTexts (tokens_list, &job, &texts, n_funcs)               &&
+                         WriteFunctionTexts (&texts, n_funcs, output_file_name);
+
+    for (size_t i = 0; i < n_funcs; i++)
+    {
+        if (job .funcs && job .funcs [i])
+            BinTree_DestroySubtree (job .funcs [i], &job .func_trees [i]);
+
+        if (texts .texts)
+            free (texts .texts [i]);
+    }
+
+    free (job .func_starts);
+    free (job .func_ends);
+    free (job .funcs);
+    free (job .func_trees);
+    free (job .is_cached);
+
+    free (texts .caches);
+    free (texts .texts);
+    free (texts .sizes);
+
+    List_Dtor (tokens_list);
+    free (tokens_list);
+    BINTREE_DTOR (&names_tree);
+
+    return is_read;
+}
+
+/*
+ * The lexer pushes the tokens to a ring on a thread of its own while
+ * they are parsed here, so only the ring is kept and not all of them.
+ * Returns false if nothing is read, so that it is read the usual way.
+ */
+static bool
+ReadTreePiped (const char*    const input_file_name,
+                     BinTree* const tree)
+{
+    assert (tree);
+
+    token_ring  ring  = {};
+    piped_names names = {};
+
+    if (!TokenRingCtor (&ring))
+        return false;
+
+    if (!PipedNamesCtor (&names))
+    {
+        TokenRingDtor (&ring);
+        return false;
+    }
+
+    lexer_job job = {.input_file_name = input_file_name,
+                     .ring            = &ring,
+                     .tree            = tree};
+
+    pthread_t lexer_thread = {};
+
+    if (pthread_create (&lexer_thread, nullptr, RunLexer, &job) != 0)
+    {
+        PipedNamesDtor (&names);
+        TokenRingDtor  (&ring);
+        return false;
+    }
+
+    token_source tokens = {.tokens_array = nullptr,
+                           .ring         = &ring,
+                           .names        = &names,
+                           .n_marked     = 0,
+                           .prev_token   = {.token_data_type = NO_TYPE,
+                                            .num_value       = BinTree_POISON,
+                                            .name_index      = VAR_INDEX_POISON},
+                           .end_token    = {.token_data_type = NO_TYPE,
+                                            .num_value       = BinTree_POISON,
+                                            .name_index      = VAR_INDEX_POISON}};
+
+    size_t token_index = 1;
+    tree -> root = GetPipedFunctions (&tokens, &token_index, tree);
+
+    syn_assert (IsPunctuation (&tokens, token_index) &&
+                GetToken (&tokens, token_index) -> punct_op_code == NULL_TERMINATOR);
+
+    pthread_join (lexer_thread, nullptr);
+
+    if (!ResolvePipedNames (&names, tree))
+        tree -> errors |= BINTREE_VAR_TABLE_NULLPTR;
+
+    SetParents (nullptr, tree -> root);
+
+    PipedNamesDtor (&names);
+    TokenRingDtor  (&ring);
+
+    return true;
+}
+
+static void*
+RunLexer (void* const lexer_job_ptr)
+{
+    assert (lexer_job_ptr);
+
+    lexer_job* const job = (lexer_job*) lexer_job_ptr;
+
+    /* token 0 is a dummy, as in the list */
+    const token dummy_token = {.token_data_type = NO_TYPE,
+                               .num_value       = BinTree_POISON,
+                               .name_index      = VAR_INDEX_POISON};
+
+    TokenRingPush (job -> ring, &dummy_token);
+
+    SeparateToTokens (job -> input_file_name, nullptr, job -> ring, job -> tree, 1);
+
+    TokenRingClose (job -> ring);
+
+    return nullptr;
+}
+
+/* pushes the tokens to the ring if there is one, to the list if not */
 static void
-SeparateToTokens (const char*    const input_file_name,
-                        List*    const tokens_list,
-                        BinTree* const tree)
+SeparateToTokens (const char*       const input_file_name,
+                        List*       const tokens_list,
+                        token_ring* const ring,
+                        BinTree*    const tree,
+                  const size_t            n_jobs)
 {
-    assert (tokens_list);
+    assert (tokens_list || ring);
     assert (tree);
 
     file_input input_parsed = {};
 
-    GetFileInput (input_file_name, &input_parsed, NOT_PARTED);
-    input_parsed .buffer [input_parsed .buffer_size - 1] = '\0';
+    /* the file is not copied, the zero after it is the NULL_TERMINATOR */
+    GetMappedFileInput (input_file_name, &input_parsed, NOT_PARTED);
 
-    if (input_parsed .buffer_size == 0) return;
+    cur_read .input = input_parsed;
 
-    size_t index = 0;
+    if (ring || !LexInChunks (&input_parsed, tokens_list, n_jobs))
+    {
+        token_sink sink = {.tokens_list = ring ? nullptr : tokens_list,
+                           .ring        = ring,
+                           .run         = nullptr};
+
+        size_t index = 0;
+
+        syn_assert (LexRange (&input_parsed, &index, input_parsed .buffer_size + 1, &sink));
+    }
+
+    cur_read .input = {};
+
+    FreeFileInput (&input_parsed);
+
+    /* the parser gives indices to names, as it reads them */
+    if (ring) return;
+
+    /*
+     * This block of two functions is used to make variables
+     * that name functions with FUNCTION data type and to give
+     * every name its index in the name table.
+     */
+
+    name_interner func_names = {};
+    name_interner var_names  = {};
+
+    if (NameInternerCtor (&func_names) && NameInternerCtor (&var_names))
+    {
+        GetFunctionNames (tokens_list, &func_names, tree);
+
+        SetNameIndices (tokens_list, &func_names, &var_names, tree);
+    }
+
+    NameInternerDtor (&func_names);
+    NameInternerDtor (&var_names);
+}
+
+/* lexes while index is before end, returns false if a token is not read */
+static bool
+LexRange (const file_input* const input_parsed,
+                size_t*     const index,
+          const size_t            end,
+                token_sink* const sink)
+{
+    assert (input_parsed);
+    assert (index);
+    assert (sink);
 
     token cur_token = {.token_data_type = NUMBER,
-                       .num_value  = BinTree_POISON};
+                       .num_value  = BinTree_POISON,
+                       .name_index = VAR_INDEX_POISON};
 
-    while (index < input_parsed .buffer_size)
+    while (*index < end)
     {
-        size_t cur_index = index;
+        size_t cur_index = *index;
 
-        if (isspace (input_parsed .buffer [index]))
+        if (isspace (input_parsed -> buffer [*index]))
         {
-            index++;
+            (*index)++;
             continue;
         }
 
-        if (input_parsed .buffer [index] == COMMENT_SYMBOL)
+        /* a comment goes on after the end, as it does in the whole code */
+        if (input_parsed -> buffer [*index] == COMMENT_SYMBOL)
         {
-            index++;
+            (*index)++;
 
-            while (index < input_parsed .buffer_size &&
-                   input_parsed .buffer [index] != COMMENT_SYMBOL)
+            while (*index < input_parsed -> buffer_size &&
+                   input_parsed -> buffer [*index] != COMMENT_SYMBOL)
             {
-                index++;
+                (*index)++;
             }
 
-            index++;
+            (*index)++;
 
             continue;
         }
 
-        GetTokenData (&input_parsed, &index, &cur_token);
+        GetTokenData (input_parsed, index, &cur_token);
 
-        syn_assert (cur_index != index);
+        if (cur_index == *index || !PushToken (sink, &cur_token))
+            return false;
+    }
+
+    return true;
+}
 
-        List_PushBack (&cur_token, tokens_list);
+static bool
+PushToken (token_sink* const sink,
+           token*      const new_token)
+{
+    assert (sink);
+    assert (new_token);
+
+    if (sink -> tokens_list)
+    {
+        List_PushBack (new_token, sink -> tokens_list);
+        return true;
     }
 
-    FreeFileInput (&input_parsed);
+    if (sink -> ring)
+    {
+        TokenRingPush (sink -> ring, new_token);
+        return true;
+    }
 
-    /*
-     * This block of two functions is used to make variables
-     * that name functions with FUNCTION data type.
-     */
+    token_run* const run = sink -> run;
+    assert (run);
+
+    if (run -> n_tokens == run -> capacity)
+    {
+        const size_t new_capacity = run -> capacity ?
+                                    run -> capacity * List_EXPAND_MULTIPLIER : List_INIT_VOLUME;
+
+        token* const new_tokens = (token*) realloc (run -> tokens, new_capacity * sizeof (token));
+        if (!new_tokens)
+        {
+            perror ("token run reallocation error");
+            return false;
+        }
+
+        run -> tokens   = new_tokens;
+        run -> capacity = new_capacity;
+    }
 
-    GetFunctionNames (tokens_list, tree);
+    run -> tokens [run -> n_tokens++] = *new_token;
 
-    SetFunctionNames (tokens_list, tree);
+    return true;
+}
+
+/*
+ * A chunk begins inside a comment if an odd number of comment symbols
+ * is before it, which is known once all are counted, so chunks are
+ * lexed as if they don't and the ones that do are lexed again from
+ * the end of the comment. Returns false if the code is to be lexed
+ * as a whole: it is small, or a chunk has an error to report.
+ */
+static bool
+LexInChunks (const file_input* const input_parsed,
+                   List*       const tokens_list,
+             const size_t            n_jobs)
+{
+    assert (input_parsed);
+    assert (tokens_list);
+
+    const size_t buffer_size = input_parsed -> buffer_size;
+
+    size_t n_chunks = buffer_size / LEX_CHUNK_MIN_SIZE;
+    if (n_chunks > n_jobs) n_chunks = n_jobs;
+
+    if (n_chunks <= 1) return false;
+
+    lex_job job = {.input_parsed      = input_parsed,
+                   .bounds            = (size_t*)    calloc (n_chunks + 1, sizeof (size_t)),
+                   .starts            = (size_t*)    calloc (n_chunks,     sizeof (size_t)),
+                   .ends              = (size_t*)    calloc (n_chunks,     sizeof (size_t)),
+                   .n_comment_symbols = (size_t*)    calloc (n_chunks,     sizeof (size_t)),
+                   .is_pending        = (bool*)      calloc (n_chunks,     sizeof (bool)),
+                   .is_lexed          = (bool*)      calloc (n_chunks,     sizeof (bool)),
+                   .runs              = (token_run*) calloc (n_chunks,     sizeof (token_run))};
+
+    bool is_done = job .bounds && job .starts && job .ends && job .n_comment_symbols &&
+                   job .is_pending && job .is_lexed && job .runs;
+
+    if (is_done)
+    {
+        job .bounds [n_chunks] = buffer_size + 1;
+
+        for (size_t i = 1; i < n_chunks; i++)
+        {
+            size_t bound = i * (buffer_size / n_chunks);
+            if (bound < job .bounds [i - 1]) bound = job .bounds [i - 1];
+
+            const char* const new_line =
+                (const char*) memchr (input_parsed -> buffer + bound, '\n', buffer_size - bound);
+
+            job .bounds [i] = new_line ? (size_t) (new_line - input_parsed -> buffer) : buffer_size;
+        }
+
+        for (size_t i = 0; i < n_chunks; i++)
+        {
+            job .starts     [i] = job .bounds [i];
+            job .is_pending [i] = true;
+        }
+
+        is_done = RunTasks (LexChunkTask, &job, n_chunks, n_jobs);
+    }
+
+    bool is_relexed = false;
+    size_t n_symbols = 0;
+
+    for (size_t i = 0; is_done && i < n_chunks; i++)
+    {
+        job .is_pending [i] = n_symbols % 2 == 1;
+        n_symbols += job .n_comment_symbols [i];
+
+        if (!job .is_pending [i]) continue;
+
+        const size_t bound = job .bounds [i];
+
+        const char* const comment_end =
+            (const char*) memchr (input_parsed -> buffer + bound, COMMENT_SYMBOL, buffer_size - bound);
+
+        job .starts [i] = comment_end ? (size_t) (comment_end - input_parsed -> buffer) + 1 :
+                                        buffer_size + 1;
+
+        job .runs [i] .n_tokens = 0;
+        is_relexed = true;
+    }
+
+    if (is_done && is_relexed)
+        is_done = RunTasks (LexChunkTask, &job, n_chunks, n_jobs);
+
+    /* each chunk stops where the next one starts */
+    for (size_t i = 0; is_done && i < n_chunks; i++)
+    {
+        is_done = job .is_lexed [i] && (i + 1 == n_chunks || job .ends [i] == job .starts [i + 1]);
+    }
+
+    for (size_t i = 0; is_done && i < n_chunks; i++)
+    {
+        for (size_t j = 0; j < job .runs [i] .n_tokens; j++)
+            List_PushBack (&job .runs [i] .tokens [j], tokens_list);
+    }
+
+    for (size_t i = 0; job .runs && i < n_chunks; i++)
+        free (job .runs [i] .tokens);
+
+    free (job .bounds);
+    free (job .starts);
+    free (job .ends);
+    free (job .n_comment_symbols);
+    free (job .is_pending);
+    free (job .is_lexed);
+    free (job .runs);
+
+    return is_done;
+}
+
+static bool
+LexChunkTask (void*  const job_ptr,
+              const size_t index)
+{
+    assert (job_ptr);
+
+    lex_job* const job = (lex_job*) job_ptr;
+
+    if (!job -> is_pending [index]) return true;
+
+    const char*  const buffer = job -> input_parsed -> buffer;
+    const size_t       end    = job -> bounds [index + 1];
+
+    size_t n_symbols = 0;
+
+    for (const char* symbol = buffer + job -> bounds [index];
+         (symbol = (const char*) memchr (symbol, COMMENT_SYMBOL,
+                                         (size_t) (buffer + end - symbol)));
+         symbol++)
+    {
+        n_symbols++;
+    }
+
+    job -> n_comment_symbols [index] = n_symbols;
+
+    token_sink sink = {.tokens_list = nullptr,
+                       .ring        = nullptr,
+                       .run         = &job -> runs [index]};
+
+    size_t cur_index = job -> starts [index];
+
+    job -> is_lexed [index] = LexRange (job -> input_parsed, &cur_index, end, &sink);
+    job -> ends     [index] = cur_index;
+
+    return true;
 }
 
 static void
@@ -327,12 +1081,8 @@ GetTokenData (const file_input* const input_parsed,
         input_parsed -> buffer [*index] == '+'     ||
         input_parsed -> buffer [*index] == '-')
     {
-        int32_t n_read_elem = 0;
-
-        sscanf (input_parsed -> buffer + *index, "%lg%n",
-                &(cur_token  -> num_value), &n_read_elem);
-
-        *index += (size_t) n_read_elem;
+        *index += ParseDouble (input_parsed -> buffer + *index,
+                               &(cur_token -> num_value));
 
         cur_token -> token_data_type = NUMBER;
         return;
@@ -340,147 +1090,479 @@ GetTokenData (const file_input* const input_parsed,
 
     else
     {
+        const size_t name_start = *index;
+
         size_t str_length = 0;
 
         while (isalnum (input_parsed -> buffer [*index]))
         {
+            /* a name that doesn't fit is not read, the index is left where it was */
+            if (str_length + 1 == VAR_NAME_MAX_LEN)
+            {
+                *index = name_start;
+                return;
+            }
+
             cur_token -> var_name [str_length++] =
                 input_parsed -> buffer  [(*index)++];
         }
 
-        cur_token -> var_name [str_length] = '\0';
+        cur_token -> var_name [str_length] = '\0';
+
+        cur_token -> token_data_type = VARIABLE;
+    }
+}
+
+static void
+GetTokenOperationType (      token* const cur_token,
+                       const op_code_type key_word)
+{
+    assert (cur_token);
+
+    if (key_word == FUNC_DEF)
+    {
+        cur_token -> token_data_type = FUNCTION;
+        cur_token -> key_op_code     = key_word;
+    }
+
+    else if (key_word < NUM_OF_UN_OP)
+    {
+        cur_token -> token_data_type = UN_OP;
+        cur_token -> un_op_code      = key_word;
+    }
+
+    else if (key_word < NUM_OF_BIN_OP)
+    {
+        cur_token -> token_data_type = BIN_OP;
+        cur_token -> bin_op_code     = key_word;
+    }
+
+    else if (key_word < NUM_OF_KEY_OP)
+    {
+        cur_token -> token_data_type = KEY_OP;
+        cur_token -> key_op_code     = key_word;
+    }
+
+    else if (key_word < NUM_OF_KEY_WORDS)
+    {
+        cur_token -> token_data_type = PUNCTUATION;
+        cur_token -> punct_op_code   = key_word;
+    }
+
+    else
+    {
+        fprintf (stderr, "Wrong data type\n");
+        return;
+    }
+}
+
+static void
+GetFunctionNames (const List*          const tokens_list,
+                        name_interner* const func_names,
+                        BinTree*       const tree)
+{
+    assert (tokens_list);
+    assert (func_names);
+    assert (tree);
+
+    for (size_t i = 0; i < tokens_list -> list_n_elems; ++i)
+    {
+        /*
+         * FUNC_DEF word is the only thing that is marked
+         * with FUNCTION data type so we could use it here
+         */
+        if (IsFunction (tokens_list -> list_data, i))
+        {
+            /* i++ to go from FUNC_DEF to func_name variable */
+            i++;
+
+            token* const name_token = &tokens_list -> list_data [i];
+
+            var_index_type func_index = FindName (func_names, name_token -> var_name);
+
+            if (func_index == VAR_INDEX_POISON)
+            {
+                func_index = PushName (name_token -> var_name, func_names,
+                                       tree -> name_table .func_table);
+
+                if (func_index == VAR_INDEX_POISON) return;
+            }
+
+            /*
+             * every function name is a variable during
+             * reading, changing it here
+             */
+            name_token -> token_data_type = FUNCTION;
+            name_token -> name_index      = func_index;
+        }
+    }
+}
+
+/*
+ * Variables are numbered in the order they first appear in, which
+ * is the order the parser meets them in.
+ */
+static void
+SetNameIndices (const List*          const tokens_list,
+                const name_interner* const func_names,
+                      name_interner* const var_names,
+                      BinTree*       const tree)
+{
+    assert (tokens_list);
+    assert (func_names);
+    assert (var_names);
+    assert (tree);
+
+    for (size_t i = 0; i < tokens_list -> list_n_elems; i++)
+    {
+        if (!IsVariable (tokens_list -> list_data, i)) continue;
+
+        token* const name_token = &tokens_list -> list_data [i];
+
+        var_index_type name_index = FindName (func_names, name_token -> var_name);
+
+        if (name_index != VAR_INDEX_POISON)
+        {
+            name_token -> token_data_type = FUNCTION;
+            name_token -> name_index      = name_index;
+
+            continue;
+        }
+
+        name_index = FindName (var_names, name_token -> var_name);
+
+        if (name_index == VAR_INDEX_POISON)
+        {
+            name_index = PushName (name_token -> var_name, var_names,
+                                   tree -> name_table .var_table);
+
+            if (name_index == VAR_INDEX_POISON) return;
+        }
+
+        name_token -> name_index = name_index;
+    }
+}
+
+/* copies the name to the table, the index in it is the one of the interner */
+static var_index_type
+PushName (const char*          const name,
+                name_interner* const interner,
+                Stack*         const table)
+{
+    assert (name);
+    assert (interner);
+    assert (table);
+
+    char* new_str = (char*) calloc (VAR_NAME_MAX_LEN, sizeof (char));
+    if (!new_str)
+    {
+        perror ("new_str allocation error");
+        return VAR_INDEX_POISON;
+    }
+
+    strcpy (new_str, name);
+
+    StackPush (table, new_str);
+
+    return AddName (interner, new_str);
+}
+
+static BinTree_node*
+GetGrammar (const List*    const tokens_list,
+                  size_t*  const token_index,
+                  BinTree* const tree,
+            const size_t         n_jobs)
+{
+    assert (tokens_list);
+    assert (token_index);
+    assert (tree);
+
+    /* token_index start value not zero because of dummy_elem in list */
+    *token_index = 1;
+
+    return GetMultipleFunctions (tokens_list, token_index, tree, n_jobs);
+}
+
+/*
+ * Functions start at "Mellon" tokens and each of them ends where the
+ * next one starts. They are parsed at once, every one with a tree of
+ * its own to count nodes in, and chained in the order of the code.
+ */
+static BinTree_node*
+GetMultipleFunctions (const List*    const tokens_list,
+                            size_t*  const token_index,
+                            BinTree* const tree,
+                      const size_t         n_jobs)
+{
+    assert (tokens_list);
+    assert (token_index);
+    assert (tree);
+
+    const size_t n_funcs = FindFunctionStarts (tokens_list, nullptr);
+
+    syn_assert (n_funcs > 0);
+
+    parse_job job = {.tokens_array = tokens_list -> list_data,
+                     .func_starts  = (size_t*)        calloc (n_funcs, sizeof (size_t)),
+                     .func_ends    = (size_t*)        calloc (n_funcs, sizeof (size_t)),
+                     .funcs        = (BinTree_node**) calloc (n_funcs, sizeof (BinTree_node*)),
+                     .func_trees   = (BinTree*)       calloc (n_funcs, sizeof (BinTree)),
+                     .is_cached    = nullptr};
+
+    cur_read .job = job;
+
+    BinTree_node* main_func = nullptr;
+
+    if (!job .func_starts || !job .func_ends || !job .funcs || !job .func_trees)
+    {
+        perror ("parse job allocation error");
+        tree -> errors |= BINTREE_NODE_NULLPTR;
+    }
+
+    else
+    {
+        FindFunctionStarts (tokens_list, job .func_starts);
+
+        syn_assert (job .func_starts [0] == *token_index);
+
+        if (!RunTasks (GetFunctionTask, &job, n_funcs, n_jobs))
+            tree -> errors |= BINTREE_NODE_NULLPTR;
+
+        for (size_t i = 0; i < n_funcs; i++)
+        {
+            tree -> n_elem += job .func_trees [i] .n_elem;
+            tree -> errors |= job .func_trees [i] .errors;
+
+            if (i + 1 < n_funcs)
+            {
+                syn_assert (job .func_ends [i] == job .func_starts [i + 1]);
+
+                if (job .funcs [i]) job .funcs [i] -> right = job .funcs [i + 1];
+            }
+        }
+
+        main_func    = job .funcs [0];
+        *token_index = job .func_ends [n_funcs - 1];
+    }
+
+    cur_read .job = {};
+
+    free (job .func_starts);
+    free (job .func_ends);
+    free (job .funcs);
+    free (job .func_trees);
+
+    return main_func;
+}
+
+static bool
+GetFunctionTask (void*  const job_ptr,
+                 const size_t index)
+{
+    assert (job_ptr);
+
+    parse_job* const job = (parse_job*) job_ptr;
+
+    if (job -> is_cached && job -> is_cached [index]) return true;
+
+    size_t token_index = job -> func_starts [index];
+
+    token_source tokens = {.tokens_array = job -> tokens_array};
+
+    job -> funcs [index] = GetFunction (&tokens, &token_index,
+                                        &job -> func_trees [index]);
+
+    job -> func_ends [index] = token_index;
+
+    return job -> func_trees [index] .errors == 0;
+}
+
+/* fills func_starts if it is not nullptr, returns the number of functions */
+static size_t
+FindFunctionStarts (const List*   const tokens_list,
+                          size_t* const func_starts)
+{
+    assert (tokens_list);
+
+    size_t n_funcs = 0;
+
+    for (size_t i = 0; i < tokens_list -> list_n_elems; i++)
+    {
+        if (!IsFunctionDef (tokens_list -> list_data, i)) continue;
 
-        cur_token -> token_data_type = VARIABLE;
+        if (func_starts) func_starts [n_funcs] = i;
+
+        n_funcs++;
     }
+
+    return n_funcs;
 }
 
-static void
-GetTokenOperationType (      token* const cur_token,
-                       const op_code_type key_word)
+/*
+ * A function ends where the next one starts, the last one at the end
+ * of the tokens, so that the null terminator after it is hashed too.
+ */
+static bool
+LoadFunctionTexts (const List*           const tokens_list,
+                         parse_job*      const job,
+                         function_texts* const texts,
+                   const size_t                n_funcs,
+                   const cache_config*   const cache_config)
 {
-    assert (cur_token);
+    assert (tokens_list);
+    assert (job);
+    assert (texts);
+    assert (cache_config);
 
-    if (key_word == FUNC_DEF)
-    {
-        cur_token -> token_data_type = FUNCTION;
-        cur_token -> key_op_code     = key_word;
-    }
+    cache_hash tool_hash = 0;
 
-    else if (key_word < NUM_OF_UN_OP)
-    {
-        cur_token -> token_data_type = UN_OP;
-        cur_token -> un_op_code      = key_word;
-    }
+    if (!StartCacheHash (cache_config, "frontend-function", &tool_hash))
+        return false;
 
-    else if (key_word < NUM_OF_BIN_OP)
+    for (size_t i = 0; i < n_funcs; i++)
     {
-        cur_token -> token_data_type = BIN_OP;
-        cur_token -> bin_op_code     = key_word;
-    }
+        const size_t end = (i + 1 < n_funcs) ? job -> func_starts [i + 1] :
+                                               tokens_list -> list_n_elems;
 
-    else if (key_word < NUM_OF_KEY_OP)
-    {
-        cur_token -> token_data_type = KEY_OP;
-        cur_token -> key_op_code     = key_word;
-    }
+        cache_hash hash = tool_hash;
 
-    else if (key_word < NUM_OF_KEY_WORDS)
-    {
-        cur_token -> token_data_type = PUNCTUATION;
-        cur_token -> punct_op_code   = key_word;
-    }
+        HashFunctionTokens (tokens_list -> list_data, job -> func_starts [i], end, &hash);
 
-    else
-    {
-        fprintf (stderr, "Wrong data type\n");
-        return;
+        SetFragmentCache (&texts -> caches [i], cache_config, hash);
+
+        FILE* const buffer = open_memstream (&texts -> texts [i], &texts -> sizes [i]);
+        if (!buffer)
+        {
+            perror ("function text open error");
+            return false;
+        }
+
+        job -> is_cached [i] = CacheLoad (&texts -> caches [i], buffer);
+
+        if (fclose (buffer) != 0)
+            return false;
+
+        /* parsed and printed again */
+        if (!job -> is_cached [i])
+        {
+            free (texts -> texts [i]);
+            texts -> texts [i] = nullptr;
+        }
     }
+
+    return true;
 }
 
 static void
-GetFunctionNames (const List*    const tokens_list,
-                        BinTree* const tree)
+HashFunctionTokens (const List_data_type* const tokens_array,
+                    const size_t                start,
+                    const size_t                end,
+                          cache_hash*     const hash)
 {
-    assert (tokens_list);
-    assert (tree);
+    assert (tokens_array);
+    assert (hash);
 
-    for (size_t i = 0; i < tokens_list -> list_n_elems; ++i)
+    for (size_t i = start; i < end; i++)
     {
-        /*
-         * FUNC_DEF word is the only thing that is marked
-         * with FUNCTION data type so we could use it here
-         */
-        if (IsFunction (tokens_list -> list_data, i))
-        {
-            /* i++ to go from FUNC_DEF to func_name variable */
-            i++;
-            var_index_type func_index =
-                GetFunctionIndex (tokens_list -> list_data, &i, tree);
+        const token* const cur_token = &tokens_array [i];
 
-            /*
-             * every function name is a variable during
-             * reading, changing it here
-             */
-            tokens_list -> list_data [i] .token_data_type = FUNCTION;
+        HashBytes (hash, &cur_token -> token_data_type, sizeof (cur_token -> token_data_type));
+        HashBytes (hash, &cur_token -> name_index,      sizeof (cur_token -> name_index));
 
-            if (func_index == VAR_INDEX_POISON)
-            {
-                char* new_str =
-                    (char*) calloc (VAR_NAME_MAX_LEN, sizeof (char));
-                if (!new_str)
-                {
-                    perror ("new_str allocation error");
-                    return;
-                }
+        switch (cur_token -> token_data_type)
+        {
+            case PUNCTUATION:
+            case BIN_OP:
+            case UN_OP:
+            case KEY_OP:
+                HashBytes (hash, &cur_token -> key_op_code, sizeof (cur_token -> key_op_code));
+                break;
 
-                strcpy (new_str, tokens_list -> list_data [i] .var_name);
+            case NUMBER:
+                HashBytes (hash, &cur_token -> num_value, sizeof (cur_token -> num_value));
+                break;
 
-                StackPush (tree -> name_table .func_table, new_str);
-            }
+            /* names are told apart by their indices */
+            case VARIABLE:
+            case FUNCTION:
+            case NO_TYPE:
+            default:
+                break;
         }
     }
 }
 
-static void
-SetFunctionNames (const List*    const tokens_list,
-                        BinTree* const tree)
+/* checks the parsed functions as GetMultipleFunctions does and caches their texts */
+static bool
+PrintFunctionTexts (const List*           const tokens_list,
+                    const parse_job*      const job,
+                          function_texts* const texts,
+                    const size_t                n_funcs)
 {
     assert (tokens_list);
-    assert (tree);
+    assert (job);
+    assert (texts);
 
-    for (size_t i = 0; i < tokens_list -> list_n_elems; i++)
+    for (size_t i = 0; i < n_funcs; i++)
     {
-        if (IsVariable (tokens_list -> list_data, i))
+        if (job -> is_cached [i]) continue;
+
+        const size_t end = job -> func_ends [i];
+
+        if (i + 1 < n_funcs)
         {
-            var_index_type func_index =
-                GetFunctionIndex (tokens_list -> list_data, &i, tree);
+            syn_assert (end == job -> func_starts [i + 1]);
+        }
 
-            if (func_index != VAR_INDEX_POISON)
-            {
-                tokens_list -> list_data [i] .token_data_type = FUNCTION;
-            }
+        else
+        {
+            syn_assert (IsPunctuation (tokens_list -> list_data, end) &&
+                        tokens_list -> list_data [end] .punct_op_code == NULL_TERMINATOR);
         }
+
+        texts -> texts [i] = PrintFunctionHead (job -> funcs [i], job -> func_trees [i] .n_elem,
+                                                &texts -> sizes [i]);
+        if (!texts -> texts [i])
+            return false;
+
+        CacheStore (&texts -> caches [i], texts -> texts [i], texts -> sizes [i]);
     }
+
+    return true;
 }
 
-static BinTree_node*
-GetGrammar (const List*    const tokens_list,
-                  size_t*  const token_index,
-                  BinTree* const tree)
+static bool
+WriteFunctionTexts (const function_texts* const texts,
+                    const size_t                n_funcs,
+                    const char*           const output_file_name)
 {
-    assert (tokens_list);
-    assert (token_index);
-    assert (tree);
+    assert (texts);
+    assert (output_file_name);
 
-    /* token_index start value not zero because of dummy_elem in list */
-    *token_index = 1;
+    FILE* const tree_out = fopen (output_file_name, "wb");
+    if (!tree_out)
+    {
+        perror ("tree_out fopen() error");
+        return false;
+    }
+
+    for (size_t i = 0; i < n_funcs; i++)
+        fwrite (texts -> texts [i], sizeof (char), texts -> sizes [i], tree_out);
+
+    /* the right child of the last function and the ends of all of them */
+    fprintf (tree_out, "_ ");
+
+    for (size_t i = 0; i < n_funcs; i++)
+        fprintf (tree_out, ") ");
 
-    return GetMultipleFunctions (tokens_list -> list_data,
-                                 token_index, tree);
+    fprintf (tree_out, "\n");
+
+    return fclose (tree_out) == 0;
 }
 
+/* functions one by one, as the tokens come */
 static BinTree_node*
-GetMultipleFunctions (GrammarParams)
+GetPipedFunctions (GrammarParams)
 {
     params_assert;
 
@@ -488,7 +1570,7 @@ GetMultipleFunctions (GrammarParams)
 
     BinTree_node* cur_func = main_func;
 
-    while (IsFunction (tokens_array, *token_index))
+    while (IsFunctionDef (tokens, *token_index))
     {
         cur_func -> right = GetFunction (GiveParams);
 
@@ -503,7 +1585,7 @@ GetFunction (GrammarParams)
 {
     params_assert;
 
-    syn_assert (IsFunction (tokens_array, *token_index));
+    syn_assert (IsFunction (tokens, *token_index));
     (*token_index)++;
 
     var_index_type cur_func_index = GetFunctionIndex (GiveParams);
@@ -515,18 +1597,18 @@ GetFunction (GrammarParams)
 
     if (cur_func_index == 0)
     {
-        return BinTree_CtorNode (FUNCTION, cur_func_index,
-                                 func_body, nullptr, nullptr, tree);
+        return CtorParsedNode (FUNCTION, cur_func_index,
+                               func_body, nullptr, nullptr, tree);
     }
 
     else
     {
         BinTree_node* whole_function =
-            BinTree_CtorNode (PUNCTUATION, END_OF_OPERATION,
-                              func_body, func_args, nullptr, tree);
+            CtorParsedNode (PUNCTUATION, END_OF_OPERATION,
+                            func_body, func_args, nullptr, tree);
 
-        return BinTree_CtorNode (FUNCTION, cur_func_index,
-                                 whole_function, nullptr, nullptr, tree);
+        return CtorParsedNode (FUNCTION, cur_func_index,
+                               whole_function, nullptr, nullptr, tree);
     }
 }
 
@@ -539,15 +1621,15 @@ GetFunctionArgs (GrammarParams)
     BinTree_node* cur_node = nullptr;
     BinTree_node* new_node = nullptr;
 
-    if (IsPunctuation (tokens_array, *token_index) &&
-        tokens_array [*token_index] .punct_op_code == FUNC_ARGS_BEGIN)
+    if (IsPunctuation (tokens, *token_index) &&
+        GetToken (tokens, *token_index) -> punct_op_code == FUNC_ARGS_BEGIN)
     {
         (*token_index)++;
 
-        ret_node = BinTree_CtorNode (PUNCTUATION, END_OF_OPERATION,
-                                     nullptr, nullptr, nullptr, tree);
+        ret_node = CtorParsedNode (PUNCTUATION, END_OF_OPERATION,
+                                   nullptr, nullptr, nullptr, tree);
 
-        while (tokens_array [*token_index] .punct_op_code != FUNC_ARGS_END)
+        while (GetToken (tokens, *token_index) -> punct_op_code != FUNC_ARGS_END)
         {
             new_node = GetExpression (GiveParams);
 
@@ -560,13 +1642,13 @@ GetFunctionArgs (GrammarParams)
             else
             {
                 cur_node -> right =
-                    BinTree_CtorNode (PUNCTUATION, END_OF_OPERATION,
-                                      new_node, nullptr, nullptr, tree);
+                    CtorParsedNode (PUNCTUATION, END_OF_OPERATION,
+                                    new_node, nullptr, nullptr, tree);
                 cur_node = cur_node -> right;
             }
 
-            if (IsPunctuation (tokens_array, *token_index) &&
-                tokens_array [*token_index] .punct_op_code == COMMA)
+            if (IsPunctuation (tokens, *token_index) &&
+                GetToken (tokens, *token_index) -> punct_op_code == COMMA)
             {
                 (*token_index)++;
             }
@@ -577,11 +1659,19 @@ GetFunctionArgs (GrammarParams)
             }
         }
 
-        syn_assert (IsPunctuation (tokens_array, *token_index) &&
-                    tokens_array [*token_index]
-                   .punct_op_code   == FUNC_ARGS_END);
+        syn_assert (IsPunctuation (tokens, *token_index) &&
+                    GetToken (tokens, *token_index)
+                   -> punct_op_code   == FUNC_ARGS_END);
 
         (*token_index)++;
+
+        /* "Fellowship of the Ring" with nothing in it is no args at all */
+        if (!ret_node -> left)
+        {
+            ForgetParsedSubtree (ret_node);
+            BinTree_DestroySubtree (ret_node, tree);
+            ret_node = nullptr;
+        }
     }
 
     return ret_node;
@@ -599,18 +1689,18 @@ GetOperation (GrammarParams)
     BinTree_node* new_node  = nullptr;
     BinTree_node* ret_value = nullptr;
 
-    if (IsUnOperation (tokens_array, *token_index))
+    if (IsUnOperation (tokens, *token_index))
     {
-        cur_op_code = tokens_array [(*token_index)++] .un_op_code;
+        cur_op_code = GetToken (tokens, (*token_index)++) -> un_op_code;
 
         ret_value = GetExpression (GiveParams);
-        new_node  = BinTree_CtorNode (UN_OP, cur_op_code, nullptr,
-                                      ret_value, nullptr, tree);
+        new_node  = CtorParsedNode (UN_OP, cur_op_code, nullptr,
+                                    ret_value, nullptr, tree);
     }
 
-    else if (IsKeyOperation (tokens_array, *token_index))
+    else if (IsKeyOperation (tokens, *token_index))
     {
-        cur_op_code = tokens_array [(*token_index)++] .key_op_code;
+        cur_op_code = GetToken (tokens, (*token_index)++) -> key_op_code;
 
         switch (cur_op_code)
         {
@@ -627,15 +1717,15 @@ GetOperation (GrammarParams)
         }
     }
 
-    else if (IsBinOperation (tokens_array, *token_index))
+    else if (IsBinOperation (tokens, *token_index))
     {
-        cur_op_code = tokens_array [(*token_index)++] .bin_op_code;
+        cur_op_code = GetToken (tokens, (*token_index)++) -> bin_op_code;
         syn_assert (cur_op_code == ASSUME_BEGIN);
 
         new_node = GetAssume (GiveParams);
     }
 
-    else if (IsFunction (tokens_array, *token_index))
+    else if (IsFunction (tokens, *token_index))
     {
         cur_func_index = GetFunctionIndex (GiveParams);
         (*token_index)++;
@@ -644,8 +1734,8 @@ GetOperation (GrammarParams)
         {
             BinTree_node* func_args = GetFunctionArgs (GiveParams);
 
-            new_node = BinTree_CtorNode (FUNCTION, cur_func_index,
-                                         nullptr, func_args, nullptr, tree);
+            new_node = CtorParsedNode (FUNCTION, cur_func_index,
+                                       nullptr, func_args, nullptr, tree);
         }
     }
 
@@ -654,9 +1744,9 @@ GetOperation (GrammarParams)
         syn_assert (0);
     }
 
-    syn_assert (IsPunctuation (tokens_array, *token_index) &&
-                tokens_array [*token_index]
-                .punct_op_code == END_OF_OPERATION);
+    syn_assert (IsPunctuation (tokens, *token_index) &&
+                GetToken (tokens, *token_index)
+                -> punct_op_code == END_OF_OPERATION);
 
     (*token_index)++;
 
@@ -671,16 +1761,16 @@ GetAssume (GrammarParams)
     BinTree_node* left_value =
         GetVariable  (GiveParams);
 
-    syn_assert (IsPunctuation (tokens_array, *token_index) &&
-                tokens_array [*token_index] .un_op_code == ASSUME_END);
+    syn_assert (IsPunctuation (tokens, *token_index) &&
+                GetToken (tokens, *token_index) -> un_op_code == ASSUME_END);
 
     (*token_index)++;
 
     BinTree_node* right_value =
         GetComparison (GiveParams);
 
-    return BinTree_CtorNode (BIN_OP, ASSUME_BEGIN, left_value,
-                             right_value, nullptr, tree);
+    return CtorParsedNode (BIN_OP, ASSUME_BEGIN, left_value,
+                           right_value, nullptr, tree);
 }
 
 static BinTree_node*
@@ -695,18 +1785,18 @@ GetIf (GrammarParams)
 
     BinTree_node* false_part = nullptr;
 
-    if (IsPunctuation (tokens_array, *token_index) &&
-        tokens_array [*token_index] .punct_op_code == OPEN_BRACE)
+    if (IsPunctuation (tokens, *token_index) &&
+        GetToken (tokens, *token_index) -> punct_op_code == OPEN_BRACE)
     {
         false_part = GetBody  (GiveParams);
     }
 
-    BinTree_node* body = BinTree_CtorNode (PUNCTUATION, END_OF_OPERATION,
-                                           true_part, false_part,
-                                           nullptr, tree);
+    BinTree_node* body = CtorParsedNode (PUNCTUATION, END_OF_OPERATION,
+                                         true_part, false_part,
+                                         nullptr, tree);
 
-    return BinTree_CtorNode (KEY_OP, IF, condition,
-                             body, nullptr, tree);
+    return CtorParsedNode (KEY_OP, IF, condition,
+                           body, nullptr, tree);
 }
 
 static BinTree_node*
@@ -722,12 +1812,12 @@ GetWhile (GrammarParams)
 
     BinTree_node* false_part = nullptr;
 
-    BinTree_node* body = BinTree_CtorNode (PUNCTUATION, END_OF_OPERATION,
-                                           true_part, false_part,
-                                           nullptr, tree);
+    BinTree_node* body = CtorParsedNode (PUNCTUATION, END_OF_OPERATION,
+                                         true_part, false_part,
+                                         nullptr, tree);
 
-    return BinTree_CtorNode (KEY_OP, WHILE, condition,
-                             body, nullptr, tree);
+    return CtorParsedNode (KEY_OP, WHILE, condition,
+                           body, nullptr, tree);
 }
 
 static BinTree_node*
@@ -735,8 +1825,8 @@ GetBody (GrammarParams)
 {
     params_assert;
 
-    syn_assert (IsPunctuation (tokens_array, *token_index) &&
-                tokens_array [*token_index] .punct_op_code == OPEN_BRACE);
+    syn_assert (IsPunctuation (tokens, *token_index) &&
+                GetToken (tokens, *token_index) -> punct_op_code == OPEN_BRACE);
 
     (*token_index)++;
 
@@ -744,33 +1834,33 @@ GetBody (GrammarParams)
     BinTree_node* cur_separator = nullptr;
     BinTree_node* new_node      = nullptr;
 
-    while (IsBinOperation (tokens_array, *token_index) ||
-           IsUnOperation  (tokens_array, *token_index) ||
-           IsKeyOperation (tokens_array, *token_index) ||
-           IsFunction     (tokens_array, *token_index))
+    while (IsBinOperation (tokens, *token_index) ||
+           IsUnOperation  (tokens, *token_index) ||
+           IsKeyOperation (tokens, *token_index) ||
+           IsFunction     (tokens, *token_index))
     {
         new_node = GetOperation (GiveParams);
 
         if (!ret_node)
         {
             ret_node =
-                BinTree_CtorNode (PUNCTUATION, END_OF_OPERATION,
-                                  new_node, nullptr, nullptr, tree);
+                CtorParsedNode (PUNCTUATION, END_OF_OPERATION,
+                                new_node, nullptr, nullptr, tree);
             cur_separator = ret_node;
         }
 
         else
         {
             cur_separator -> right =
-                BinTree_CtorNode (PUNCTUATION, END_OF_OPERATION,
-                                  new_node, nullptr, nullptr, tree);
+                CtorParsedNode (PUNCTUATION, END_OF_OPERATION,
+                                new_node, nullptr, nullptr, tree);
 
             cur_separator = cur_separator -> right;
         }
     }
 
-    syn_assert (IsPunctuation (tokens_array, *token_index) &&
-                tokens_array [*token_index] .punct_op_code == CLOSE_BRACE);
+    syn_assert (IsPunctuation (tokens, *token_index) &&
+                GetToken (tokens, *token_index) -> punct_op_code == CLOSE_BRACE);
 
     (*token_index)++;
 
@@ -787,27 +1877,27 @@ GetComparison (GrammarParams)
     BinTree_node* right_value = nullptr;
     BinTree_node* new_node    = nullptr;
 
-    bool is_bin_operation = IsBinOperation (tokens_array, *token_index);
+    bool is_bin_operation = IsBinOperation (tokens, *token_index);
 
     if (!is_bin_operation) return left_value;
 
     bool is_comparison_sign =
-        tokens_array [*token_index] .bin_op_code == IS_EQUAL         ||
-        tokens_array [*token_index] .bin_op_code == GREATER          ||
-        tokens_array [*token_index] .bin_op_code == LESS             ||
-        tokens_array [*token_index] .bin_op_code == GREATER_OR_EQUAL ||
-        tokens_array [*token_index] .bin_op_code == LESS_OR_EQUAL    ||
-        tokens_array [*token_index] .bin_op_code == NOT_EQUAL;
+        GetToken (tokens, *token_index) -> bin_op_code == IS_EQUAL         ||
+        GetToken (tokens, *token_index) -> bin_op_code == GREATER          ||
+        GetToken (tokens, *token_index) -> bin_op_code == LESS             ||
+        GetToken (tokens, *token_index) -> bin_op_code == GREATER_OR_EQUAL ||
+        GetToken (tokens, *token_index) -> bin_op_code == LESS_OR_EQUAL    ||
+        GetToken (tokens, *token_index) -> bin_op_code == NOT_EQUAL;
 
     if (is_bin_operation && is_comparison_sign)
     {
         op_code_type op_code =
-            tokens_array [(*token_index)++] .bin_op_code;
+            GetToken (tokens, (*token_index)++) -> bin_op_code;
 
         right_value = GetExpression (GiveParams);
 
-        new_node = BinTree_CtorNode (BIN_OP, op_code, left_value,
-                                     right_value, nullptr, tree);
+        new_node = CtorParsedNode (BIN_OP, op_code, left_value,
+                                   right_value, nullptr, tree);
 
         left_value = new_node;
     }
@@ -825,31 +1915,31 @@ GetExpression (GrammarParams)
     BinTree_node* right_value = nullptr;
     BinTree_node* new_node    = nullptr;
 
-    bool is_bin_operation = IsBinOperation (tokens_array, *token_index);
+    bool is_bin_operation = IsBinOperation (tokens, *token_index);
 
     if (!is_bin_operation) return left_value;
 
-    bool is_add = tokens_array [*token_index] .bin_op_code == ADD;
+    bool is_add = GetToken (tokens, *token_index) -> bin_op_code == ADD;
 
-    bool is_sub = tokens_array [*token_index] .bin_op_code == SUB;
+    bool is_sub = GetToken (tokens, *token_index) -> bin_op_code == SUB;
 
     while (is_bin_operation && (is_add || is_sub))
     {
         op_code_type op_code =
-            tokens_array [(*token_index)++] .bin_op_code;
+            GetToken (tokens, (*token_index)++) -> bin_op_code;
 
         right_value = GetTerm (GiveParams);
 
-        new_node = BinTree_CtorNode (BIN_OP, op_code, left_value,
-                                     right_value, nullptr, tree);
+        new_node = CtorParsedNode (BIN_OP, op_code, left_value,
+                                   right_value, nullptr, tree);
 
         left_value = new_node;
 
-        is_bin_operation = IsBinOperation (tokens_array, *token_index);
+        is_bin_operation = IsBinOperation (tokens, *token_index);
 
-        is_add = tokens_array [*token_index] .bin_op_code == ADD;
+        is_add = GetToken (tokens, *token_index) -> bin_op_code == ADD;
 
-        is_sub = tokens_array [*token_index] .bin_op_code == SUB;
+        is_sub = GetToken (tokens, *token_index) -> bin_op_code == SUB;
     }
 
     return left_value;
@@ -864,35 +1954,35 @@ GetTerm (GrammarParams)
     BinTree_node* right_value = nullptr;
     BinTree_node* new_node    = nullptr;
 
-    bool is_bin_operation = IsBinOperation (tokens_array, *token_index);
+    bool is_bin_operation = IsBinOperation (tokens, *token_index);
 
     if (!is_bin_operation) return left_value;
 
-    bool is_mul = tokens_array [*token_index] .bin_op_code == MUL;
+    bool is_mul = GetToken (tokens, *token_index) -> bin_op_code == MUL;
 
-    bool is_div = tokens_array [*token_index] .bin_op_code == DIV;
+    bool is_div = GetToken (tokens, *token_index) -> bin_op_code == DIV;
 
-    bool is_pow = tokens_array [*token_index] .bin_op_code == POW;
+    bool is_pow = GetToken (tokens, *token_index) -> bin_op_code == POW;
 
     while (is_bin_operation && (is_mul || is_div || is_pow))
     {
         op_code_type op_code =
-            tokens_array [(*token_index)++] .bin_op_code;
+            GetToken (tokens, (*token_index)++) -> bin_op_code;
 
         right_value = GetPrimary (GiveParams);
 
-        new_node = BinTree_CtorNode (BIN_OP, op_code, left_value,
-                                     right_value, nullptr, tree);
+        new_node = CtorParsedNode (BIN_OP, op_code, left_value,
+                                   right_value, nullptr, tree);
 
         left_value = new_node;
 
-        is_bin_operation = IsBinOperation (tokens_array, *token_index);
+        is_bin_operation = IsBinOperation (tokens, *token_index);
 
-        is_mul = tokens_array [*token_index] .bin_op_code == MUL;
+        is_mul = GetToken (tokens, *token_index) -> bin_op_code == MUL;
 
-        is_div = tokens_array [*token_index] .bin_op_code == DIV;
+        is_div = GetToken (tokens, *token_index) -> bin_op_code == DIV;
 
-        is_pow = tokens_array [*token_index] .bin_op_code == POW;
+        is_pow = GetToken (tokens, *token_index) -> bin_op_code == POW;
     }
 
     return left_value;
@@ -905,16 +1995,16 @@ GetPrimary (GrammarParams)
 
     BinTree_node* node = nullptr;
 
-    if (IsPunctuation (tokens_array, *token_index) &&
-        tokens_array [*token_index] .punct_op_code == OPEN_PARENTHESIS)
+    if (IsPunctuation (tokens, *token_index) &&
+        GetToken (tokens, *token_index) -> punct_op_code == OPEN_PARENTHESIS)
     {
         (*token_index)++;
 
         node = GetComparison (GiveParams);
 
-        syn_assert (IsPunctuation (tokens_array, *token_index) &&
-                    tokens_array [*token_index]
-                    .punct_op_code == CLOSE_PARENTHESIS);
+        syn_assert (IsPunctuation (tokens, *token_index) &&
+                    GetToken (tokens, *token_index)
+                    -> punct_op_code == CLOSE_PARENTHESIS);
 
         (*token_index)++;
 
@@ -934,14 +2024,15 @@ GetValue (GrammarParams)
 
     op_code_type   un_operation = OP_CODE_POISON;
     BinTree_node*  un_op_args   = nullptr;
+    BinTree_node*  diff_var     = nullptr;
 
-    switch (tokens_array [*token_index] .token_data_type)
+    switch (GetToken (tokens, *token_index) -> token_data_type)
     {
         case NUMBER:
             return
-                BinTree_CtorNode (NUMBER,
-                                  tokens_array [(*token_index)++] .num_value,
-                                  nullptr, nullptr, nullptr, tree);
+                CtorParsedNode (NUMBER,
+                                GetToken (tokens, (*token_index)++) -> num_value,
+                                nullptr, nullptr, nullptr, tree);
 
         case VARIABLE:
             return GetVariable  (GiveParams);
@@ -954,17 +2045,28 @@ GetValue (GrammarParams)
             (*token_index)++;
             func_args  = GetFunctionArgs  (GiveParams);
 
-            return BinTree_CtorNode (FUNCTION, func_index, nullptr,
-                                     func_args, nullptr, tree);
+            return CtorParsedNode (FUNCTION, func_index, nullptr,
+                                   func_args, nullptr, tree);
 
         case UN_OP:
-            un_operation = tokens_array [*token_index] .un_op_code;
+            un_operation = GetToken (tokens, *token_index) -> un_op_code;
             (*token_index)++;
             un_op_args = GetExpression (GiveParams);
 
+            /* Narsil f Gollum x is df/dx, x goes to the left child */
+            if (un_operation == DIFF &&
+                IsPunctuation (tokens, *token_index) &&
+                GetToken (tokens, *token_index) -> punct_op_code == COMMA)
+            {
+                (*token_index)++;
+
+                syn_assert (IsVariable (tokens, *token_index));
+                diff_var = GetVariable (GiveParams);
+            }
+
             return
-                BinTree_CtorNode (UN_OP, un_operation, nullptr,
-                                  un_op_args, nullptr, tree);
+                CtorParsedNode (UN_OP, un_operation, diff_var,
+                                un_op_args, nullptr, tree);
 
         case PUNCTUATION: [[fallthrough]];
         case KEY_OP:      [[fallthrough]];
@@ -981,32 +2083,224 @@ GetVariable (GrammarParams)
 {
     params_assert;
 
-    for (var_index_type i = 0;
-                        i < tree -> name_table .var_table -> data_size; i++)
+    syn_assert (IsVariable (tokens, *token_index));
+
+    return CtorParsedNode (VARIABLE,
+                           GetToken (tokens, (*token_index)++) -> name_index,
+                           nullptr, nullptr, nullptr, tree);
+}
+
+/*
+ * Marks the names up to the token, which needs the token after a
+ * name. The ones before the token before it are not read again.
+ */
+static token*
+GetPipedToken (      token_source* const tokens,
+               const size_t              token_index)
+{
+    assert (tokens);
+    assert (tokens -> ring);
+
+    while (tokens -> n_marked <= token_index)
     {
-        if (strcmp (tokens_array [*token_index] .var_name,
-                    tree -> name_table .var_table -> data [i]) == 0)
+        token* const cur_token = TokenRingGet (tokens -> ring, tokens -> n_marked);
+        if (!cur_token) return &tokens -> end_token;
+
+        if (cur_token -> token_data_type == VARIABLE)
         {
-            (*token_index)++;
-            return BinTree_CtorNode (VARIABLE, i, nullptr,
-                                     nullptr, nullptr, tree);
+            MarkPipedName (tokens, cur_token,
+                           TokenRingGet (tokens -> ring, tokens -> n_marked + 1));
         }
+
+        tokens -> prev_token = *cur_token;
+        tokens -> n_marked++;
     }
 
-    char* new_str = (char*) calloc (VAR_NAME_MAX_LEN, sizeof (char));
-    if (!new_str)
+    if (token_index > 1)
+        TokenRingRelease (tokens -> ring, token_index - 1);
+
+    return TokenRingGet (tokens -> ring, token_index);
+}
+
+static void
+MarkPipedName (      token_source* const tokens,
+                     token*        const name_token,
+               const token*        const next_token)
+{
+    assert (tokens);
+    assert (name_token);
+
+    piped_names* const names = tokens -> names;
+
+    var_index_type name_index = FindName (&names -> interner, name_token -> var_name);
+
+    if (name_index == VAR_INDEX_POISON)
     {
-        perror ("new_str allocation error");
-        return nullptr;
+        if (names -> interner .n_names == names -> capacity)
+        {
+            const size_t new_capacity = names -> capacity * VAR_TABLE_CAPACITY_MULTIPLIER;
+
+            var_index_type* const new_func_indices = (var_index_type*)
+                realloc (names -> func_indices, new_capacity * sizeof (var_index_type));
+            if (new_func_indices) names -> func_indices = new_func_indices;
+
+            var_index_type* const new_func_names = (var_index_type*)
+                realloc (names -> func_names, new_capacity * sizeof (var_index_type));
+            if (new_func_names) names -> func_names = new_func_names;
+
+            syn_assert (new_func_indices && new_func_names);
+
+            names -> capacity = new_capacity;
+        }
+
+        char* new_str = (char*) calloc (VAR_NAME_MAX_LEN, sizeof (char));
+        syn_assert (new_str);
+
+        strcpy (new_str, name_token -> var_name);
+
+        name_index = AddName (&names -> interner, new_str);
+        syn_assert (name_index != VAR_INDEX_POISON);
+
+        names -> func_indices [name_index] = VAR_INDEX_POISON;
+    }
+
+    name_token -> name_index = name_index;
+
+    const token* const prev_token = &tokens -> prev_token;
+
+    const bool is_defined = prev_token -> token_data_type == FUNCTION &&
+                            prev_token -> name_index      == VAR_INDEX_POISON;
+
+    const bool is_op_start = prev_token -> token_data_type == PUNCTUATION &&
+                            (prev_token -> punct_op_code   == OPEN_BRACE ||
+                             prev_token -> punct_op_code   == END_OF_OPERATION);
+
+    const bool is_called = next_token &&
+                           next_token -> token_data_type == PUNCTUATION &&
+                           next_token -> punct_op_code   == FUNC_ARGS_BEGIN;
+
+    if (is_defined && names -> func_indices [name_index] == VAR_INDEX_POISON)
+    {
+        names -> func_indices [name_index]     = names -> n_funcs;
+        names -> func_names   [names -> n_funcs] = name_index;
+        names -> n_funcs++;
+    }
+
+    if (is_defined || is_op_start || is_called)
+        name_token -> token_data_type = FUNCTION;
+}
+
+static bool
+PipedNamesCtor (piped_names* const names)
+{
+    assert (names);
+
+    names -> capacity = NAME_INTERNER_INIT_CAPACITY;
+    names -> n_funcs  = 0;
+
+    names -> func_indices = (var_index_type*) calloc (names -> capacity, sizeof (var_index_type));
+    names -> func_names   = (var_index_type*) calloc (names -> capacity, sizeof (var_index_type));
+
+    if (!names -> func_indices || !names -> func_names ||
+        !NameInternerCtor (&names -> interner))
+    {
+        perror ("piped names allocation error");
+        PipedNamesDtor (names);
+
+        return false;
+    }
+
+    return true;
+}
+
+/* the names themselves are in the name table by now, or freed here */
+static void
+PipedNamesDtor (piped_names* const names)
+{
+    assert (names);
+
+    free (names -> func_indices);
+    free (names -> func_names);
+    free (names -> var_indices);
+
+    NameInternerDtor (&names -> interner);
+
+    *names = {};
+}
+
+/*
+ * Functions are numbered as they are defined, variables as they first
+ * appear in, which are the indices the list mode gives them. Nodes of
+ * names that turn out to be functions are calls.
+ */
+static bool
+ResolvePipedNames (piped_names* const names,
+                   BinTree*     const tree)
+{
+    assert (names);
+    assert (tree);
+
+    Stack* const func_table = tree -> name_table .func_table;
+    Stack* const var_table  = tree -> name_table .var_table;
+
+    /* the names were copied for the table */
+    char** const name_strs = const_cast <char**> (names -> interner .names);
+
+    names -> var_indices = (var_index_type*) calloc (names -> interner .n_names + 1,
+                                                     sizeof (var_index_type));
+    if (!names -> var_indices)
+    {
+        perror ("var_indices allocation error");
+        return false;
+    }
+
+    for (size_t i = 0; i < names -> n_funcs; i++)
+        StackPush (func_table, name_strs [names -> func_names [i]]);
+
+    for (size_t i = 0; i < names -> interner .n_names; i++)
+    {
+        if (names -> func_indices [i] != VAR_INDEX_POISON) continue;
+
+        names -> var_indices [i] = var_table -> data_size;
+
+        StackPush (var_table, name_strs [i]);
     }
 
-    strcpy (new_str, tokens_array [(*token_index)++] .var_name);
+    if (tree -> root)
+        SetPipedNodeNames (names, tree -> root);
+
+    return true;
+}
+
+static void
+SetPipedNodeNames (const piped_names*  const names,
+                         BinTree_node* const node)
+{
+    assert (names);
+    assert (node);
+
+    if (node -> data .data_type == VARIABLE || node -> data .data_type == FUNCTION)
+    {
+        const var_index_type name_index = node -> data .var_index;
+        const var_index_type func_index = names -> func_indices [name_index];
+
+        if (func_index != VAR_INDEX_POISON)
+        {
+            node -> data .data_type  = FUNCTION;
+            node -> data .func_index = func_index;
+        }
+
+        else
+        {
+            /* only functions are called */
+            syn_assert (node -> data .data_type == VARIABLE);
 
-    StackPush (tree -> name_table .var_table, new_str);
+            node -> data .var_index = names -> var_indices [name_index];
+        }
+    }
 
-    return BinTree_CtorNode (VARIABLE, tree -> name_table
-                            .var_table -> data_size - 1,
-                             nullptr, nullptr, nullptr, tree);
+    if (node -> left)  SetPipedNodeNames (names, node -> left);
+    if (node -> right) SetPipedNodeNames (names, node -> right);
 }
 
 static inline void
@@ -1016,26 +2310,91 @@ syn_assert_func (const size_t n_line,
     if (!expression)
     {
         fprintf (stderr, "Aborting line %zd\n", n_line);
+
+        if (syntax_error_exit)
+            longjmp (*syntax_error_exit, 1);
+
         abort ();
     }
 }
 
-static var_index_type
-GetFunctionIndex (GrammarParams)
+/* makes a node of the code, logging it if a syntax error may jump out of the read */
+static BinTree_node*
+CtorParsedNode (const data_type           data_type,
+                const double              data_value,
+                      BinTree_node* const left,
+                      BinTree_node* const right,
+                      BinTree_node* const parent,
+                      BinTree*      const tree)
 {
-    params_assert;
+    assert (tree);
+
+    BinTree_node* const node = BinTree_CtorNode (data_type, data_value,
+                                                 left, right, parent, tree);
+
+    if (!node || !syntax_error_exit)
+        return node;
+
+    if (cur_read .n_nodes == cur_read .nodes_capacity)
+    {
+        const size_t capacity = cur_read .nodes_capacity ?
+                                cur_read .nodes_capacity * 2 : NODE_LOG_MIN_CAPACITY;
+
+        BinTree_node** const nodes = (BinTree_node**)
+            realloc (cur_read .nodes, capacity * sizeof (BinTree_node*));
+        if (!nodes)
+        {
+            perror ("node log allocation error");
+            tree -> errors |= BINTREE_NODE_NULLPTR;
+
+            return node;
+        }
+
+        cur_read .nodes          = nodes;
+        cur_read .nodes_capacity = capacity;
+    }
+
+    cur_read .nodes [cur_read .n_nodes++] = node;
+
+    return node;
+}
+
+/* the nodes of a subtree the parser frees itself, they are the last ones logged */
+static void
+ForgetParsedSubtree (const BinTree_node* const node)
+{
+    if (!node) return;
+
+    ForgetParsedSubtree (node -> left);
+    ForgetParsedSubtree (node -> right);
 
-    for (var_index_type i = 0;
-                        i < tree -> name_table .func_table -> data_size; i++)
+    for (size_t i = cur_read .n_nodes; i > 0; i--)
     {
-        if (strcmp (tree -> name_table .func_table -> data [i],
-                    tokens_array [*token_index] .var_name) == 0)
+        if (cur_read .nodes [i - 1] == node)
         {
-            return i;
+            cur_read .nodes [i - 1] = nullptr;
+            break;
         }
     }
+}
+
+/* the read went well, its nodes are the tree's */
+static void
+ForgetReadNodes ()
+{
+    free (cur_read .nodes);
+
+    cur_read .nodes          = nullptr;
+    cur_read .n_nodes        = 0;
+    cur_read .nodes_capacity = 0;
+}
+
+static var_index_type
+GetFunctionIndex (GrammarParams)
+{
+    params_assert;
 
-    return VAR_INDEX_POISON;
+    return GetToken (tokens, *token_index) -> name_index;
 }
 
 static inline bool
@@ -1050,3 +2409,45 @@ IsType (const List_data_type* const tokens_array,
 
     return false;
 }
+
+static inline bool
+IsFunctionDef (const List_data_type* const tokens_array,
+               const size_t                token_index)
+{
+    assert (tokens_array);
+
+    return IsFunction (tokens_array, token_index) &&
+           tokens_array [token_index] .name_index == VAR_INDEX_POISON;
+}
+
+static inline const token*
+GetToken (      token_source* const tokens,
+          const size_t              token_index)
+{
+    assert (tokens);
+
+    if (tokens -> ring)
+        return GetPipedToken (tokens, token_index);
+
+    return &tokens -> tokens_array [token_index];
+}
+
+static inline bool
+IsType (      token_source* const tokens,
+        const size_t              token_index,
+        const data_type           type)
+{
+    assert (tokens);
+
+    return GetToken (tokens, token_index) -> token_data_type == type;
+}
+
+static inline bool
+IsFunctionDef (      token_source* const tokens,
+               const size_t              token_index)
+{
+    assert (tokens);
+
+    return IsFunction (tokens, token_index) &&
+           GetToken (tokens, token_index) -> name_index == VAR_INDEX_POISON;
+}
@@ -0,0 +1,97 @@
+#include <sched.h>
+#include "token_ring.h"
+
+bool
+TokenRingCtor (token_ring* const ring)
+{
+    assert (ring);
+
+    ring -> slots = (token*) calloc (TOKEN_RING_CAPACITY, sizeof (token));
+    if (!ring -> slots)
+    {
+        perror ("token ring allocation error");
+        return false;
+    }
+
+    ring -> head .store (0, std::memory_order_relaxed);
+    ring -> tail .store (0, std::memory_order_relaxed);
+    ring -> is_closed .store (false, std::memory_order_relaxed);
+
+    ring -> cached_head = 0;
+    ring -> cached_tail = 0;
+
+    return true;
+}
+
+void
+TokenRingDtor (token_ring* const ring)
+{
+    assert (ring);
+
+    free (ring -> slots);
+    ring -> slots = nullptr;
+}
+
+void
+TokenRingPush (      token_ring* const ring,
+               const token*      const new_token)
+{
+    assert (ring);
+    assert (new_token);
+
+    const size_t head = ring -> head .load (std::memory_order_relaxed);
+
+    while (head - ring -> cached_tail == TOKEN_RING_CAPACITY)
+    {
+        ring -> cached_tail = ring -> tail .load (std::memory_order_acquire);
+
+        if (head - ring -> cached_tail == TOKEN_RING_CAPACITY)
+            sched_yield ();
+    }
+
+    ring -> slots [head & (TOKEN_RING_CAPACITY - 1)] = *new_token;
+
+    ring -> head .store (head + 1, std::memory_order_release);
+}
+
+void
+TokenRingClose (token_ring* const ring)
+{
+    assert (ring);
+
+    ring -> is_closed .store (true, std::memory_order_release);
+}
+
+token*
+TokenRingGet (      token_ring* const ring,
+              const size_t            index)
+{
+    assert (ring);
+    assert (index >= ring -> tail .load (std::memory_order_relaxed));
+
+    while (index >= ring -> cached_head)
+    {
+        /* the last push is seen before the close */
+        const bool is_closed = ring -> is_closed .load (std::memory_order_acquire);
+
+        ring -> cached_head = ring -> head .load (std::memory_order_acquire);
+
+        if (index < ring -> cached_head) break;
+
+        if (is_closed) return nullptr;
+
+        sched_yield ();
+    }
+
+    return &ring -> slots [index & (TOKEN_RING_CAPACITY - 1)];
+}
+
+void
+TokenRingRelease (      token_ring* const ring,
+                  const size_t            index)
+{
+    assert (ring);
+
+    if (index > ring -> tail .load (std::memory_order_relaxed))
+        ring -> tail .store (index, std::memory_order_release);
+}
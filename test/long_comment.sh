@@ -0,0 +1,38 @@
+#!/bin/sh
+# Lexes fact.txt with a comment of long words after it, big enough to be
+# lexed in chunks. The chunks lex the comment as code first, the tree
+# has to be the one of fact.txt however many jobs there are.
+# Usage: long_comment.sh <frontend>
+
+FRONTEND=$(realpath "$1")
+TEST_DIR=$(dirname "$(realpath "$0")")
+
+WORK_DIR=$(mktemp -d)
+
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+cd "$WORK_DIR" || exit 1
+
+{
+    cat "$TEST_DIR/fact.txt"
+    echo "#"
+    awk 'BEGIN { word = sprintf ("%200s", ""); gsub (/ /, "z", word);
+                 for (i = 0; i < 12000; i++) print word }'
+    echo "#"
+} > long_comment.txt
+
+"$FRONTEND" "$TEST_DIR/fact.txt" fact.tree > /dev/null || exit 1
+
+for JOBS in 1 2 4; do
+    if ! "$FRONTEND" --jobs=$JOBS long_comment.txt long_comment.tree > /dev/null; then
+        echo "long_comment: --jobs=$JOBS failed" >&2
+        exit 1
+    fi
+
+    if ! cmp -s fact.tree long_comment.tree; then
+        echo "long_comment: --jobs=$JOBS read another tree" >&2
+        exit 1
+    fi
+done
+
+echo "long_comment: ok"
@@ -0,0 +1,49 @@
+#!/bin/sh
+# Asks a server for the same program twice, the second answer has to come
+# from the compile cache and be the same as the first one.
+# Usage: serve_cache.sh <lotrc> <client>
+
+LOTRC=$(realpath "$1")
+CLIENT=$(realpath "$2")
+SOURCE=$(dirname "$(realpath "$0")")/fact.txt
+
+WORK_DIR=$(mktemp -d)
+SOCKET=$WORK_DIR/sock
+
+export LOTR_CACHE_DIR=$WORK_DIR/cache
+
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+"$LOTRC" --serve --socket="$SOCKET" &
+
+for i in 1 2 3 4 5 6 7 8 9 10; do
+    [ -S "$SOCKET" ] && break
+    sleep 1
+done
+
+"$CLIENT" --socket="$SOCKET" -O1 "$SOURCE" > "$WORK_DIR/first.asm" &&
+"$CLIENT" --socket="$SOCKET" -O1 "$SOURCE" > "$WORK_DIR/second.asm"
+IS_ANSWERED=$?
+
+"$CLIENT" --socket="$SOCKET" --stop > /dev/null
+wait
+
+if [ $IS_ANSWERED -ne 0 ]; then
+    echo "serve_cache: the server did not answer" >&2
+    exit 1
+fi
+
+if ! cmp -s "$WORK_DIR/first.asm" "$WORK_DIR/second.asm"; then
+    echo "serve_cache: the cached answer differs from the compiled one" >&2
+    exit 1
+fi
+
+STATS=$("$LOTRC" --cache-stats)
+
+if ! echo "$STATS" | grep -q "^hits: *1$" || ! echo "$STATS" | grep -q "^misses: *1$"; then
+    echo "serve_cache: the repeated request was not served from the cache" >&2
+    echo "$STATS" >&2
+    exit 1
+fi
+
+echo "serve_cache: ok"